@@ -0,0 +1,446 @@
+#!/usr/bin/env python3
+"""
+Read the converter's HID diagnostics (include/ups_diag.h) and read or
+change its runtime tuning (include/ups_tuning.h).
+
+The diagnostics are FEATURE reports in a vendor-page (0xFF00) collection
+next to the UPS one, so they can be read from an installed unit without a
+debug UART. No driver or extra package is needed: hidraw on Linux,
+HidD_GetFeature on Windows.
+
+  python hiddiag.py
+  python hiddiag.py --port 1 --watch 2
+  python hiddiag.py --raw
+  python hiddiag.py --tuning
+  python hiddiag.py --set dynamic_update_period_s=30 --set reply_timeout_ms=800
+  python hiddiag.py --set defaults
+
+On Linux the hidraw nodes must be readable (root, or a udev rule for VID
+051d).
+"""
+
+from __future__ import annotations
+
+import argparse
+import glob
+import os
+import struct
+import sys
+import time
+
+VID = 0x051D
+VENDOR_PAGE = 0xFF00
+
+REPORT_ENGINE = 0x10
+REPORT_LATENCY = 0x11
+REPORT_LINK = 0x12
+REPORT_LOOP = 0x13
+REPORT_MEMORY = 0x14
+REPORT_USB = 0x15
+REPORT_TUNING = 0x18
+
+REPORT_SIZES = {
+    REPORT_ENGINE: 27,
+    REPORT_LATENCY: 60,
+    REPORT_LINK: 26,
+    REPORT_LOOP: 34,
+    REPORT_MEMORY: 18,
+    REPORT_USB: 29,
+    REPORT_TUNING: 18,
+}
+
+TUNING_VERSION = 1
+TUNING_FORMAT = "<BB5HBBI"
+# Field names in report order after version and flags.
+TUNING_FIELDS = ["dynamic_update_period_s", "init_retry_period_s", "interjob_cooldown_ms",
+                 "reply_timeout_ms", "iwdg_timeout_ms", "failure_threshold", "reserved", "ups_baud"]
+TUNING_FLAGS = [(0x01, "stored"), (0x02, "save pending"), (0x04, "last write rejected"), (0x08, "save failed")]
+TUNING_DEFAULTS = 0x80
+
+READINESS = ["none", "link", "minimum", "constants", "full"]
+
+
+class Device:
+    """One HID interface of the converter, i.e. one UPS port."""
+
+    def __init__(self, path: str, interface: int) -> None:
+        self.path = path
+        self.interface = interface
+
+    def get_feature(self, report_id: int, size: int) -> bytes:
+        raise NotImplementedError
+
+    def set_feature(self, report_id: int, data: bytes) -> None:
+        raise NotImplementedError
+
+    def close(self) -> None:
+        pass
+
+
+# ----------------------------
+# Linux: hidraw
+# ----------------------------
+
+def _ioc(direction: int, ioc_type: str, nr: int, size: int) -> int:
+    return (direction << 30) | (size << 16) | (ord(ioc_type) << 8) | nr
+
+
+class HidrawDevice(Device):
+    def __init__(self, path: str, interface: int) -> None:
+        super().__init__(path, interface)
+        self.fd = os.open(path, os.O_RDWR)
+
+    def get_feature(self, report_id: int, size: int) -> bytes:
+        import fcntl
+
+        buf = bytearray(size + 1)
+        buf[0] = report_id
+        # HIDIOCGFEATURE(len)
+        n = fcntl.ioctl(self.fd, _ioc(3, "H", 0x07, len(buf)), buf, True)
+        return bytes(buf[1:n]) if n > 0 else b""
+
+    def set_feature(self, report_id: int, data: bytes) -> None:
+        import fcntl
+
+        buf = bytearray([report_id]) + data
+        # HIDIOCSFEATURE(len)
+        fcntl.ioctl(self.fd, _ioc(3, "H", 0x06, len(buf)), buf, True)
+
+    def close(self) -> None:
+        os.close(self.fd)
+
+
+def _has_vendor_collection(descriptor: bytes) -> bool:
+    # Usage Page (0xFF00) as a 2-byte global item.
+    return b"\x06\x00\xff" in descriptor
+
+
+def find_hidraw() -> list[Device]:
+    found: list[Device] = []
+    for node in sorted(glob.glob("/sys/class/hidraw/hidraw*")):
+        try:
+            with open(os.path.join(node, "device", "uevent"), encoding="ascii") as f:
+                uevent = f.read()
+            with open(os.path.join(node, "device", "report_descriptor"), "rb") as f:
+                descriptor = f.read()
+        except OSError:
+            continue
+        hid_id = next((line.split("=", 1)[1] for line in uevent.splitlines() if line.startswith("HID_ID=")), "")
+        parts = hid_id.split(":")
+        if len(parts) != 3 or int(parts[1], 16) != VID or not _has_vendor_collection(descriptor):
+            continue
+        # .../1-2:1.<interface>/0003:051D:....
+        usb_dir = os.path.basename(os.path.dirname(os.path.realpath(os.path.join(node, "device"))))
+        interface = int(usb_dir.rsplit(".", 1)[-1]) if "." in usb_dir else 0
+        found.append(HidrawDevice("/dev/" + os.path.basename(node), interface))
+    return found
+
+
+# ----------------------------
+# Windows: SetupAPI + hid.dll
+# ----------------------------
+
+def find_windows() -> list[Device]:
+    import ctypes
+    from ctypes import wintypes
+
+    setupapi = ctypes.WinDLL("setupapi", use_last_error=True)
+    hid = ctypes.WinDLL("hid", use_last_error=True)
+    kernel32 = ctypes.WinDLL("kernel32", use_last_error=True)
+
+    class GUID(ctypes.Structure):
+        _fields_ = [("Data1", wintypes.DWORD), ("Data2", wintypes.WORD),
+                    ("Data3", wintypes.WORD), ("Data4", ctypes.c_ubyte * 8)]
+
+    class SP_DEVICE_INTERFACE_DATA(ctypes.Structure):
+        _fields_ = [("cbSize", wintypes.DWORD), ("InterfaceClassGuid", GUID),
+                    ("Flags", wintypes.DWORD), ("Reserved", ctypes.c_size_t)]
+
+    class HIDD_ATTRIBUTES(ctypes.Structure):
+        _fields_ = [("Size", wintypes.ULONG), ("VendorID", wintypes.USHORT),
+                    ("ProductID", wintypes.USHORT), ("VersionNumber", wintypes.USHORT)]
+
+    class HIDP_CAPS(ctypes.Structure):
+        _fields_ = [("Usage", wintypes.USHORT), ("UsagePage", wintypes.USHORT),
+                    ("InputReportByteLength", wintypes.USHORT),
+                    ("OutputReportByteLength", wintypes.USHORT),
+                    ("FeatureReportByteLength", wintypes.USHORT),
+                    ("Reserved", wintypes.USHORT * 17),
+                    ("Counts", wintypes.USHORT * 10)]
+
+    setupapi.SetupDiGetClassDevsW.restype = wintypes.HANDLE
+    setupapi.SetupDiGetClassDevsW.argtypes = [ctypes.POINTER(GUID), wintypes.LPCWSTR, wintypes.HWND, wintypes.DWORD]
+    setupapi.SetupDiEnumDeviceInterfaces.argtypes = [wintypes.HANDLE, wintypes.LPVOID, ctypes.POINTER(GUID),
+                                                     wintypes.DWORD, ctypes.POINTER(SP_DEVICE_INTERFACE_DATA)]
+    setupapi.SetupDiGetDeviceInterfaceDetailW.argtypes = [wintypes.HANDLE, ctypes.POINTER(SP_DEVICE_INTERFACE_DATA),
+                                                          wintypes.LPVOID, wintypes.DWORD,
+                                                          ctypes.POINTER(wintypes.DWORD), wintypes.LPVOID]
+    setupapi.SetupDiDestroyDeviceInfoList.argtypes = [wintypes.HANDLE]
+    kernel32.CreateFileW.restype = wintypes.HANDLE
+    kernel32.CreateFileW.argtypes = [wintypes.LPCWSTR, wintypes.DWORD, wintypes.DWORD, wintypes.LPVOID,
+                                     wintypes.DWORD, wintypes.DWORD, wintypes.HANDLE]
+    kernel32.CloseHandle.argtypes = [wintypes.HANDLE]
+    hid.HidD_GetHidGuid.argtypes = [ctypes.POINTER(GUID)]
+    hid.HidD_GetAttributes.argtypes = [wintypes.HANDLE, ctypes.POINTER(HIDD_ATTRIBUTES)]
+    hid.HidD_GetPreparsedData.argtypes = [wintypes.HANDLE, ctypes.POINTER(ctypes.c_void_p)]
+    hid.HidD_FreePreparsedData.argtypes = [ctypes.c_void_p]
+    hid.HidP_GetCaps.argtypes = [ctypes.c_void_p, ctypes.POINTER(HIDP_CAPS)]
+    hid.HidD_GetFeature.argtypes = [wintypes.HANDLE, wintypes.LPVOID, wintypes.ULONG]
+    hid.HidD_SetFeature.argtypes = [wintypes.HANDLE, wintypes.LPVOID, wintypes.ULONG]
+
+    invalid = wintypes.HANDLE(-1).value
+    generic_rw = 0x80000000 | 0x40000000
+    share_rw = 0x1 | 0x2
+
+    class WinDevice(Device):
+        def __init__(self, path: str, interface: int, handle: int, feature_len: int) -> None:
+            super().__init__(path, interface)
+            self.handle = handle
+            self.feature_len = feature_len
+
+        def get_feature(self, report_id: int, size: int) -> bytes:
+            # Windows wants the longest feature report of the collection.
+            buf = (ctypes.c_ubyte * max(self.feature_len, size + 1))()
+            buf[0] = report_id
+            if not hid.HidD_GetFeature(self.handle, buf, len(buf)):
+                raise OSError(ctypes.get_last_error(), f"HidD_GetFeature(0x{report_id:02X}) failed")
+            return bytes(buf[1:size + 1])
+
+        def set_feature(self, report_id: int, data: bytes) -> None:
+            buf = (ctypes.c_ubyte * max(self.feature_len, len(data) + 1))()
+            buf[0] = report_id
+            for i, b in enumerate(data):
+                buf[i + 1] = b
+            if not hid.HidD_SetFeature(self.handle, buf, len(buf)):
+                raise OSError(ctypes.get_last_error(), f"HidD_SetFeature(0x{report_id:02X}) failed")
+
+        def close(self) -> None:
+            kernel32.CloseHandle(self.handle)
+
+    guid = GUID()
+    hid.HidD_GetHidGuid(ctypes.byref(guid))
+    hinfo = setupapi.SetupDiGetClassDevsW(ctypes.byref(guid), None, None, 0x2 | 0x10)
+    found: list[Device] = []
+    try:
+        index = 0
+        while True:
+            iface = SP_DEVICE_INTERFACE_DATA()
+            iface.cbSize = ctypes.sizeof(iface)
+            if not setupapi.SetupDiEnumDeviceInterfaces(hinfo, None, ctypes.byref(guid), index, ctypes.byref(iface)):
+                break
+            index += 1
+
+            needed = wintypes.DWORD()
+            setupapi.SetupDiGetDeviceInterfaceDetailW(hinfo, ctypes.byref(iface), None, 0, ctypes.byref(needed), None)
+            detail = ctypes.create_string_buffer(needed.value)
+            # cbSize of SP_DEVICE_INTERFACE_DETAIL_DATA_W: 8 on 64-bit, 6 on 32-bit.
+            ctypes.cast(detail, ctypes.POINTER(wintypes.DWORD))[0] = 8 if ctypes.sizeof(ctypes.c_void_p) == 8 else 6
+            if not setupapi.SetupDiGetDeviceInterfaceDetailW(hinfo, ctypes.byref(iface), detail, needed, None, None):
+                continue
+            path = ctypes.wstring_at(ctypes.addressof(detail) + 4)
+            if f"vid_{VID:04x}" not in path.lower():
+                continue
+
+            handle = kernel32.CreateFileW(path, generic_rw, share_rw, None, 3, 0, None)
+            if handle == invalid:
+                continue
+            caps = HIDP_CAPS()
+            preparsed = ctypes.c_void_p()
+            if hid.HidD_GetPreparsedData(handle, ctypes.byref(preparsed)):
+                hid.HidP_GetCaps(preparsed, ctypes.byref(caps))
+                hid.HidD_FreePreparsedData(preparsed)
+            if caps.UsagePage != VENDOR_PAGE:
+                kernel32.CloseHandle(handle)
+                continue
+            lower = path.lower()
+            interface = int(lower.split("&mi_", 1)[1][:2], 16) if "&mi_" in lower else 0
+            found.append(WinDevice(path, interface, handle, caps.FeatureReportByteLength))
+    finally:
+        setupapi.SetupDiDestroyDeviceInfoList(hinfo)
+    return found
+
+
+# ----------------------------
+# Report decoding
+# ----------------------------
+
+def cmd_name(cmd: int) -> str:
+    raw = bytes([cmd & 0xFF, cmd >> 8]).rstrip(b"\0")
+    text = "".join(chr(b) if 32 <= b <= 126 else "." for b in raw)
+    return f"0x{cmd:04X} {text!r}"
+
+
+def show_engine(data: bytes) -> list[str]:
+    enq, done, failed, retries, timeouts, full, depth, high, consecutive = struct.unpack("<6I3B", data)
+    return [f"engine   enqueued {enq}  completed {done}  failed {failed}  retries {retries}  timeouts {timeouts}",
+            f"         queue_full {full}  depth {depth}  high_water {high}  consecutive_failures {consecutive}"]
+
+
+def show_latency(data: bytes) -> list[str]:
+    lines = []
+    for cmd, count, avg, last, worst in struct.iter_unpack("<5H", data):
+        if count == 0 and cmd == 0:
+            continue
+        lines.append(f"latency  {cmd_name(cmd):<14} n {count:<6} avg {avg:>5} ms  last {last:>5} ms  max {worst:>5} ms")
+    return lines or ["latency  no replies timed yet"]
+
+
+def show_link(data: bytes) -> list[str]:
+    level, flags, baud, age, link_ms, errors, dropped, high, size = struct.unpack("<2B5I2H", data)
+    name = READINESS[level] if level < len(READINESS) else str(level)
+    age_text = "never" if age == 0xFFFFFFFF else f"{age} ms ago"
+    return [f"link     readiness {name}  ready {flags & 1}  constants {(flags >> 1) & 1}  baud {baud}  "
+            f"link at {link_ms} ms  last reply {age_text}",
+            f"         rx_errors {errors}  rx_dropped {dropped}  rx_high_water {high}/{size}"]
+
+
+def show_loop(data: bytes) -> list[str]:
+    uptime, passes, idle, runs, event_runs, wakeups, tickless, max_us, busy = struct.unpack("<8IH", data)
+    return [f"loop     uptime {uptime / 1000:.1f} s  passes {passes}  idle {idle}  runs {runs}  event_runs {event_runs}",
+            f"         wakeups/s {wakeups}  tickless {tickless} ms  max pass {max_us} us  busy {busy / 10:.1f} %"]
+
+
+def show_memory(data: bytes) -> list[str]:
+    ram, static, heap, stack, headroom, log_high, log_size, log_dropped = struct.unpack("<7HI", data)
+    return [f"memory   ram {ram}  static {static}  heap {heap}  stack max {stack}  headroom min {headroom}",
+            f"         log ring high_water {log_high}/{log_size}  dropped {log_dropped}"]
+
+
+def show_usb(data: bytes) -> list[str]:
+    flags, suspends, resumes, wakeups, blocked, last_resume, max_resume, last_report, max_report, low_ms = \
+        struct.unpack("<B4I4HI", data)
+    state = ("suspended, low power" if flags & 8 else "suspended") if flags & 1 else "running"
+    allowed = "allowed" if flags & 2 else "not allowed"
+    pending = "  (alert not read yet)" if flags & 4 else ""
+    return [f"usb      {state}  remote wakeup {allowed}{pending}  suspends {suspends}  resumes {resumes}"
+            f"  low power {low_ms / 1000:.1f} s",
+            f"         wakeups {wakeups}  blocked {blocked}  alert to resume last {last_resume} ms max {max_resume} ms"
+            f"  to report last {last_report} ms max {max_report} ms"]
+
+
+def read_tuning(dev: Device) -> tuple[int, int, dict[str, int]]:
+    data = dev.get_feature(REPORT_TUNING, REPORT_SIZES[REPORT_TUNING])
+    if len(data) < REPORT_SIZES[REPORT_TUNING]:
+        raise OSError(f"tuning report short ({len(data)} bytes)")
+    version, flags, *values = struct.unpack(TUNING_FORMAT, data[:REPORT_SIZES[REPORT_TUNING]])
+    return version, flags, dict(zip(TUNING_FIELDS, values))
+
+
+def show_tuning(dev: Device) -> None:
+    version, flags, values = read_tuning(dev)
+    names = [name for bit, name in TUNING_FLAGS if flags & bit] or ["build defaults"]
+    print(f"tuning   version {version}  ({', '.join(names)})")
+    for name in TUNING_FIELDS:
+        if name != "reserved":
+            print(f"  {name:<24} {values[name]}")
+
+
+def write_tuning(dev: Device, settings: list[str]) -> None:
+    version, _flags, values = read_tuning(dev)
+    if version != TUNING_VERSION:
+        raise OSError(f"firmware tuning version {version}, this tool knows {TUNING_VERSION}")
+    flags = 0
+    for item in settings:
+        if item == "defaults":
+            flags |= TUNING_DEFAULTS
+            continue
+        name, sep, value = item.partition("=")
+        if not sep or name not in TUNING_FIELDS or name == "reserved":
+            raise ValueError(f"unknown setting {item!r}; fields: {', '.join(f for f in TUNING_FIELDS if f != 'reserved')}")
+        values[name] = int(value, 0)
+    data = struct.pack(TUNING_FORMAT, version, flags, *(values[name] for name in TUNING_FIELDS))
+    dev.set_feature(REPORT_TUNING, data)
+    _version, flags, _values = read_tuning(dev)
+    if flags & 0x04:
+        raise ValueError("the converter rejected the values (out of range)")
+
+
+SHOW = [
+    (REPORT_ENGINE, show_engine),
+    (REPORT_LATENCY, show_latency),
+    (REPORT_LINK, show_link),
+    (REPORT_LOOP, show_loop),
+    (REPORT_MEMORY, show_memory),
+    (REPORT_USB, show_usb),
+]
+
+
+def dump(dev: Device, port: int, raw: bool, device_wide: bool) -> None:
+    print(f"port {port}  ({dev.path})")
+    for report_id, show in SHOW:
+        if report_id in (REPORT_LOOP, REPORT_MEMORY, REPORT_USB) and not device_wide:
+            continue
+        size = REPORT_SIZES[report_id]
+        try:
+            data = dev.get_feature(report_id, size)
+        except OSError as e:
+            print(f"  report 0x{report_id:02X}: {e}")
+            continue
+        if len(data) < size:
+            print(f"  report 0x{report_id:02X}: short ({len(data)} of {size} bytes)")
+            continue
+        data = data[:size]
+        if raw:
+            print(f"  0x{report_id:02X}: {data.hex(' ')}")
+        else:
+            for line in show(data):
+                print("  " + line)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Read the converter's HID diagnostics")
+    parser.add_argument("--port", type=int, help="only this UPS port (0 = first HID interface)")
+    parser.add_argument("--watch", type=float, metavar="S", help="repeat every S seconds")
+    parser.add_argument("--raw", action="store_true", help="print the report bytes instead of decoding them")
+    parser.add_argument("--tuning", action="store_true", help="print the runtime tuning instead")
+    parser.add_argument("--set", action="append", metavar="NAME=VALUE",
+                        help="change a tuning value (repeatable); 'defaults' restores the build defaults")
+    args = parser.parse_args()
+
+    try:
+        devices = find_windows() if sys.platform == "win32" else find_hidraw()
+    except OSError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 2
+    if not devices:
+        print("No converter with a diagnostics collection found.", file=sys.stderr)
+        return 1
+    devices.sort(key=lambda d: d.interface)
+
+    if args.tuning or args.set:
+        # The tuning is device-wide: any interface will do.
+        dev = devices[args.port if args.port is not None and args.port < len(devices) else 0]
+        try:
+            if args.set:
+                write_tuning(dev, args.set)
+            show_tuning(dev)
+        except (OSError, ValueError) as e:
+            print(f"Error: {e}", file=sys.stderr)
+            return 2
+        finally:
+            for d in devices:
+                d.close()
+        return 0
+
+    try:
+        while True:
+            for port, dev in enumerate(devices):
+                if args.port is not None and port != args.port:
+                    continue
+                # LOOP, MEMORY and USB are device-wide: print them once.
+                first = port == (args.port if args.port is not None else 0)
+                dump(dev, port, args.raw, first)
+            if args.watch is None:
+                break
+            time.sleep(args.watch)
+            print()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        for dev in devices:
+            dev.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
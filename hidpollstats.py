@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""
+Count HID GET_REPORT control transfers per host poll cycle in a Wireshark
+USB capture (USBPcap on Windows, usbmon on Linux).
+
+A poll cycle is a burst of GET_REPORT requests; a new cycle starts after
+--gap seconds without one. Prints one line per cycle and a summary, so the
+same capture procedure can be run against two firmware builds and compared.
+
+Default display filter (class request, device-to-host, interface recipient):
+  usb.bmRequestType == 0xa1
+"""
+
+from __future__ import annotations
+
+import argparse
+import subprocess
+import sys
+from collections import Counter
+
+from pcapanalyze import get_available_fields, resolve_tshark
+
+DEFAULT_FILTER = "usb.bmRequestType == 0xa1"
+HID_GET_REPORT = 0x01
+REPORT_TYPE_NAMES = {1: "IN", 2: "OUT", 3: "FEAT"}
+
+TIME_FIELD = "frame.time_relative"
+REQUEST_FIELD_CANDIDATES = ["usbhid.setup.bRequest", "usb.setup.bRequest"]
+WVALUE_FIELD_CANDIDATES = ["usb.setup.wValue"]
+REPORT_ID_FIELD_CANDIDATES = ["usbhid.setup.ReportID"]
+REPORT_TYPE_FIELD_CANDIDATES = ["usbhid.setup.ReportType"]
+
+
+def parse_int(raw: str) -> int | None:
+    raw = (raw or "").strip().split(",")[0]
+    if not raw:
+        return None
+    try:
+        return int(raw, 0)
+    except ValueError:
+        return None
+
+
+def first_available(candidates: list[str], available: set[str]) -> list[str]:
+    if not available:
+        return candidates
+    return [f for f in candidates if f in available]
+
+
+def run(args: argparse.Namespace) -> int:
+    tshark = resolve_tshark(args.tshark)
+    if not tshark:
+        print(
+            "Error: tshark not found. Install Wireshark/tshark or pass --tshark <path>.",
+            file=sys.stderr,
+        )
+        return 2
+
+    available = get_available_fields(tshark)
+    fields = [TIME_FIELD]
+    for group in (
+        REQUEST_FIELD_CANDIDATES,
+        WVALUE_FIELD_CANDIDATES,
+        REPORT_ID_FIELD_CANDIDATES,
+        REPORT_TYPE_FIELD_CANDIDATES,
+    ):
+        fields.extend(first_available(group, available))
+
+    cmd = [
+        tshark,
+        "-r",
+        args.capture,
+        "-Y",
+        args.display_filter,
+        "-T",
+        "fields",
+        "-E",
+        "header=n",
+        "-E",
+        "separator=\t",
+        "-E",
+        "quote=n",
+    ]
+    for f in fields:
+        cmd.extend(["-e", f])
+
+    proc = subprocess.run(cmd, capture_output=True, text=True, errors="replace")
+    if proc.returncode != 0:
+        print("tshark failed:", file=sys.stderr)
+        print(proc.stderr.strip(), file=sys.stderr)
+        return proc.returncode
+
+    requests: list[tuple[float, str]] = []
+    for line in proc.stdout.splitlines():
+        if not line.strip():
+            continue
+        cols = line.split("\t")
+        cols += [""] * (len(fields) - len(cols))
+        row = dict(zip(fields, cols))
+
+        request = None
+        for f in REQUEST_FIELD_CANDIDATES:
+            request = parse_int(row.get(f, ""))
+            if request is not None:
+                break
+        if request != HID_GET_REPORT:
+            continue
+
+        report_id = parse_int(row.get("usbhid.setup.ReportID", ""))
+        report_type = parse_int(row.get("usbhid.setup.ReportType", ""))
+        wvalue = parse_int(row.get("usb.setup.wValue", ""))
+        if wvalue is not None:
+            if report_id is None:
+                report_id = wvalue & 0xFF
+            if report_type is None:
+                report_type = (wvalue >> 8) & 0xFF
+
+        try:
+            t = float(row.get(TIME_FIELD, "") or 0.0)
+        except ValueError:
+            t = 0.0
+        name = REPORT_TYPE_NAMES.get(report_type, "?")
+        requests.append((t, f"{name}{report_id if report_id is not None else '?'}"))
+
+    if not requests:
+        print("No GET_REPORT requests found.")
+        return 0
+
+    cycles: list[list[tuple[float, str]]] = []
+    for req in requests:
+        if not cycles or (req[0] - cycles[-1][-1][0]) >= args.gap:
+            cycles.append([])
+        cycles[-1].append(req)
+
+    totals: Counter[str] = Counter()
+    for cycle in cycles:
+        reports = [r for _t, r in cycle]
+        totals.update(reports)
+        if args.verbose:
+            print(f"{cycle[0][0]:10.3f}s  {len(cycle):3d}  {' '.join(reports)}")
+
+    counts = [len(c) for c in cycles]
+    print(f"GET_REPORT total: {len(requests)}")
+    print(f"Poll cycles: {len(cycles)} (gap >= {args.gap:g}s)")
+    print(
+        f"Transfers per cycle: mean {sum(counts) / len(counts):.2f}, "
+        f"min {min(counts)}, max {max(counts)}"
+    )
+    print("Per report: " + ", ".join(f"{k}={v}" for k, v in sorted(totals.items())))
+    return 0
+
+
+def build_parser() -> argparse.ArgumentParser:
+    parser = argparse.ArgumentParser(
+        description="Count HID GET_REPORT control transfers per host poll cycle."
+    )
+    parser.add_argument("capture", help="Path to .pcap/.pcapng capture file")
+    parser.add_argument(
+        "--gap",
+        type=float,
+        default=0.5,
+        help="Seconds without GET_REPORT that end a poll cycle (default: 0.5)",
+    )
+    parser.add_argument(
+        "--display-filter",
+        default=DEFAULT_FILTER,
+        help=f'Wireshark display filter (default: "{DEFAULT_FILTER}")',
+    )
+    parser.add_argument(
+        "--tshark",
+        default="tshark",
+        help="tshark executable path (default: auto-detect in PATH/common locations)",
+    )
+    parser.add_argument(
+        "-v",
+        "--verbose",
+        action="store_true",
+        help="Print one line per poll cycle",
+    )
+    return parser
+
+
+def main() -> int:
+    parser = build_parser()
+    args = parser.parse_args()
+    return run(args)
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,23 @@
+#ifndef CRC16_H_
+#define CRC16_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-16/MODBUS, table driven (one lookup per byte). Sent low byte first.
+#define CRC16_MODBUS_INIT 0xFFFFU
+
+uint16_t crc16_modbus(const uint8_t *data, size_t len);
+
+// Continues a CRC over more data; start with CRC16_MODBUS_INIT.
+uint16_t crc16_modbus_update(uint16_t crc, const uint8_t *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CRC16_H_
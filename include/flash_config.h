@@ -0,0 +1,70 @@
+#ifndef FLASH_CONFIG_H_
+#define FLASH_CONFIG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ups_data.h"
+
+// Records kept in flash pages.
+//
+// Each page is used as an append log of one fixed-size record: each save
+// programs the next blank slot and load returns the newest slot whose CRC
+// checks, so the page is erased only once every FLASH_CONFIG_PAGE_SIZE /
+// slot size saves. A save that would not change the stored record writes
+// nothing.
+
+// Last 1 KB page of a 64 KB STM32F103C8. The three pages here are kept out
+// of the firmware image by board_upload.maximum_size in platformio.ini.
+#ifndef FLASH_CONFIG_PAGE_ADDR
+#define FLASH_CONFIG_PAGE_ADDR 0x0800FC00UL
+#endif
+
+#ifndef FLASH_CONFIG_PAGE_SIZE
+#define FLASH_CONFIG_PAGE_SIZE 0x400U
+#endif
+
+// Page used by ups_cache.c, right below the config page.
+#ifndef FLASH_CACHE_PAGE_ADDR
+#define FLASH_CACHE_PAGE_ADDR (FLASH_CONFIG_PAGE_ADDR - FLASH_CONFIG_PAGE_SIZE)
+#endif
+
+// Page used by ups_tuning.c, below the cache page.
+#ifndef FLASH_TUNING_PAGE_ADDR
+#define FLASH_TUNING_PAGE_ADDR (FLASH_CACHE_PAGE_ADDR - FLASH_CONFIG_PAGE_SIZE)
+#endif
+
+// Stored in ups_sub_adapter[] while a port has no detected protocol.
+#define FLASH_CONFIG_SUB_ADAPTER_NONE 0xFFU
+
+typedef struct
+{
+    // Last protocol and UART rate that bootstrapped, per UPS port.
+    uint32_t ups_baud[UPS_PORT_COUNT];
+    uint8_t ups_sub_adapter[UPS_PORT_COUNT];
+} flash_config_t;
+
+// Generic append log in the page at page_addr. load copies the newest
+// len-byte record to out and returns false when there is none; save blocks
+// for the flash program (and erase when the page is full) and returns false
+// on a flash error or when the firmware image reaches into the page.
+bool flash_log_load(uint32_t page_addr, void *out, uint16_t len);
+bool flash_log_save(uint32_t page_addr, const void *data, uint16_t len);
+
+// Settings record in the config page.
+// Fills out with the stored record, or with defaults (no protocol, baud 0)
+// and returns false when the page holds none.
+bool flash_config_load(flash_config_t *out);
+
+// Stores cfg if it differs from the stored record.
+bool flash_config_save(const flash_config_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FLASH_CONFIG_H_
@@ -0,0 +1,44 @@
+#ifndef IDLE_SLEEP_H_
+#define IDLE_SLEEP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Idle for the main loop: sleeps (WFI) until the next task_sched deadline.
+//
+// With IDLE_SLEEP_TICKLESS_ENABLED the 1 ms SysTick is reprogrammed to fire
+// once at the deadline and HAL_GetTick() is advanced by the time slept, so
+// the core is not woken a thousand times a second while nothing is due.
+// Every other interrupt (USB, UART, DMA) still wakes it at once.
+
+#ifndef IDLE_SLEEP_TICKLESS_ENABLED
+#define IDLE_SLEEP_TICKLESS_ENABLED 1
+#endif
+
+// Shorter waits just sleep until the next SysTick.
+#ifndef IDLE_SLEEP_TICKLESS_MIN_MS
+#define IDLE_SLEEP_TICKLESS_MIN_MS 2U
+#endif
+
+typedef struct
+{
+    uint32_t wakeups;          // returns from WFI
+    uint32_t wakeups_per_s;    // over the last full second
+    uint32_t tickless_sleeps;  // sleeps with the SysTick reprogrammed
+    uint32_t tickless_ms;      // ms skipped by those sleeps
+} idle_sleep_stats_t;
+
+// Sleeps unless a task is due or an event is pending.
+void idle_sleep(void);
+
+void idle_sleep_get_stats(idle_sleep_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // IDLE_SLEEP_H_
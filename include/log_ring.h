@@ -0,0 +1,104 @@
+#ifndef LOG_RING_H_
+#define LOG_RING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Deferred binary log.
+//
+// A log call stores the address of its format string and its arguments as
+// raw 32-bit words in a RAM ring; nothing is formatted on the device. The
+// main loop drains the ring over USART1 DMA (see ups_log_drain_task() in
+// main.c), and logdecode.py expands the records using the firmware ELF.
+// A call costs a copy of a few words; when the ring is full the record is
+// dropped and counted instead of waiting.
+//
+// Record layout, little endian:
+//   0     0xA5 sync
+//   1     type << 6 | count
+//   2..3  sequence number (records written, wraps)
+//   4..7  HAL tick in ms
+//   8..11 format string address (0 for text records)
+//   12..  payload: count words (LOG_RING_TYPE_ARGS, LOG_RING_TYPE_DROPPED)
+//         or count bytes (LOG_RING_TYPE_BYTES, LOG_RING_TYPE_TEXT)
+//
+// Format strings must be literals (the decoder reads them from the ELF).
+// %s arguments are stored as pointers, so they must point to constant
+// strings too; %f is not supported.
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 2048U
+#endif
+
+#define LOG_RING_SYNC 0xA5U
+#define LOG_RING_HEADER_SIZE 12U
+#define LOG_RING_MAX_ARGS 10U
+#define LOG_RING_MAX_BYTES 63U
+
+typedef enum
+{
+    LOG_RING_TYPE_ARGS = 0,    // printf-style format and arguments
+    LOG_RING_TYPE_BYTES = 1,   // prefix string and a hex dump
+    LOG_RING_TYPE_TEXT = 2,    // already formatted text (_write)
+    LOG_RING_TYPE_DROPPED = 3, // one word: records dropped since the last one
+} log_ring_type_t;
+
+typedef struct
+{
+    uint32_t records;    // records stored
+    uint32_t dropped;    // records lost to a full ring
+    uint32_t bytes_out;  // bytes handed to the drain
+    uint16_t high_water; // most bytes queued at once
+} log_ring_stats_t;
+
+void log_ring_write(const char *fmt, uint8_t nargs, const uint32_t *args);
+void log_ring_write_bytes(const char *prefix, const uint8_t *data, uint16_t len);
+void log_ring_write_text(const char *text, uint16_t len);
+
+// Drain side: returns the longest contiguous run of queued bytes (0 when
+// empty). The bytes stay queued until log_ring_consume().
+uint16_t log_ring_peek(const uint8_t **out_data);
+void log_ring_consume(uint16_t len);
+
+void log_ring_get_stats(log_ring_stats_t *out);
+
+// LOG_RING_PRINTF("fmt", args...): up to LOG_RING_MAX_ARGS integer or
+// pointer arguments, each stored as one word.
+#define LOG_RING_ARG(x) ((uint32_t)(uintptr_t)(x))
+#define LOG_RING_NARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, n, ...) n
+#define LOG_RING_NARGS(...) LOG_RING_NARGS_(__VA_ARGS__, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 0)
+#define LOG_RING_FMT_(f, ...) f
+#define LOG_RING_FMT(...) LOG_RING_FMT_(__VA_ARGS__, 0)
+#define LOG_RING_CAT_(a, b) a##b
+#define LOG_RING_CAT(a, b) LOG_RING_CAT_(a, b)
+#define LOG_RING_A0(f)
+#define LOG_RING_A1(f, a) , LOG_RING_ARG(a)
+#define LOG_RING_A2(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A1(f, __VA_ARGS__)
+#define LOG_RING_A3(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A2(f, __VA_ARGS__)
+#define LOG_RING_A4(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A3(f, __VA_ARGS__)
+#define LOG_RING_A5(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A4(f, __VA_ARGS__)
+#define LOG_RING_A6(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A5(f, __VA_ARGS__)
+#define LOG_RING_A7(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A6(f, __VA_ARGS__)
+#define LOG_RING_A8(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A7(f, __VA_ARGS__)
+#define LOG_RING_A9(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A8(f, __VA_ARGS__)
+#define LOG_RING_A10(f, a, ...) , LOG_RING_ARG(a) LOG_RING_A9(f, __VA_ARGS__)
+#define LOG_RING_ARGS_(...) LOG_RING_CAT(LOG_RING_A, LOG_RING_NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+#define LOG_RING_PRINTF(...)                                                    \
+    do                                                                          \
+    {                                                                           \
+        uint32_t const log_ring_args_[] = {0U LOG_RING_ARGS_(__VA_ARGS__)};     \
+        log_ring_write(LOG_RING_FMT(__VA_ARGS__),                               \
+                       (uint8_t)LOG_RING_NARGS(__VA_ARGS__),                    \
+                       &log_ring_args_[1]);                                     \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOG_RING_H_
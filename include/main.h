@@ -63,18 +63,35 @@ void Error_Handler(void);
 
 /* USER CODE BEGIN Private defines */
 
-#define UART2_RX_BUFFER_SIZE 256U
-
-void UART2_RxStartIT(void);
-HAL_StatusTypeDef UART2_SendBytes(const uint8_t *data, uint16_t len, uint32_t timeout_ms);
-HAL_StatusTypeDef UART2_SendBytesDMA(const uint8_t *data, uint16_t len);
-bool UART2_TxDone(void);
-void UART2_TxDoneClear(void);
-uint16_t UART2_Available(void);
-int UART2_ReadByte(uint8_t *out);
-uint16_t UART2_Read(uint8_t *dst, uint16_t len);
-void UART2_DiscardBuffered(void);
-bool UART2_ReadExactTimeout(uint8_t *dst, uint16_t len, uint32_t timeout_ms);
+#define UPS_UART_RX_BUFFER_SIZE 256U
+
+// UPS UARTs, by port (see UPS_PORT_COUNT in ups_data.h).
+void UPS_UART_RxStartIT(uint8_t port);
+HAL_StatusTypeDef UPS_UART_SetBaud(uint8_t port, uint32_t baud);
+uint32_t UPS_UART_GetBaud(uint8_t port);
+HAL_StatusTypeDef UPS_UART_SendBytes(uint8_t port, const uint8_t *data, uint16_t len, uint32_t timeout_ms);
+HAL_StatusTypeDef UPS_UART_SendBytesDMA(uint8_t port, const uint8_t *data, uint16_t len);
+bool UPS_UART_TxDone(uint8_t port);
+void UPS_UART_TxDoneClear(uint8_t port);
+uint16_t UPS_UART_Available(uint8_t port);
+int UPS_UART_ReadByte(uint8_t port, uint8_t *out);
+uint16_t UPS_UART_Read(uint8_t port, uint8_t *dst, uint16_t len);
+// In-place read: *data points at the oldest waiting byte; returns how many
+// follow it before the ring wraps. They stay until UPS_UART_Skip().
+uint16_t UPS_UART_Peek(uint8_t port, const uint8_t **data);
+void UPS_UART_Skip(uint8_t port, uint16_t len);
+void UPS_UART_DiscardBuffered(uint8_t port);
+bool UPS_UART_ReadExactTimeout(uint8_t port, uint8_t *dst, uint16_t len, uint32_t timeout_ms);
+
+// Line counters per port, reset only at power-up.
+typedef struct
+{
+  uint32_t rx_errors;     // parity, noise, framing and overrun errors
+  uint32_t rx_dropped;    // bytes lost to a full RX ring
+  uint16_t rx_high_water; // most bytes waiting in the RX ring at once
+} ups_uart_stats_t;
+
+void UPS_UART_GetStats(uint8_t port, ups_uart_stats_t *out);
 
 // Variable-length response support (terminator-based).
 //
@@ -105,8 +122,9 @@ bool UART2_ReadLineTerminatedTimeout(char *dst,
                                     uint16_t dst_cap,
                                     uint32_t timeout_ms);
 
-bool UART2_TryLock(void);
-void UART2_Unlock(void);
+// Ownership lock, taken by whoever talks to the UPS on that port.
+bool UPS_UART_TryLock(uint8_t port);
+void UPS_UART_Unlock(uint8_t port);
 
 /* USER CODE END Private defines */
 
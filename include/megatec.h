@@ -0,0 +1,55 @@
+#ifndef MEGATEC_H_
+#define MEGATEC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "uart_engine.h"
+#include "ups_data.h"
+
+// Megatec ("Q1") protocol lookup tables.
+//
+// Megatec UPSes report every volatile value in one reply:
+//   Q1<cr> -> (MMM.M NNN.N PPP.P QQQ RR.R S.SS TT.T b7..b0<cr>
+// input V, input fault V, output V, load %, input Hz, battery V (total or
+// per cell), temperature C and 8 status bits. The dynamic LUT is that single
+// request, so a refresh cycle is one round trip.
+//
+// The constant LUT reads the ratings (F) and the model string (I). The
+// protocol has no charge or runtime; both are estimated from the battery
+// voltage (MEGATEC_CELL_EMPTY_MV..MEGATEC_CELL_FULL_MV per 2 V cell) and
+// the load (MEGATEC_RUNTIME_FULL_LOAD_S).
+
+// Lookup table: initialized/constant values.
+extern const uart_engine_request_t g_megatec_constant_lut[];
+extern const size_t g_megatec_constant_lut_count;
+
+// Lookup table: dynamic/telemetry values.
+extern const uart_engine_request_t g_megatec_dynamic_lut[];
+extern const size_t g_megatec_dynamic_lut_count;
+
+// Lookup table: what a host needs to see a battery, read first at
+// bootstrap. F comes before Q1: the capacity estimate needs the rated
+// battery voltage.
+extern const uart_engine_request_t g_megatec_minimum_lut[];
+extern const size_t g_megatec_minimum_lut_count;
+
+// Heartbeat definition for the Megatec sub-adapter. The reply must start
+// with g_megatec_constant_heartbeat_expect_return.
+extern const uart_engine_request_t g_megatec_constant_heartbeat;
+extern const uint8_t g_megatec_constant_heartbeat_expect_return[];
+extern const size_t g_megatec_constant_heartbeat_expect_return_len;
+
+bool megatec_process_status(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool megatec_process_rating(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool megatec_process_info(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEGATEC_H_
@@ -0,0 +1,55 @@
+#ifndef MODBUS_H_
+#define MODBUS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "uart_engine.h"
+#include "ups_data.h"
+
+// APC Modbus RTU lookup tables.
+//
+// Newer Smart-UPS units answer Modbus RTU (function 03, read holding
+// registers) on the serial port, at 9600 8N1 by default. Registers follow
+// APC's published map, the same one NUT's apc_modbus driver uses:
+// - status block 0..22: UPSStatus, PowerSystemError, SimpleSignalingStatus,
+//   BatterySystemError
+// - measurement block 128..151: runtime, charge, battery voltage and
+//   temperature, load, output current/voltage/frequency, input voltage
+// A refresh cycle is those two reads. Values are binary fixed point and are
+// rescaled to the ups_data.h units. Frames carry CRC-16/MODBUS, which the
+// engine adds and checks (uart_engine_request_t.modbus_crc).
+
+// Slave address of the UPS.
+#ifndef MODBUS_UPS_ADDRESS
+#define MODBUS_UPS_ADDRESS 1U
+#endif
+
+// Lookup table: initialized/constant values.
+extern const uart_engine_request_t g_modbus_constant_lut[];
+extern const size_t g_modbus_constant_lut_count;
+
+// Lookup table: dynamic/telemetry values.
+extern const uart_engine_request_t g_modbus_dynamic_lut[];
+extern const size_t g_modbus_dynamic_lut_count;
+
+// Heartbeat definition for the Modbus sub-adapter. The reply (CRC already
+// checked and removed) must start with g_modbus_constant_heartbeat_expect_return.
+extern const uart_engine_request_t g_modbus_constant_heartbeat;
+extern const uint8_t g_modbus_constant_heartbeat_expect_return[];
+extern const size_t g_modbus_constant_heartbeat_expect_return_len;
+
+bool modbus_process_status_block(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool modbus_process_measurement_block(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool modbus_process_string(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool modbus_process_rating_block(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODBUS_H_
@@ -0,0 +1,74 @@
+#ifndef POWER_MODE_H_
+#define POWER_MODE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Power mode that follows the USB bus state.
+//
+// RUN is the normal mode. The TinyUSB suspend callback enters SUSPEND: the
+// core drops to the HSE (8 MHz, PLL and USB clock off, which the USB cell
+// allows while suspended), the refresh period is stretched by
+// POWER_MODE_SUSPEND_POLL_FACTOR and each refresh reads only the minimum
+// set (status flags, AC, capacity) that the remote wakeup alerts need.
+// WAKING is entered before remote wakeup is signalled: full clocks again,
+// so the USB cell can drive RESUME, while the bus is still suspended. The
+// resume callback (or a bus reset) goes back to RUN from either.
+//
+// The module only keeps the state; the clock switches are done by
+// power_mode_clock_low() and power_mode_clock_run(), which the board code
+// (main.c) provides. Both are called from the main loop, never from an
+// interrupt.
+
+#ifndef POWER_MODE_SUSPEND_ENABLED
+#define POWER_MODE_SUSPEND_ENABLED 1
+#endif
+
+#ifndef POWER_MODE_SUSPEND_POLL_FACTOR
+#define POWER_MODE_SUSPEND_POLL_FACTOR 3U
+#endif
+
+typedef enum
+{
+    POWER_MODE_RUN = 0,
+    POWER_MODE_SUSPEND,
+    POWER_MODE_WAKING,
+} power_mode_t;
+
+typedef struct
+{
+    uint32_t suspends;     // SUSPEND entered
+    uint32_t wakes;        // WAKING entered
+    uint32_t low_power_ms; // total time in SUSPEND, the current stretch included
+} power_mode_stats_t;
+
+// Bus events, from tud_suspend_cb() and tud_resume_cb()/tud_mount_cb().
+void power_mode_usb_suspend(uint32_t now_ms);
+void power_mode_usb_resume(uint32_t now_ms);
+
+// Full clocks back before tud_remote_wakeup(). No-op unless in SUSPEND.
+void power_mode_wake(uint32_t now_ms);
+
+power_mode_t power_mode_get(void);
+
+// True in SUSPEND: refresh only what the alerts need.
+bool power_mode_alerts_only(void);
+
+// Refresh period to use in the current mode.
+uint32_t power_mode_poll_period_ms(uint32_t period_ms);
+
+void power_mode_get_stats(uint32_t now_ms, power_mode_stats_t *out);
+
+// Board hooks, see above.
+void power_mode_clock_low(void);
+void power_mode_clock_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POWER_MODE_H_
@@ -9,6 +9,7 @@ extern "C" {
 #include <stdint.h>
 
 #include "uart_engine.h"
+#include "ups_data.h"
 
 // SPM2K protocol lookup tables.
 //
@@ -26,34 +27,67 @@ extern const size_t g_spm2k_constant_lut_count;
 extern const uart_engine_request_t g_spm2k_dynamic_lut[];
 extern const size_t g_spm2k_dynamic_lut_count;
 
+// Lookup table: the few dynamic values a host needs to see a battery
+// (capacity, AC present, status flags), read first at bootstrap.
+extern const uart_engine_request_t g_spm2k_minimum_lut[];
+extern const size_t g_spm2k_minimum_lut_count;
+
 // Heartbeat definition for SPM2K sub-adapter.
 // Expected response must fully match g_spm2k_constant_heartbeat_expect_return.
 extern const uart_engine_request_t g_spm2k_constant_heartbeat;
 extern const uint8_t g_spm2k_constant_heartbeat_expect_return[];
 extern const size_t g_spm2k_constant_heartbeat_expect_return_len;
 
-bool spm2k_process_string(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_rated_info(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_manufacturer_date(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_voltage(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_frequency(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_percent_load(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_runtime_minutes_to_seconds(uint16_t cmd,
+// Numeric field descriptor consumed by spm2k_feed_field().
+//
+// A LUT entry using the parser passes a pointer to one of these as
+// out_value. The reply is parsed as a fixed-point decimal with fraction_digits
+// decimals kept (value x 10^fraction_digits),
+// range-checked against [min_value, max_value], then offset and divided, and
+// finally clamped to the destination width before being stored at
+// dest_offset (UPS_STATE_OFFSET()) in the replying port's ups_state_t.
+typedef enum
+{
+    SPM2K_FIELD_U8 = 0,
+    SPM2K_FIELD_U16,
+    SPM2K_FIELD_I16,
+} spm2k_field_width_t;
+
+typedef struct
+{
+    uint16_t dest_offset;
+    uint8_t fraction_digits;
+    int32_t min_value;
+    int32_t max_value;
+    int32_t offset;  // added to the scaled value before dividing
+    int32_t divisor; // 0 or 1 keeps the scaled value
+    spm2k_field_width_t width;
+    void (*on_stored)(ups_state_t *ups, int32_t value); // optional, called with the stored value
+} spm2k_field_t;
+
+// Setting write-behind.
+//
+// The UPS changes a setting when '-' follows the setting's query: it steps to
+// the next value of a fixed list. spm2k_setting_write_start() begins stepping
+// towards the value now in the setting's ups_data.h shadow (rounded to the
+// UPS resolution). Call spm2k_setting_write_step() whenever the engine is
+// idle; it returns false once done. Every write ends with a readback into the
+// shadow, so the shadow shows what the UPS really took, even on failure.
+// Each port can have one write in progress.
+bool spm2k_setting_write_start(uint8_t port, ups_setting_t setting);
+bool spm2k_setting_write_step(uint8_t port);
+
+uart_engine_feed_result_t spm2k_feed_field(uint8_t port, uart_engine_feed_state_t *state, const uint8_t *data, uint16_t len, void *out_value);
+bool spm2k_process_string(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool spm2k_process_rated_info(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool spm2k_process_manufacturer_date(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool spm2k_process_runtime_minutes_to_seconds(uint8_t port,
+                                              uint16_t cmd,
                                               const uint8_t *rx,
                                               uint16_t rx_len,
                                               void *out_value);
-bool spm2k_process_temperature_c_to_kelvin(uint16_t cmd,
-                                           const uint8_t *rx,
-                                           uint16_t rx_len,
-                                           void *out_value);
-bool spm2k_process_remaining_capacity(uint16_t cmd,
-                                      const uint8_t *rx,
-                                      uint16_t rx_len,
-                                      void *out_value);
-bool spm2k_process_status_flags(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_ac_present(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_bat_current(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
-bool spm2k_process_ac_current(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool spm2k_process_status_flags(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool spm2k_process_ac_present(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
 
 #ifdef __cplusplus
 }
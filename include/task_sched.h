@@ -0,0 +1,73 @@
+#ifndef TASK_SCHED_H_
+#define TASK_SCHED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Cooperative deadline scheduler for the main loop.
+//
+// A task runs when its deadline has passed, when one of the events it
+// listens to was raised (task_sched_notify(), safe from interrupts), or
+// after task_sched_wake(). It returns the delay until it wants to run again,
+// or TASK_SCHED_NEVER to sleep until an event or wake. task_sched_run()
+// does nothing but a compare when no task is due, and returns the time
+// until the next deadline so the caller can sleep that long.
+//
+// The table is a plain array: with a handful of tasks a scan beats a heap,
+// and the scan only happens on passes where something actually ran.
+// The module has no HAL dependency; the caller passes the tick in.
+
+#ifndef TASK_SCHED_MAX_TASKS
+#define TASK_SCHED_MAX_TASKS 8U
+#endif
+
+#define TASK_SCHED_NEVER 0xFFFFFFFFUL
+#define TASK_SCHED_INVALID 0xFFU
+
+// Event bits.
+#define TASK_SCHED_EVENT_USB (1UL << 0) // USB interrupt
+#define TASK_SCHED_EVENT_UART (1UL << 1) // UPS UART RX/TX/error interrupt
+#define TASK_SCHED_EVENT_LOG (1UL << 2)  // record added to the log ring
+#define TASK_SCHED_EVENT_TUNING (1UL << 3) // tuning written by the host
+
+// Returns ms until the next run, or TASK_SCHED_NEVER.
+typedef uint32_t (*task_sched_fn_t)(uint32_t now_ms);
+
+typedef struct
+{
+    uint32_t passes;      // task_sched_run() calls
+    uint32_t idle_passes; // calls that ran nothing
+    uint32_t runs;        // task runs
+    uint32_t event_runs;  // task runs caused by an event or wake
+} task_sched_stats_t;
+
+// Adds a task that first runs after first_delay_ms (or on one of events).
+// Returns its id, or TASK_SCHED_INVALID when the table is full.
+uint8_t task_sched_add(task_sched_fn_t fn, uint32_t events, uint32_t first_delay_ms, uint32_t now_ms);
+
+// Raises events; every task listening to one runs on the next pass.
+void task_sched_notify(uint32_t events);
+
+// Makes one task run on the next pass.
+void task_sched_wake(uint8_t id);
+
+// Runs the tasks that are due, once each. Returns ms until the next
+// deadline: 0 if a task is already due again, TASK_SCHED_NEVER if every
+// task waits for an event.
+uint32_t task_sched_run(uint32_t now_ms);
+
+// Same value without running anything, for the idle code to re-check with
+// interrupts masked right before it sleeps.
+uint32_t task_sched_next_delay_ms(uint32_t now_ms);
+
+void task_sched_get_stats(task_sched_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TASK_SCHED_H_
@@ -31,6 +31,8 @@
 #define CFG_TUSB_RHPORT0_MODE (OPT_MODE_DEVICE | OPT_MODE_FULL_SPEED)
 #define CFG_TUSB_RHPORT1_MODE 0
 
+#include "ups_data.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -89,8 +91,17 @@
 #endif
 
 //------------- CLASS -------------//
-#define CFG_TUD_HID               1
-#define CFG_TUD_CDC               0
+// One HID power device per UPS port (UPS_PORT_COUNT, ups_data.h).
+#define CFG_TUD_HID               UPS_PORT_COUNT
+// Raw UPS serial passthrough on a second CDC port (usb_cdc_passthrough.c).
+#ifndef UPS_CDC_PASSTHROUGH_ENABLED
+#define UPS_CDC_PASSTHROUGH_ENABLED 1
+#endif
+
+// CDC port 0: telemetry (usb_cdc_telemetry.c); port 1: passthrough.
+#ifndef CFG_TUD_CDC
+#define CFG_TUD_CDC               (1 + UPS_CDC_PASSTHROUGH_ENABLED)
+#endif
 #define CFG_TUD_MSC               0
 #define CFG_TUD_MIDI              0
 #define CFG_TUD_VENDOR            0
@@ -98,6 +109,12 @@
 // HID buffer size Should be sufficient to hold ID (if any) + Data
 #define CFG_TUD_HID_EP_BUFSIZE    64
 
+// CDC FIFO sizes. TX holds a few telemetry records so one missed frame does
+// not cost a sample; RX only receives short command lines.
+#define CFG_TUD_CDC_RX_BUFSIZE    64
+#define CFG_TUD_CDC_TX_BUFSIZE    512
+#define CFG_TUD_CDC_EP_BUFSIZE    64
+
 #ifdef __cplusplus
  }
 #endif
@@ -13,16 +13,30 @@ extern "C" {
 #define UART_ENGINE_MAX_ENDING_LEN 8U
 #endif
 
+// Bytes a protocol may send after cmd, e.g. a CR terminator or the
+// address/count words of a Modbus read.
+#ifndef UART_ENGINE_MAX_SUFFIX_LEN
+#define UART_ENGINE_MAX_SUFFIX_LEN 4U
+#endif
+
 #ifndef UART_ENGINE_INTERJOB_COOLDOWN_MS
 #define UART_ENGINE_INTERJOB_COOLDOWN_MS 15U
 #endif
 
+// Failed jobs in a row before the battery is reported critical.
+#ifndef UART_ENGINE_FAILURE_THRESHOLD
+#define UART_ENGINE_FAILURE_THRESHOLD 5U
+#endif
+
 // Non-blocking UART request engine.
 //
 // - Enqueue requests (cmd 8/16-bit, expected response length) paired with a
 //   process callback.
 // - Call uart_engine_tick() frequently from the main loop.
-// - Engine uses UART2_* adapter functions (DMA TX, ring-buffer RX).
+// - Engine uses UPS_UART_* adapter functions (DMA TX, ring-buffer RX).
+// - There is one engine per UPS port. Every function takes the port it works
+//   on; uart_engine_tick() runs all of them. Callbacks get the port of their
+//   job, so protocol code stores into g_ups[port] (ups_data.h).
 
 typedef enum
 {
@@ -32,7 +46,44 @@ typedef enum
     UART_ENGINE_ERR_DISABLED,
 } uart_engine_result_t;
 
-typedef bool (*uart_engine_process_fn)(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+typedef bool (*uart_engine_process_fn)(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len,
+                                       void *out_value);
+
+// Incremental (streaming) response parsing.
+//
+// A request may set feed_fn to parse the reply while it is being received.
+// Each tick the engine hands feed_fn the bytes received since the last call,
+// in place in the UART ring (two runs when the ring wraps), together with a
+// small zeroed scratch state owned by the engine. The bytes are not kept, so
+// feed_fn must take what it needs before returning. Bytes after the one that
+// ends or rejects the reply are ignored.
+// - UART_ENGINE_FEED_MORE: keep receiving.
+// - UART_ENGINE_FEED_DONE: reply complete; feed_fn has already stored the value.
+// - UART_ENGINE_FEED_ERROR: reply is malformed. The engine drains the rest of
+//   the reply (up to the terminator or a short idle gap) and fails/retries the
+//   job without waiting for timeout_ms.
+// When feed_fn is set, process_fn is not called.
+typedef enum
+{
+    UART_ENGINE_FEED_MORE = 0,
+    UART_ENGINE_FEED_DONE,
+    UART_ENGINE_FEED_ERROR,
+} uart_engine_feed_result_t;
+
+#ifndef UART_ENGINE_FEED_STATE_WORDS
+#define UART_ENGINE_FEED_STATE_WORDS 3U
+#endif
+
+typedef struct
+{
+    uint32_t words[UART_ENGINE_FEED_STATE_WORDS];
+} uart_engine_feed_state_t;
+
+typedef uart_engine_feed_result_t (*uart_engine_feed_fn)(uint8_t port,
+                                                         uart_engine_feed_state_t *state,
+                                                         const uint8_t *data,
+                                                         uint16_t len,
+                                                         void *out_value);
 
 // Request struct. See uart_engine_enqueue().
 // 
@@ -41,6 +92,9 @@ typedef struct
     void *out_value;
     uint16_t cmd;
     uint8_t cmd_bits;      // 8 or 16. For 16-bit, bytes are sent MSB then LSB.
+    uint8_t cmd_suffix_len; // 0..UART_ENGINE_MAX_SUFFIX_LEN bytes sent right after cmd
+    uint8_t cmd_suffix_bytes[UART_ENGINE_MAX_SUFFIX_LEN];
+    bool modbus_crc;       // append CRC-16/MODBUS to the command and check it on the reply (fixed-length mode only)
     uint16_t expected_len; // fixed mode: exact bytes; ending mode: max bytes before fail
     bool expected_ending;  // false: fixed-length mode, true: stop once expected_ending_bytes is seen
     uint8_t expected_ending_len; // 1..UART_ENGINE_MAX_ENDING_LEN when expected_ending=true, length is in bytes
@@ -49,8 +103,10 @@ typedef struct
     uint8_t max_retries;   // max retries after a failure (engine will attempt 1 + max_retries total)
 
     uart_engine_process_fn process_fn;
+    uart_engine_feed_fn feed_fn; // optional streaming parser, see above
 } uart_engine_request_t;
 
+// Initializes and enables the engines of all ports.
 void uart_engine_init(void);
 
 // Enable/disable the engine at runtime.
@@ -60,30 +116,37 @@ void uart_engine_init(void);
 // - queued/active jobs are dropped
 // - heartbeat scheduling is stopped
 // - UART lock is released (so other code won't deadlock)
-void uart_engine_set_enabled(bool enable);
-bool uart_engine_is_enabled(void);
-bool uart_engine_is_busy(void);
+void uart_engine_set_enabled(uint8_t port, bool enable);
+bool uart_engine_is_enabled(uint8_t port);
+bool uart_engine_is_busy(uint8_t port);
 
-// Call frequently (e.g., each main loop iteration).
+// Call frequently (e.g., each main loop iteration). Advances every port.
 void uart_engine_tick(void);
 
-// Enqueue a request that will call process_fn(cmd, rx, rx_len, out_value).
+// Enqueue a request on port's engine that will call
+// process_fn(port, cmd, rx, rx_len, out_value).
 // If process_fn returns true, the value is considered successfully updated.
 // Note: process_fn should only write to out_value on success.
 //
 // cmd_bits must be 8 or 16.
-// Command framing/suffix bytes (e.g., CRLF) should be handled by caller-side
-// protocol code, not by this engine.
+// Command framing bytes (e.g., a CR terminator) are protocol knowledge: the
+// protocol code lists them in cmd_suffix_bytes and the engine sends them
+// verbatim after cmd.
 //
 // RX modes:
 // - expected_ending=false: fixed-length mode (wait until expected_len bytes).
 // - expected_ending=true: terminator mode (wait until expected_ending_bytes;
 //   expected_len becomes the maximum capture length).
+//
+// With modbus_crc, expected_len includes the 2 CRC bytes. A reply with a bad
+// CRC fails (and is retried) like a parse error; process_fn gets the reply
+// without its CRC.
 
-uart_engine_result_t uart_engine_enqueue(const uart_engine_request_t *req);
+uart_engine_result_t uart_engine_enqueue(uint8_t port, const uart_engine_request_t *req);
 
 // Convenience for common usage.
-static inline uart_engine_result_t uart_engine_enqueue_value(void *out_value,
+static inline uart_engine_result_t uart_engine_enqueue_value(uint8_t port,
+                                                            void *out_value,
                                                             uint16_t cmd,
                                                             uint8_t cmd_bits,
                                                             uint16_t expected_len,
@@ -102,14 +165,65 @@ static inline uart_engine_result_t uart_engine_enqueue_value(void *out_value,
         .max_retries = max_retries,
         .process_fn = process_fn,
     };
-    return uart_engine_enqueue(&req);
+    return uart_engine_enqueue(port, &req);
 }
 
+// Engine counters, reset only at power-up. A job is enqueued once and ends
+// completed or failed (or dropped by uart_engine_set_enabled(false)); each
+// retry in between is counted in retries.
+typedef struct
+{
+    uint32_t enqueued;   // jobs accepted, heartbeats included
+    uint32_t completed;
+    uint32_t failed;     // no retries left
+    uint32_t retries;
+    uint32_t timeouts;   // RX timeouts, retried or not
+    uint32_t queue_full; // uart_engine_enqueue() refused, queue full
+    uint8_t queue_depth; // jobs waiting right now
+    uint8_t queue_high_water;
+    uint8_t consecutive_failures; // failed jobs in a row (since the last completed heartbeat, if one is set)
+    uint32_t last_completed_ms;   // tick of the last completed job, 0 = none yet
+} uart_engine_stats_t;
+
+void uart_engine_get_stats(uint8_t port, uart_engine_stats_t *out);
+
+// Reply latency per command: from the start of the send to the end of a
+// reply that was accepted. Kept for the first UART_ENGINE_LATENCY_SLOTS
+// commands a port sends; later ones are not timed.
+#ifndef UART_ENGINE_LATENCY_SLOTS
+#define UART_ENGINE_LATENCY_SLOTS 6U
+#endif
+
+typedef struct
+{
+    uint16_t cmd;
+    uint16_t last_ms;
+    uint16_t max_ms;
+    uint32_t count;    // replies timed
+    uint32_t total_ms; // average = total_ms / count
+} uart_engine_latency_t;
+
+// Copies up to max slots; returns the number copied.
+uint8_t uart_engine_get_latencies(uint8_t port, uart_engine_latency_t *out, uint8_t max);
+
+// Timing shared by the engines of all ports. Starts at the build defaults
+// above; ups_tuning.c sets it from the stored tuning record.
+typedef struct
+{
+    uint16_t interjob_cooldown_ms; // line gap after each job
+    uint16_t reply_timeout_ms;     // replaces every request's timeout_ms; 0 keeps them
+    uint8_t failure_threshold;     // 0 = UART_ENGINE_FAILURE_THRESHOLD
+} uart_engine_tuning_t;
+
+// Takes effect from the next job on.
+void uart_engine_set_tuning(const uart_engine_tuning_t *cfg);
+
 // Heartbeat monitor.
 //
 // The heartbeat is scheduled periodically by the engine.
 // If the heartbeat request fails (after its internal retries) consecutively
-// failure_threshold times (default 5), battery fields are forced to 0.
+// failure_threshold times (default: the uart_engine_tuning_t one), battery
+// fields are forced to 0.
 
 typedef struct
 {
@@ -119,7 +233,7 @@ typedef struct
 } uart_engine_heartbeat_cfg_t;
 
 // Enable heartbeat scheduling. Pass NULL to disable.
-void uart_engine_set_heartbeat(const uart_engine_heartbeat_cfg_t *cfg);
+void uart_engine_set_heartbeat(uint8_t port, const uart_engine_heartbeat_cfg_t *cfg);
 
 // Helper process function: exact match against expected bytes.
 // out_value should point to a uart_engine_expect_bytes_t.
@@ -130,7 +244,8 @@ typedef struct
     uint16_t expected_len;
 } uart_engine_expect_bytes_t;
 
-bool uart_engine_process_expect_exact(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+bool uart_engine_process_expect_exact(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len,
+                                      void *out_value);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,86 @@
+#ifndef UART_TRACE_H_
+#define UART_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Wire-level trace of the UPS UARTs.
+//
+// A flight recorder that is always on: every byte sent or received on a UPS
+// port, the engine's state changes and job outcomes, and baud changes go
+// into a RAM ring of 8-byte events that keeps the last UART_TRACE_EVENTS of
+// them. The CDC telemetry TRACE command dumps the ring and uarttrace.py
+// turns the dump back into Send:/Receive: lines with timings.
+//
+// Received bytes are appended to the open RX event of their port, so the
+// per-byte cost in the RX interrupt is a compare and a store; a new event
+// (and a time stamp) is taken every UART_TRACE_DATA_MAX bytes, or when
+// something else happened in between.
+//
+// Event layout:
+//   0     type << 5 | port << 3 | count   (count: data bytes used, TX/RX)
+//   1..3  time stamp, 24 bits in 100 us units (wraps after ~28 min)
+//   4..7  data: TX/RX bytes, or as described at uart_trace_type_t
+
+#ifndef UART_TRACE_EVENTS
+#define UART_TRACE_EVENTS 128U
+#endif
+
+#define UART_TRACE_DATA_MAX 4U
+#define UART_TRACE_TIME_MASK 0xFFFFFFU
+
+typedef enum
+{
+    UART_TRACE_TX = 0,       // bytes handed to the UART
+    UART_TRACE_TX_DONE = 1,  // last byte left the UART
+    UART_TRACE_RX = 2,       // bytes received
+    UART_TRACE_RX_ERROR = 3, // data[0]: HAL UART error code
+    UART_TRACE_STATE = 4,    // data[0]: engine state, data[1..2]: cmd, data[3]: retries left
+    UART_TRACE_OUTCOME = 5,  // data[0]: uart_trace_outcome_t, data[1..2]: cmd, data[3]: retries left
+    UART_TRACE_BAUD = 6,     // data[0..3]: new baud rate
+} uart_trace_type_t;
+
+typedef enum
+{
+    UART_TRACE_OUTCOME_OK = 0,
+    UART_TRACE_OUTCOME_RETRY = 1,
+    UART_TRACE_OUTCOME_TIMEOUT = 2,
+    UART_TRACE_OUTCOME_FAIL = 3,
+} uart_trace_outcome_t;
+
+typedef struct
+{
+    uint8_t info;
+    uint8_t time[3];
+    uint8_t data[UART_TRACE_DATA_MAX];
+} uart_trace_event_t;
+
+// Writers; safe from interrupt handlers.
+void uart_trace_tx(uint8_t port, const uint8_t *data, uint16_t len);
+void uart_trace_tx_done(uint8_t port);
+void uart_trace_rx_byte(uint8_t port, uint8_t byte);
+void uart_trace_rx_error(uint8_t port, uint32_t error_code);
+void uart_trace_state(uint8_t port, uint8_t state, uint16_t cmd, uint8_t retries_left);
+void uart_trace_outcome(uint8_t port, uart_trace_outcome_t outcome, uint16_t cmd, uint8_t retries_left);
+void uart_trace_baud(uint8_t port, uint32_t baud);
+
+// Current time in trace units (100 us, 24 bits).
+uint32_t uart_trace_now(void);
+
+// Reader: events are numbered by a running count. uart_trace_written() is
+// the number of events so far; the ring holds the last UART_TRACE_EVENTS of
+// them. uart_trace_read() copies event number index and returns false if it
+// was already overwritten or not written yet. The newest event can still
+// grow while its RX or TX burst continues.
+uint32_t uart_trace_written(void);
+bool uart_trace_read(uint32_t index, uart_trace_event_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UART_TRACE_H_
@@ -0,0 +1,34 @@
+#ifndef UPS_CACHE_H_
+#define UPS_CACHE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Constant UPS data kept in flash (FLASH_CACHE_PAGE_ADDR): the USB
+// manufacturer/product/serial strings and, per port, the values the
+// constant LUT reads (rated voltages and power, transfer voltages, battery
+// date). Restoring it at boot lets USB enumerate at once; the bootstrap
+// still re-reads everything and ups_cache_update() stores what it found.
+
+// Applies the stored strings and constant values to the USB descriptors and
+// g_ups[]. Returns true when the record had data for at least one port.
+bool ups_cache_restore(void);
+
+// True when ups_cache_restore() filled in this port.
+bool ups_cache_port_is_restored(uint8_t port);
+
+// Stores the port's constant values (and for port 0 the USB strings)
+// after its bootstrap. Returns true when the USB identity differs
+// from the restored one, i.e. the host enumerated a different UPS and the
+// device has to re-enumerate.
+bool ups_cache_update(uint8_t port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UPS_CACHE_H_
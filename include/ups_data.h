@@ -6,17 +6,49 @@ extern "C" {
 #endif
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+// Number of UPSes served, each on its own UART and HID interface.
+// Port 0 is USART2; build with UPS_PORT_COUNT=2 to add a UPS on USART3.
+// tusb_config.h includes this header for the HID interface count.
+#ifndef UPS_PORT_COUNT
+#define UPS_PORT_COUNT 1U
+#endif
+
 // Report IDs used by the UPS HID report descriptor.
+// Reports are grouped by how often hosts read them, not by collection:
+// everything polled each cycle is in STATUS, static data is in CONFIG.
+enum
+{
+    REPORT_ID_STATUS = 1,
+    REPORT_ID_CONFIG = 2,
+};
+
+// Report IDs of the vendor collection: read-only diagnostics (ups_diag.h)
+// and the read/write tuning record (ups_tuning.h).
 enum
 {
-    REPORT_ID_POWER_SUMMARY = 1,
-    REPORT_ID_INPUT = 2,
-    REPORT_ID_OUTPUT = 3,
-    REPORT_ID_BATTERY = 4,
+    REPORT_ID_DIAG_ENGINE = 0x10,
+    REPORT_ID_DIAG_LATENCY = 0x11,
+    REPORT_ID_DIAG_LINK = 0x12,
+    REPORT_ID_DIAG_LOOP = 0x13,
+    REPORT_ID_DIAG_MEMORY = 0x14,
+    REPORT_ID_DIAG_USB = 0x15,
+    REPORT_ID_TUNING = 0x18,
 };
 
+// UPS-side settings a host can change with a CONFIG feature write.
+// Writable fields that map to UPS_SETTING_NONE are kept host-side only.
+typedef enum
+{
+    UPS_SETTING_NONE = 0,
+    UPS_SETTING_LOW_VOLTAGE_TRANSFER,
+    UPS_SETTING_HIGH_VOLTAGE_TRANSFER,
+    UPS_SETTING_REMAINING_TIME_LIMIT,
+    UPS_SETTING_COUNT,
+} ups_setting_t;
+
 typedef struct
 {
     bool ac_present;
@@ -82,12 +114,56 @@ typedef struct
     uint16_t frequency;
 } ups_output_t;
 
-// Global UPS state (defined in src/main.c)
-extern ups_present_status_t g_power_summary_present_status;
-extern ups_summary_t g_power_summary;
-extern ups_battery_t g_battery;
-extern ups_input_t g_input;
-extern ups_output_t g_output;
+// Everything known about one UPS.
+typedef struct
+{
+    ups_present_status_t present_status;
+    ups_summary_t summary;
+    ups_battery_t battery;
+    ups_input_t input;
+    ups_output_t output;
+} ups_state_t;
+
+// Global UPS state, one per port (defined in src/main.c). Code that works
+// on one UPS is handed its port (engine callbacks, HID instances, the main
+// loop tasks) and uses g_ups[port]; nothing runs from interrupts.
+extern ups_state_t g_ups[UPS_PORT_COUNT];
+
+// How far a port's bootstrap has got. Levels only go up.
+typedef enum
+{
+    UPS_READINESS_NONE = 0,
+    UPS_READINESS_LINK,      // heartbeat answered
+    UPS_READINESS_MINIMUM,   // capacity and status read; USB starts here
+    UPS_READINESS_CONSTANTS, // ratings, transfer voltages, strings read
+    UPS_READINESS_FULL,      // every telemetry value read once
+    UPS_READINESS_COUNT,
+} ups_readiness_t;
+
+ups_readiness_t ups_port_readiness(uint8_t port);
+
+// HAL_GetTick() when the port first reached level, 0 if it has not.
+uint32_t ups_port_readiness_ms(uint8_t port, ups_readiness_t level);
+
+// True once the port has reached UPS_READINESS_MINIMUM; its STATUS values
+// are meaningless before that.
+bool ups_port_is_ready(uint8_t port);
+
+// True once the port's constant values (the CONFIG report) are known, from
+// the bootstrap or from the flash cache (ups_cache.h).
+bool ups_port_has_constants(uint8_t port);
+
+// Restarts the port's bootstrap at baud, or with the auto-baud probe when
+// baud is 0, once the jobs already sent and a setting write in flight have
+// finished. A rate that bootstraps is remembered like a detected one.
+// Returns false for a bad port or a rate outside 1200..115200.
+bool ups_port_set_baud(uint8_t port, uint32_t baud);
+
+// Constant tables are shared by all ports, so they hold offsets into
+// ups_state_t instead of addresses, e.g. UPS_STATE_OFFSET(battery.temperature),
+// and UPS_STATE_AT(ups, uint16_t, offset) finds the member in one port's state.
+#define UPS_STATE_OFFSET(member) ((uint16_t)offsetof(ups_state_t, member))
+#define UPS_STATE_AT(ups, type, offset) ((type *)(void *)((uint8_t *)(ups) + (offset)))
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,79 @@
+#ifndef UPS_DIAG_H_
+#define UPS_DIAG_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Diagnostics over HID, for units in the field.
+//
+// A second top-level collection on the vendor page (0xFF00) next to the UPS
+// collection carries read-only FEATURE reports with the counters that
+// otherwise need the USART1 debug log. Being a separate collection, it can
+// be opened on its own (HidD_GetFeature on Windows, hidraw on Linux) while
+// the OS power driver owns the UPS one; hiddiag.py reads them. The same
+// collection holds the read/write tuning report (ups_tuning.h).
+//
+// Every counter is kept all the time: the engine and UART counters anyway,
+// and the loop profile costs two DWT cycle counter reads per scheduler
+// pass. Reports are built only when the host asks for one.
+//
+// Reports, little endian, packed; ENGINE, LATENCY and LINK are per port
+// (the HID interface asked), LOOP, MEMORY and USB are the same on every
+// port:
+//
+//   ENGINE   u32 enqueued, completed, failed, retries, timeouts, queue_full
+//            u8 queue_depth, queue_high_water, consecutive_failures
+//   LATENCY  UPS_DIAG_LATENCY_SLOTS x {u16 cmd, count, avg_ms, last_ms, max_ms}
+//            (uart_engine_get_latencies(); unused slots are zero, count
+//            saturates at 65535)
+//   LINK     u8 readiness (ups_readiness_t), flags (bit 0 ready, bit 1
+//            constants known), u32 baud, last_reply_age_ms (0xFFFFFFFF =
+//            none yet), link_ms, rx_errors, rx_dropped,
+//            u16 rx_high_water, rx_buffer_size
+//   LOOP     u32 uptime_ms, passes, idle_passes, runs, event_runs,
+//            wakeups_per_s, tickless_ms, max_pass_us, u16 busy_permille
+//   MEMORY   u16 ram_size, static_bytes, heap_bytes, stack_max_bytes,
+//            stack_headroom_min, log_high_water, log_size, u32 log_dropped
+//   USB      u8 flags (bit 0 suspended, bit 1 remote wakeup allowed, bit 2
+//            wakeup not read yet, bit 3 low-power mode), u32 suspends,
+//            resumes, wakeups, wakeups_blocked, u16 last_resume_ms,
+//            max_resume_ms, last_report_ms, max_report_ms
+//            (ups_hid_wakeup_stats_t), u32 low_power_ms (power_mode.h)
+//
+// busy_permille is the share of the last full second spent in scheduler
+// passes, interrupts that hit them included. stack_max_bytes is the deepest
+// the stack has reached since reset, from stack painting; stack_headroom_min
+// what was left between it and the heap.
+
+#define UPS_DIAG_LATENCY_SLOTS 6U
+
+#define UPS_DIAG_ENGINE_SIZE 27U
+#define UPS_DIAG_LATENCY_SIZE (UPS_DIAG_LATENCY_SLOTS * 10U)
+#define UPS_DIAG_LINK_SIZE 26U
+#define UPS_DIAG_LOOP_SIZE 34U
+#define UPS_DIAG_MEMORY_SIZE 18U
+#define UPS_DIAG_USB_SIZE 29U
+
+// Paints the free stack and starts the cycle counter. Call once, early.
+void ups_diag_init(void);
+
+// Around each task_sched_run() call.
+void ups_diag_pass_begin(void);
+void ups_diag_pass_end(uint32_t now_ms);
+
+bool ups_diag_is_report(uint8_t report_id);
+
+// Builds a diagnostics FEATURE report payload (without the Report ID byte)
+// for the HID instance port. Returns the number of bytes written, 0 for an
+// unknown report or a short buffer.
+uint16_t ups_diag_build_report(uint8_t port, uint8_t report_id, uint8_t *buffer, uint16_t reqlen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UPS_DIAG_H_
@@ -5,10 +5,85 @@
 extern "C" {
 #endif
 
-// Runs periodic HID housekeeping (e.g., interrupt IN heartbeat report).
-// Call this frequently from the main loop.
+#include <stdbool.h>
+#include <stdint.h>
+
+// GET_REPORT accounting, to measure control transfers per host poll cycle.
+// A poll cycle is a burst of GET_REPORT requests; it ends once the host has
+// been quiet for UPS_HID_POLL_CYCLE_GAP_MS.
+typedef struct
+{
+    uint32_t get_report_total;
+    uint32_t get_report_input;
+    uint32_t get_report_feature;
+    uint32_t poll_cycles;
+    uint16_t last_cycle_transfers;
+    uint16_t max_cycle_transfers;
+} ups_hid_poll_stats_t;
+
+typedef enum
+{
+    UPS_HID_TX_PRIORITY_NORMAL = 0,
+    UPS_HID_TX_PRIORITY_HIGH = 1,
+} ups_hid_tx_priority_t;
+
+// Interrupt IN counters. Counters are reset only at power-up.
+typedef struct
+{
+    uint32_t queued;    // accepted by ups_hid_tx_enqueue()
+    uint32_t sent;      // handed to TinyUSB
+    uint32_t coalesced; // replaced the pending report
+    uint32_t dropped;   // rejected: a HIGH priority report was pending
+} ups_hid_tx_stats_t;
+
+// Remote wakeup while the host sleeps. Counters are reset only at power-up.
+// Latencies run from the pass that saw a new power alert (AC lost, capacity
+// below the remaining capacity limit, shutdown imminent) to the bus resume,
+// and to the host reading the first STATUS report after it; 0xFFFF = longer.
+typedef struct
+{
+    uint32_t suspends;
+    uint32_t resumes;
+    uint32_t wakeups;         // remote wakeup signalled, retries included
+    uint32_t wakeups_blocked; // alert while suspended, host did not allow remote wakeup
+    uint16_t last_resume_ms;
+    uint16_t max_resume_ms;
+    uint16_t last_report_ms;
+    uint16_t max_report_ms;
+    bool suspended;
+    bool remote_wakeup_en; // as set by the host at the last suspend
+    bool wakeup_pending;   // signalled, no report read yet
+} ups_hid_wakeup_stats_t;
+
+void ups_hid_get_wakeup_stats(ups_hid_wakeup_stats_t *out);
+
+// HID instance n is the power device of UPS port n (see ups_data.h).
+//
+// Pushes the STATUS INPUT report on the interrupt endpoint when it changes,
+// plus a periodic heartbeat. Ports that have not finished bootstrap are
+// skipped, and GET_REPORT on them stalls. While the bus is suspended it
+// instead watches for power alerts and signals remote wakeup. Call this
+// frequently from the main loop, suspended or not.
 void ups_hid_periodic_task(void);
 
+// Queues an INPUT report (payload without report ID) for the interrupt
+// endpoint. There is one pending slot per instance and a newer report
+// replaces the pending one, unless that one was queued with HIGH priority
+// (a power state change the host must see). Returns false if the report was
+// dropped; the caller tries again on its next pass.
+bool ups_hid_tx_enqueue(uint8_t instance, uint8_t report_id, ups_hid_tx_priority_t priority,
+                        uint8_t const *data, uint16_t len);
+
+void ups_hid_get_tx_stats(uint8_t instance, ups_hid_tx_stats_t *out);
+
+// Returns and clears the settings (mask of 1 << ups_setting_t) hosts changed
+// with SET_REPORT since the last call. The new values are already in the
+// ups_data.h shadows; the caller pushes them to the UPS.
+uint32_t ups_hid_take_pending_settings(uint8_t instance);
+
+// Copies the GET_REPORT counters. Counters are reset on USB mount.
+void ups_hid_get_poll_stats(uint8_t instance, ups_hid_poll_stats_t *out);
+
 #ifdef __cplusplus
 }
 #endif
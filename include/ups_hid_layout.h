@@ -0,0 +1,242 @@
+#ifndef UPS_HID_LAYOUT_H_
+#define UPS_HID_LAYOUT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "ups_data.h"
+
+// ------------------------------------------------------------------
+// Single source of truth for the UPS HID reports.
+//
+// UPS_HID_LAYOUT is one ordered X-macro table. The same table generates:
+//  - the HID report descriptor (TUD_HID_REPORT_DESC_UPS, usb_descriptors.h)
+//  - the packed payload structs, one per (report, INPUT/FEATURE)
+//  - the report builders (ups_hid_reports.c)
+// so the three can no longer drift apart. Payload size vs. descriptor bit
+// count is checked at compile time in ups_hid_reports.c.
+//
+// Collections give the usage path (UPS.PowerSummary.RemainingCapacity, ...).
+// The report ID is chosen per field, independently of the collection:
+// NUT and Windows fetch a whole report per GET_REPORT, so every value that
+// is polled each cycle sits in STATUS and one transfer refreshes them all.
+// CONFIG holds data hosts read once at attach.
+//
+// Volatile STATUS values are declared BOTH (INPUT and FEATURE, identical
+// layout). The INPUT report is pushed on the interrupt endpoint when it
+// changes (usb_hid_ups.c), so hosts in interrupt mode need no GET_REPORT.
+//
+// Table entries (the table is expanded with FIELD, PAD, BEGIN, END, GLOBAL,
+// sel):
+//   FIELD(sel, report, kind, member, ctype, bits, page, usage, lmin, lmax, unit, exp, flags, value)
+//     sel    forwarded unchanged; lets a generator pick one (report, kind)
+//     report STATUS or CONFIG (REPORT_ID_<report>)
+//     kind   INPUT, FEATURE or BOTH (one item of each kind)
+//     member struct member name (unique per report and kind)
+//     ctype  storage type of the bit-field (uint8_t/uint16_t/int16_t)
+//     bits   HID Report Size, one usage per field (Report Count 1)
+//     page   usage page suffix: HID_USAGE_PAGE_<page>
+//     usage  usage suffix:      HID_USAGE_<page>_<usage>
+//     lmin/lmax  logical range
+//     unit/exp   HID unit suffix (UPS_HID_UNIT_<unit>) and unit exponent
+//     flags  HID_VOLATILE or HID_NON_VOLATILE
+//     value  ups_state_t member (ups_data.h) the report reads and writes
+//   PAD(sel, report, kind, bits)  constant padding
+//   BEGIN(page, usage)            logical collection
+//   END()                         end of collection
+//   GLOBAL(item, ...)             HID global item for the entries that follow:
+//     REPORT(report), PAGE(page), UNIT(unit), EXP(exp), SIZE(bits),
+//     MIN(lmin, size), MAX(lmax, size)  size: 1, 2 or 3 (4 bytes), signed
+//
+// The descriptor states a global only where a GLOBAL entry sets it, so one
+// is written exactly where the value changes. BEGIN does not set the usage
+// page; it must already be page. Each FIELD still names all of its own
+// values: the other generators use them, and test/test_hid_descriptor
+// checks that every field sees them in the descriptor.
+//
+// Field order is wire order: each (report, kind) is packed in the order its
+// entries appear, across collections.
+// ------------------------------------------------------------------
+
+// HID units (SI linear). See HID 1.11 section 6.2.2.7.
+#define UPS_HID_UNIT_NONE 0x00000000UL
+#define UPS_HID_UNIT_SECOND 0x00001001UL
+#define UPS_HID_UNIT_HERTZ 0x0000F001UL
+#define UPS_HID_UNIT_VOLT 0x00F0D121UL
+#define UPS_HID_UNIT_AMP 0x00100001UL
+#define UPS_HID_UNIT_WATT 0x0000D121UL
+#define UPS_HID_UNIT_KELVIN 0x00010001UL
+
+// Item size code of each unit value (1, 2 or 3 for 4 bytes).
+#define UPS_HID_UNIT_SIZE_NONE 1
+#define UPS_HID_UNIT_SIZE_SECOND 2
+#define UPS_HID_UNIT_SIZE_HERTZ 2
+#define UPS_HID_UNIT_SIZE_VOLT 3
+#define UPS_HID_UNIT_SIZE_AMP 3
+#define UPS_HID_UNIT_SIZE_WATT 2
+#define UPS_HID_UNIT_SIZE_KELVIN 3
+
+/* Power Summary
+    - UPS.PowerSummary.AudibleAlarmControl               (Not implemented)
+    - UPS.PowerSummary.DelayBeforeStartup                (Not implemented)
+    - UPS.PowerSummary.DelayBeforeShutdown               (Not implemented)
+    - UPS.PowerSummary.DelayBeforeReboot                 (Not implemented)
+    - UPS.PowerSummary.APCBattReplaceDate                (Not implemented)
+    - UPS.PowerSummary.APCPanelTest                      (Not implemented)
+
+    Extra required info to make it compatible with windows's battc.sys which convert hid device into ACPI battery device
+    According to pdc 5.6 Equivalence between ACPI Battery Information and Power Summary Usages
+    - UPS.PowerSummary.PresentStatus.RemainingTimeLimitExpired (not implemented)
+
+   Input
+    - UPS.Input.APCLineFailCause  (Not implemented)
+    - UPS.Input.APCSensitivity    (Not implemented)
+    Unfortunately, things like input frequency is not present in NUT's apc-hid.c maybe i can write a stm32 usb hid driver for nut later?
+*/
+#define UPS_HID_LAYOUT(FIELD, PAD, BEGIN, END, GLOBAL, sel) \
+  BEGIN(POWER, POWER_SUMMARY) \
+    GLOBAL(REPORT, STATUS) GLOBAL(PAGE, BATTERY) GLOBAL(MIN, 0, 1) GLOBAL(MAX, 100, 1) GLOBAL(UNIT, NONE) GLOBAL(EXP, 0) GLOBAL(SIZE, 8) \
+    FIELD(sel, STATUS, BOTH, ps_remaining_capacity, uint8_t, 8, BATTERY, REMAINING_CAPACITY, 0, 100, NONE, 0, HID_VOLATILE, battery.remaining_capacity) \
+    GLOBAL(MAX, 65534, 3) GLOBAL(UNIT, SECOND) GLOBAL(SIZE, 16) \
+    FIELD(sel, STATUS, BOTH, ps_run_time_to_empty_s, uint16_t, 16, BATTERY, RUN_TIME_TO_EMPTY, 0, 65534, SECOND, 0, HID_VOLATILE, battery.run_time_to_empty_s) \
+    GLOBAL(PAGE, POWER) GLOBAL(UNIT, VOLT) GLOBAL(EXP, 5) \
+    FIELD(sel, STATUS, BOTH, ps_voltage, uint16_t, 16, POWER, VOLTAGE, 0, 65534, VOLT, 5, HID_VOLATILE, battery.battery_voltage) \
+    GLOBAL(REPORT, CONFIG) GLOBAL(PAGE, BATTERY) GLOBAL(MAX, 100, 1) GLOBAL(UNIT, NONE) GLOBAL(EXP, 0) GLOBAL(SIZE, 8) \
+    FIELD(sel, CONFIG, FEATURE, ps_warning_capacity_limit, uint8_t, 8, BATTERY, WARNING_CAPACITY_LIMIT, 0, 100, NONE, 0, HID_NON_VOLATILE, summary.warning_capacity_limit) \
+    FIELD(sel, CONFIG, FEATURE, ps_remaining_capacity_limit, uint8_t, 8, BATTERY, REMAINING_CAPACITY_LIMIT, 0, 100, NONE, 0, HID_NON_VOLATILE, summary.remaining_capacity_limit) \
+    GLOBAL(MAX, 65534, 3) GLOBAL(UNIT, SECOND) GLOBAL(SIZE, 16) \
+    FIELD(sel, CONFIG, FEATURE, ps_remaining_time_limit_s, uint16_t, 16, BATTERY, REMAINING_TIME_LIMIT, 0, 65534, SECOND, 0, HID_NON_VOLATILE, battery.remaining_time_limit_s) \
+    GLOBAL(MAX, 255, 2) GLOBAL(UNIT, NONE) GLOBAL(SIZE, 8) \
+    FIELD(sel, CONFIG, FEATURE, ps_i_device_chemistry, uint8_t, 8, BATTERY, I_DEVICE_CHEMISTRY, 0, 255, NONE, 0, HID_NON_VOLATILE, summary.i_device_chemistry) \
+    GLOBAL(MAX, 3, 1) \
+    FIELD(sel, CONFIG, FEATURE, ps_capacity_mode, uint8_t, 8, BATTERY, CAPACITY_MODE, 0, 3, NONE, 0, HID_NON_VOLATILE, summary.capacity_mode) \
+    GLOBAL(MAX, 100, 1) \
+    FIELD(sel, CONFIG, FEATURE, ps_full_charge_capacity, uint8_t, 8, BATTERY, FULL_CHARGE_CAPACITY, 0, 100, NONE, 0, HID_NON_VOLATILE, summary.full_charge_capacity) \
+    FIELD(sel, CONFIG, FEATURE, ps_design_capacity, uint8_t, 8, BATTERY, DESIGN_CAPACITY, 0, 100, NONE, 0, HID_NON_VOLATILE, summary.design_capacity) \
+    GLOBAL(MAX, 1, 1) GLOBAL(SIZE, 1) \
+    FIELD(sel, CONFIG, FEATURE, ps_rechargeable, uint8_t, 1, BATTERY, RECHARGEABLE, 0, 1, NONE, 0, HID_NON_VOLATILE, summary.rechargeable) \
+    GLOBAL(SIZE, 7) \
+    PAD(sel, CONFIG, FEATURE, 7) \
+    GLOBAL(MAX, 100, 1) GLOBAL(SIZE, 8) \
+    FIELD(sel, CONFIG, FEATURE, ps_capacity_granularity_1, uint8_t, 8, BATTERY, CAPACITY_GRANULARITY_1, 0, 100, NONE, 0, HID_NON_VOLATILE, summary.capacity_granularity_1) \
+    FIELD(sel, CONFIG, FEATURE, ps_capacity_granularity_2, uint8_t, 8, BATTERY, CAPACITY_GRANULARITY_2, 0, 100, NONE, 0, HID_NON_VOLATILE, summary.capacity_granularity_2) \
+    GLOBAL(PAGE, POWER) GLOBAL(MAX, 3, 1) GLOBAL(SIZE, 2) \
+    FIELD(sel, CONFIG, FEATURE, ps_i_manufacturer, uint8_t, 2, POWER, I_MANUFACTURER, 0, 3, NONE, 0, HID_NON_VOLATILE, summary.i_manufacturer_2bit) \
+    FIELD(sel, CONFIG, FEATURE, ps_i_product, uint8_t, 2, POWER, I_PRODUCT, 0, 3, NONE, 0, HID_NON_VOLATILE, summary.i_product_2bit) \
+    FIELD(sel, CONFIG, FEATURE, ps_i_serial_number, uint8_t, 2, POWER, I_SERIAL_NUMBER, 0, 3, NONE, 0, HID_NON_VOLATILE, summary.i_serial_number_2bit) \
+    FIELD(sel, CONFIG, FEATURE, ps_i_name, uint8_t, 2, POWER, I_NAME, 0, 3, NONE, 0, HID_NON_VOLATILE, summary.i_name_2bit) \
+    BEGIN(POWER, PRESENT_STATUS) \
+      UPS_HID_LAYOUT_PRESENT_STATUS(FIELD, PAD, GLOBAL, sel, STATUS, BOTH) \
+    END() \
+  END() \
+  BEGIN(POWER, INPUT) \
+    GLOBAL(MAX, 65534, 3) GLOBAL(UNIT, VOLT) GLOBAL(EXP, 5) GLOBAL(SIZE, 16) \
+    FIELD(sel, STATUS, BOTH, in_voltage, uint16_t, 16, POWER, VOLTAGE, 0, 65534, VOLT, 5, HID_VOLATILE, input.voltage) \
+    GLOBAL(UNIT, HERTZ) GLOBAL(EXP, -2) \
+    FIELD(sel, STATUS, BOTH, in_frequency, uint16_t, 16, POWER, FREQUENCY, 0, 65534, HERTZ, -2, HID_VOLATILE, input.frequency) \
+    GLOBAL(REPORT, CONFIG) GLOBAL(UNIT, VOLT) GLOBAL(EXP, 5) \
+    FIELD(sel, CONFIG, FEATURE, in_config_voltage, uint16_t, 16, POWER, CONFIG_VOLTAGE, 0, 65534, VOLT, 5, HID_NON_VOLATILE, input.config_voltage) \
+    GLOBAL(MAX, 400, 2) \
+    FIELD(sel, CONFIG, FEATURE, in_low_voltage_transfer, uint16_t, 16, POWER, LOW_VOLTAGE_TRANSFER, 0, 400, VOLT, 5, HID_NON_VOLATILE, input.low_voltage_transfer) \
+    FIELD(sel, CONFIG, FEATURE, in_high_voltage_transfer, uint16_t, 16, POWER, HIGH_VOLTAGE_TRANSFER, 0, 400, VOLT, 5, HID_NON_VOLATILE, input.high_voltage_transfer) \
+  END() \
+  BEGIN(POWER, OUTPUT) \
+    GLOBAL(REPORT, STATUS) GLOBAL(MAX, 100, 1) GLOBAL(UNIT, NONE) GLOBAL(EXP, 0) GLOBAL(SIZE, 8) \
+    FIELD(sel, STATUS, BOTH, out_percent_load, uint8_t, 8, POWER, PERCENT_LOAD, 0, 100, NONE, 0, HID_VOLATILE, output.percent_load) \
+    GLOBAL(MAX, 65534, 3) GLOBAL(UNIT, VOLT) GLOBAL(EXP, 5) GLOBAL(SIZE, 16) \
+    FIELD(sel, STATUS, BOTH, out_voltage, uint16_t, 16, POWER, VOLTAGE, 0, 65534, VOLT, 5, HID_VOLATILE, output.voltage) \
+    GLOBAL(MIN, -32768, 2) GLOBAL(MAX, 32767, 2) GLOBAL(UNIT, AMP) GLOBAL(EXP, -2) \
+    FIELD(sel, STATUS, BOTH, out_current, int16_t, 16, POWER, CURRENT, -32768, 32767, AMP, -2, HID_VOLATILE, output.current) \
+    GLOBAL(MIN, 0, 1) GLOBAL(MAX, 65534, 3) GLOBAL(UNIT, HERTZ) \
+    FIELD(sel, STATUS, BOTH, out_frequency, uint16_t, 16, POWER, FREQUENCY, 0, 65534, HERTZ, -2, HID_VOLATILE, output.frequency) \
+    GLOBAL(REPORT, CONFIG) GLOBAL(UNIT, WATT) GLOBAL(EXP, 7) \
+    FIELD(sel, CONFIG, FEATURE, out_config_active_power, uint16_t, 16, POWER, CONFIG_ACTIVE_POWER, 0, 65534, WATT, 7, HID_NON_VOLATILE, output.config_active_power) \
+    GLOBAL(MAX, 400, 2) GLOBAL(UNIT, VOLT) GLOBAL(EXP, 5) \
+    FIELD(sel, CONFIG, FEATURE, out_config_voltage, uint16_t, 16, POWER, CONFIG_VOLTAGE, 0, 400, VOLT, 5, HID_NON_VOLATILE, output.config_voltage) \
+  END() \
+  BEGIN(POWER, BATTERY) \
+    GLOBAL(REPORT, STATUS) GLOBAL(PAGE, BATTERY) GLOBAL(MAX, 65534, 3) GLOBAL(UNIT, SECOND) GLOBAL(EXP, 0) \
+    FIELD(sel, STATUS, BOTH, bat_run_time_to_empty_s, uint16_t, 16, BATTERY, RUN_TIME_TO_EMPTY, 0, 65534, SECOND, 0, HID_VOLATILE, battery.run_time_to_empty_s) \
+    GLOBAL(PAGE, POWER) GLOBAL(UNIT, VOLT) GLOBAL(EXP, 5) \
+    FIELD(sel, STATUS, BOTH, bat_voltage, uint16_t, 16, POWER, VOLTAGE, 0, 65534, VOLT, 5, HID_VOLATILE, battery.battery_voltage) \
+    GLOBAL(MIN, -32768, 2) GLOBAL(MAX, 32767, 2) GLOBAL(UNIT, AMP) GLOBAL(EXP, -2) \
+    FIELD(sel, STATUS, BOTH, bat_current, int16_t, 16, POWER, CURRENT, -32768, 32767, AMP, -2, HID_VOLATILE, battery.battery_current) \
+    GLOBAL(MIN, 0, 1) GLOBAL(MAX, 4000, 2) GLOBAL(UNIT, KELVIN) GLOBAL(EXP, -1) \
+    FIELD(sel, STATUS, BOTH, bat_temperature, uint16_t, 16, POWER, TEMPERATURE, 0, 4000, KELVIN, -1, HID_VOLATILE, battery.temperature) \
+    GLOBAL(REPORT, CONFIG) GLOBAL(PAGE, BATTERY) GLOBAL(MAX, 65534, 3) GLOBAL(UNIT, SECOND) GLOBAL(EXP, 0) \
+    FIELD(sel, CONFIG, FEATURE, bat_remaining_time_limit_s, uint16_t, 16, BATTERY, REMAINING_TIME_LIMIT, 0, 65534, SECOND, 0, HID_NON_VOLATILE, battery.remaining_time_limit_s) \
+    GLOBAL(UNIT, NONE) \
+    FIELD(sel, CONFIG, FEATURE, bat_manufacturer_date, uint16_t, 16, BATTERY, MANUFACTURER_DATE, 0, 65534, NONE, 0, HID_NON_VOLATILE, battery.manufacturer_date) \
+    GLOBAL(PAGE, POWER) GLOBAL(UNIT, VOLT) GLOBAL(EXP, 5) \
+    FIELD(sel, CONFIG, FEATURE, bat_config_voltage, uint16_t, 16, POWER, CONFIG_VOLTAGE, 0, 65534, VOLT, 5, HID_NON_VOLATILE, battery.config_voltage) \
+  END()
+
+// PresentStatus bits.
+#define UPS_HID_LAYOUT_PRESENT_STATUS(FIELD, PAD, GLOBAL, sel, report, kind) \
+  GLOBAL(REPORT, report) GLOBAL(PAGE, BATTERY) GLOBAL(MAX, 1, 1) GLOBAL(SIZE, 1) \
+  FIELD(sel, report, kind, ac_present, uint8_t, 1, BATTERY, AC_PRESENT, 0, 1, NONE, 0, HID_VOLATILE, present_status.ac_present) \
+  FIELD(sel, report, kind, charging, uint8_t, 1, BATTERY, CHARGING, 0, 1, NONE, 0, HID_VOLATILE, present_status.charging) \
+  FIELD(sel, report, kind, discharging, uint8_t, 1, BATTERY, DISCHARGING, 0, 1, NONE, 0, HID_VOLATILE, present_status.discharging) \
+  FIELD(sel, report, kind, fully_charged, uint8_t, 1, BATTERY, FULLY_CHARGED, 0, 1, NONE, 0, HID_VOLATILE, present_status.fully_charged) \
+  FIELD(sel, report, kind, need_replacement, uint8_t, 1, BATTERY, NEED_REPLACEMENT, 0, 1, NONE, 0, HID_VOLATILE, present_status.need_replacement) \
+  FIELD(sel, report, kind, below_remaining_capacity_limit, uint8_t, 1, BATTERY, BELOW_REMAINING_CAPACITY_LIMIT, 0, 1, NONE, 0, HID_VOLATILE, present_status.below_remaining_capacity_limit) \
+  FIELD(sel, report, kind, battery_present, uint8_t, 1, BATTERY, BATTERY_PRESENT, 0, 1, NONE, 0, HID_VOLATILE, present_status.battery_present) \
+  GLOBAL(PAGE, POWER) \
+  FIELD(sel, report, kind, overload, uint8_t, 1, POWER, OVERLOAD, 0, 1, NONE, 0, HID_VOLATILE, present_status.overload) \
+  FIELD(sel, report, kind, shutdown_imminent, uint8_t, 1, POWER, SHUTDOWN_IMMINENT, 0, 1, NONE, 0, HID_VOLATILE, present_status.shutdown_imminent) \
+  GLOBAL(SIZE, 7) \
+  PAD(sel, report, kind, 7)
+
+// All reports: REPORT(report). The ID is REPORT_ID_<report>.
+#define UPS_HID_REPORTS(REPORT) \
+  REPORT(STATUS) \
+  REPORT(CONFIG)
+
+// Fields hosts may write with SET_REPORT(FEATURE, CONFIG). WRITABLE marks a
+// CONFIG FEATURE member; SETTING names the ups_setting_t the sub-adapter must
+// push to the UPS afterwards (UPS_SETTING_NONE: the shadow is all there is).
+#define UPS_HID_WRITABLE_ps_warning_capacity_limit ~, 1
+#define UPS_HID_WRITABLE_ps_remaining_capacity_limit ~, 1
+#define UPS_HID_WRITABLE_ps_remaining_time_limit_s ~, 1
+#define UPS_HID_WRITABLE_in_low_voltage_transfer ~, 1
+#define UPS_HID_WRITABLE_in_high_voltage_transfer ~, 1
+#define UPS_HID_WRITABLE_bat_remaining_time_limit_s ~, 1
+
+#define UPS_HID_SETTING_ps_warning_capacity_limit UPS_SETTING_NONE
+#define UPS_HID_SETTING_ps_remaining_capacity_limit UPS_SETTING_NONE
+#define UPS_HID_SETTING_ps_remaining_time_limit_s UPS_SETTING_REMAINING_TIME_LIMIT
+#define UPS_HID_SETTING_in_low_voltage_transfer UPS_SETTING_LOW_VOLTAGE_TRANSFER
+#define UPS_HID_SETTING_in_high_voltage_transfer UPS_SETTING_HIGH_VOLTAGE_TRANSFER
+#define UPS_HID_SETTING_bat_remaining_time_limit_s UPS_SETTING_REMAINING_TIME_LIMIT
+
+// UPS_HID_IF_WRITABLE(member, x) keeps x only for a WRITABLE member.
+#define UPS_HID_IF_WRITABLE(member, x) \
+  UPS_HID_KEEP(UPS_HID_PROBE(UPS_HID_WRITABLE_##member), x)
+
+// UPS_HID_SELECT(sel, report, kind, x) keeps x only when sel is <report>_<kind>
+// (a BOTH entry matches both <report>_INPUT and <report>_FEATURE).
+// Every (report, kind) pair a generator may select needs a MATCH line.
+#define UPS_HID_MATCH_STATUS_INPUT__STATUS_INPUT ~, 1
+#define UPS_HID_MATCH_STATUS_INPUT__STATUS_BOTH ~, 1
+#define UPS_HID_MATCH_STATUS_FEATURE__STATUS_FEATURE ~, 1
+#define UPS_HID_MATCH_STATUS_FEATURE__STATUS_BOTH ~, 1
+#define UPS_HID_MATCH_CONFIG_INPUT__CONFIG_INPUT ~, 1
+#define UPS_HID_MATCH_CONFIG_INPUT__CONFIG_BOTH ~, 1
+#define UPS_HID_MATCH_CONFIG_FEATURE__CONFIG_FEATURE ~, 1
+#define UPS_HID_MATCH_CONFIG_FEATURE__CONFIG_BOTH ~, 1
+
+#define UPS_HID_SELECT(sel, report, kind, x) \
+  UPS_HID_KEEP(UPS_HID_PROBE(UPS_HID_MATCH_##sel##__##report##_##kind), x)
+#define UPS_HID_PROBE(...) UPS_HID_PROBE_I(__VA_ARGS__, 0, ~)
+#define UPS_HID_PROBE_I(a, b, ...) b
+#define UPS_HID_KEEP(n, x) UPS_HID_KEEP_I(n, x)
+#define UPS_HID_KEEP_I(n, x) UPS_HID_KEEP_##n(x)
+#define UPS_HID_KEEP_0(x)
+#define UPS_HID_KEEP_1(x) x
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UPS_HID_LAYOUT_H_
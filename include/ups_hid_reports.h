@@ -7,13 +7,21 @@ extern "C" {
 
 #include <stdint.h>
 
-// Builds a HID INPUT report payload (without the leading Report ID byte).
-// Returns number of bytes written to buffer.
-uint16_t build_hid_input_report(uint8_t report_id, uint8_t *buffer, uint16_t reqlen);
+#include "ups_data.h"
 
-// Builds a HID FEATURE report payload (without the leading Report ID byte).
-// Returns number of bytes written to buffer.
-uint16_t build_hid_feature_report(uint8_t report_id, uint8_t *buffer, uint16_t reqlen);
+// Builds a HID INPUT report payload (without the leading Report ID byte)
+// from one UPS's state. Returns number of bytes written to buffer.
+uint16_t build_hid_input_report(const ups_state_t *ups, uint8_t report_id, uint8_t *buffer, uint16_t reqlen);
+
+// Builds a HID FEATURE report payload (without the leading Report ID byte)
+// from one UPS's state. Returns number of bytes written to buffer.
+uint16_t build_hid_feature_report(const ups_state_t *ups, uint8_t report_id, uint8_t *buffer, uint16_t reqlen);
+
+// Applies a FEATURE report written by the host (without the Report ID byte).
+// Writable fields (UPS_HID_WRITABLE_* in ups_hid_layout.h) that changed are
+// stored in their shadow in ups right away. Returns a mask of
+// (1 << ups_setting_t) for the settings that still have to reach the UPS.
+uint32_t apply_hid_feature_report(ups_state_t *ups, uint8_t report_id, const uint8_t *buffer, uint16_t len);
 
 // Packs a date string "MM/DD/YY" into HID Battery ManufacturerDate format.
 // Returns 1 on success, 0 on failure.
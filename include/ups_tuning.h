@@ -0,0 +1,106 @@
+#ifndef UPS_TUNING_H_
+#define UPS_TUNING_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Polling and timeout parameters that can be changed on a deployed unit.
+//
+// The build-time knobs below (and UART_ENGINE_INTERJOB_COOLDOWN_MS,
+// UART_ENGINE_FAILURE_THRESHOLD) are now only the defaults. The values in
+// use live in a versioned record in their own flash page
+// (FLASH_TUNING_PAGE_ADDR), kept with flash_log_save(): CRC-checked slots,
+// one page erase every few dozen saves, nothing written when unchanged. A
+// record of another version or size is ignored and the defaults apply.
+//
+// Hosts read and write the record with the TUNING feature report of the
+// vendor collection (REPORT_ID_TUNING, see ups_diag.h), little endian:
+//
+//   u8 version (UPS_TUNING_VERSION), u8 flags,
+//   u16 dynamic_update_period_s, init_retry_period_s, interjob_cooldown_ms,
+//       reply_timeout_ms, iwdg_timeout_ms,
+//   u8 failure_threshold, u8 reserved, u32 ups_baud
+//
+// Read flags: UPS_TUNING_FLAG_*. A write must carry the current version;
+// with UPS_TUNING_FLAG_DEFAULTS set the rest is ignored and the build
+// defaults are restored. A write with a value out of range changes nothing
+// and sets UPS_TUNING_FLAG_REJECTED. Accepted values apply at once, except
+// iwdg_timeout_ms and ups_baud, which are used from the next reset; they
+// are stored UPS_TUNING_SAVE_DELAY_MS after the last write, so a tool that
+// sets fields one write at a time costs one flash slot.
+
+// Telemetry refresh period once a port has bootstrapped.
+#ifndef UPS_DYNAMIC_UPDATE_PERIOD_S
+#define UPS_DYNAMIC_UPDATE_PERIOD_S 10U
+#endif
+
+// Wait before a port whose UPS did not answer starts over.
+#ifndef UPS_INIT_RETRY_PERIOD_S
+#define UPS_INIT_RETRY_PERIOD_S 5U
+#endif
+
+// UPS UART rate when no protocol is cached. APC Modbus units default to 9600.
+#ifndef UPS_UART_BAUD
+#define UPS_UART_BAUD 2400U
+#endif
+
+#ifndef UPS_IWDG_TIMEOUT_MS
+#define UPS_IWDG_TIMEOUT_MS 8000U
+#endif
+
+#ifndef UPS_TUNING_SAVE_DELAY_MS
+#define UPS_TUNING_SAVE_DELAY_MS 3000U
+#endif
+
+// Bumped whenever ups_tuning_t changes meaning.
+#define UPS_TUNING_VERSION 1U
+
+#define UPS_TUNING_REPORT_SIZE 18U
+
+#define UPS_TUNING_FLAG_STORED (1U << 0)   // read: values came from flash
+#define UPS_TUNING_FLAG_PENDING (1U << 1)  // read: not saved yet
+#define UPS_TUNING_FLAG_REJECTED (1U << 2) // read: the last write was refused
+#define UPS_TUNING_FLAG_SAVE_ERROR (1U << 3) // read: the last save failed
+#define UPS_TUNING_FLAG_DEFAULTS (1U << 7) // write: restore the build defaults
+
+typedef struct
+{
+    uint16_t dynamic_update_period_s; // 1..3600
+    uint16_t init_retry_period_s;     // 1..3600
+    uint16_t interjob_cooldown_ms;    // 0..1000
+    uint16_t reply_timeout_ms;        // 0 = each command's own, else 50..10000
+    uint16_t iwdg_timeout_ms;         // 1000..26000, next reset
+    uint8_t failure_threshold;        // 1..255
+    uint8_t reserved;
+    uint32_t ups_baud;                // 1200..115200, next reset
+} ups_tuning_t;
+
+// Loads the stored record (or the defaults) and applies it. Call before the
+// watchdog and the UART engines are set up.
+void ups_tuning_init(void);
+
+// Values in use; iwdg_timeout_ms and ups_baud as stored for the next reset.
+const ups_tuning_t *ups_tuning_get(void);
+
+// Validates and applies values, and schedules the save. Returns false, with
+// nothing changed, when a value is out of range.
+bool ups_tuning_set(const ups_tuning_t *values, uint32_t now_ms);
+
+// Writes the record to flash once UPS_TUNING_SAVE_DELAY_MS have passed
+// since the last change. Returns ms until it wants to be called again, or
+// 0xFFFFFFFF when nothing is pending (task_sched_fn_t compatible).
+uint32_t ups_tuning_flush(uint32_t now_ms);
+
+// HID TUNING feature report payload, without the Report ID byte.
+uint16_t ups_tuning_build_report(uint8_t *buffer, uint16_t reqlen);
+void ups_tuning_apply_report(const uint8_t *buffer, uint16_t len, uint32_t now_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UPS_TUNING_H_
@@ -0,0 +1,49 @@
+#ifndef USB_CDC_PASSTHROUGH_H_
+#define USB_CDC_PASSTHROUGH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Raw UPS serial passthrough on the second CDC port.
+//
+// Bytes from the host go to the UART of port UPS_CDC_PASSTHROUGH_PORT
+// (default 0, USART2) unchanged and UPS bytes come back, so apcupsd
+// (apcsmart) or test scripts can talk to the UPS without unplugging the
+// converter. The host's line coding is ignored; the link stays at the UART's
+// rate.
+//
+// The UART is shared with that port's uart_engine at transaction boundaries,
+// using the UPS_UART_TryLock() ownership lock:
+// - A slice starts when host bytes are waiting and the engine is between
+//   jobs. Host bytes simply wait in the CDC FIFO until then.
+// - It ends once both directions have been quiet for
+//   UPS_CDC_PASSTHROUGH_IDLE_MS, so a reply is never split. After
+//   UPS_CDC_PASSTHROUGH_SLICE_MAX_MS no new host bytes are sent and the
+//   slice ends at the next quiet gap.
+// - The next slice waits until the engine has finished a job (or has
+//   nothing queued), so HID values keep being refreshed.
+// Each side discards stale RX bytes before it transmits, so neither sees
+// the other's replies.
+typedef struct
+{
+    uint32_t slices;
+    uint32_t host_bytes; // host -> UPS
+    uint32_t ups_bytes;  // UPS -> host
+    uint32_t dropped;    // host bytes lost to a failed UART TX start
+    bool active;         // passthrough owns the UART right now
+} ups_cdc_passthrough_stats_t;
+
+// Call frequently from the main loop, after tud_task().
+void ups_cdc_passthrough_task(void);
+
+void ups_cdc_passthrough_get_stats(ups_cdc_passthrough_stats_t *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_CDC_PASSTHROUGH_H_
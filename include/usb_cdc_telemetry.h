@@ -0,0 +1,61 @@
+#ifndef USB_CDC_TELEMETRY_H_
+#define USB_CDC_TELEMETRY_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+
+// USB CDC-ACM telemetry interface (second interface next to the HID UPS).
+//
+// While a terminal has the port open (DTR set), one record per period is
+// written, comma separated and CRLF terminated:
+//   D,port,seq,ms,status,capacity_pct,runtime_s,battery_cV,battery_cA,temp_dK,
+//     input_cV,input_cHz,output_cV,output_cA,output_cHz,load_pct
+//   E,port,ms,enqueued,completed,failed,retries,timeouts,queue_full,depth,high_water
+//   H,port,ms,tx_queued,tx_sent,tx_coalesced,tx_dropped,get_reports,poll_cycles,cdc_dropped
+//   B,port,ms,level,link_ms,minimum_ms,constants_ms,full_ms
+//   P,ms,slices,host_bytes,ups_bytes,dropped,active   (serial passthrough, if built)
+//   S,ms,passes,idle_passes,runs,event_runs,wakeups,wakeups_per_s,tickless_ms
+// port is the UPS port (0 = USART2, 1 = USART3); D, E, H and B come once
+// per port, and seq counts D records over all ports.
+// status is PresentStatus as hex, bit 0 = ACPresent in HID layout order.
+// B is the bootstrap: level is ups_readiness_t, and *_ms the tick at which
+// each level was reached (0 = not yet); minimum_ms is when the battery
+// became visible to the host.
+// S is the main loop: task_sched passes and task runs, and the idle
+// wake-ups (idle_sleep.h), whose rate drops with the tickless idle.
+// E (UART engine), H (USB), B, P and S records follow every
+// UPS_CDC_COUNTERS_EVERY D records. Records that do not fit the CDC TX FIFO are dropped, never
+// waited for, so a slow host can't stall the main loop.
+//
+// TRACE dumps the UART wire trace (uart_trace.h), oldest event first:
+//   T,BEGIN,now,first,end
+//   T,index,event        (the 8 event bytes as hex, one line per event)
+//   T,END,end,lost
+// now is the trace clock when the dump started; events overwritten before
+// they were sent are skipped and counted in lost. uarttrace.py decodes it.
+//
+// Commands (one per line, case-insensitive), answered with OK or ERR:
+//   START / STOP   enable or pause the stream
+//   RATE <ms>      record period
+//   GET            one D record now
+//   STATS          one set of E, H, B, (P) and S records now
+//   TRACE          dump the UART wire trace
+//   BAUD <port> <rate>|AUTO   restart the port's bootstrap at rate, or with
+//                  the auto-baud probe (ups_port_set_baud())
+//   HELP           column legend ('#' lines)
+//
+// Call ups_cdc_telemetry_task() frequently from the main loop, after tud_task().
+void ups_cdc_telemetry_task(void);
+
+// True while a terminal is open and the stream is on or a TRACE dump is
+// running, i.e. while the task has records due every period.
+bool ups_cdc_telemetry_is_streaming(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // USB_CDC_TELEMETRY_H_
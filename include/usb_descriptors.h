@@ -8,404 +8,94 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#define TUD_HID_REPORT_DESC_UPS(...) \
-  HID_USAGE_PAGE(HID_USAGE_PAGE_POWER), \
-  HID_USAGE(HID_USAGE_POWER_UPS), \
-  HID_COLLECTION(HID_COLLECTION_APPLICATION), \
-  /* Power Summary */ \
-  /*
-      Battery Page
-    Feature(in order)
-    UPS.PowerSummary.WarningCapacityLimit
-    UPS.PowerSummary.RemainingCapacityLimit            
-    UPS.PowerSummary.RemainingCapacity
-    UPS.PowerSummary.RunTimeToEmpty
-    UPS.PowerSummary.RemainingTimeLimit      
-    UPS.PowerSummary.iDeviceChemistry    
-    UPS.PowerSummary.CapacityMode
-    UPS.PowerSummary.DesignCapacity
-    UPS.PowerSummary.FullChargeCapacity
-    UPS.PowerSummary.Rechargable
-    UPS.PowerSummary.CapacityGranularity1
-    UPS.PowerSummary.CapacityGranularity2
-    UPS.PowerSummary.iManufacturer
-    UPS.PowerSummary.iProduct
-    UPS.PowerSummary.iSerialNumber
-    UPS.PowerSummary.iName
-    UPS.PowerSummary.PresentStatus.ACPresent
-    UPS.PowerSummary.PresentStatus.Charging
-    UPS.PowerSummary.PresentStatus.Discharging
-    UPS.PowerSummary.PresentStatus.FullyCharged
-    UPS.PowerSummary.PresentStatus.NeedReplacement
-    UPS.PowerSummary.PresentStatus.BelowRemainingCapacityLimit
-    UPS.PowerSummary.PresentStatus.BatteryPresent
-    UPS.PowerSummary.PresentStatus.Overload
-    UPS.PowerSummary.PresentStatus.ShutdownImminent
-
-    INPUT(in order)
-    UPS.PowerSummary.RemainingCapacity
-    UPS.PowerSummary.RunTimeToEmpty
-    UPS.PowerSummary.Voltage
-    UPS.PowerSummary.PresentStatus.ACPresent
-    UPS.PowerSummary.PresentStatus.Charging
-    UPS.PowerSummary.PresentStatus.Discharging
-    UPS.PowerSummary.PresentStatus.FullyCharged
-    UPS.PowerSummary.PresentStatus.NeedReplacement
-    UPS.PowerSummary.PresentStatus.BelowRemainingCapacityLimit
-    UPS.PowerSummary.PresentStatus.BatteryPresent
-    UPS.PowerSummary.PresentStatus.Overload
-    UPS.PowerSummary.PresentStatus.ShutdownImminent
+#include "ups_diag.h"
+#include "ups_hid_layout.h"
+#include "ups_tuning.h"
+
+// HID interrupt IN endpoint polling interval (bInterval, ms at full speed).
+// Volatile values are pushed on this endpoint, so keep it short.
+#ifndef UPS_HID_EP_INTERVAL_MS
+#define UPS_HID_EP_INTERVAL_MS 10U
+#endif
 
-    - UPS.PowerSummary.AudibleAlarmControl               (Not implemented)      
-    - UPS.PowerSummary.DelayBeforeStartup                (Not implemented)      
-    - UPS.PowerSummary.DelayBeforeShutdown               (Not implemented)      
-    - UPS.PowerSummary.DelayBeforeReboot                 (Not implemented)      
-    - UPS.PowerSummary.APCBattReplaceDate                (Not implemented)      
-    - UPS.PowerSummary.APCPanelTest                      (Not implemented)     
+// ------------------------------------------------------------------
+// UPS HID report descriptor, generated from the tables in ups_hid_layout.h
+// ------------------------------------------------------------------
 
-    Extra required info to make it compatible with windows's battc.sys which convert hid device into ACPI battery device
-    According to pdc 5.6 Equivalence between ACPI Battery Information and Power Summary Usages
-    - UPS.PowerSummary.PresentStatus.RemainingTimeLimitExpired (not implemented)
+// A field is its usage and the main item; its globals come from the GLOBAL
+// entries before it.
+#define UPS_HID_DESC_FIELD(sel, report, kind, member, ctype, bits, page, usage, lmin, lmax, unit, exp, flags, value) \
+  UPS_HID_DESC_FOR_##kind(UPS_HID_DESC_ITEM, HID_USAGE_##page##_##usage, flags)
+
+#define UPS_HID_DESC_ITEM(main_item, usage_id, flags) \
+  HID_USAGE(usage_id), \
+  main_item(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | (flags)),
+
+#define UPS_HID_DESC_PAD(sel, report, kind, bits) \
+  UPS_HID_DESC_FOR_##kind(UPS_HID_DESC_PAD_ITEM, ~)
+
+#define UPS_HID_DESC_PAD_ITEM(main_item, unused) \
+  main_item(HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE),
+
+// A BOTH entry becomes two items; the usage is local and must be repeated.
+#define UPS_HID_DESC_FOR_INPUT(ITEM, ...) ITEM(HID_INPUT, __VA_ARGS__)
+#define UPS_HID_DESC_FOR_FEATURE(ITEM, ...) ITEM(HID_FEATURE, __VA_ARGS__)
+#define UPS_HID_DESC_FOR_BOTH(ITEM, ...) ITEM(HID_INPUT, __VA_ARGS__) ITEM(HID_FEATURE, __VA_ARGS__)
+
+#define UPS_HID_DESC_GLOBAL(item, ...) UPS_HID_DESC_GLOBAL_##item(__VA_ARGS__)
+#define UPS_HID_DESC_GLOBAL_REPORT(report) HID_REPORT_ID(REPORT_ID_##report)
+#define UPS_HID_DESC_GLOBAL_PAGE(page) HID_USAGE_PAGE(HID_USAGE_PAGE_##page),
+#define UPS_HID_DESC_GLOBAL_UNIT(unit) HID_UNIT_N(UPS_HID_UNIT_##unit, UPS_HID_UNIT_SIZE_##unit),
+#define UPS_HID_DESC_GLOBAL_EXP(exp) HID_UNIT_EXPONENT(exp),
+#define UPS_HID_DESC_GLOBAL_MIN(lmin, size) HID_LOGICAL_MIN_N(lmin, size),
+#define UPS_HID_DESC_GLOBAL_MAX(lmax, size) HID_LOGICAL_MAX_N(lmax, size),
+#define UPS_HID_DESC_GLOBAL_SIZE(bits) HID_REPORT_SIZE(bits),
+
+// The collection usage is on the current page, which the table keeps at
+// page wherever a collection begins.
+#define UPS_HID_DESC_BEGIN(page, usage) \
+  HID_USAGE(HID_USAGE_##page##_##usage), \
+  HID_COLLECTION(HID_COLLECTION_LOGICAL),
+
+#define UPS_HID_DESC_END() \
+  HID_COLLECTION_END,
+
+// Vendor diagnostics (ups_diag.h) and tuning (ups_tuning.h): opaque byte
+// arrays, one FEATURE report each, in their own top-level collection.
+// Globals carry over from the UPS collection (logical minimum 0), so the
+// unit is cleared and the byte range and size are set once.
+#define UPS_HID_DESC_DIAG_REPORT(report_id, size) \
+  HID_REPORT_ID(report_id) \
+  HID_USAGE(report_id), \
+  HID_REPORT_COUNT(size), \
+  HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
 
-  */ \
-    HID_REPORT_ID(1) \
-    HID_USAGE(HID_USAGE_POWER_POWER_SUMMARY), \
-    HID_COLLECTION(HID_COLLECTION_LOGICAL), \
-      HID_USAGE_PAGE(HID_USAGE_PAGE_BATTERY), \
-      HID_USAGE(HID_USAGE_BATTERY_REMAINING_CAPACITY), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX(100), \
-      HID_REPORT_SIZE(8), \
-      HID_REPORT_COUNT(1), \
-      HID_UNIT_EXPONENT(0), \
-      HID_UNIT(0x00), \
-      HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-      HID_USAGE(HID_USAGE_BATTERY_RUN_TIME_TO_EMPTY), \
-      HID_UNIT_N(0x0110, 2), /* SI Lin: Time */ \
-      HID_REPORT_SIZE(16), \
-      HID_REPORT_COUNT(1), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX_N(65534,3), \
-      HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-      HID_USAGE_PAGE(HID_USAGE_PAGE_POWER), \
-      HID_USAGE(HID_USAGE_POWER_VOLTAGE), \
-      HID_UNIT_N(0x00F0D121, 3), /* SI Lin: Volts */ \
-      HID_UNIT_EXPONENT(5), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX_N(65534,3), \
-      HID_REPORT_SIZE(16), \
-      HID_REPORT_COUNT(1), \
-      HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-      HID_USAGE_PAGE(HID_USAGE_PAGE_BATTERY), \
-      HID_USAGE(HID_USAGE_BATTERY_WARNING_CAPACITY_LIMIT), \
-      HID_USAGE(HID_USAGE_BATTERY_REMAINING_CAPACITY_LIMIT), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX(100), \
-      HID_REPORT_SIZE(8), \
-      HID_REPORT_COUNT(2), \
-      HID_UNIT_EXPONENT(0), \
-      HID_UNIT(0x00), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_USAGE(HID_USAGE_BATTERY_REMAINING_CAPACITY), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX(100), \
-      HID_REPORT_SIZE(8), \
-      HID_REPORT_COUNT(1), \
-      HID_UNIT_EXPONENT(0), \
-      HID_UNIT(0x00), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-      HID_USAGE(HID_USAGE_BATTERY_RUN_TIME_TO_EMPTY), \
-      HID_UNIT_N(0x0110, 2), /* SI Lin: Time */ \
-      HID_REPORT_SIZE(16), \
-      HID_REPORT_COUNT(1), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX_N(65534,3), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-      HID_USAGE(HID_USAGE_BATTERY_REMAINING_TIME_LIMIT), \
-      HID_UNIT_N(0x1001, 2), /* SI Lin: Time */ \
-      HID_REPORT_SIZE(16), \
-      HID_REPORT_COUNT(1), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX_N(65534,3), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_USAGE(HID_USAGE_BATTERY_I_DEVICE_CHEMISTRY), \
-      HID_UNIT(0), \
-      HID_REPORT_SIZE(8), \
-      HID_REPORT_COUNT(1), \
-      HID_UNIT_EXPONENT(0), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX_N(255,2), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_USAGE(HID_USAGE_BATTERY_CAPACITY_MODE), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX(3), \
-      HID_REPORT_SIZE(8), \
-      HID_REPORT_COUNT(1), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_USAGE(HID_USAGE_BATTERY_FULL_CHARGE_CAPACITY), \
-      HID_USAGE(HID_USAGE_BATTERY_DESIGN_CAPACITY), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX(100), \
-      HID_REPORT_SIZE(8), \
-      HID_REPORT_COUNT(2), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_USAGE(HID_USAGE_BATTERY_RECHARGEABLE), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX(1), \
-      HID_REPORT_SIZE(1), \
-      HID_REPORT_COUNT(1), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-      /* Padding */ \
-      HID_REPORT_SIZE(7), \
-      HID_REPORT_COUNT(1), \
-      HID_FEATURE(HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_USAGE(HID_USAGE_BATTERY_CAPACITY_GRANULARITY_1), \
-      HID_USAGE(HID_USAGE_BATTERY_CAPACITY_GRANULARITY_2), \
-      HID_LOGICAL_MIN(0), \
-      HID_LOGICAL_MAX(100), \
-      HID_REPORT_SIZE(8), \
-      HID_REPORT_COUNT(2), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_USAGE_PAGE(HID_USAGE_PAGE_POWER), \
-      HID_USAGE(HID_USAGE_POWER_I_MANUFACTURER), \
-      HID_USAGE(HID_USAGE_POWER_I_PRODUCT), \
-      HID_USAGE(HID_USAGE_POWER_I_SERIAL_NUMBER), \
-      HID_USAGE(HID_USAGE_POWER_I_NAME), \
-      HID_REPORT_SIZE(2), \
-      HID_REPORT_COUNT(4), \
-      HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_USAGE_PAGE(HID_USAGE_PAGE_POWER), \
-      HID_USAGE(HID_USAGE_POWER_PRESENT_STATUS), \
-      HID_COLLECTION(HID_COLLECTION_LOGICAL), \
-        HID_USAGE_PAGE(HID_USAGE_PAGE_BATTERY), \
-        HID_USAGE(HID_USAGE_BATTERY_AC_PRESENT), \
-        HID_USAGE(HID_USAGE_BATTERY_CHARGING), \
-        HID_USAGE(HID_USAGE_BATTERY_DISCHARGING), \
-        HID_USAGE(HID_USAGE_BATTERY_FULLY_CHARGED), \
-        HID_USAGE(HID_USAGE_BATTERY_NEED_REPLACEMENT), \
-        HID_USAGE(HID_USAGE_BATTERY_BELOW_REMAINING_CAPACITY_LIMIT), \
-        HID_USAGE(HID_USAGE_BATTERY_BATTERY_PRESENT), \
-        HID_USAGE_PAGE(HID_USAGE_PAGE_POWER), \
-        HID_USAGE(HID_USAGE_POWER_OVERLOAD), \
-        HID_USAGE(HID_USAGE_POWER_SHUTDOWN_IMMINENT), \
-        HID_REPORT_SIZE(1), \
-        HID_REPORT_COUNT(9), \
-        HID_UNIT_EXPONENT(0), \
-        HID_UNIT(0x00), \
-        HID_LOGICAL_MIN(0), \
-        HID_LOGICAL_MAX(1), \
-        HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-        /* Padding */ \
-        HID_REPORT_SIZE(1), \
-        HID_REPORT_COUNT(7), \
-        HID_INPUT(HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE), \
-        HID_USAGE_PAGE(HID_USAGE_PAGE_BATTERY), \
-        HID_USAGE(HID_USAGE_BATTERY_AC_PRESENT), \
-        HID_USAGE(HID_USAGE_BATTERY_CHARGING), \
-        HID_USAGE(HID_USAGE_BATTERY_DISCHARGING), \
-        HID_USAGE(HID_USAGE_BATTERY_FULLY_CHARGED), \
-        HID_USAGE(HID_USAGE_BATTERY_NEED_REPLACEMENT), \
-        HID_USAGE(HID_USAGE_BATTERY_BELOW_REMAINING_CAPACITY_LIMIT), \
-        HID_USAGE(HID_USAGE_BATTERY_BATTERY_PRESENT), \
-        HID_USAGE_PAGE(HID_USAGE_PAGE_POWER), \
-        HID_USAGE(HID_USAGE_POWER_OVERLOAD), \
-        HID_USAGE(HID_USAGE_POWER_SHUTDOWN_IMMINENT), \
-        HID_REPORT_SIZE(1), \
-        HID_REPORT_COUNT(9), \
-        HID_UNIT_EXPONENT(0), \
-        HID_UNIT(0x00), \
-        HID_LOGICAL_MIN(0), \
-        HID_LOGICAL_MAX(1), \
-        HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-        /* Padding */ \
-        HID_REPORT_SIZE(1), \
-        HID_REPORT_COUNT(7), \
-        HID_FEATURE(HID_CONSTANT | HID_VARIABLE | HID_ABSOLUTE), \
-      HID_COLLECTION_END, \
-    HID_COLLECTION_END, \
-  /* Input Section
-      UPS.Input.APCLineFailCause  (Not implemented)
-      UPS.Input.Voltage                 16b
-      UPS.Input.Frequency               16b
-      UPS.Input.ConfigVoltage           16b
-      UPS.Input.LowVoltageTransfer      16b
-      UPS.Input.HighVoltageTransfer     16b
-      UPS.Input.APCSensitivity    (Not implemented)
-      Total : 5 fields, 80 bits = 10 bytes
-      Unfortunately, things like input frequency is not present in NUT's apc-hid.c maybe i can write a stm32 usb hid driver for nut later?
-  */ \
-  HID_REPORT_ID(2) \
+#define TUD_HID_REPORT_DESC_UPS(...) \
   HID_USAGE_PAGE(HID_USAGE_PAGE_POWER), \
-  HID_USAGE(HID_USAGE_POWER_INPUT), \
-  HID_COLLECTION(HID_COLLECTION_LOGICAL), \
-    HID_USAGE(HID_USAGE_POWER_VOLTAGE), \
-    HID_UNIT_N(0x00F0D121, 3), /* SI Lin: Volts */ \
-    HID_UNIT_EXPONENT(5), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-    HID_USAGE(HID_USAGE_POWER_FREQUENCY), \
-    HID_UNIT_N(0xF001, 2), /* SI Lin: Hertz */ \
-    HID_UNIT_EXPONENT(-2), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-    HID_USAGE(HID_USAGE_POWER_CONFIG_VOLTAGE), \
-    HID_UNIT_N(0x00F0D121, 3), /* SI Lin: Volts */ \
-    HID_UNIT_EXPONENT(5), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-    HID_USAGE(HID_USAGE_POWER_LOW_VOLTAGE_TRANSFER), \
-    HID_USAGE(HID_USAGE_POWER_HIGH_VOLTAGE_TRANSFER), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(400,2), \
-    HID_UNIT_EXPONENT(5), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(2), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-  HID_COLLECTION_END,\
-    /* Output Section
-      UPS.Output.PercentLoad          8b
-      UPS.Output.ConfigActivePower    16b
-      UPS.Output.ConfigVoltage        16b
-      UPS.Output.Voltage              16b
-      UPS.Output.Current              16b
-      UPS.Output.Frequency            16b
-      Total: 6 fields, 80 bits = 10 bytes
-  */ \
-  HID_REPORT_ID(3) \
-  HID_USAGE(HID_USAGE_POWER_OUTPUT), \
-  HID_COLLECTION(HID_COLLECTION_LOGICAL), \
-    HID_USAGE(HID_USAGE_POWER_PERCENT_LOAD), \
-    HID_UNIT(0x00), \
-    HID_UNIT_EXPONENT(0), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX(100), \
-    HID_REPORT_SIZE(8), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-    HID_USAGE(HID_USAGE_POWER_CONFIG_ACTIVE_POWER), \
-    HID_UNIT_N(0xD121, 2), /* SI Lin: Watts */ \
-    HID_UNIT_EXPONENT(7), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-    HID_USAGE(HID_USAGE_POWER_CONFIG_VOLTAGE), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(400,2), \
-    HID_UNIT_EXPONENT(5), \
-    HID_UNIT_N(0x00F0D121, 3), /* SI Lin: Volts */ \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-    HID_USAGE(HID_USAGE_POWER_VOLTAGE), \
-    HID_UNIT_N(0x00F0D121, 3), /* SI Lin: Volts */ \
-    HID_UNIT_EXPONENT(5), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-    HID_USAGE(HID_USAGE_POWER_CURRENT), \
-    HID_UNIT_N(0x00100001, 3), /* SI Lin: Amps */ \
-    HID_UNIT_EXPONENT(-2), \
-    HID_LOGICAL_MIN_N(-32768,2), \
-    HID_LOGICAL_MAX_N(32767,2), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-    HID_USAGE(HID_USAGE_POWER_FREQUENCY), \
-    HID_UNIT_N(0xF001, 2), /* SI Lin: Hertz */ \
-    HID_UNIT_EXPONENT(-2), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-  HID_COLLECTION_END, \
-  /* Battery 
-    UPS.Battery.RunTimeToEmpty        16b
-    UPS.Battery.RemainingTimeLimit    16b
-    UPS.Battery.ManufacturerDate      16b
-    UPS.Battery.Voltage               16b
-    UPS.Battery.Current               16b
-    UPS.Battery.ConfigVoltage         16b
-    UPS.Battery.Temperature           16b
-    Total: 7 fields, 112 bits = 14 bytes
-  */ \
-  HID_REPORT_ID(4) \
-  HID_USAGE(HID_USAGE_POWER_BATTERY), \
-  HID_COLLECTION(HID_COLLECTION_LOGICAL), \
-    HID_USAGE_PAGE(HID_USAGE_PAGE_BATTERY), \
-    HID_USAGE(HID_USAGE_BATTERY_RUN_TIME_TO_EMPTY), \
-    HID_UNIT_N(0x0110, 2), /* SI Lin: Time */ \
-    HID_UNIT_EXPONENT(0), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-    HID_USAGE(HID_USAGE_BATTERY_REMAINING_TIME_LIMIT), \
-    HID_UNIT_N(0x1001, 2), /* SI Lin: Time */ \
-    HID_UNIT_EXPONENT(0), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-    HID_USAGE(HID_USAGE_BATTERY_MANUFACTURER_DATE), \
-    HID_UNIT(0), \
-    HID_UNIT_EXPONENT(0), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-    HID_USAGE_PAGE(HID_USAGE_PAGE_POWER), \
-    HID_USAGE(HID_USAGE_POWER_VOLTAGE), \
-    HID_UNIT_N(0x00F0D121, 3), /* SI Lin: Volts */ \
-    HID_UNIT_EXPONENT(5), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-    HID_USAGE(HID_USAGE_POWER_CURRENT), \
-    HID_UNIT_N(0x00100001, 3), /* SI Lin: Amps */ \
-    HID_UNIT_EXPONENT(-2), \
-    HID_LOGICAL_MIN_N(-32768,2), \
-    HID_LOGICAL_MAX_N(32767,2), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
-    HID_USAGE(HID_USAGE_POWER_CONFIG_VOLTAGE), \
-    HID_UNIT_N(0x00F0D121, 3), /* SI Lin: Volts */ \
-    HID_UNIT_EXPONENT(5), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(65534,3), \
-    HID_REPORT_SIZE(16), \
-    HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE), \
-    HID_USAGE(HID_USAGE_POWER_TEMPERATURE), \
-    HID_UNIT_N(0x00010001, 3), /* SI Lin: Temperature */ \
-    HID_UNIT_EXPONENT(-1), \
-    HID_LOGICAL_MIN(0), \
-    HID_LOGICAL_MAX_N(4000,2), \
-    HID_REPORT_SIZE(16), \
+  HID_USAGE(HID_USAGE_POWER_UPS), \
+  HID_COLLECTION(HID_COLLECTION_APPLICATION), \
     HID_REPORT_COUNT(1), \
-    HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE | HID_VOLATILE), \
+    UPS_HID_LAYOUT(UPS_HID_DESC_FIELD, UPS_HID_DESC_PAD, UPS_HID_DESC_BEGIN, UPS_HID_DESC_END, UPS_HID_DESC_GLOBAL, ~) \
   HID_COLLECTION_END, \
-HID_COLLECTION_END \
-
+  HID_UNIT(0), \
+  HID_UNIT_EXPONENT(0), \
+  HID_USAGE_PAGE_N(HID_USAGE_PAGE_VENDOR, 2), \
+  HID_USAGE(0x01), \
+  HID_COLLECTION(HID_COLLECTION_APPLICATION), \
+    HID_LOGICAL_MAX_N(255, 2), \
+    HID_REPORT_SIZE(8), \
+    UPS_HID_DESC_DIAG_REPORT(REPORT_ID_DIAG_ENGINE, UPS_DIAG_ENGINE_SIZE) \
+    UPS_HID_DESC_DIAG_REPORT(REPORT_ID_DIAG_LATENCY, UPS_DIAG_LATENCY_SIZE) \
+    UPS_HID_DESC_DIAG_REPORT(REPORT_ID_DIAG_LINK, UPS_DIAG_LINK_SIZE) \
+    UPS_HID_DESC_DIAG_REPORT(REPORT_ID_DIAG_LOOP, UPS_DIAG_LOOP_SIZE) \
+    UPS_HID_DESC_DIAG_REPORT(REPORT_ID_DIAG_MEMORY, UPS_DIAG_MEMORY_SIZE) \
+    UPS_HID_DESC_DIAG_REPORT(REPORT_ID_DIAG_USB, UPS_DIAG_USB_SIZE) \
+    UPS_HID_DESC_DIAG_REPORT(REPORT_ID_TUNING, UPS_TUNING_REPORT_SIZE) \
+  HID_COLLECTION_END
+
+// Length of TUD_HID_REPORT_DESC_UPS(), checked at compile time in
+// usb_descriptors.c. Update it when the layout changes.
+#define UPS_HID_REPORT_DESC_LEN 639U
 
 // ------------------------------------------------------------------
 // USB string descriptor accessors
@@ -419,8 +109,15 @@ typedef enum
   USB_STRID_SERIAL = 3,
   USB_STRID_HID_INAME = 4,
   USB_STRID_HID_DEVICE_CHEM = 5,
+  USB_STRID_CDC_INAME = 6,
+  USB_STRID_CDC_PASSTHROUGH_INAME = 7,
 } usb_string_id_t;
 
+// Storage per settable string, including the terminator.
+#ifndef USB_DESC_STR_MAX_CHARS
+#define USB_DESC_STR_MAX_CHARS 32U
+#endif
+
 // Returns the number of supported string descriptor indices.
 uint8_t usb_desc_string_count(void);
 
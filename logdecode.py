@@ -0,0 +1,214 @@
+#!/usr/bin/env python3
+"""
+Decode the converter's binary debug log (include/log_ring.h).
+
+The firmware stores only the address of each format string and the raw
+argument words; the strings are read back from the firmware ELF, so the ELF
+must be the one that is flashed. Read live from the USB-TTL adapter on
+USART1 (PA9, 115200 8N1) or from a raw capture file:
+
+  python logdecode.py .pio/build/genericSTM32F103C8/firmware.elf COM7
+  python logdecode.py firmware.elf /dev/ttyUSB0 --save capture.bin
+  python logdecode.py firmware.elf --file capture.bin
+
+Each line starts with the device tick in seconds. Records lost because the
+ring was full are reported by the firmware ("dropped"), records lost on the
+serial line show up as sequence gaps.
+
+Reading a serial port requires pyserial.
+"""
+
+from __future__ import annotations
+
+import argparse
+import re
+import struct
+import sys
+from typing import BinaryIO, Iterator
+
+try:
+    import serial
+except ImportError:
+    serial = None
+
+SYNC = 0xA5
+HEADER = struct.Struct("<BBHII")
+TYPE_ARGS, TYPE_BYTES, TYPE_TEXT, TYPE_DROPPED = range(4)
+
+CONVERSION = re.compile(r"%([-+ #0]*)(\d*)(?:\.(\d+))?(?:hh|h|ll|l|z|j|t)?([diuxXcsp%])")
+
+
+class Elf:
+    """Allocated, initialised sections of a 32-bit little-endian ELF."""
+
+    def __init__(self, path: str) -> None:
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[4] != 1 or data[5] != 1:
+            raise ValueError(f"{path}: not a 32-bit little-endian ELF")
+        shoff, = struct.unpack_from("<I", data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", data, 0x2E)
+        self.sections: list[tuple[int, bytes]] = []
+        for i in range(shnum):
+            _name, sh_type, flags, addr, offset, size = struct.unpack_from(
+                "<IIIIII", data, shoff + i * shentsize)
+            # SHT_PROGBITS with SHF_ALLOC: flash contents (.text, .rodata).
+            if sh_type == 1 and (flags & 0x2) and addr != 0:
+                self.sections.append((addr, data[offset:offset + size]))
+
+    def string(self, addr: int) -> str | None:
+        for base, blob in self.sections:
+            if base <= addr < base + len(blob):
+                end = blob.find(b"\0", addr - base)
+                if end < 0:
+                    end = len(blob)
+                return blob[addr - base:end].decode("latin-1")
+        return None
+
+
+def format_record(elf: Elf, fmt: str, args: list[int]) -> str:
+    it = iter(args)
+
+    def convert(m: re.Match[str]) -> str:
+        flags, width, precision, conv = m.groups()
+        if conv == "%":
+            return "%"
+        value = next(it, 0)
+        spec = "%" + flags + width + (f".{precision}" if precision else "")
+        if conv in "di":
+            value = value - (1 << 32) if value & 0x80000000 else value
+            return (spec + "d") % value
+        if conv == "u":
+            return (spec + "d") % value
+        if conv in "xX":
+            return (spec + conv) % value
+        if conv == "c":
+            return (spec + "c") % chr(value & 0xFF)
+        if conv == "p":
+            return f"0x{value:08x}"
+        text = elf.string(value)
+        return (spec + "s") % (text if text is not None else f"<0x{value:08x}>")
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def records(stream: Iterator[bytes]) -> Iterator[tuple[int, int, int, int, bytes]]:
+    """Yields (type, seq, tick, fmt_addr, payload), resyncing on garbage."""
+    buf = bytearray()
+    for chunk in stream:
+        buf += chunk
+        while True:
+            start = buf.find(bytes([SYNC]))
+            if start < 0:
+                buf.clear()
+                break
+            del buf[:start]
+            if len(buf) < HEADER.size:
+                break
+            _sync, type_count, seq, tick, fmt_addr = HEADER.unpack_from(buf)
+            rtype, count = type_count >> 6, type_count & 0x3F
+            size = count * 4 if rtype in (TYPE_ARGS, TYPE_DROPPED) else count
+            if len(buf) < HEADER.size + size:
+                break
+            payload = bytes(buf[HEADER.size:HEADER.size + size])
+            del buf[:HEADER.size + size]
+            yield rtype, seq, tick, fmt_addr, payload
+
+
+def serial_chunks(port: str, baud: int, save: BinaryIO | None) -> Iterator[bytes]:
+    with serial.Serial(port, baud, timeout=0.1) as ser:
+        while True:
+            data = ser.read(256)
+            if save is not None and data:
+                save.write(data)
+                save.flush()
+            yield data
+
+
+def file_chunks(path: str) -> Iterator[bytes]:
+    with open(path, "rb") as f:
+        while True:
+            data = f.read(4096)
+            if not data:
+                return
+            yield data
+
+
+def decode(elf: Elf, stream: Iterator[bytes], show_seq: bool) -> None:
+    expected_seq: int | None = None
+    text = ""
+    text_tick = 0
+    for rtype, seq, tick, fmt_addr, payload in records(stream):
+        if expected_seq is not None and seq != expected_seq:
+            lost = (seq - expected_seq) & 0xFFFF
+            print(f"{'':>10}  *** {lost} records lost on the line (seq {expected_seq} -> {seq})")
+        expected_seq = (seq + 1) & 0xFFFF
+        stamp = f"{tick / 1000:10.3f}" + (f" #{seq:05d}" if show_seq else "")
+
+        if rtype == TYPE_TEXT:
+            # _write() output: print whole lines.
+            if not text:
+                text_tick = tick
+            text += payload.decode("latin-1")
+            while "\n" in text:
+                line, text = text.split("\n", 1)
+                print(f"{text_tick / 1000:10.3f}  {line.rstrip()}")
+                text_tick = tick
+            continue
+
+        if rtype == TYPE_DROPPED:
+            dropped, = struct.unpack("<I", payload)
+            print(f"{stamp}  *** {dropped} records dropped (log ring full)")
+            continue
+
+        fmt = elf.string(fmt_addr)
+        if fmt is None:
+            fmt = f"<unknown format 0x{fmt_addr:08x}>"
+        if rtype == TYPE_BYTES:
+            line = fmt + " ".join(f"{b:02X}" for b in payload)
+        else:
+            args = list(struct.unpack(f"<{len(payload) // 4}I", payload))
+            line = format_record(elf, fmt, args)
+        print(f"{stamp}  {line.rstrip()}")
+        sys.stdout.flush()
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Decode the converter's binary debug log")
+    parser.add_argument("elf", help="firmware ELF that is flashed (format strings are read from it)")
+    parser.add_argument("port", nargs="?", help="serial port of the USART1 adapter, e.g. COM7 or /dev/ttyUSB0")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--file", help="decode a raw capture instead of a serial port")
+    parser.add_argument("--save", help="also write the raw bytes read from the port to this file")
+    parser.add_argument("--seq", action="store_true", help="print record sequence numbers")
+    args = parser.parse_args()
+
+    try:
+        elf = Elf(args.elf)
+    except (OSError, ValueError) as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 2
+
+    if args.file:
+        decode(elf, file_chunks(args.file), args.seq)
+        return 0
+
+    if not args.port:
+        parser.error("a serial port or --file is required")
+    if serial is None:
+        print("Error: pyserial is required (pip install pyserial).", file=sys.stderr)
+        return 2
+
+    save = open(args.save, "wb") if args.save else None
+    try:
+        decode(elf, serial_chunks(args.port, args.baud, save), args.seq)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        if save is not None:
+            save.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
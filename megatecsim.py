@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""
+Simulate a Megatec ("Q1") UPS on a serial port, for testing the converter's
+Megatec sub-adapter without a real UPS.
+
+Connect a USB-TTL adapter to the converter's UPS UART (TX to RX, RX to TX,
+GND) and build the firmware with -D UPS_ACTIVE_SUB_ADAPTER=UPS_SUB_ADAPTER_MEGATEC.
+The script answers Q1, F and I and prints one line per second with the
+number of requests seen, so a refresh cycle can be checked to take a single
+Q1 round trip.
+
+  python megatecsim.py COM5
+  python megatecsim.py /dev/ttyUSB0 --outage-after 30 --drain 0.02
+
+Requires pyserial.
+"""
+
+from __future__ import annotations
+
+import argparse
+import sys
+import time
+from collections import Counter
+
+try:
+    import serial
+except ImportError:
+    serial = None
+
+RATING = "#230.0 004 24.00 50.0"
+INFO = "#SIMULATED UPS   MEGATECSIM 1.0       "
+
+
+class SimUps:
+    def __init__(self, args: argparse.Namespace) -> None:
+        self.args = args
+        self.start = time.monotonic()
+        self.battery_v = args.battery_v
+
+    def on_battery(self) -> bool:
+        after = self.args.outage_after
+        return after is not None and (time.monotonic() - self.start) >= after
+
+    def q1(self) -> str:
+        outage = self.on_battery()
+        if outage:
+            self.battery_v = max(self.args.empty_v, self.battery_v - self.args.drain)
+        else:
+            self.battery_v = self.args.battery_v
+        input_v = 0.0 if outage else self.args.input_v
+        input_hz = 0.0 if outage else 50.0
+        low = self.battery_v <= self.args.low_v
+        bits = f"{int(outage)}{int(outage and low)}000001"
+        return (
+            f"({input_v:05.1f} 140.0 {self.args.input_v:05.1f} {self.args.load:03d} "
+            f"{input_hz:04.1f} {self.battery_v:04.1f} 25.0 {bits}"
+        )
+
+    def answer(self, line: str) -> str | None:
+        if line == "Q1":
+            return self.q1()
+        if line == "F":
+            return RATING
+        if line == "I":
+            return INFO
+        return None
+
+
+def run(args: argparse.Namespace) -> int:
+    if serial is None:
+        print("Error: pyserial is required (pip install pyserial).", file=sys.stderr)
+        return 2
+
+    ups = SimUps(args)
+    counts: Counter[str] = Counter()
+    next_report = time.monotonic() + 1.0
+    buf = b""
+
+    with serial.Serial(args.port, args.baud, timeout=0.05) as port:
+        while True:
+            buf += port.read(64)
+            while b"\r" in buf:
+                raw, buf = buf.split(b"\r", 1)
+                line = raw.decode("ascii", errors="replace").strip()
+                counts[line or "<empty>"] += 1
+                reply = ups.answer(line)
+                if reply is not None:
+                    port.write(reply.encode("ascii") + b"\r")
+                if args.verbose:
+                    print(f"<- {line!r} -> {reply!r}")
+
+            now = time.monotonic()
+            if now >= next_report:
+                summary = " ".join(f"{k}={v}" for k, v in sorted(counts.items())) or "idle"
+                state = "battery" if ups.on_battery() else "line"
+                print(f"{state} {ups.battery_v:.2f}V  {summary}")
+                counts.clear()
+                next_report = now + 1.0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Megatec Q1 UPS simulator")
+    parser.add_argument("port", help="serial port, e.g. COM5 or /dev/ttyUSB0")
+    parser.add_argument("--baud", type=int, default=2400)
+    parser.add_argument("--input-v", type=float, default=230.0)
+    parser.add_argument("--load", type=int, default=35, help="load in percent")
+    parser.add_argument("--battery-v", type=float, default=27.0, help="battery voltage on line")
+    parser.add_argument("--low-v", type=float, default=22.0, help="battery low flag below this")
+    parser.add_argument("--empty-v", type=float, default=20.8)
+    parser.add_argument("--outage-after", type=float, default=None, help="seconds until a simulated outage")
+    parser.add_argument("--drain", type=float, default=0.01, help="volts lost per Q1 while on battery")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print every request")
+    args = parser.parse_args()
+    try:
+        return run(args)
+    except KeyboardInterrupt:
+        return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Stand in for an APC Modbus RTU UPS on a serial port, for testing the
+converter's Modbus sub-adapter without a real UPS.
+
+Connect a USB-TTL adapter to the converter's UPS UART and build the firmware
+with -D UPS_ACTIVE_SUB_ADAPTER=UPS_SUB_ADAPTER_MODBUS -D UPS_UART_BAUD=9600.
+The script answers function 03 (read holding registers) from a register
+image filled like a Smart-UPS, and prints one line per second with the
+transactions seen, so a refresh cycle can be checked to take two reads.
+
+  python modbussim.py COM5
+  python modbussim.py /dev/ttyUSB0 --outage-after 30
+
+--dump prints request/reply frames for a block read without a serial port.
+
+Requires pyserial (except for --dump).
+"""
+
+from __future__ import annotations
+
+import argparse
+import sys
+import time
+from collections import Counter
+
+try:
+    import serial
+except ImportError:
+    serial = None
+
+
+def crc16_modbus(data: bytes) -> int:
+    crc = 0xFFFF
+    for b in data:
+        crc ^= b
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def with_crc(frame: bytes) -> bytes:
+    crc = crc16_modbus(frame)
+    return frame + bytes([crc & 0xFF, crc >> 8])
+
+
+def put_string(regs: dict[int, int], start: int, count: int, text: str) -> None:
+    raw = text.encode("ascii")[: count * 2].ljust(count * 2, b" ")
+    for i in range(count):
+        regs[start + i] = (raw[2 * i] << 8) | raw[2 * i + 1]
+
+
+class SimUps:
+    def __init__(self, args: argparse.Namespace) -> None:
+        self.args = args
+        self.start = time.monotonic()
+        self.charge = 100.0
+
+    def on_battery(self) -> bool:
+        after = self.args.outage_after
+        return after is not None and (time.monotonic() - self.start) >= after
+
+    def registers(self) -> dict[int, int]:
+        outage = self.on_battery()
+        if outage:
+            self.charge = max(0.0, self.charge - 0.2)
+        regs: dict[int, int] = {}
+        status = (1 << 2) if outage else (1 << 1)
+        regs[0], regs[1] = status >> 16, status & 0xFFFF
+        regs[18] = (1 << 1) if self.charge < 5.0 else 0
+        runtime = int(self.charge * 30)
+        regs[128], regs[129] = runtime >> 16, runtime & 0xFFFF
+        regs[130] = int(self.charge * 512)
+        regs[131] = int((25.0 if outage else 27.3) * 32)
+        regs[135] = int(28.5 * 128)
+        regs[136] = int(self.args.load * 256)
+        regs[140] = int(2.1 * 32)
+        regs[142] = int(self.args.input_v * 64)
+        regs[144] = int(50.0 * 128)
+        regs[151] = 0 if outage else int(self.args.input_v * 64)
+        put_string(regs, 532, 16, "Smart-UPS 1500")
+        put_string(regs, 564, 8, "AS1234567890")
+        regs[588] = 1500
+        regs[589] = 1000
+        regs[595] = 8766  # 2024-01-01
+        return regs
+
+    def answer(self, frame: bytes) -> bytes | None:
+        if len(frame) != 8 or crc16_modbus(frame) != 0:
+            return None
+        if frame[0] != self.args.address or frame[1] != 0x03:
+            return None
+        start = (frame[2] << 8) | frame[3]
+        count = (frame[4] << 8) | frame[5]
+        if not 1 <= count <= 125:
+            return with_crc(bytes([frame[0], 0x83, 0x03]))
+        regs = self.registers()
+        data = b"".join(regs.get(start + i, 0).to_bytes(2, "big") for i in range(count))
+        return with_crc(bytes([frame[0], 0x03, 2 * count]) + data)
+
+
+def dump(args: argparse.Namespace) -> int:
+    ups = SimUps(args)
+    start, count = args.dump
+    request = with_crc(bytes([args.address, 0x03, start >> 8, start & 0xFF, count >> 8, count & 0xFF]))
+    print("request:", request.hex(" "))
+    print("reply:  ", (ups.answer(request) or b"").hex(" "))
+    return 0
+
+
+def run(args: argparse.Namespace) -> int:
+    if serial is None:
+        print("Error: pyserial is required (pip install pyserial).", file=sys.stderr)
+        return 2
+
+    ups = SimUps(args)
+    counts: Counter[str] = Counter()
+    next_report = time.monotonic() + 1.0
+    buf = b""
+
+    with serial.Serial(args.port, args.baud, timeout=0.005) as port:
+        while True:
+            chunk = port.read(64)
+            if chunk:
+                buf += chunk
+                continue
+            # Quiet line: whatever arrived is one frame.
+            if buf:
+                reply = ups.answer(buf)
+                key = f"{(buf[2] << 8) | buf[3]}+{(buf[4] << 8) | buf[5]}" if reply else "bad"
+                counts[key] += 1
+                if reply is not None:
+                    port.write(reply)
+                if args.verbose:
+                    print(f"<- {buf.hex(' ')} -> {reply.hex(' ') if reply else None}")
+                buf = b""
+
+            now = time.monotonic()
+            if now >= next_report:
+                summary = " ".join(f"{k}={v}" for k, v in sorted(counts.items())) or "idle"
+                state = "battery" if ups.on_battery() else "line"
+                print(f"{state} {ups.charge:.1f}%  {summary}")
+                counts.clear()
+                next_report = now + 1.0
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="APC Modbus RTU UPS stand-in")
+    parser.add_argument("port", nargs="?", help="serial port, e.g. COM5 or /dev/ttyUSB0")
+    parser.add_argument("--baud", type=int, default=9600)
+    parser.add_argument("--address", type=int, default=1)
+    parser.add_argument("--input-v", type=float, default=230.0)
+    parser.add_argument("--load", type=float, default=35.0, help="load in percent")
+    parser.add_argument("--outage-after", type=float, default=None, help="seconds until a simulated outage")
+    parser.add_argument("--dump", type=int, nargs=2, metavar=("START", "COUNT"),
+                        help="print the frames of one block read and exit")
+    parser.add_argument("-v", "--verbose", action="store_true", help="print every frame")
+    args = parser.parse_args()
+    if args.dump:
+        return dump(args)
+    if not args.port:
+        parser.error("port is required unless --dump is given")
+    try:
+        return run(args)
+    except KeyboardInterrupt:
+        return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
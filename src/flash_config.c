@@ -0,0 +1,196 @@
+#include "flash_config.h"
+
+#include "crc16.h"
+#include "main.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FLASH_LOG_MAGIC 0xC0F1U
+#define FLASH_LOG_BLANK 0xFFFFU
+
+// A slot is magic, length, the payload (padded to a halfword) and a CRC over
+// all but the padding, rounded up to a word. magic is the first halfword, so
+// a blank slot reads FLASH_LOG_BLANK there.
+typedef struct
+{
+    uint16_t magic;
+    uint16_t length;
+} flash_log_header_t;
+
+// Linker script symbols: .data is stored right after code and rodata.
+extern uint32_t _sidata;
+extern uint32_t _sdata;
+extern uint32_t _edata;
+
+static uint32_t flash_log_slot_size(uint16_t len)
+{
+    uint32_t const size = (uint32_t)sizeof(flash_log_header_t) + (((uint32_t)len + 1U) & ~1UL) + 2U;
+    return (size + 3U) & ~3UL;
+}
+
+static uint16_t flash_log_read_u16(uint32_t addr)
+{
+    return *(const volatile uint16_t *)(uintptr_t)addr;
+}
+
+static uint16_t flash_log_crc(const flash_log_header_t *header, const void *payload, uint16_t len)
+{
+    uint16_t const crc = crc16_modbus((const uint8_t *)header, sizeof(*header));
+    return crc16_modbus_update(crc, (const uint8_t *)payload, len);
+}
+
+static bool flash_log_slot_is_valid(uint32_t slot, uint16_t len)
+{
+    flash_log_header_t const *header = (flash_log_header_t const *)(uintptr_t)slot;
+    if ((header->magic != FLASH_LOG_MAGIC) || (header->length != len))
+    {
+        return false;
+    }
+
+    uint32_t const payload = slot + sizeof(flash_log_header_t);
+    uint32_t const crc_addr = payload + (((uint32_t)len + 1U) & ~1UL);
+    return (flash_log_read_u16(crc_addr) == flash_log_crc(header, (const void *)(uintptr_t)payload, len));
+}
+
+// Scans the append log. Returns the address of the newest valid slot (0 if
+// none) and the first blank slot address (0 when the page is full).
+static uint32_t flash_log_find(uint32_t page_addr, uint16_t len, uint32_t *out_next_free)
+{
+    uint32_t const slot_size = flash_log_slot_size(len);
+    uint32_t latest = 0U;
+    uint32_t slot = page_addr;
+
+    *out_next_free = 0U;
+    for (; (slot + slot_size) <= (page_addr + FLASH_CONFIG_PAGE_SIZE); slot += slot_size)
+    {
+        if (flash_log_read_u16(slot) == FLASH_LOG_BLANK)
+        {
+            *out_next_free = slot;
+            break;
+        }
+        if (flash_log_slot_is_valid(slot, len))
+        {
+            latest = slot;
+        }
+    }
+    return latest;
+}
+
+// The page must be past the end of the firmware image.
+static bool flash_log_page_is_free(uint32_t page_addr)
+{
+    uintptr_t const image_end = (uintptr_t)&_sidata + ((uintptr_t)&_edata - (uintptr_t)&_sdata);
+    return (image_end <= page_addr);
+}
+
+static bool flash_log_erase_page(uint32_t page_addr)
+{
+    FLASH_EraseInitTypeDef erase = {
+        .TypeErase = FLASH_TYPEERASE_PAGES,
+        .Banks = FLASH_BANK_1,
+        .PageAddress = page_addr,
+        .NbPages = 1U,
+    };
+    uint32_t page_error = 0U;
+    return (HAL_FLASHEx_Erase(&erase, &page_error) == HAL_OK);
+}
+
+// Programs len bytes as halfwords; an odd last byte is padded with 0xFF.
+static bool flash_log_program(uint32_t addr, const void *data, uint16_t len)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    for (uint32_t offset = 0U; offset < len; offset += 2U)
+    {
+        uint16_t half = 0xFFFFU;
+        memcpy(&half, &src[offset], ((offset + 1U) < len) ? 2U : 1U);
+        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, addr + offset, half) != HAL_OK)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool flash_log_load(uint32_t page_addr, void *out, uint16_t len)
+{
+    if ((out == NULL) || (len == 0U))
+    {
+        return false;
+    }
+
+    uint32_t next_free = 0U;
+    uint32_t const slot = flash_log_find(page_addr, len, &next_free);
+    if (slot == 0U)
+    {
+        return false;
+    }
+
+    memcpy(out, (const void *)(uintptr_t)(slot + sizeof(flash_log_header_t)), len);
+    return true;
+}
+
+bool flash_log_save(uint32_t page_addr, const void *data, uint16_t len)
+{
+    if ((data == NULL) || (len == 0U) || (flash_log_slot_size(len) > FLASH_CONFIG_PAGE_SIZE) ||
+        !flash_log_page_is_free(page_addr))
+    {
+        return false;
+    }
+
+    uint32_t next_free = 0U;
+    uint32_t const latest = flash_log_find(page_addr, len, &next_free);
+    if ((latest != 0U) && (memcmp((const void *)(uintptr_t)(latest + sizeof(flash_log_header_t)), data, len) == 0))
+    {
+        return true;
+    }
+
+    flash_log_header_t const header = { .magic = FLASH_LOG_MAGIC, .length = len };
+    uint16_t const crc = flash_log_crc(&header, data, len);
+
+    bool ok = (HAL_FLASH_Unlock() == HAL_OK);
+    if (ok && (next_free == 0U))
+    {
+        ok = flash_log_erase_page(page_addr);
+        next_free = page_addr;
+    }
+    if (ok)
+    {
+        uint32_t const payload = next_free + sizeof(header);
+        // Header first: a slot cut short by a reset is no longer blank and
+        // fails its CRC, so it is skipped rather than reused.
+        ok = flash_log_program(next_free, &header, sizeof(header)) &&
+             flash_log_program(payload, data, len) &&
+             flash_log_program(payload + (((uint32_t)len + 1U) & ~1UL), &crc, sizeof(crc));
+    }
+    (void)HAL_FLASH_Lock();
+    return ok;
+}
+
+static void flash_config_defaults(flash_config_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    memset(out->ups_sub_adapter, FLASH_CONFIG_SUB_ADAPTER_NONE, sizeof(out->ups_sub_adapter));
+}
+
+bool flash_config_load(flash_config_t *out)
+{
+    if (out == NULL)
+    {
+        return false;
+    }
+
+    if (!flash_log_load(FLASH_CONFIG_PAGE_ADDR, out, (uint16_t)sizeof(*out)))
+    {
+        flash_config_defaults(out);
+        return false;
+    }
+    return true;
+}
+
+bool flash_config_save(const flash_config_t *cfg)
+{
+    return flash_log_save(FLASH_CONFIG_PAGE_ADDR, cfg, (uint16_t)sizeof(*cfg));
+}
@@ -0,0 +1,147 @@
+#include "idle_sleep.h"
+
+#include "task_sched.h"
+
+#include "stm32f1xx_hal.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static idle_sleep_stats_t s_stats;
+static uint32_t s_second_start_ms = 0U;
+static uint32_t s_second_wakeups = 0U;
+
+static void idle_sleep_count_wakeup(uint32_t now_ms)
+{
+    s_stats.wakeups++;
+    s_second_wakeups++;
+
+    uint32_t const elapsed_ms = now_ms - s_second_start_ms;
+    if (elapsed_ms >= 1000U)
+    {
+        s_stats.wakeups_per_s = (uint32_t)(((uint64_t)s_second_wakeups * 1000U) / elapsed_ms);
+        s_second_wakeups = 0U;
+        s_second_start_ms = now_ms;
+    }
+}
+
+static void idle_sleep_wfi(void)
+{
+    __DSB();
+    __WFI();
+    __ISB();
+}
+
+#if (IDLE_SLEEP_TICKLESS_ENABLED != 0)
+// Called with interrupts masked. Stretches the current SysTick period to
+// end sleep_ms ticks from the last one, sleeps, then puts the SysTick back
+// on the 1 ms grid and adds the whole ms that passed to the HAL tick.
+// Returns those ms.
+static uint32_t idle_sleep_tickless(uint32_t sleep_ms)
+{
+    uint32_t const ticks_per_ms = SysTick->LOAD + 1U;
+    uint32_t const max_ms = SysTick_LOAD_RELOAD_Msk / ticks_per_ms;
+    if (sleep_ms > max_ms)
+    {
+        sleep_ms = max_ms;
+    }
+
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0U)
+    {
+        // A tick fell due meanwhile; let its handler run first.
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+        return 0U;
+    }
+
+    uint32_t const reload = SysTick->VAL + (ticks_per_ms * (sleep_ms - 1U));
+    SysTick->LOAD = reload;
+    SysTick->VAL = 0U;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+    idle_sleep_wfi();
+
+    // Reading CTRL clears COUNTFLAG, so read it once.
+    uint32_t const ctrl = SysTick->CTRL;
+    SysTick->CTRL = ctrl & ~SysTick_CTRL_ENABLE_Msk;
+
+    uint32_t complete_ms;
+    if ((ctrl & SysTick_CTRL_COUNTFLAG_Msk) != 0U)
+    {
+        // Slept to the deadline: the pending SysTick interrupt counts the
+        // last ms, the rest of the current one is what the counter has left.
+        uint32_t load = (ticks_per_ms - 1U) - (reload - SysTick->VAL);
+        if ((load <= 1U) || (load > (ticks_per_ms - 1U)))
+        {
+            load = ticks_per_ms - 1U;
+        }
+        SysTick->LOAD = load;
+        complete_ms = sleep_ms - 1U;
+    }
+    else
+    {
+        // Woken early by another interrupt.
+        uint32_t const counted = (sleep_ms * ticks_per_ms) - SysTick->VAL;
+        complete_ms = counted / ticks_per_ms;
+        SysTick->LOAD = ((complete_ms + 1U) * ticks_per_ms) - counted;
+    }
+
+    // Restart on the shortened period; the 1 ms reload applies from the
+    // next wrap.
+    SysTick->VAL = 0U;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    SysTick->LOAD = ticks_per_ms - 1U;
+
+    for (uint32_t i = 0U; i < complete_ms; i++)
+    {
+        HAL_IncTick();
+    }
+    return complete_ms;
+}
+#endif
+
+void idle_sleep(void)
+{
+    // Same as HAL_PWR_EnterSLEEPMode(): plain sleep, not stop mode.
+    SCB->SCR &= ~((uint32_t)SCB_SCR_SLEEPDEEP_Msk);
+
+    // Masked, an interrupt still ends WFI but its handler runs only after
+    // __enable_irq(), so an event raised after this check cannot be missed.
+    __disable_irq();
+    uint32_t const delay_ms = task_sched_next_delay_ms(HAL_GetTick());
+    if (delay_ms == 0U)
+    {
+        __enable_irq();
+        return;
+    }
+
+#if (IDLE_SLEEP_TICKLESS_ENABLED != 0)
+    if (delay_ms >= IDLE_SLEEP_TICKLESS_MIN_MS)
+    {
+        uint32_t const slept_ms = idle_sleep_tickless(delay_ms);
+        if (slept_ms > 0U)
+        {
+            s_stats.tickless_sleeps++;
+            s_stats.tickless_ms += slept_ms;
+        }
+    }
+    else
+    {
+        idle_sleep_wfi();
+    }
+#else
+    idle_sleep_wfi();
+#endif
+    __enable_irq();
+
+    idle_sleep_count_wakeup(HAL_GetTick());
+}
+
+void idle_sleep_get_stats(idle_sleep_stats_t *out)
+{
+    if (out != NULL)
+    {
+        *out = s_stats;
+    }
+}
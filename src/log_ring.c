@@ -0,0 +1,183 @@
+#include "log_ring.h"
+
+#include "task_sched.h"
+
+#include "stm32f1xx_hal.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+_Static_assert(LOG_RING_SIZE <= 0x8000U, "ring indices are 16-bit");
+_Static_assert(LOG_RING_MAX_ARGS < 64U, "count field is 6 bits");
+
+// One byte stays free so head == tail means empty.
+static uint8_t s_buf[LOG_RING_SIZE];
+static volatile uint16_t s_head = 0U;
+static volatile uint16_t s_tail = 0U;
+static uint16_t s_seq = 0U;
+static uint32_t s_pending_dropped = 0U;
+static log_ring_stats_t s_stats;
+
+static uint16_t log_ring_used(void)
+{
+    return (uint16_t)((s_head + LOG_RING_SIZE - s_tail) % LOG_RING_SIZE);
+}
+
+static void log_ring_put(const void *src, uint16_t len)
+{
+    const uint8_t *p = (const uint8_t *)src;
+    uint16_t head = s_head;
+    uint16_t const first = (uint16_t)(LOG_RING_SIZE - head);
+    if (len <= first)
+    {
+        memcpy(&s_buf[head], p, len);
+    }
+    else
+    {
+        memcpy(&s_buf[head], p, first);
+        memcpy(&s_buf[0], &p[first], (size_t)(len - first));
+    }
+    s_head = (uint16_t)((head + len) % LOG_RING_SIZE);
+}
+
+static void log_ring_put_record(log_ring_type_t type,
+                                uint8_t count,
+                                const char *fmt,
+                                const void *payload,
+                                uint16_t payload_len)
+{
+    uint32_t const tick = HAL_GetTick();
+    uint32_t const fmt_addr = (uint32_t)(uintptr_t)fmt;
+    uint8_t header[LOG_RING_HEADER_SIZE];
+
+    header[0] = LOG_RING_SYNC;
+    header[1] = (uint8_t)(((uint8_t)type << 6) | (count & 0x3FU));
+    header[2] = (uint8_t)(s_seq & 0xFFU);
+    header[3] = (uint8_t)(s_seq >> 8);
+    memcpy(&header[4], &tick, sizeof(tick));
+    memcpy(&header[8], &fmt_addr, sizeof(fmt_addr));
+
+    log_ring_put(header, LOG_RING_HEADER_SIZE);
+    if (payload_len > 0U)
+    {
+        log_ring_put(payload, payload_len);
+    }
+    s_seq++;
+    s_stats.records++;
+}
+
+static void log_ring_store(log_ring_type_t type,
+                           uint8_t count,
+                           const char *fmt,
+                           const void *payload,
+                           uint16_t payload_len)
+{
+    // Callers may be interrupt handlers; keep whatever mask they run with.
+    uint32_t const primask = __get_PRIMASK();
+    __disable_irq();
+
+    uint16_t const free_bytes = (uint16_t)(LOG_RING_SIZE - 1U - log_ring_used());
+    uint16_t need = (uint16_t)(LOG_RING_HEADER_SIZE + payload_len);
+    if (s_pending_dropped > 0U)
+    {
+        need = (uint16_t)(need + LOG_RING_HEADER_SIZE + sizeof(uint32_t));
+    }
+
+    if (need > free_bytes)
+    {
+        s_pending_dropped++;
+        s_stats.dropped++;
+        __set_PRIMASK(primask);
+        return;
+    }
+
+    if (s_pending_dropped > 0U)
+    {
+        log_ring_put_record(LOG_RING_TYPE_DROPPED, 1U, NULL, &s_pending_dropped, sizeof(uint32_t));
+        s_pending_dropped = 0U;
+    }
+    log_ring_put_record(type, count, fmt, payload, payload_len);
+
+    uint16_t const used = log_ring_used();
+    if (used > s_stats.high_water)
+    {
+        s_stats.high_water = used;
+    }
+    __set_PRIMASK(primask);
+
+    task_sched_notify(TASK_SCHED_EVENT_LOG);
+}
+
+void log_ring_write(const char *fmt, uint8_t nargs, const uint32_t *args)
+{
+    if ((fmt == NULL) || ((nargs > 0U) && (args == NULL)))
+    {
+        return;
+    }
+    if (nargs > LOG_RING_MAX_ARGS)
+    {
+        nargs = LOG_RING_MAX_ARGS;
+    }
+    log_ring_store(LOG_RING_TYPE_ARGS, nargs, fmt, args, (uint16_t)(nargs * sizeof(uint32_t)));
+}
+
+void log_ring_write_bytes(const char *prefix, const uint8_t *data, uint16_t len)
+{
+    if ((data == NULL) && (len > 0U))
+    {
+        return;
+    }
+    if (len > LOG_RING_MAX_BYTES)
+    {
+        len = LOG_RING_MAX_BYTES;
+    }
+    log_ring_store(LOG_RING_TYPE_BYTES, (uint8_t)len, prefix, data, len);
+}
+
+void log_ring_write_text(const char *text, uint16_t len)
+{
+    // Longer text goes out as several records.
+    while (len > 0U)
+    {
+        uint16_t const n = (len > LOG_RING_MAX_BYTES) ? LOG_RING_MAX_BYTES : len;
+        log_ring_store(LOG_RING_TYPE_TEXT, (uint8_t)n, NULL, text, n);
+        text += n;
+        len = (uint16_t)(len - n);
+    }
+}
+
+uint16_t log_ring_peek(const uint8_t **out_data)
+{
+    uint16_t const head = s_head;
+    uint16_t const tail = s_tail;
+    if (out_data != NULL)
+    {
+        *out_data = &s_buf[tail];
+    }
+    if (head >= tail)
+    {
+        return (uint16_t)(head - tail);
+    }
+    return (uint16_t)(LOG_RING_SIZE - tail);
+}
+
+void log_ring_consume(uint16_t len)
+{
+    uint16_t const used = log_ring_used();
+    if (len > used)
+    {
+        len = used;
+    }
+    s_tail = (uint16_t)((s_tail + len) % LOG_RING_SIZE);
+    s_stats.bytes_out += len;
+}
+
+void log_ring_get_stats(log_ring_stats_t *out)
+{
+    if (out != NULL)
+    {
+        *out = s_stats;
+    }
+}
@@ -22,8 +22,20 @@
 #include "usb_descriptors.h"
 #include "ups_hid_reports.h"
 #include "ups_hid_device.h"
+#include "usb_cdc_passthrough.h"
+#include "usb_cdc_telemetry.h"
 #include "uart_engine.h"
+#include "flash_config.h"
+#include "idle_sleep.h"
+#include "log_ring.h"
+#include "megatec.h"
+#include "modbus.h"
+#include "power_mode.h"
 #include "spm2k.h"
+#include "task_sched.h"
+#include "ups_cache.h"
+#include "ups_diag.h"
+#include "ups_tuning.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include <stdbool.h>
@@ -50,6 +62,9 @@
 /* Private variables ---------------------------------------------------------*/
 UART_HandleTypeDef huart1;
 UART_HandleTypeDef huart2;
+#if (UPS_PORT_COUNT > 1U)
+UART_HandleTypeDef huart3;
+#endif
 IWDG_HandleTypeDef hiwdg;
 
 PCD_HandleTypeDef hpcd_USB_FS;
@@ -62,6 +77,9 @@ void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 static void MX_USART1_UART_Init(void);
 static void MX_USART2_UART_Init(void);
+#if (UPS_PORT_COUNT > 1U)
+static void MX_USART3_UART_Init(void);
+#endif
 static void MX_USB_PCD_Init(void);
 static void MX_IWDG_Init(void);
 /* USER CODE BEGIN PFP */
@@ -87,13 +105,8 @@ static bool s_usb_started = false;
 #define USB_HOLD_DP_LOW_UNTIL_USB_START 1
 #endif
 
-#ifndef UPS_DYNAMIC_UPDATE_PERIOD_S
-#define UPS_DYNAMIC_UPDATE_PERIOD_S 10U
-#endif
-
-#ifndef UPS_INIT_RETRY_PERIOD_S
-#define UPS_INIT_RETRY_PERIOD_S 5U
-#endif
+// UPS_UART_BAUD, UPS_DYNAMIC_UPDATE_PERIOD_S, UPS_INIT_RETRY_PERIOD_S and
+// UPS_IWDG_TIMEOUT_MS are defaults of the runtime tuning (ups_tuning.h).
 
 #ifndef UPS_DEBUG_STATUS_PRINT_ENABLED
 #define UPS_DEBUG_STATUS_PRINT_ENABLED 0
@@ -107,6 +120,17 @@ static bool s_usb_started = false;
 #define UPS_LED_BUSY_BLINK_PERIOD_MS 80U
 #endif
 
+// Delay before a failed bootstrap step is read again, and how many tries a
+// step gets. Constants and telemetry are accepted partially after that; the
+// minimum step falls back to the heartbeat.
+#ifndef UPS_BOOTSTRAP_STEP_RETRY_MS
+#define UPS_BOOTSTRAP_STEP_RETRY_MS 500U
+#endif
+
+#ifndef UPS_BOOTSTRAP_STEP_TRIES
+#define UPS_BOOTSTRAP_STEP_TRIES 3U
+#endif
+
 #ifndef UPS_BOOTSTRAP_HEARTBEAT_RX_BUF_SIZE
 #define UPS_BOOTSTRAP_HEARTBEAT_RX_BUF_SIZE 16U
 #endif
@@ -115,19 +139,59 @@ static bool s_usb_started = false;
 #define UPS_IWDG_ENABLED 1
 #endif
 
-#ifndef UPS_IWDG_TIMEOUT_MS
-#define UPS_IWDG_TIMEOUT_MS 8000U
+// Enumerate right after reset with the constant data cached in flash
+// (ups_cache.h) instead of waiting for the first bootstrap.
+#ifndef UPS_CACHE_ENABLED
+#define UPS_CACHE_ENABLED 1
+#endif
+
+// D+ low time when the cached identity turned out wrong and USB re-enumerates.
+#ifndef UPS_USB_REENUMERATE_GAP_MS
+#define UPS_USB_REENUMERATE_GAP_MS 200U
 #endif
 
 #ifndef UPS_IDLE_SLEEP_ENABLED
 #define UPS_IDLE_SLEEP_ENABLED 1
 #endif
 
-#define UPS_DYNAMIC_UPDATE_PERIOD_MS ((uint32_t)(UPS_DYNAMIC_UPDATE_PERIOD_S) * 1000U)
-#define UPS_INIT_RETRY_PERIOD_MS ((uint32_t)(UPS_INIT_RETRY_PERIOD_S) * 1000U)
+// Main loop deadlines (task_sched.h). The USB and engine tasks also run on
+// their interrupts; these periods are the fallback poll. USB uses the short
+// one only while CDC telemetry streams (its RATE goes down to 10 ms), the
+// long one bounds how late a changed HID report goes out.
+#ifndef UPS_SCHED_USB_PERIOD_MS
+#define UPS_SCHED_USB_PERIOD_MS 10U
+#endif
+
+#ifndef UPS_SCHED_USB_IDLE_PERIOD_MS
+#define UPS_SCHED_USB_IDLE_PERIOD_MS 100U
+#endif
+
+// While the bus is suspended nothing is read; the alert check after each
+// refresh runs on the engine task's wake-up.
+#ifndef UPS_SCHED_USB_SUSPEND_PERIOD_MS
+#define UPS_SCHED_USB_SUSPEND_PERIOD_MS 1000U
+#endif
+
+// Engine task period while a transaction or bootstrap step is in flight
+// (reply timeouts and the inter-job gap are timed in ms).
+#ifndef UPS_SCHED_ENGINE_BUSY_POLL_MS
+#define UPS_SCHED_ENGINE_BUSY_POLL_MS 1U
+#endif
+
+// Default: a quarter of the IWDG timeout set at boot.
+#ifndef UPS_SCHED_WATCHDOG_PERIOD_MS
+#define UPS_SCHED_WATCHDOG_PERIOD_MS (s_iwdg_timeout_ms / 4U)
+#endif
+
+// Read on each use, so a host write of the tuning applies at once. The
+// refresh period is stretched while the host sleeps (power_mode.h).
+#define UPS_DYNAMIC_UPDATE_PERIOD_MS power_mode_poll_period_ms((uint32_t)ups_tuning_get()->dynamic_update_period_s * 1000U)
+#define UPS_INIT_RETRY_PERIOD_MS ((uint32_t)ups_tuning_get()->init_retry_period_s * 1000U)
 
+// Debug output goes through the log ring (log_ring.h): a call stores its
+// arguments and returns, USART1 DMA sends the records in the background.
 #if (UPS_DEBUG_STATUS_PRINT_ENABLED != 0)
-#define UPS_DEBUG_PRINTF(...) printf(__VA_ARGS__)
+#define UPS_DEBUG_PRINTF(...) LOG_RING_PRINTF(__VA_ARGS__)
 const bool g_ups_debug_status_print_enabled = true;
 #else
 #define UPS_DEBUG_PRINTF(...)
@@ -194,6 +258,9 @@ static void iwdg_compute_config(uint32_t timeout_ms,
     *out_reload = chosen_reload;
 }
 
+// IWDG timeout in use; the tuned one is read once, at boot.
+static uint32_t s_iwdg_timeout_ms = UPS_IWDG_TIMEOUT_MS;
+
 static void watchdog_refresh(void)
 {
 #if (UPS_IWDG_ENABLED != 0)
@@ -204,7 +271,7 @@ static void watchdog_refresh(void)
 static void ups_idle_sleep(void)
 {
 #if (UPS_IDLE_SLEEP_ENABLED != 0)
-    HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+    idle_sleep();
 #endif
 }
 
@@ -216,16 +283,7 @@ void UPS_DebugPrintTxCommand(const uint8_t *data, uint16_t len)
         return;
     }
 
-    printf("UART_TX cmd len=%u data=", (unsigned int)len);
-    for (uint16_t i = 0U; i < len; i++)
-    {
-        printf("%02X", data[i]);
-        if ((uint16_t)(i + 1U) < len)
-        {
-            printf(" ");
-        }
-    }
-    printf("\r\n");
+    log_ring_write_bytes("UART_TX cmd data=", data, len);
 #else
     (void)data;
     (void)len;
@@ -289,134 +347,405 @@ static void usb_start_if_enabled(void)
     s_usb_started = true;
 }
 
+static bool s_usb_reconnect_pending = false;
+static uint32_t s_usb_reconnect_ms = 0U;
+
+// Drops off the bus so the host reads the descriptors again.
+static void usb_reenumerate(void)
+{
+    if (!s_usb_started)
+    {
+        return;
+    }
+
+    (void)tud_disconnect();
+    s_usb_reconnect_pending = true;
+    s_usb_reconnect_ms = HAL_GetTick() + UPS_USB_REENUMERATE_GAP_MS;
+}
+
+static void usb_reconnect_task(void)
+{
+    if (s_usb_reconnect_pending && ((int32_t)(HAL_GetTick() - s_usb_reconnect_ms) >= 0))
+    {
+        s_usb_reconnect_pending = false;
+        (void)tud_connect();
+    }
+}
+
 typedef enum
 {
     UPS_SUB_ADAPTER_SPM2K = 0,
+    UPS_SUB_ADAPTER_MEGATEC,
+    UPS_SUB_ADAPTER_MODBUS,
 } ups_sub_adapter_t;
 
 #ifndef UPS_ACTIVE_SUB_ADAPTER
 #define UPS_ACTIVE_SUB_ADAPTER UPS_SUB_ADAPTER_SPM2K
 #endif
 
+// Probe the protocols in k_ups_probe_candidates when the UPS does not answer
+// the cached (or UPS_ACTIVE_SUB_ADAPTER) protocol, and remember the winner in
+// flash. With 0, every port always uses UPS_ACTIVE_SUB_ADAPTER at the tuned
+// rate (UPS_UART_BAUD by default).
+#ifndef UPS_AUTODETECT_ENABLED
+#define UPS_AUTODETECT_ENABLED 1
+#endif
+
+// Heartbeat timeout while probing. Long enough for a Megatec Q1 line at 2400.
+#ifndef UPS_AUTODETECT_PROBE_TIMEOUT_MS
+#define UPS_AUTODETECT_PROBE_TIMEOUT_MS 400U
+#endif
+
 typedef enum
 {
     UPS_BOOTSTRAP_ENQUEUE_HEARTBEAT = 0,
     UPS_BOOTSTRAP_WAIT_HEARTBEAT_DRAIN,
     UPS_BOOTSTRAP_HEARTBEAT_VERIFY,
     UPS_BOOTSTRAP_WAIT_RETRY,
-    UPS_BOOTSTRAP_ENQUEUE_CONSTANT,
-    UPS_BOOTSTRAP_ENQUEUE_DYNAMIC,
-    UPS_BOOTSTRAP_WAIT_DRAIN,
-    UPS_BOOTSTRAP_SANITY_CHECK,
+    UPS_BOOTSTRAP_STEP_ENQUEUE,
+    UPS_BOOTSTRAP_STEP_WAIT_DRAIN,
+    UPS_BOOTSTRAP_STEP_VERIFY,
+    UPS_BOOTSTRAP_STEP_WAIT_RETRY,
     UPS_BOOTSTRAP_DONE,
 } ups_bootstrap_state_t;
 
-static const uart_engine_request_t *g_sub_adapter_constant_lut = NULL;
-static size_t g_sub_adapter_constant_lut_count = 0U;
-static const uart_engine_request_t *g_sub_adapter_dynamic_lut = NULL;
-static size_t g_sub_adapter_dynamic_lut_count = 0U;
-static const uart_engine_request_t *g_sub_adapter_constant_heartbeat = NULL;
-static const uint8_t *g_sub_adapter_constant_heartbeat_expect_return = NULL;
-static size_t g_sub_adapter_constant_heartbeat_expect_return_len = 0U;
+// After the heartbeat, bootstrap reads one LUT per readiness level. A step
+// that fails is retried on its own; the heartbeat is only redone when the
+// minimum step keeps failing.
+typedef enum
+{
+    UPS_BOOTSTRAP_STEP_MINIMUM = 0, // -> UPS_READINESS_MINIMUM
+    UPS_BOOTSTRAP_STEP_CONSTANTS,   // -> UPS_READINESS_CONSTANTS
+    UPS_BOOTSTRAP_STEP_TELEMETRY,   // -> UPS_READINESS_FULL
+    UPS_BOOTSTRAP_STEP_COUNT,
+} ups_bootstrap_step_t;
 
-static ups_bootstrap_state_t s_ups_bootstrap_state = UPS_BOOTSTRAP_ENQUEUE_HEARTBEAT;
-static size_t s_bootstrap_constant_idx = 0U;
-static size_t s_bootstrap_dynamic_idx = 0U;
-static uint32_t s_init_retry_not_before_ms = 0U;
-static uint32_t s_init_bootstrap_start_ms = 0U;
-static bool s_init_bootstrap_started = false;
-static uint32_t s_last_dynamic_cycle_start_ms = 0U;
+// LUTs and hooks of one sub-adapter (protocol module).
+typedef struct
+{
+    const char *name;
+    const uart_engine_request_t *constant_lut;
+    size_t constant_lut_count;
+    const uart_engine_request_t *dynamic_lut;
+    size_t dynamic_lut_count;
+    const uart_engine_request_t *minimum_lut;
+    size_t minimum_lut_count;
+    const uart_engine_request_t *constant_heartbeat;
+    const uint8_t *constant_heartbeat_expect_return;
+    size_t constant_heartbeat_expect_return_len;
+    bool (*setting_write_start)(uint8_t port, ups_setting_t setting);
+    bool (*setting_write_step)(uint8_t port);
+} ups_sub_adapter_desc_t;
 
-static uint8_t s_bootstrap_heartbeat_rx[UPS_BOOTSTRAP_HEARTBEAT_RX_BUF_SIZE];
-static uint16_t s_bootstrap_heartbeat_rx_len = 0U;
-static bool s_bootstrap_heartbeat_done = false;
+typedef struct
+{
+    ups_sub_adapter_t sub_adapter;
+    uint32_t baud;
+} ups_probe_candidate_t;
+
+// Tried in order until one heartbeat matches. SPM2K goes first: its
+// single-byte Y is harmless to the others, and Q1 is a status query on APC
+// units. Within a protocol the faster rate goes first, as a UPS set to it
+// polls several times faster.
+static const ups_probe_candidate_t k_ups_probe_candidates[] = {
+    { UPS_SUB_ADAPTER_SPM2K, 2400U },
+    { UPS_SUB_ADAPTER_MEGATEC, 9600U },
+    { UPS_SUB_ADAPTER_MEGATEC, 2400U },
+    { UPS_SUB_ADAPTER_MODBUS, 19200U },
+    { UPS_SUB_ADAPTER_MODBUS, 9600U },
+};
 
-static bool s_dynamic_update_cycle_active = false;
-static size_t s_dynamic_update_idx = 0U;
-static uint32_t s_next_dynamic_update_ms = 0U;
+#define UPS_PROBE_CANDIDATE_COUNT (sizeof(k_ups_probe_candidates) / sizeof(k_ups_probe_candidates[0]))
 
-static void ups_sub_adapter_select(void)
+// Bootstrap, refresh and setting-write progress of one UPS port. The tasks
+// below run once per port per main loop pass.
+typedef struct
 {
-    switch ((ups_sub_adapter_t)UPS_ACTIVE_SUB_ADAPTER)
+    uint8_t port; // index into g_ups[] and the engines
+    ups_sub_adapter_desc_t adapter;
+    ups_sub_adapter_t sub_adapter;
+    uint32_t baud;
+    bool probing;
+    uint8_t probe_idx;
+    bool probe_other_protocols;         // past the auto-baud pass
+    ups_sub_adapter_t probe_sub_adapter; // protocol and rate that failed first
+    uint32_t probe_baud;
+
+    ups_bootstrap_state_t bootstrap_state;
+    ups_bootstrap_step_t bootstrap_step;
+    size_t bootstrap_step_idx;
+    uint8_t bootstrap_step_tries;
+    uint32_t bootstrap_step_failed_before;
+    ups_readiness_t readiness;
+    uint32_t readiness_ms[UPS_READINESS_COUNT];
+    uint32_t init_retry_not_before_ms;
+    uint32_t init_bootstrap_start_ms;
+    bool init_bootstrap_started;
+    uint32_t last_dynamic_cycle_start_ms;
+
+    uint8_t bootstrap_heartbeat_rx[UPS_BOOTSTRAP_HEARTBEAT_RX_BUF_SIZE];
+    uint16_t bootstrap_heartbeat_rx_len;
+    bool bootstrap_heartbeat_done;
+
+    bool dynamic_update_cycle_active;
+    const uart_engine_request_t *dynamic_update_lut; // chosen at the start of a refresh
+    size_t dynamic_update_lut_count;
+    size_t dynamic_update_idx;
+    uint32_t last_dynamic_update_ms; // end of the last refresh; the next is due a period later
+
+    uint32_t pending_settings;
+    bool setting_write_active;
+
+    bool restart_pending;  // a host rate change, applied once the port is quiet
+    uint32_t restart_baud; // 0 = auto-baud probe
+} ups_port_ctx_t;
+
+static ups_port_ctx_t s_port_ctx[UPS_PORT_COUNT];
+
+static void ups_sub_adapter_get(ups_sub_adapter_t sub_adapter, ups_sub_adapter_desc_t *out)
+{
+    switch (sub_adapter)
     {
     case UPS_SUB_ADAPTER_SPM2K:
-        g_sub_adapter_constant_lut = g_spm2k_constant_lut;
-        g_sub_adapter_constant_lut_count = g_spm2k_constant_lut_count;
-        g_sub_adapter_dynamic_lut = g_spm2k_dynamic_lut;
-        g_sub_adapter_dynamic_lut_count = g_spm2k_dynamic_lut_count;
-        g_sub_adapter_constant_heartbeat = &g_spm2k_constant_heartbeat;
-        g_sub_adapter_constant_heartbeat_expect_return = g_spm2k_constant_heartbeat_expect_return;
-        g_sub_adapter_constant_heartbeat_expect_return_len = g_spm2k_constant_heartbeat_expect_return_len;
+        out->name = "spm2k";
+        out->constant_lut = g_spm2k_constant_lut;
+        out->constant_lut_count = g_spm2k_constant_lut_count;
+        out->dynamic_lut = g_spm2k_dynamic_lut;
+        out->dynamic_lut_count = g_spm2k_dynamic_lut_count;
+        out->minimum_lut = g_spm2k_minimum_lut;
+        out->minimum_lut_count = g_spm2k_minimum_lut_count;
+        out->constant_heartbeat = &g_spm2k_constant_heartbeat;
+        out->constant_heartbeat_expect_return = g_spm2k_constant_heartbeat_expect_return;
+        out->constant_heartbeat_expect_return_len = g_spm2k_constant_heartbeat_expect_return_len;
+        out->setting_write_start = spm2k_setting_write_start;
+        out->setting_write_step = spm2k_setting_write_step;
+        break;
+    case UPS_SUB_ADAPTER_MEGATEC:
+        out->name = "megatec";
+        out->constant_lut = g_megatec_constant_lut;
+        out->constant_lut_count = g_megatec_constant_lut_count;
+        out->dynamic_lut = g_megatec_dynamic_lut;
+        out->dynamic_lut_count = g_megatec_dynamic_lut_count;
+        out->minimum_lut = g_megatec_minimum_lut;
+        out->minimum_lut_count = g_megatec_minimum_lut_count;
+        out->constant_heartbeat = &g_megatec_constant_heartbeat;
+        out->constant_heartbeat_expect_return = g_megatec_constant_heartbeat_expect_return;
+        out->constant_heartbeat_expect_return_len = g_megatec_constant_heartbeat_expect_return_len;
+        // The protocol has no way to change settings.
+        out->setting_write_start = NULL;
+        out->setting_write_step = NULL;
+        break;
+    case UPS_SUB_ADAPTER_MODBUS:
+        out->name = "modbus";
+        out->constant_lut = g_modbus_constant_lut;
+        out->constant_lut_count = g_modbus_constant_lut_count;
+        out->dynamic_lut = g_modbus_dynamic_lut;
+        out->dynamic_lut_count = g_modbus_dynamic_lut_count;
+        // Two block reads already carry everything.
+        out->minimum_lut = g_modbus_dynamic_lut;
+        out->minimum_lut_count = g_modbus_dynamic_lut_count;
+        out->constant_heartbeat = &g_modbus_constant_heartbeat;
+        out->constant_heartbeat_expect_return = g_modbus_constant_heartbeat_expect_return;
+        out->constant_heartbeat_expect_return_len = g_modbus_constant_heartbeat_expect_return_len;
+        // Settings are not written over Modbus yet.
+        out->setting_write_start = NULL;
+        out->setting_write_step = NULL;
         break;
     default:
-        g_sub_adapter_constant_lut = NULL;
-        g_sub_adapter_constant_lut_count = 0U;
-        g_sub_adapter_dynamic_lut = NULL;
-        g_sub_adapter_dynamic_lut_count = 0U;
-        g_sub_adapter_constant_heartbeat = NULL;
-        g_sub_adapter_constant_heartbeat_expect_return = NULL;
-        g_sub_adapter_constant_heartbeat_expect_return_len = 0U;
+        out->name = "none";
+        out->constant_lut = NULL;
+        out->constant_lut_count = 0U;
+        out->dynamic_lut = NULL;
+        out->dynamic_lut_count = 0U;
+        out->minimum_lut = NULL;
+        out->minimum_lut_count = 0U;
+        out->constant_heartbeat = NULL;
+        out->constant_heartbeat_expect_return = NULL;
+        out->constant_heartbeat_expect_return_len = 0U;
+        out->setting_write_start = NULL;
+        out->setting_write_step = NULL;
         break;
     }
 }
 
-static bool ups_bootstrap_heartbeat_capture(uint16_t cmd,
+// Switches the port to a protocol. The UART rate follows in
+// UPS_BOOTSTRAP_ENQUEUE_HEARTBEAT, once the line is free.
+static void ups_port_use_protocol(ups_port_ctx_t *ctx, ups_sub_adapter_t sub_adapter, uint32_t baud)
+{
+    ctx->sub_adapter = sub_adapter;
+    ctx->baud = baud;
+    ups_sub_adapter_get(sub_adapter, &ctx->adapter);
+}
+
+// Protocol that bootstrapped last time, per port.
+static flash_config_t s_flash_config;
+
+// First protocol tried after power-on: the cached one, else the build default.
+static void ups_autodetect_init(void)
+{
+    bool const cached = flash_config_load(&s_flash_config);
+
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        ups_port_ctx_t *ctx = &s_port_ctx[port];
+        uint8_t const stored = s_flash_config.ups_sub_adapter[port];
+
+        if ((UPS_AUTODETECT_ENABLED != 0) && cached &&
+            (stored != FLASH_CONFIG_SUB_ADAPTER_NONE) && (s_flash_config.ups_baud[port] != 0U))
+        {
+            ups_port_use_protocol(ctx, (ups_sub_adapter_t)stored, s_flash_config.ups_baud[port]);
+        }
+        else
+        {
+            ups_port_use_protocol(ctx, (ups_sub_adapter_t)UPS_ACTIVE_SUB_ADAPTER, ups_tuning_get()->ups_baud);
+        }
+    }
+}
+
+// Candidates of the auto-baud pass are the failed protocol at its other
+// rates; the second pass takes every other protocol.
+static bool ups_probe_candidate_in_pass(const ups_port_ctx_t *ctx, const ups_probe_candidate_t *c)
+{
+    bool const same_protocol = (c->sub_adapter == ctx->probe_sub_adapter);
+    if (!ctx->probe_other_protocols)
+    {
+        return same_protocol && (c->baud != ctx->probe_baud);
+    }
+    return !same_protocol;
+}
+
+// After a heartbeat mismatch: moves to the next probe candidate and returns
+// true, or returns false once every candidate has failed this round. The
+// protocol that failed is first tried at its other rates (auto-baud: the
+// UPS's rate setting changed), then the other protocols are.
+static bool ups_autodetect_next(ups_port_ctx_t *ctx)
+{
+    if (UPS_AUTODETECT_ENABLED == 0)
+    {
+        return false;
+    }
+
+    size_t idx = 0U;
+    if (!ctx->probing)
+    {
+        ctx->probing = true;
+        ctx->probe_other_protocols = false;
+        ctx->probe_sub_adapter = ctx->sub_adapter;
+        ctx->probe_baud = ctx->baud;
+    }
+    else
+    {
+        idx = (size_t)ctx->probe_idx + 1U;
+    }
+
+    for (;;)
+    {
+        for (; idx < UPS_PROBE_CANDIDATE_COUNT; idx++)
+        {
+            if (ups_probe_candidate_in_pass(ctx, &k_ups_probe_candidates[idx]))
+            {
+                ctx->probe_idx = (uint8_t)idx;
+                ups_port_use_protocol(ctx, k_ups_probe_candidates[idx].sub_adapter, k_ups_probe_candidates[idx].baud);
+                return true;
+            }
+        }
+        if (ctx->probe_other_protocols)
+        {
+            break;
+        }
+        ctx->probe_other_protocols = true;
+        idx = 0U;
+    }
+
+    // Start over from the protocol and rate that failed first, after the
+    // retry period.
+    ctx->probing = false;
+    ups_port_use_protocol(ctx, ctx->probe_sub_adapter, ctx->probe_baud);
+    return false;
+}
+
+// Stores the port's working protocol; a no-op when flash already has it.
+static void ups_autodetect_remember(const ups_port_ctx_t *ctx)
+{
+    if (UPS_AUTODETECT_ENABLED == 0)
+    {
+        return;
+    }
+
+    uint8_t const port = ctx->port;
+    s_flash_config.ups_sub_adapter[port] = (uint8_t)ctx->sub_adapter;
+    s_flash_config.ups_baud[port] = ctx->baud;
+    if (!flash_config_save(&s_flash_config))
+    {
+        UPS_DEBUG_PRINTF("INIT ups%u protocol not saved to flash\r\n", (unsigned)port);
+    }
+}
+
+static bool ups_bootstrap_heartbeat_capture(uint8_t port,
+                                            uint16_t cmd,
                                             const uint8_t *rx,
                                             uint16_t rx_len,
                                             void *out_value)
 {
+    (void)port;
     (void)cmd;
-    (void)out_value;
 
-    s_bootstrap_heartbeat_done = false;
-    s_bootstrap_heartbeat_rx_len = 0U;
+    ups_port_ctx_t *ctx = (ups_port_ctx_t *)out_value;
+
+    ctx->bootstrap_heartbeat_done = false;
+    ctx->bootstrap_heartbeat_rx_len = 0U;
 
     if (rx == NULL)
     {
         return false;
     }
 
-    if (rx_len > (uint16_t)sizeof(s_bootstrap_heartbeat_rx))
+    // Only the start of the reply is compared; longer replies are cut.
+    if (rx_len > (uint16_t)sizeof(ctx->bootstrap_heartbeat_rx))
     {
-        return false;
+        rx_len = (uint16_t)sizeof(ctx->bootstrap_heartbeat_rx);
     }
 
-    memcpy(s_bootstrap_heartbeat_rx, rx, rx_len);
-    s_bootstrap_heartbeat_rx_len = rx_len;
-    s_bootstrap_heartbeat_done = true;
+    memcpy(ctx->bootstrap_heartbeat_rx, rx, rx_len);
+    ctx->bootstrap_heartbeat_rx_len = rx_len;
+    ctx->bootstrap_heartbeat_done = true;
     return true;
 }
 
-static bool ups_bootstrap_heartbeat_matches_expected(void)
+static bool ups_bootstrap_heartbeat_matches_expected(const ups_port_ctx_t *ctx)
 {
-    if (!s_bootstrap_heartbeat_done ||
-        (g_sub_adapter_constant_heartbeat_expect_return == NULL) ||
-        (g_sub_adapter_constant_heartbeat_expect_return_len == 0U))
+    if (!ctx->bootstrap_heartbeat_done ||
+        (ctx->adapter.constant_heartbeat_expect_return == NULL) ||
+        (ctx->adapter.constant_heartbeat_expect_return_len == 0U))
     {
         return false;
     }
 
-    if (s_bootstrap_heartbeat_rx_len != g_sub_adapter_constant_heartbeat_expect_return_len)
+    // The reply must start with the expected bytes. SPM2K's heartbeat is a
+    // fixed-length request, so for it this is an exact match.
+    if (ctx->bootstrap_heartbeat_rx_len < ctx->adapter.constant_heartbeat_expect_return_len)
     {
         return false;
     }
 
-    return (memcmp(s_bootstrap_heartbeat_rx,
-                   g_sub_adapter_constant_heartbeat_expect_return,
-                   s_bootstrap_heartbeat_rx_len) == 0);
+    return (memcmp(ctx->bootstrap_heartbeat_rx,
+                   ctx->adapter.constant_heartbeat_expect_return,
+                   ctx->adapter.constant_heartbeat_expect_return_len) == 0);
 }
 
-static void ups_bootstrap_reset_for_retry(uint32_t now_ms)
+static void ups_bootstrap_reset_for_retry(ups_port_ctx_t *ctx, uint32_t now_ms)
 {
-    s_bootstrap_constant_idx = 0U;
-    s_bootstrap_dynamic_idx = 0U;
-    s_bootstrap_heartbeat_rx_len = 0U;
-    s_bootstrap_heartbeat_done = false;
-    s_init_retry_not_before_ms = now_ms + UPS_INIT_RETRY_PERIOD_MS;
-    s_ups_bootstrap_state = UPS_BOOTSTRAP_WAIT_RETRY;
+    ctx->bootstrap_step = UPS_BOOTSTRAP_STEP_MINIMUM;
+    ctx->bootstrap_step_idx = 0U;
+    ctx->bootstrap_step_tries = 0U;
+    ctx->bootstrap_heartbeat_rx_len = 0U;
+    ctx->bootstrap_heartbeat_done = false;
+    ctx->init_retry_not_before_ms = now_ms + UPS_INIT_RETRY_PERIOD_MS;
+    ctx->bootstrap_state = UPS_BOOTSTRAP_WAIT_RETRY;
 }
 
-static void ups_enqueue_full_lut_step(const uart_engine_request_t *lut,
+static void ups_enqueue_full_lut_step(uint8_t port,
+                                      const uart_engine_request_t *lut,
                                       size_t lut_count,
                                       size_t *inout_index)
 {
@@ -430,114 +759,256 @@ static void ups_enqueue_full_lut_step(const uart_engine_request_t *lut,
         return;
     }
 
-    uart_engine_result_t const result = uart_engine_enqueue(&lut[*inout_index]);
+    uart_engine_result_t const result = uart_engine_enqueue(port, &lut[*inout_index]);
     if (result == UART_ENGINE_OK)
     {
         (*inout_index)++;
     }
 }
 
-static void ups_bootstrap_task(void)
+static uint32_t ups_engine_failed_count(uint8_t port)
 {
+    uart_engine_stats_t stats;
+    uart_engine_get_stats(port, &stats);
+    return stats.failed;
+}
+
+static const uart_engine_request_t *ups_bootstrap_step_lut(const ups_port_ctx_t *ctx, size_t *out_count)
+{
+    switch (ctx->bootstrap_step)
+    {
+    case UPS_BOOTSTRAP_STEP_MINIMUM:
+        *out_count = ctx->adapter.minimum_lut_count;
+        return ctx->adapter.minimum_lut;
+    case UPS_BOOTSTRAP_STEP_CONSTANTS:
+        *out_count = ctx->adapter.constant_lut_count;
+        return ctx->adapter.constant_lut;
+    case UPS_BOOTSTRAP_STEP_TELEMETRY:
+        *out_count = ctx->adapter.dynamic_lut_count;
+        return ctx->adapter.dynamic_lut;
+    default:
+        *out_count = 0U;
+        return NULL;
+    }
+}
+
+// Records when the port first got to a level (ms since reset).
+static void ups_readiness_reach(ups_port_ctx_t *ctx, ups_readiness_t level, uint32_t now_ms)
+{
+    if (level > ctx->readiness)
+    {
+        ctx->readiness = level;
+    }
+    if (ctx->readiness_ms[level] == 0U)
+    {
+        ctx->readiness_ms[level] = (now_ms == 0U) ? 1U : now_ms;
+        UPS_DEBUG_PRINTF("INIT ups%u readiness %u after %lu ms\r\n",
+                         (unsigned)ctx->port,
+                         (unsigned)level,
+                         (unsigned long)now_ms);
+    }
+}
+
+static void ups_bootstrap_step_done(ups_port_ctx_t *ctx, uint32_t now_ms)
+{
+    switch (ctx->bootstrap_step)
+    {
+    case UPS_BOOTSTRAP_STEP_MINIMUM:
+        // Capacity and status are known: the host can see the battery.
+        ups_readiness_reach(ctx, UPS_READINESS_MINIMUM, now_ms);
+        g_usb_init_enabled = true;
+        ups_autodetect_remember(ctx);
+        ctx->bootstrap_step = UPS_BOOTSTRAP_STEP_CONSTANTS;
+        ctx->bootstrap_state = UPS_BOOTSTRAP_STEP_ENQUEUE;
+        break;
+
+    case UPS_BOOTSTRAP_STEP_CONSTANTS:
+        ups_readiness_reach(ctx, UPS_READINESS_CONSTANTS, now_ms);
+        if ((UPS_CACHE_ENABLED != 0) && ups_cache_update(ctx->port))
+        {
+            UPS_DEBUG_PRINTF("INIT ups%u identity differs from the cache, re-enumerating\r\n",
+                             (unsigned)ctx->port);
+            usb_reenumerate();
+        }
+        ctx->bootstrap_step = UPS_BOOTSTRAP_STEP_TELEMETRY;
+        ctx->bootstrap_state = UPS_BOOTSTRAP_STEP_ENQUEUE;
+        break;
+
+    case UPS_BOOTSTRAP_STEP_TELEMETRY:
+    default:
+        ups_readiness_reach(ctx, UPS_READINESS_FULL, now_ms);
+        ctx->last_dynamic_update_ms = now_ms;
+        ctx->bootstrap_state = UPS_BOOTSTRAP_DONE;
+        UPS_DEBUG_PRINTF("INIT ups%u full bootstrap done in %lu ms\r\n",
+                         (unsigned)ctx->port,
+                         (unsigned long)(now_ms - ctx->init_bootstrap_start_ms));
+        break;
+    }
+}
+
+static void ups_bootstrap_task(ups_port_ctx_t *ctx)
+{
+    if (ctx->restart_pending)
+    {
+        return;
+    }
+
     uint32_t const now_ms = HAL_GetTick();
 
-    if (!s_init_bootstrap_started)
+    if (!ctx->init_bootstrap_started)
     {
-        s_init_bootstrap_started = true;
-        s_init_bootstrap_start_ms = now_ms;
+        ctx->init_bootstrap_started = true;
+        ctx->init_bootstrap_start_ms = now_ms;
     }
 
-    switch (s_ups_bootstrap_state)
+    switch (ctx->bootstrap_state)
     {
     case UPS_BOOTSTRAP_ENQUEUE_HEARTBEAT:
     {
-        if (g_sub_adapter_constant_heartbeat == NULL)
+        if (ctx->adapter.constant_heartbeat == NULL)
         {
-            ups_bootstrap_reset_for_retry(now_ms);
+            ups_bootstrap_reset_for_retry(ctx, now_ms);
             break;
         }
 
-        uart_engine_request_t hb_req = *g_sub_adapter_constant_heartbeat;
-        hb_req.out_value = NULL;
+        // Replies to jobs sent at the old rate must drain, and the
+        // passthrough, if any, release the line, before the rate changes.
+        uint8_t const port = ctx->port;
+        if (UPS_UART_GetBaud(port) != ctx->baud)
+        {
+            if (uart_engine_is_busy(port) || !UPS_UART_TryLock(port))
+            {
+                break;
+            }
+            (void)UPS_UART_SetBaud(port, ctx->baud);
+            UPS_UART_Unlock(port);
+        }
+
+        uart_engine_request_t hb_req = *ctx->adapter.constant_heartbeat;
+        hb_req.out_value = ctx;
         hb_req.process_fn = ups_bootstrap_heartbeat_capture;
+        if (ctx->probing)
+        {
+            // A wrong guess should cost one short wait, not retries.
+            hb_req.timeout_ms = UPS_AUTODETECT_PROBE_TIMEOUT_MS;
+            hb_req.max_retries = 0U;
+        }
 
-        uart_engine_result_t const result = uart_engine_enqueue(&hb_req);
+        uart_engine_result_t const result = uart_engine_enqueue(port, &hb_req);
         if (result == UART_ENGINE_OK)
         {
-            s_bootstrap_heartbeat_done = false;
-            s_ups_bootstrap_state = UPS_BOOTSTRAP_WAIT_HEARTBEAT_DRAIN;
+            ctx->bootstrap_heartbeat_done = false;
+            ctx->bootstrap_state = UPS_BOOTSTRAP_WAIT_HEARTBEAT_DRAIN;
         }
         break;
     }
 
     case UPS_BOOTSTRAP_WAIT_HEARTBEAT_DRAIN:
-        if (!uart_engine_is_busy())
+        if (!uart_engine_is_busy(ctx->port))
         {
-            s_ups_bootstrap_state = UPS_BOOTSTRAP_HEARTBEAT_VERIFY;
+            ctx->bootstrap_state = UPS_BOOTSTRAP_HEARTBEAT_VERIFY;
         }
         break;
 
     case UPS_BOOTSTRAP_HEARTBEAT_VERIFY:
-        if (ups_bootstrap_heartbeat_matches_expected())
+        if (ups_bootstrap_heartbeat_matches_expected(ctx))
         {
-            s_ups_bootstrap_state = UPS_BOOTSTRAP_ENQUEUE_CONSTANT;
+            UPS_DEBUG_PRINTF("INIT ups%u %s at %lu baud answered after %lu ms\r\n",
+                             (unsigned)ctx->port,
+                             ctx->adapter.name,
+                             (unsigned long)ctx->baud,
+                             (unsigned long)(now_ms - ctx->init_bootstrap_start_ms));
+            ctx->probing = false;
+            ups_readiness_reach(ctx, UPS_READINESS_LINK, now_ms);
+            ctx->bootstrap_step = UPS_BOOTSTRAP_STEP_MINIMUM;
+            ctx->bootstrap_step_idx = 0U;
+            ctx->bootstrap_step_tries = 0U;
+            ctx->bootstrap_state = UPS_BOOTSTRAP_STEP_ENQUEUE;
+        }
+        else if (ups_autodetect_next(ctx))
+        {
+            ctx->bootstrap_heartbeat_done = false;
+            ctx->bootstrap_state = UPS_BOOTSTRAP_ENQUEUE_HEARTBEAT;
         }
         else
         {
-            UPS_DEBUG_PRINTF("INIT heartbeat failed, retry in %lu ms\r\n",
+            UPS_DEBUG_PRINTF("INIT ups%u heartbeat failed, retry in %lu ms\r\n",
+                             (unsigned)ctx->port,
                              (unsigned long)UPS_INIT_RETRY_PERIOD_MS);
-            ups_bootstrap_reset_for_retry(now_ms);
+            ups_bootstrap_reset_for_retry(ctx, now_ms);
         }
         break;
 
     case UPS_BOOTSTRAP_WAIT_RETRY:
-        if ((int32_t)(now_ms - s_init_retry_not_before_ms) >= 0)
+        if ((int32_t)(now_ms - ctx->init_retry_not_before_ms) >= 0)
         {
-            s_ups_bootstrap_state = UPS_BOOTSTRAP_ENQUEUE_HEARTBEAT;
+            ctx->bootstrap_state = UPS_BOOTSTRAP_ENQUEUE_HEARTBEAT;
         }
         break;
 
-    case UPS_BOOTSTRAP_ENQUEUE_CONSTANT:
-        ups_enqueue_full_lut_step(g_sub_adapter_constant_lut,
-                                  g_sub_adapter_constant_lut_count,
-                                  &s_bootstrap_constant_idx);
-        if (s_bootstrap_constant_idx >= g_sub_adapter_constant_lut_count)
+    case UPS_BOOTSTRAP_STEP_ENQUEUE:
+    {
+        size_t lut_count = 0U;
+        const uart_engine_request_t *lut = ups_bootstrap_step_lut(ctx, &lut_count);
+        if (ctx->bootstrap_step_idx == 0U)
         {
-            s_ups_bootstrap_state = UPS_BOOTSTRAP_ENQUEUE_DYNAMIC;
+            ctx->bootstrap_step_failed_before = ups_engine_failed_count(ctx->port);
         }
-        break;
-
-    case UPS_BOOTSTRAP_ENQUEUE_DYNAMIC:
-        ups_enqueue_full_lut_step(g_sub_adapter_dynamic_lut,
-                                  g_sub_adapter_dynamic_lut_count,
-                                  &s_bootstrap_dynamic_idx);
-        if (s_bootstrap_dynamic_idx >= g_sub_adapter_dynamic_lut_count)
+        ups_enqueue_full_lut_step(ctx->port, lut, lut_count, &ctx->bootstrap_step_idx);
+        if (ctx->bootstrap_step_idx >= lut_count)
         {
-            s_ups_bootstrap_state = UPS_BOOTSTRAP_WAIT_DRAIN;
+            ctx->bootstrap_state = UPS_BOOTSTRAP_STEP_WAIT_DRAIN;
         }
         break;
+    }
 
-    case UPS_BOOTSTRAP_WAIT_DRAIN:
-        if (!uart_engine_is_busy())
+    case UPS_BOOTSTRAP_STEP_WAIT_DRAIN:
+        if (!uart_engine_is_busy(ctx->port))
         {
-            s_ups_bootstrap_state = UPS_BOOTSTRAP_SANITY_CHECK;
+            ctx->bootstrap_state = UPS_BOOTSTRAP_STEP_VERIFY;
         }
         break;
 
-    case UPS_BOOTSTRAP_SANITY_CHECK:
-        if (g_battery.remaining_capacity > 0U)
+    case UPS_BOOTSTRAP_STEP_VERIFY:
+    {
+        // Every minimum LUT reads what the capacity depends on, so a step
+        // whose jobs all succeeded has it, 0 % included.
+        bool const ok = (ups_engine_failed_count(ctx->port) == ctx->bootstrap_step_failed_before);
+
+        ctx->bootstrap_step_idx = 0U;
+        ctx->bootstrap_step_tries++;
+        if (!ok && (ctx->bootstrap_step_tries < UPS_BOOTSTRAP_STEP_TRIES))
         {
-            g_usb_init_enabled = true;
-            s_next_dynamic_update_ms = HAL_GetTick() + UPS_DYNAMIC_UPDATE_PERIOD_MS;
-            s_ups_bootstrap_state = UPS_BOOTSTRAP_DONE;
-            UPS_DEBUG_PRINTF("INIT full bootstrap done in %lu ms\r\n",
-                             (unsigned long)(now_ms - s_init_bootstrap_start_ms));
+            UPS_DEBUG_PRINTF("INIT ups%u step %u failed, retry in %lu ms\r\n",
+                             (unsigned)ctx->port,
+                             (unsigned)ctx->bootstrap_step,
+                             (unsigned long)UPS_BOOTSTRAP_STEP_RETRY_MS);
+            ctx->init_retry_not_before_ms = now_ms + UPS_BOOTSTRAP_STEP_RETRY_MS;
+            ctx->bootstrap_state = UPS_BOOTSTRAP_STEP_WAIT_RETRY;
+            break;
         }
-        else
+
+        if (!ok && (ctx->bootstrap_step == UPS_BOOTSTRAP_STEP_MINIMUM))
         {
-            UPS_DEBUG_PRINTF("INIT sanity failed (remaining_capacity=0), retry in %lu ms\r\n",
+            // No battery state without it; assume the link is gone.
+            UPS_DEBUG_PRINTF("INIT ups%u no battery state, retry in %lu ms\r\n",
+                             (unsigned)ctx->port,
                              (unsigned long)UPS_INIT_RETRY_PERIOD_MS);
-            ups_bootstrap_reset_for_retry(now_ms);
+            ups_bootstrap_reset_for_retry(ctx, now_ms);
+            break;
+        }
+
+        // Constants and telemetry that keep failing stay at their last
+        // values; the periodic refresh retries the telemetry anyway.
+        ctx->bootstrap_step_tries = 0U;
+        ups_bootstrap_step_done(ctx, now_ms);
+        break;
+    }
+
+    case UPS_BOOTSTRAP_STEP_WAIT_RETRY:
+        if ((int32_t)(now_ms - ctx->init_retry_not_before_ms) >= 0)
+        {
+            ctx->bootstrap_state = UPS_BOOTSTRAP_STEP_ENQUEUE;
         }
         break;
 
@@ -547,132 +1018,262 @@ static void ups_bootstrap_task(void)
     }
 }
 
-static void ups_dynamic_update_task(void)
+static void ups_dynamic_update_task(ups_port_ctx_t *ctx)
 {
-    if (s_ups_bootstrap_state != UPS_BOOTSTRAP_DONE)
+    if ((ctx->bootstrap_state != UPS_BOOTSTRAP_DONE) || ctx->restart_pending)
     {
         return;
     }
 
     uint32_t const now_ms = HAL_GetTick();
-    if (!s_dynamic_update_cycle_active)
+    if (!ctx->dynamic_update_cycle_active)
     {
-        if ((int32_t)(now_ms - s_next_dynamic_update_ms) < 0)
+        if ((int32_t)(now_ms - (ctx->last_dynamic_update_ms + UPS_DYNAMIC_UPDATE_PERIOD_MS)) < 0)
         {
             return;
         }
 
-        s_dynamic_update_cycle_active = true;
-        s_dynamic_update_idx = 0U;
-        s_last_dynamic_cycle_start_ms = now_ms;
+        ctx->dynamic_update_cycle_active = true;
+        ctx->dynamic_update_idx = 0U;
+        ctx->last_dynamic_cycle_start_ms = now_ms;
+
+        // While the host sleeps only the alerts matter: status, AC and
+        // capacity are the minimum set.
+        bool const alerts_only = power_mode_alerts_only() && (ctx->adapter.minimum_lut != NULL);
+        ctx->dynamic_update_lut = alerts_only ? ctx->adapter.minimum_lut : ctx->adapter.dynamic_lut;
+        ctx->dynamic_update_lut_count = alerts_only ? ctx->adapter.minimum_lut_count : ctx->adapter.dynamic_lut_count;
     }
 
-    if (s_dynamic_update_idx < g_sub_adapter_dynamic_lut_count)
+    if (ctx->dynamic_update_idx < ctx->dynamic_update_lut_count)
     {
-        ups_enqueue_full_lut_step(g_sub_adapter_dynamic_lut,
-                                  g_sub_adapter_dynamic_lut_count,
-                                  &s_dynamic_update_idx);
+        ups_enqueue_full_lut_step(ctx->port,
+                                  ctx->dynamic_update_lut,
+                                  ctx->dynamic_update_lut_count,
+                                  &ctx->dynamic_update_idx);
         return;
     }
 
-    if (uart_engine_is_busy())
+    if (uart_engine_is_busy(ctx->port))
     {
         return;
     }
 
-    s_dynamic_update_cycle_active = false;
-    s_next_dynamic_update_ms = now_ms + UPS_DYNAMIC_UPDATE_PERIOD_MS;
-    UPS_DEBUG_PRINTF("DYN refresh done in %lu ms\r\n",
-                     (unsigned long)(now_ms - s_last_dynamic_cycle_start_ms));
-}
+    ctx->dynamic_update_cycle_active = false;
+    ctx->last_dynamic_update_ms = now_ms;
 
-static void ups_debug_status_print_task(void)
-{
-#if (UPS_DEBUG_STATUS_PRINT_ENABLED != 0)
-    static uint32_t next_print_ms = 0U;
-    uint32_t const now_ms = HAL_GetTick();
-    if ((int32_t)(now_ms - next_print_ms) < 0)
+    uart_engine_stats_t stats;
+    uart_engine_get_stats(ctx->port, &stats);
+    if (stats.consecutive_failures >= ups_tuning_get()->failure_threshold)
     {
+        // The UPS stopped answering: look for it again from the heartbeat,
+        // at its other rates too if it still does not answer.
+        UPS_DEBUG_PRINTF("DYN ups%u link lost after %u failures, rebootstrapping\r\n",
+                         (unsigned)ctx->port,
+                         (unsigned)stats.consecutive_failures);
+        ups_bootstrap_reset_for_retry(ctx, now_ms);
         return;
     }
-
-    next_print_ms = now_ms + UPS_DEBUG_STATUS_PRINT_PERIOD_MS;
-
-    printf("PS: ac=%u chg=%u dis=%u full=%u repl=%u low=%u bpres=%u ovl=%u shut=%u\r\n",
-           (unsigned)g_power_summary_present_status.ac_present,
-           (unsigned)g_power_summary_present_status.charging,
-           (unsigned)g_power_summary_present_status.discharging,
-           (unsigned)g_power_summary_present_status.fully_charged,
-           (unsigned)g_power_summary_present_status.need_replacement,
-           (unsigned)g_power_summary_present_status.below_remaining_capacity_limit,
-           (unsigned)g_power_summary_present_status.battery_present,
-           (unsigned)g_power_summary_present_status.overload,
-           (unsigned)g_power_summary_present_status.shutdown_imminent);
-
-    printf("BAT: cap=%u rt=%u rtl=%u vb=%u ib=%d cfgv=%u temp=%u mfg=%u\r\n",
-           (unsigned)g_battery.remaining_capacity,
-           (unsigned)g_battery.run_time_to_empty_s,
-           (unsigned)g_battery.remaining_time_limit_s,
-           (unsigned)g_battery.battery_voltage,
-           (int)g_battery.battery_current,
-           (unsigned)g_battery.config_voltage,
-           (unsigned)g_battery.temperature,
-           (unsigned)g_battery.manufacturer_date);
-
-    printf("IN: v=%u f=%u cfgv=%u low=%u high=%u\r\n",
-           (unsigned)g_input.voltage,
-           (unsigned)g_input.frequency,
-           (unsigned)g_input.config_voltage,
-           (unsigned)g_input.low_voltage_transfer,
-           (unsigned)g_input.high_voltage_transfer);
-
-    printf("OUT: load=%u cfgp=%u cfgv=%u v=%u i=%d f=%u\r\n",
-           (unsigned)g_output.percent_load,
-           (unsigned)g_output.config_active_power,
-           (unsigned)g_output.config_voltage,
-           (unsigned)g_output.voltage,
-           (int)g_output.current,
-           (unsigned)g_output.frequency);
-#endif
+    UPS_DEBUG_PRINTF("DYN ups%u refresh done in %lu ms\r\n",
+                     (unsigned)ctx->port,
+                     (unsigned long)(now_ms - ctx->last_dynamic_cycle_start_ms));
 }
 
-static void ups_led_task(void)
+// Pushes host-written settings to the UPS, one at a time. Steps run only
+// while the engine is idle and no dynamic refresh is in flight, so each
+// step's reply is known before the next command is chosen. A write in
+// flight when the host changes the rate runs to its readback first.
+static void ups_setting_write_task(ups_port_ctx_t *ctx)
 {
-    static bool led_state_low = true;
-    static uint32_t next_toggle_ms = 0U;
+    ctx->pending_settings |= ups_hid_take_pending_settings(ctx->port);
 
-    if (!uart_engine_is_enabled())
+    if ((ctx->bootstrap_state != UPS_BOOTSTRAP_DONE) && !ctx->restart_pending)
     {
-        led_state_low = true;
-        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_RESET);
-        next_toggle_ms = 0U;
         return;
     }
 
-    if (!uart_engine_is_busy())
+    if ((ctx->adapter.setting_write_start == NULL) || (ctx->adapter.setting_write_step == NULL))
     {
-        led_state_low = true;
-        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_RESET);
-        next_toggle_ms = 0U;
+        ctx->pending_settings = 0U;
         return;
     }
 
-    uint32_t const now_ms = HAL_GetTick();
-    if (next_toggle_ms == 0U)
+    if (ctx->dynamic_update_cycle_active || uart_engine_is_busy(ctx->port))
     {
-        next_toggle_ms = now_ms;
+        return;
     }
 
-    if ((int32_t)(now_ms - next_toggle_ms) < 0)
+    if (ctx->setting_write_active)
     {
+        ctx->setting_write_active = ctx->adapter.setting_write_step(ctx->port);
         return;
     }
 
+    if (ctx->restart_pending)
+    {
+        return; // new writes wait for the new rate
+    }
+
+    for (uint32_t setting = 0U; setting < (uint32_t)UPS_SETTING_COUNT; setting++)
+    {
+        uint32_t const bit = (1UL << setting);
+        if ((ctx->pending_settings & bit) == 0U)
+        {
+            continue;
+        }
+
+        ctx->pending_settings &= ~bit;
+        ctx->setting_write_active = ctx->adapter.setting_write_start(ctx->port, (ups_setting_t)setting);
+        UPS_DEBUG_PRINTF("SET ups%u setting %lu %s\r\n",
+                         (unsigned)ctx->port,
+                         (unsigned long)setting,
+                         ctx->setting_write_active ? "started" : "not supported");
+        break;
+    }
+}
+
+static uint32_t ups_debug_status_print_task(uint32_t now_ms)
+{
+    (void)now_ms;
+#if (UPS_DEBUG_STATUS_PRINT_ENABLED != 0)
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        ups_state_t const *ups = &g_ups[port];
+        LOG_RING_PRINTF("UPS%u PS: ac=%u chg=%u dis=%u full=%u repl=%u low=%u bpres=%u ovl=%u shut=%u\r\n",
+                        (unsigned)port,
+                        (unsigned)ups->present_status.ac_present,
+                        (unsigned)ups->present_status.charging,
+                        (unsigned)ups->present_status.discharging,
+                        (unsigned)ups->present_status.fully_charged,
+                        (unsigned)ups->present_status.need_replacement,
+                        (unsigned)ups->present_status.below_remaining_capacity_limit,
+                        (unsigned)ups->present_status.battery_present,
+                        (unsigned)ups->present_status.overload,
+                        (unsigned)ups->present_status.shutdown_imminent);
+
+        LOG_RING_PRINTF("BAT: cap=%u rt=%u rtl=%u vb=%u ib=%d cfgv=%u temp=%u mfg=%u\r\n",
+                        (unsigned)ups->battery.remaining_capacity,
+                        (unsigned)ups->battery.run_time_to_empty_s,
+                        (unsigned)ups->battery.remaining_time_limit_s,
+                        (unsigned)ups->battery.battery_voltage,
+                        (int)ups->battery.battery_current,
+                        (unsigned)ups->battery.config_voltage,
+                        (unsigned)ups->battery.temperature,
+                        (unsigned)ups->battery.manufacturer_date);
+
+        LOG_RING_PRINTF("IN: v=%u f=%u cfgv=%u low=%u high=%u\r\n",
+                        (unsigned)ups->input.voltage,
+                        (unsigned)ups->input.frequency,
+                        (unsigned)ups->input.config_voltage,
+                        (unsigned)ups->input.low_voltage_transfer,
+                        (unsigned)ups->input.high_voltage_transfer);
+
+        LOG_RING_PRINTF("OUT: load=%u cfgp=%u cfgv=%u v=%u i=%d f=%u\r\n",
+                        (unsigned)ups->output.percent_load,
+                        (unsigned)ups->output.config_active_power,
+                        (unsigned)ups->output.config_voltage,
+                        (unsigned)ups->output.voltage,
+                        (int)ups->output.current,
+                        (unsigned)ups->output.frequency);
+
+        ups_hid_poll_stats_t hid_stats;
+        ups_hid_get_poll_stats(port, &hid_stats);
+        LOG_RING_PRINTF("HID: get=%lu in=%lu feat=%lu cycles=%lu last=%u max=%u\r\n",
+                        (unsigned long)hid_stats.get_report_total,
+                        (unsigned long)hid_stats.get_report_input,
+                        (unsigned long)hid_stats.get_report_feature,
+                        (unsigned long)hid_stats.poll_cycles,
+                        (unsigned)hid_stats.last_cycle_transfers,
+                        (unsigned)hid_stats.max_cycle_transfers);
+
+        ups_hid_tx_stats_t tx_stats;
+        ups_hid_get_tx_stats(port, &tx_stats);
+        LOG_RING_PRINTF("HID TX: queued=%lu sent=%lu coalesced=%lu dropped=%lu\r\n",
+                        (unsigned long)tx_stats.queued,
+                        (unsigned long)tx_stats.sent,
+                        (unsigned long)tx_stats.coalesced,
+                        (unsigned long)tx_stats.dropped);
+    }
+
+    task_sched_stats_t sched_stats;
+    task_sched_get_stats(&sched_stats);
+    LOG_RING_PRINTF("SCHED: passes=%lu idle=%lu runs=%lu event_runs=%lu\r\n",
+                    (unsigned long)sched_stats.passes,
+                    (unsigned long)sched_stats.idle_passes,
+                    (unsigned long)sched_stats.runs,
+                    (unsigned long)sched_stats.event_runs);
+
+    idle_sleep_stats_t idle_stats;
+    idle_sleep_get_stats(&idle_stats);
+    LOG_RING_PRINTF("IDLE: wakeups=%lu per_s=%lu tickless=%lu tickless_ms=%lu\r\n",
+                    (unsigned long)idle_stats.wakeups,
+                    (unsigned long)idle_stats.wakeups_per_s,
+                    (unsigned long)idle_stats.tickless_sleeps,
+                    (unsigned long)idle_stats.tickless_ms);
+
+    log_ring_stats_t log_stats;
+    log_ring_get_stats(&log_stats);
+    LOG_RING_PRINTF("LOG: records=%lu dropped=%lu bytes=%lu high_water=%u\r\n",
+                    (unsigned long)log_stats.records,
+                    (unsigned long)log_stats.dropped,
+                    (unsigned long)log_stats.bytes_out,
+                    (unsigned)log_stats.high_water);
+    return UPS_DEBUG_STATUS_PRINT_PERIOD_MS;
+#else
+    return TASK_SCHED_NEVER;
+#endif
+}
+
+static bool s_led_blinking = false;
+
+static void ups_engines_state(bool *out_enabled, bool *out_busy)
+{
+    bool enabled = false;
+    bool busy = false;
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        enabled = enabled || uart_engine_is_enabled(port);
+        busy = busy || uart_engine_is_busy(port);
+    }
+
+    *out_enabled = enabled;
+    *out_busy = busy;
+}
+
+// Blinks while any engine is busy. Sleeps while idle; the engine task wakes
+// it when traffic starts.
+static uint32_t ups_led_task(uint32_t now_ms)
+{
+    static bool led_state_low = true;
+    (void)now_ms;
+
+    bool enabled = false;
+    bool busy = false;
+    ups_engines_state(&enabled, &busy);
+
+    if (power_mode_get() == POWER_MODE_SUSPEND)
+    {
+        // Dark while the host sleeps; the LED alone is a good share of the
+        // suspend current. The resume wakes this task again.
+        led_state_low = false;
+        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_SET);
+        s_led_blinking = false;
+        return TASK_SCHED_NEVER;
+    }
+
+    if (!enabled || !busy)
+    {
+        led_state_low = true;
+        HAL_GPIO_WritePin(GPIOC, GPIO_PIN_13, GPIO_PIN_RESET);
+        s_led_blinking = false;
+        return TASK_SCHED_NEVER;
+    }
+
     led_state_low = !led_state_low;
     HAL_GPIO_WritePin(GPIOC,
                       GPIO_PIN_13,
                       led_state_low ? GPIO_PIN_RESET : GPIO_PIN_SET);
-    next_toggle_ms = now_ms + UPS_LED_BUSY_BLINK_PERIOD_MS;
+    s_led_blinking = true;
+    return UPS_LED_BUSY_BLINK_PERIOD_MS;
 }
 
 // UART engine enable switch.
@@ -684,61 +1285,329 @@ static void ups_led_task(void)
 
 static bool s_uart_engine_enabled = (UART_ENGINE_DEFAULT_ENABLED != 0);
 
-ups_present_status_t g_power_summary_present_status = {
-    .ac_present = false,
-    .charging = false,
-    .discharging = false,
-    .fully_charged = false,
-    .need_replacement = false,
-    .below_remaining_capacity_limit = false,
-    .battery_present = false,
-    .overload = false,
-    .shutdown_imminent = false,
+// Power-up state of every port.
+static const ups_state_t k_ups_state_defaults = {
+    .present_status = {
+        .ac_present = false,
+        .charging = false,
+        .discharging = false,
+        .fully_charged = false,
+        .need_replacement = false,
+        .below_remaining_capacity_limit = false,
+        .battery_present = false,
+        .overload = false,
+        .shutdown_imminent = false,
+    },
+    .summary = {
+        .rechargeable = true,
+        .capacity_mode = 2U,
+        .design_capacity = 100U,
+        .full_charge_capacity = 100U,
+        .warning_capacity_limit = 20U,
+        .remaining_capacity_limit = 10U,
+        .i_device_chemistry = 0x05U,
+        .capacity_granularity_1 = 1U,
+        .capacity_granularity_2 = 1U,
+        // Descriptor uses 2-bit fields, so values are 0..3.
+        .i_manufacturer_2bit = 1U,
+        .i_product_2bit = 2U,
+        .i_serial_number_2bit = 3U,
+        .i_name_2bit = 2U,
+    },
+    .battery = {
+        .battery_voltage = 0,
+        .battery_current = 0,
+        .config_voltage = 0,
+        .run_time_to_empty_s = 0,
+        .remaining_time_limit_s = 120,
+        .temperature = 0,
+        .manufacturer_date = 0,
+        .remaining_capacity = 0,
+    },
+    .input = {
+        .voltage = 0,
+        .frequency = 0,
+        .config_voltage = 0,
+        .low_voltage_transfer = 0,
+        .high_voltage_transfer = 0,
+    },
+    .output = {
+        .percent_load = 0,
+        .config_active_power = 0,
+        .config_voltage = 0,
+        .voltage = 0,
+        .current = 0,
+        .frequency = 0,
+    },
 };
 
-ups_summary_t g_power_summary ={
-    .rechargeable = true,
-    .capacity_mode = 2U,
-    .design_capacity = 100U,
-    .full_charge_capacity = 100U,
-    .warning_capacity_limit = 20U,
-    .remaining_capacity_limit = 10U,
-    .i_device_chemistry = 0x05U,
-    .capacity_granularity_1 = 1U,
-    .capacity_granularity_2 = 1U,
-    // Descriptor uses 2-bit fields, so values are 0..3.
-    .i_manufacturer_2bit = 1U,
-    .i_product_2bit = 2U,
-    .i_serial_number_2bit = 3U,
-    .i_name_2bit = 2U,
-};
+ups_state_t g_ups[UPS_PORT_COUNT];
 
-ups_battery_t g_battery = {
-    .battery_voltage = 0,
-    .battery_current = 0,
-    .config_voltage = 0,
-    .run_time_to_empty_s = 0,
-    .remaining_time_limit_s = 120,
-    .temperature = 0,
-    .manufacturer_date = 0,
-    .remaining_capacity = 0,
-};
+ups_readiness_t ups_port_readiness(uint8_t port)
+{
+    return (port < UPS_PORT_COUNT) ? s_port_ctx[port].readiness : UPS_READINESS_NONE;
+}
 
-ups_input_t g_input = {
-    .voltage = 0,
-    .frequency = 0,
-    .config_voltage = 0,
-    .low_voltage_transfer = 0,
-    .high_voltage_transfer = 0,
-};
-ups_output_t g_output = {
-    .percent_load = 0,
-    .config_active_power = 0,
-    .config_voltage = 0,
-    .voltage = 0,
-    .current = 0,
-    .frequency = 0,
-};
+uint32_t ups_port_readiness_ms(uint8_t port, ups_readiness_t level)
+{
+    if ((port >= UPS_PORT_COUNT) || (level >= UPS_READINESS_COUNT))
+    {
+        return 0U;
+    }
+    return s_port_ctx[port].readiness_ms[level];
+}
+
+bool ups_port_is_ready(uint8_t port)
+{
+    return (ups_port_readiness(port) >= UPS_READINESS_MINIMUM);
+}
+
+bool ups_port_has_constants(uint8_t port)
+{
+    return ups_port_is_ready(port) || ((UPS_CACHE_ENABLED != 0) && ups_cache_port_is_restored(port));
+}
+
+bool ups_port_set_baud(uint8_t port, uint32_t baud)
+{
+    if ((port >= UPS_PORT_COUNT) || ((baud != 0U) && ((baud < 1200U) || (baud > 115200U))))
+    {
+        return false;
+    }
+
+    // Applied by ups_port_restart_task() once the port is quiet.
+    s_port_ctx[port].restart_baud = baud;
+    s_port_ctx[port].restart_pending = true;
+    return true;
+}
+
+// Restarts the bootstrap for a host rate change, from the heartbeat. The
+// rest of a refresh is dropped, but the jobs already sent and a setting
+// write in flight finish first: a reply read at the new rate is garbage,
+// and a write cut short leaves the UPS stepped part of the way.
+static void ups_port_restart_task(ups_port_ctx_t *ctx)
+{
+    if (!ctx->restart_pending)
+    {
+        return;
+    }
+
+    ctx->dynamic_update_cycle_active = false;
+    if (uart_engine_is_busy(ctx->port) || ctx->setting_write_active)
+    {
+        return;
+    }
+
+    ctx->restart_pending = false;
+    ctx->probing = false;
+    if (ctx->restart_baud != 0U)
+    {
+        ctx->baud = ctx->restart_baud;
+    }
+    else
+    {
+        (void)ups_autodetect_next(ctx);
+    }
+
+    ctx->bootstrap_step = UPS_BOOTSTRAP_STEP_MINIMUM;
+    ctx->bootstrap_step_idx = 0U;
+    ctx->bootstrap_step_tries = 0U;
+    ctx->bootstrap_heartbeat_done = false;
+    ctx->bootstrap_state = UPS_BOOTSTRAP_ENQUEUE_HEARTBEAT;
+    UPS_DEBUG_PRINTF("INIT ups%u restart at %lu baud\r\n", (unsigned)ctx->port, (unsigned long)ctx->baud);
+}
+
+static void ups_state_init(void)
+{
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        g_ups[port] = k_ups_state_defaults;
+        s_port_ctx[port].port = port;
+    }
+}
+
+// Runs the restart, bootstrap, refresh and setting-write tasks of every port.
+static void ups_port_tasks(void)
+{
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        ups_port_ctx_t *ctx = &s_port_ctx[port];
+        ups_port_restart_task(ctx);
+        ups_bootstrap_task(ctx);
+        ups_dynamic_update_task(ctx);
+        ups_setting_write_task(ctx);
+    }
+}
+
+// Time until the port's state machines have something to do on their own,
+// assuming its engine is idle: a retry wait or the next refresh. Any other
+// state is progressing and is polled.
+static uint32_t ups_port_next_delay_ms(const ups_port_ctx_t *ctx, uint32_t now_ms)
+{
+    if (ctx->restart_pending)
+    {
+        return UPS_SCHED_ENGINE_BUSY_POLL_MS;
+    }
+
+    uint32_t due_ms = now_ms;
+    switch (ctx->bootstrap_state)
+    {
+    case UPS_BOOTSTRAP_WAIT_RETRY:
+    case UPS_BOOTSTRAP_STEP_WAIT_RETRY:
+        due_ms = ctx->init_retry_not_before_ms;
+        break;
+
+    case UPS_BOOTSTRAP_DONE:
+        if (ctx->dynamic_update_cycle_active || ctx->setting_write_active || (ctx->pending_settings != 0U))
+        {
+            return UPS_SCHED_ENGINE_BUSY_POLL_MS;
+        }
+        due_ms = ctx->last_dynamic_update_ms + UPS_DYNAMIC_UPDATE_PERIOD_MS;
+        break;
+
+    default:
+        return UPS_SCHED_ENGINE_BUSY_POLL_MS;
+    }
+
+    return ((int32_t)(due_ms - now_ms) > 0) ? (due_ms - now_ms) : 0U;
+}
+
+static uint8_t s_led_task_id = TASK_SCHED_INVALID;
+static uint8_t s_usb_task_id = TASK_SCHED_INVALID;
+static power_mode_t s_power_mode_seen = POWER_MODE_RUN;
+
+// UART engines and the per-port state machines. Runs on UART interrupts
+// and on host setting writes (USB), and otherwise sleeps until the nearest
+// port deadline.
+static uint32_t ups_engine_task(uint32_t now_ms)
+{
+    ups_port_tasks();
+    uart_engine_tick();
+
+    static bool was_busy = false;
+    bool enabled = false;
+    bool busy = false;
+    ups_engines_state(&enabled, &busy);
+    if (busy && !s_led_blinking)
+    {
+        task_sched_wake(s_led_task_id);
+    }
+    if (was_busy && !busy)
+    {
+        // A refresh or bootstrap step ended: push what changed to the host
+        // now rather than at the next USB poll.
+        task_sched_wake(s_usb_task_id);
+    }
+    was_busy = busy;
+    if (busy)
+    {
+        return UPS_SCHED_ENGINE_BUSY_POLL_MS;
+    }
+
+    uint32_t next_ms = TASK_SCHED_NEVER;
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        uint32_t const port_ms = ups_port_next_delay_ms(&s_port_ctx[port], now_ms);
+        if (port_ms < next_ms)
+        {
+            next_ms = port_ms;
+        }
+    }
+    return next_ms;
+}
+
+// TinyUSB and the USB classes. Runs on USB interrupts, on UART interrupts
+// for the passthrough, when the engine goes idle, and on the timed reports'
+// period.
+static uint32_t ups_usb_task(uint32_t now_ms)
+{
+    (void)now_ms;
+    usb_start_if_enabled();
+    usb_reconnect_task();
+    if (s_usb_started)
+    {
+        tud_task(); // TinyUSB device task
+        ups_hid_periodic_task();
+        ups_cdc_telemetry_task();
+        ups_cdc_passthrough_task();
+    }
+
+    // A suspend or resume in tud_task() changed the clocks and the LED.
+    power_mode_t const mode = power_mode_get();
+    if (mode != s_power_mode_seen)
+    {
+        s_power_mode_seen = mode;
+        task_sched_wake(s_led_task_id);
+        UPS_DEBUG_PRINTF("USB power mode %u, hclk %lu Hz\r\n",
+                         (unsigned)mode, (unsigned long)SystemCoreClock);
+    }
+    if (mode == POWER_MODE_SUSPEND)
+    {
+        return UPS_SCHED_USB_SUSPEND_PERIOD_MS;
+    }
+    return ups_cdc_telemetry_is_streaming() ? UPS_SCHED_USB_PERIOD_MS : UPS_SCHED_USB_IDLE_PERIOD_MS;
+}
+
+static uint32_t ups_watchdog_task(uint32_t now_ms)
+{
+    (void)now_ms;
+    watchdog_refresh();
+    return UPS_SCHED_WATCHDOG_PERIOD_MS;
+}
+
+// Sends the log ring over USART1 with DMA so a separate USB-TTL adapter can
+// be used as a monitor (logdecode.py expands the records).
+// Wiring (STM32F103): PA9=USART1_TX -> USB-TTL RX, GND shared.
+static uint32_t ups_log_drain_task(uint32_t now_ms)
+{
+    static uint16_t in_flight = 0U;
+    (void)now_ms;
+
+    if (huart1.gState != HAL_UART_STATE_READY)
+    {
+        return 1U;
+    }
+
+    log_ring_consume(in_flight);
+    in_flight = 0U;
+
+    const uint8_t *chunk = NULL;
+    uint16_t const len = log_ring_peek(&chunk);
+    if (len == 0U)
+    {
+        return TASK_SCHED_NEVER;
+    }
+
+    if (HAL_UART_Transmit_DMA(&huart1, (uint8_t *)chunk, len) != HAL_OK)
+    {
+        return 1U;
+    }
+    in_flight = len;
+
+    // 10 bits per byte; check back when the chunk should be out.
+    uint32_t const baud = (huart1.Init.BaudRate != 0U) ? huart1.Init.BaudRate : 115200U;
+    return (((uint32_t)len * 10000U) + baud - 1U) / baud;
+}
+
+// Stores host-written tuning once the writes have stopped for a while.
+static uint32_t ups_tuning_task(uint32_t now_ms)
+{
+    return ups_tuning_flush(now_ms);
+}
+
+static void ups_sched_init(void)
+{
+    uint32_t const now_ms = HAL_GetTick();
+
+    // USB first: a setting written by the host in this pass reaches the
+    // engine task in the same pass.
+    s_usb_task_id = task_sched_add(ups_usb_task, TASK_SCHED_EVENT_USB | TASK_SCHED_EVENT_UART, 0U, now_ms);
+    (void)task_sched_add(ups_engine_task, TASK_SCHED_EVENT_UART | TASK_SCHED_EVENT_USB, 0U, now_ms);
+    s_led_task_id = task_sched_add(ups_led_task, 0U, 0U, now_ms);
+    (void)task_sched_add(ups_watchdog_task, 0U, 0U, now_ms);
+    (void)task_sched_add(ups_debug_status_print_task, 0U, 0U, now_ms);
+    (void)task_sched_add(ups_log_drain_task, TASK_SCHED_EVENT_LOG, 0U, now_ms);
+    (void)task_sched_add(ups_tuning_task, TASK_SCHED_EVENT_TUNING, TASK_SCHED_NEVER, now_ms);
+}
 
 int _write(int file, char *ptr, int len)
 {
@@ -749,9 +1618,9 @@ int _write(int file, char *ptr, int len)
         return 0;
     }
 
-    // Route stdout to USART1 so a separate USB-TTL adapter can be used as a monitor.
-    // Wiring (STM32F103): PA9=USART1_TX -> USB-TTL RX, GND shared.
-    (void)HAL_UART_Transmit(&huart1, (uint8_t *)ptr, (uint16_t)len, 200U);
+    // Plain stdout (printf) is queued as text records; the log drain sends it
+    // with everything else instead of blocking here.
+    log_ring_write_text(ptr, (uint16_t)len);
     return len;
 }
 /* USER CODE END 0 */
@@ -779,6 +1648,8 @@ int main(void)
     SystemClock_Config();
 
     /* USER CODE BEGIN SysInit */
+    ups_diag_init();
+    ups_tuning_init();
 
     /* USER CODE END SysInit */
 
@@ -793,13 +1664,28 @@ int main(void)
     }
 #endif
 
+    ups_state_init();
     MX_USART1_UART_Init();
     MX_USART2_UART_Init();
-    UART2_RxStartIT();
+#if (UPS_PORT_COUNT > 1U)
+    MX_USART3_UART_Init();
+#endif
     uart_engine_init();
-    uart_engine_set_enabled(s_uart_engine_enabled);
-    ups_sub_adapter_select();
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        UPS_UART_RxStartIT(port);
+        uart_engine_set_enabled(port, s_uart_engine_enabled);
+    }
+    ups_autodetect_init();
+#if (UPS_CACHE_ENABLED != 0)
+    if (ups_cache_restore())
+    {
+        // Known UPS: enumerate now, the bootstrap revalidates in the background.
+        g_usb_init_enabled = true;
+    }
+#endif
     MX_IWDG_Init();
+    ups_sched_init();
 
     /* Infinite loop */
     /* USER CODE BEGIN WHILE */
@@ -807,18 +1693,10 @@ int main(void)
     {
         /* USER CODE END WHILE */
 
-        usb_start_if_enabled();
-        if (s_usb_started) {
-            tud_task(); // TinyUSB device task
-            ups_hid_periodic_task();
-
-        }
-        ups_bootstrap_task();
-        ups_dynamic_update_task();
-        ups_debug_status_print_task();
-        ups_led_task();
-        uart_engine_tick();
-        watchdog_refresh();
+        // Runs only the tasks that are due or were woken by an interrupt.
+        ups_diag_pass_begin();
+        (void)task_sched_run(HAL_GetTick());
+        ups_diag_pass_end(HAL_GetTick());
         ups_idle_sleep();
     }
     /* USER CODE END 3 */
@@ -875,6 +1753,57 @@ void SystemClock_Config(void)
     HAL_RCC_EnableCSS();
 }
 
+// The UART rates are divided from the APB clocks, so their dividers are set
+// again after a clock change. BRR can be written with the UART running; at
+// worst the character on the line is lost and the engine retries the job.
+static void uart_reclock(UART_HandleTypeDef *huart)
+{
+    uint32_t const pclk = (huart->Instance == USART1) ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+    huart->Instance->BRR = UART_BRR_SAMPLING16(pclk, huart->Init.BaudRate);
+}
+
+static void uart_reclock_all(void)
+{
+    uart_reclock(&huart1);
+    uart_reclock(&huart2);
+#if (UPS_PORT_COUNT > 1U)
+    uart_reclock(&huart3);
+#endif
+}
+
+// USB suspend: run from the HSE at 8 MHz on every bus and stop the PLL,
+// which also stops the 48 MHz USB clock (allowed while suspended, the cell
+// sees resume and reset without it). HSI stays on for flash writes.
+// HAL_RCC_ClockConfig() sets the SysTick up for 1 ms at the new rate.
+void power_mode_clock_low(void)
+{
+    RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+    RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+    RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSE;
+    RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
+    RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
+    RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
+    if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
+    {
+        return;
+    }
+
+    RCC_OscInitTypeDef RCC_OscInitStruct = {0};
+    RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_NONE;
+    RCC_OscInitStruct.PLL.PLLState = RCC_PLL_OFF;
+    (void)HAL_RCC_OscConfig(&RCC_OscInitStruct);
+
+    uart_reclock_all();
+}
+
+// Resume or remote wakeup: back to the boot clocks, PLL and USB clock
+// included.
+void power_mode_clock_run(void)
+{
+    SystemClock_Config();
+    uart_reclock_all();
+}
+
 /**
  * @brief USART2 Initialization Function
  * @param None
@@ -891,7 +1820,7 @@ static void MX_USART2_UART_Init(void)
 
     /* USER CODE END USART2_Init 1 */
     huart2.Instance = USART2;
-    huart2.Init.BaudRate = 2400;
+    huart2.Init.BaudRate = UPS_UART_BAUD;
     huart2.Init.WordLength = UART_WORDLENGTH_8B;
     huart2.Init.StopBits = UART_STOPBITS_1;
     huart2.Init.Parity = UART_PARITY_NONE;
@@ -907,6 +1836,29 @@ static void MX_USART2_UART_Init(void)
     /* USER CODE END USART2_Init 2 */
 }
 
+#if (UPS_PORT_COUNT > 1U)
+/**
+ * @brief USART3 Initialization Function (second UPS, same settings as USART2)
+ * @param None
+ * @retval None
+ */
+static void MX_USART3_UART_Init(void)
+{
+    huart3.Instance = USART3;
+    huart3.Init.BaudRate = UPS_UART_BAUD;
+    huart3.Init.WordLength = UART_WORDLENGTH_8B;
+    huart3.Init.StopBits = UART_STOPBITS_1;
+    huart3.Init.Parity = UART_PARITY_NONE;
+    huart3.Init.Mode = UART_MODE_TX_RX;
+    huart3.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+    huart3.Init.OverSampling = UART_OVERSAMPLING_16;
+    if (HAL_UART_Init(&huart3) != HAL_OK)
+    {
+        Error_Handler();
+    }
+}
+#endif
+
 /**
  * @brief USART1 Initialization Function (monitor/printf output)
  * @param None
@@ -976,7 +1928,8 @@ static void MX_IWDG_Init(void)
     uint32_t iwdg_prescaler = IWDG_PRESCALER_256;
     uint32_t iwdg_reload = 4095U;
 
-    iwdg_compute_config(UPS_IWDG_TIMEOUT_MS, &iwdg_prescaler, &iwdg_reload);
+    s_iwdg_timeout_ms = ups_tuning_get()->iwdg_timeout_ms;
+    iwdg_compute_config(s_iwdg_timeout_ms, &iwdg_prescaler, &iwdg_reload);
 
     hiwdg.Instance = IWDG;
     hiwdg.Init.Prescaler = iwdg_prescaler;
@@ -0,0 +1,407 @@
+#include "megatec.h"
+
+#include "ups_data.h"
+#include "usb_descriptors.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MEGATEC_CMD_TIMEOUT_MS 500U
+#define MEGATEC_CMD_RETRIES 0U
+// Q1 replies are 47 bytes, F 22, I 39.
+#define MEGATEC_LINE_MAX_LEN 64U
+#define MEGATEC_Q1_FIELD_COUNT 8U
+#define MEGATEC_F_FIELD_COUNT 4U
+#define MEGATEC_STATUS_BITS 8U
+
+// Charge estimate, per 2 V lead-acid cell. Same defaults as NUT's blazer
+// driver (10.4 V .. 13.0 V for a 12 V block).
+#ifndef MEGATEC_CELL_EMPTY_MV
+#define MEGATEC_CELL_EMPTY_MV 1733U
+#endif
+#ifndef MEGATEC_CELL_FULL_MV
+#define MEGATEC_CELL_FULL_MV 2167U
+#endif
+
+// Runtime estimate: seconds a full battery lasts at 100% load. Scaled by
+// charge and inversely by load (at least MEGATEC_RUNTIME_MIN_LOAD_PCT).
+#ifndef MEGATEC_RUNTIME_FULL_LOAD_S
+#define MEGATEC_RUNTIME_FULL_LOAD_S 300U
+#endif
+#ifndef MEGATEC_RUNTIME_MIN_LOAD_PCT
+#define MEGATEC_RUNTIME_MIN_LOAD_PCT 10U
+#endif
+
+// Status bits, b7 first in the reply.
+#define MEGATEC_BIT_UTILITY_FAIL 7U
+#define MEGATEC_BIT_BATTERY_LOW 6U
+#define MEGATEC_BIT_SHUTDOWN_ACTIVE 1U
+
+// Ratings from F, needed to scale Q1 values. One per port.
+typedef struct
+{
+    uint16_t current_a;
+    uint16_t battery_cv; // 0 until F has been answered
+} megatec_rating_t;
+
+static megatec_rating_t s_megatec_rating[UPS_PORT_COUNT];
+
+const uart_engine_request_t g_megatec_constant_lut[] = {
+    { .out_value = NULL, .cmd = (uint16_t)0x46U, .cmd_bits = 8U, .cmd_suffix_len = 1U, .cmd_suffix_bytes = {0x0DU}, .expected_len = MEGATEC_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 1U, .expected_ending_bytes = {0x0DU}, .timeout_ms = MEGATEC_CMD_TIMEOUT_MS, .max_retries = MEGATEC_CMD_RETRIES, .process_fn = megatec_process_rating },
+    { .out_value = NULL, .cmd = (uint16_t)0x49U, .cmd_bits = 8U, .cmd_suffix_len = 1U, .cmd_suffix_bytes = {0x0DU}, .expected_len = MEGATEC_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 1U, .expected_ending_bytes = {0x0DU}, .timeout_ms = MEGATEC_CMD_TIMEOUT_MS, .max_retries = MEGATEC_CMD_RETRIES, .process_fn = megatec_process_info },
+};
+
+const size_t g_megatec_constant_lut_count = sizeof(g_megatec_constant_lut) / sizeof(g_megatec_constant_lut[0]);
+
+const uart_engine_request_t g_megatec_dynamic_lut[] = {
+    { .out_value = NULL, .cmd = (uint16_t)0x5131U, .cmd_bits = 16U, .cmd_suffix_len = 1U, .cmd_suffix_bytes = {0x0DU}, .expected_len = MEGATEC_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 1U, .expected_ending_bytes = {0x0DU}, .timeout_ms = MEGATEC_CMD_TIMEOUT_MS, .max_retries = MEGATEC_CMD_RETRIES, .process_fn = megatec_process_status },
+};
+
+const size_t g_megatec_dynamic_lut_count = sizeof(g_megatec_dynamic_lut) / sizeof(g_megatec_dynamic_lut[0]);
+
+// F first: the capacity estimate in Q1 needs the rated battery voltage.
+const uart_engine_request_t g_megatec_minimum_lut[] = {
+    { .out_value = NULL, .cmd = (uint16_t)0x46U, .cmd_bits = 8U, .cmd_suffix_len = 1U, .cmd_suffix_bytes = {0x0DU}, .expected_len = MEGATEC_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 1U, .expected_ending_bytes = {0x0DU}, .timeout_ms = MEGATEC_CMD_TIMEOUT_MS, .max_retries = MEGATEC_CMD_RETRIES, .process_fn = megatec_process_rating },
+    { .out_value = NULL, .cmd = (uint16_t)0x5131U, .cmd_bits = 16U, .cmd_suffix_len = 1U, .cmd_suffix_bytes = {0x0DU}, .expected_len = MEGATEC_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 1U, .expected_ending_bytes = {0x0DU}, .timeout_ms = MEGATEC_CMD_TIMEOUT_MS, .max_retries = MEGATEC_CMD_RETRIES, .process_fn = megatec_process_status },
+};
+
+const size_t g_megatec_minimum_lut_count = sizeof(g_megatec_minimum_lut) / sizeof(g_megatec_minimum_lut[0]);
+
+const uart_engine_request_t g_megatec_constant_heartbeat =
+    { .out_value = NULL, .cmd = (uint16_t)0x5131U, .cmd_bits = 16U, .cmd_suffix_len = 1U, .cmd_suffix_bytes = {0x0DU}, .expected_len = MEGATEC_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 1U, .expected_ending_bytes = {0x0DU}, .timeout_ms = MEGATEC_CMD_TIMEOUT_MS, .max_retries = MEGATEC_CMD_RETRIES, .process_fn = NULL };
+
+const uint8_t g_megatec_constant_heartbeat_expect_return[] = {0x28U}; // "("
+const size_t g_megatec_constant_heartbeat_expect_return_len = sizeof(g_megatec_constant_heartbeat_expect_return);
+
+// Copies the reply without its lead byte ('(' or '#') and trailing CR.
+static bool megatec_extract_text(const uint8_t *rx, uint16_t rx_len, char lead, char *out, size_t out_size)
+{
+    if ((rx == NULL) || (out == NULL) || (rx_len < 3U) || (rx[0] != (uint8_t)lead) || (rx[rx_len - 1U] != 0x0DU))
+    {
+        return false;
+    }
+
+    size_t const payload_len = (size_t)rx_len - 2U;
+    if (payload_len >= out_size)
+    {
+        return false;
+    }
+
+    for (size_t i = 0U; i < payload_len; ++i)
+    {
+        uint8_t const c = rx[i + 1U];
+        if ((c < 0x20U) || (c > 0x7EU))
+        {
+            return false;
+        }
+        out[i] = (char)c;
+    }
+    out[payload_len] = '\0';
+    return true;
+}
+
+// Splits text in place at spaces. Returns the number of fields found, at
+// most max_fields; runs of spaces count as one separator.
+static uint8_t megatec_split(char *text, char **fields, uint8_t max_fields)
+{
+    uint8_t count = 0U;
+    char *cursor = text;
+
+    while (*cursor != '\0')
+    {
+        while (*cursor == ' ')
+        {
+            *cursor++ = '\0';
+        }
+        if (*cursor == '\0')
+        {
+            break;
+        }
+        if (count == max_fields)
+        {
+            return (uint8_t)(max_fields + 1U); // too many fields
+        }
+        fields[count++] = cursor;
+        while ((*cursor != ' ') && (*cursor != '\0'))
+        {
+            cursor++;
+        }
+    }
+    return count;
+}
+
+// "[-]digits[.digits]" scaled by 10^fraction_digits; surplus fraction digits
+// are truncated. At most 9 digits are accepted, so 32 bits never overflow.
+static bool megatec_parse_fixed(const char *text,
+                                uint8_t fraction_digits,
+                                int32_t min_value,
+                                int32_t max_value,
+                                int32_t *out_value)
+{
+    bool negative = false;
+    bool seen_digit = false;
+    bool in_fraction = false;
+    uint8_t digits = 0U;
+    uint8_t kept_fraction = 0U;
+    int32_t value = 0;
+
+    if (*text == '-')
+    {
+        negative = true;
+        text++;
+    }
+
+    for (; *text != '\0'; text++)
+    {
+        char const c = *text;
+        if ((c == '.') && !in_fraction && seen_digit)
+        {
+            in_fraction = true;
+            continue;
+        }
+        if ((c < '0') || (c > '9') || (++digits > 9U))
+        {
+            return false;
+        }
+        seen_digit = true;
+        if (in_fraction)
+        {
+            if (kept_fraction == fraction_digits)
+            {
+                continue;
+            }
+            kept_fraction++;
+        }
+        value = (value * 10) + (int32_t)(c - '0');
+    }
+
+    if (!seen_digit)
+    {
+        return false;
+    }
+
+    for (; kept_fraction < fraction_digits; kept_fraction++)
+    {
+        if (value > (INT32_MAX / 10))
+        {
+            return false;
+        }
+        value *= 10;
+    }
+
+    if (negative)
+    {
+        value = -value;
+    }
+    if ((value < min_value) || (value > max_value))
+    {
+        return false;
+    }
+
+    *out_value = value;
+    return true;
+}
+
+static uint8_t megatec_estimate_capacity(uint16_t battery_cv, uint16_t cells)
+{
+    uint32_t const cell_mv = ((uint32_t)battery_cv * 10U) / cells;
+    if (cell_mv <= MEGATEC_CELL_EMPTY_MV)
+    {
+        return 0U;
+    }
+    if (cell_mv >= MEGATEC_CELL_FULL_MV)
+    {
+        return 100U;
+    }
+    return (uint8_t)(((cell_mv - MEGATEC_CELL_EMPTY_MV) * 100U) / (MEGATEC_CELL_FULL_MV - MEGATEC_CELL_EMPTY_MV));
+}
+
+bool megatec_process_status(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+    (void)out_value;
+
+    char text[MEGATEC_LINE_MAX_LEN];
+    char *fields[MEGATEC_Q1_FIELD_COUNT];
+    if (!megatec_extract_text(rx, rx_len, '(', text, sizeof(text)) ||
+        (megatec_split(text, fields, MEGATEC_Q1_FIELD_COUNT) != MEGATEC_Q1_FIELD_COUNT) ||
+        (strlen(fields[7]) != MEGATEC_STATUS_BITS))
+    {
+        return false;
+    }
+
+    int32_t input_cv = 0;
+    int32_t output_cv = 0;
+    int32_t load_pct = 0;
+    int32_t input_chz = 0;
+    int32_t battery_cv = 0;
+    if (!megatec_parse_fixed(fields[0], 2U, 0, UINT16_MAX, &input_cv) ||
+        !megatec_parse_fixed(fields[2], 2U, 0, UINT16_MAX, &output_cv) ||
+        !megatec_parse_fixed(fields[3], 0U, 0, 999, &load_pct) ||
+        !megatec_parse_fixed(fields[4], 2U, 0, UINT16_MAX, &input_chz) ||
+        !megatec_parse_fixed(fields[5], 2U, 0, UINT16_MAX, &battery_cv))
+    {
+        return false;
+    }
+
+    uint8_t bits = 0U;
+    for (uint8_t i = 0U; i < MEGATEC_STATUS_BITS; i++)
+    {
+        char const c = fields[7][i];
+        if ((c != '0') && (c != '1'))
+        {
+            return false;
+        }
+        bits = (uint8_t)((bits << 1) | (uint8_t)(c - '0'));
+    }
+
+    ups_state_t *ups = &g_ups[port];
+
+    // Some units have no sensor and send "--.-"; the old value is kept.
+    int32_t temperature_dc = 0;
+    if (megatec_parse_fixed(fields[6], 1U, -400, 1000, &temperature_dc))
+    {
+        ups->battery.temperature = (uint16_t)(temperature_dc + 2731);
+    }
+
+    megatec_rating_t const *rating = &s_megatec_rating[port];
+    uint16_t const cells = (uint16_t)(rating->battery_cv / 200U);
+    // Online units report the voltage of one cell (S.SS), standby units the
+    // whole string (SS.S).
+    if ((cells > 0U) && (battery_cv < (int32_t)(rating->battery_cv / 4U)))
+    {
+        battery_cv *= (int32_t)cells;
+        if (battery_cv > UINT16_MAX)
+        {
+            battery_cv = UINT16_MAX;
+        }
+    }
+
+    ups->input.voltage = (uint16_t)input_cv;
+    ups->input.frequency = (uint16_t)input_chz;
+    ups->output.voltage = (uint16_t)output_cv;
+    ups->output.percent_load = (uint8_t)((load_pct > UINT8_MAX) ? UINT8_MAX : load_pct);
+    ups->battery.battery_voltage = (uint16_t)battery_cv;
+
+    // Load is a percentage of the rated current.
+    int32_t const output_ca = load_pct * (int32_t)rating->current_a;
+    ups->output.current = (int16_t)((output_ca > INT16_MAX) ? INT16_MAX : output_ca);
+
+    if (cells > 0U)
+    {
+        ups->battery.remaining_capacity = megatec_estimate_capacity((uint16_t)battery_cv, cells);
+
+        uint32_t const load = ((uint32_t)load_pct < MEGATEC_RUNTIME_MIN_LOAD_PCT) ? MEGATEC_RUNTIME_MIN_LOAD_PCT
+                                                                                   : (uint32_t)load_pct;
+        uint32_t const runtime_s = ((uint32_t)ups->battery.remaining_capacity * MEGATEC_RUNTIME_FULL_LOAD_S) / load;
+        ups->battery.run_time_to_empty_s = (uint16_t)((runtime_s > UINT16_MAX) ? UINT16_MAX : runtime_s);
+    }
+
+    bool const utility_fail = ((bits & (1U << MEGATEC_BIT_UTILITY_FAIL)) != 0U);
+    bool const battery_low = ((bits & (1U << MEGATEC_BIT_BATTERY_LOW)) != 0U);
+    bool const shutdown_active = ((bits & (1U << MEGATEC_BIT_SHUTDOWN_ACTIVE)) != 0U);
+
+    ups->present_status.ac_present = !utility_fail;
+    ups->present_status.discharging = utility_fail;
+    ups->present_status.charging = !utility_fail && (ups->battery.remaining_capacity < 100U);
+    ups->present_status.fully_charged = (ups->battery.remaining_capacity >= 100U);
+    ups->present_status.overload = (load_pct > 100);
+    ups->present_status.below_remaining_capacity_limit = battery_low;
+    ups->present_status.shutdown_imminent = battery_low || shutdown_active;
+    ups->present_status.battery_present = true;
+
+    return true;
+}
+
+bool megatec_process_rating(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+    (void)out_value;
+
+    char text[MEGATEC_LINE_MAX_LEN];
+    char *fields[MEGATEC_F_FIELD_COUNT];
+    if (!megatec_extract_text(rx, rx_len, '#', text, sizeof(text)) ||
+        (megatec_split(text, fields, MEGATEC_F_FIELD_COUNT) != MEGATEC_F_FIELD_COUNT))
+    {
+        return false;
+    }
+
+    int32_t voltage_cv = 0;
+    int32_t current_a = 0;
+    int32_t battery_cv = 0;
+    int32_t frequency_chz = 0;
+    if (!megatec_parse_fixed(fields[0], 2U, 0, UINT16_MAX, &voltage_cv) ||
+        !megatec_parse_fixed(fields[1], 0U, 0, 999, &current_a) ||
+        !megatec_parse_fixed(fields[2], 2U, 200, UINT16_MAX, &battery_cv) ||
+        !megatec_parse_fixed(fields[3], 2U, 0, UINT16_MAX, &frequency_chz))
+    {
+        return false;
+    }
+
+    ups_state_t *ups = &g_ups[port];
+    megatec_rating_t *rating = &s_megatec_rating[port];
+    rating->current_a = (uint16_t)current_a;
+    rating->battery_cv = (uint16_t)battery_cv;
+
+    ups->input.config_voltage = (uint16_t)voltage_cv;
+    ups->output.config_voltage = (uint16_t)voltage_cv;
+    ups->battery.config_voltage = (uint16_t)battery_cv;
+    // Q1 has no output frequency; the rated one is the best there is.
+    ups->output.frequency = (uint16_t)frequency_chz;
+
+    return true;
+}
+
+static void megatec_copy_trimmed(char *dst, size_t dst_size, const char *src, size_t src_len)
+{
+    while ((src_len > 0U) && (*src == ' '))
+    {
+        src++;
+        src_len--;
+    }
+    while ((src_len > 0U) && (src[src_len - 1U] == ' '))
+    {
+        src_len--;
+    }
+    if (src_len >= dst_size)
+    {
+        src_len = dst_size - 1U;
+    }
+    memcpy(dst, src, src_len);
+    dst[src_len] = '\0';
+}
+
+// "#Company_Name UPS_Model Version": fixed 15, 10 and 10 character columns.
+bool megatec_process_info(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+    (void)out_value;
+
+    char text[MEGATEC_LINE_MAX_LEN];
+    if (!megatec_extract_text(rx, rx_len, '#', text, sizeof(text)) || (strlen(text) < 26U))
+    {
+        return false;
+    }
+
+    // The device has one manufacturer and product string; port 0's UPS names it.
+    if (port != 0U)
+    {
+        return true;
+    }
+
+    char company[16];
+    char model[11];
+    megatec_copy_trimmed(company, sizeof(company), &text[0], 15U);
+    megatec_copy_trimmed(model, sizeof(model), &text[16], 10U);
+
+    if (company[0] != '\0')
+    {
+        (void)usb_desc_set_string_ascii(USB_STRID_MANUFACTURER, company);
+    }
+    if (model[0] != '\0')
+    {
+        (void)usb_desc_set_string_ascii(USB_STRID_PRODUCT, model);
+    }
+    return true;
+}
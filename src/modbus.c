@@ -0,0 +1,301 @@
+#include "modbus.h"
+
+#include "ups_data.h"
+#include "usb_descriptors.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MODBUS_CMD_TIMEOUT_MS 500U
+#define MODBUS_CMD_RETRIES 1U
+#define MODBUS_FC_READ_HOLDING 0x03U
+// Address, function code and byte count in front of the register data.
+#define MODBUS_REPLY_HEADER_LEN 3U
+
+// Register blocks, see modbus.h.
+#define MODBUS_STATUS_START 0U
+#define MODBUS_STATUS_COUNT 23U
+#define MODBUS_MEASUREMENT_START 128U
+#define MODBUS_MEASUREMENT_COUNT 24U
+#define MODBUS_RATING_START 588U
+#define MODBUS_RATING_COUNT 8U
+
+// Offsets inside the status block.
+#define MODBUS_REG_UPS_STATUS 0U            // 32 bit
+#define MODBUS_REG_SIMPLE_SIGNALING 18U
+#define MODBUS_REG_BATTERY_SYSTEM_ERROR 22U
+#define MODBUS_UPS_STATUS_ONLINE (1UL << 1)
+#define MODBUS_UPS_STATUS_ON_BATTERY (1UL << 2)
+#define MODBUS_SIGNALING_SHUTDOWN_IMMINENT (1U << 1)
+#define MODBUS_BATTERY_ERROR_NEEDS_REPLACEMENT (1U << 2)
+
+// Offsets inside the measurement block (register - 128).
+#define MODBUS_REG_RUNTIME 0U         // 32 bit, s
+#define MODBUS_REG_CHARGE 2U          // % / 512
+#define MODBUS_REG_BATTERY_VOLTAGE 3U // signed, V / 32
+#define MODBUS_REG_TEMPERATURE 7U     // signed, C / 128
+#define MODBUS_REG_LOAD 8U            // % / 256
+#define MODBUS_REG_OUTPUT_CURRENT 12U // A / 32
+#define MODBUS_REG_OUTPUT_VOLTAGE 14U // V / 64
+#define MODBUS_REG_OUTPUT_FREQUENCY 16U // Hz / 128
+#define MODBUS_REG_INPUT_VOLTAGE 23U  // V / 64
+
+// Offsets inside the rating block (register - 588).
+#define MODBUS_REG_REAL_POWER_NOMINAL 1U // W
+#define MODBUS_REG_BATTERY_DATE 7U       // days since 2000-01-01
+
+// A function 03 read of count registers from start.
+#define MODBUS_READ_REQUEST(start, count, fn, out)                                                     \
+    { .out_value = (void *)(out), .cmd = (uint16_t)((MODBUS_UPS_ADDRESS << 8) | MODBUS_FC_READ_HOLDING), \
+      .cmd_bits = 16U, .cmd_suffix_len = 4U,                                                          \
+      .cmd_suffix_bytes = {(uint8_t)((start) >> 8), (uint8_t)((start) & 0xFFU), 0U, (uint8_t)(count)}, \
+      .modbus_crc = true, .expected_len = (uint16_t)(MODBUS_REPLY_HEADER_LEN + (2U * (count)) + 2U),  \
+      .expected_ending = false, .expected_ending_len = 0U, .expected_ending_bytes = {0},              \
+      .timeout_ms = MODBUS_CMD_TIMEOUT_MS, .max_retries = MODBUS_CMD_RETRIES, .process_fn = (fn) }
+
+// String registers hold two ASCII characters each, high byte first.
+typedef struct
+{
+    uint8_t count;
+    uint8_t usb_strid;
+} modbus_string_t;
+
+static const modbus_string_t s_modbus_string_model = { .count = 16U, .usb_strid = USB_STRID_PRODUCT };
+static const modbus_string_t s_modbus_string_serial = { .count = 8U, .usb_strid = USB_STRID_SERIAL };
+
+const uart_engine_request_t g_modbus_constant_lut[] = {
+    MODBUS_READ_REQUEST(532U, 16U, modbus_process_string, &s_modbus_string_model),
+    MODBUS_READ_REQUEST(564U, 8U, modbus_process_string, &s_modbus_string_serial),
+    MODBUS_READ_REQUEST(MODBUS_RATING_START, MODBUS_RATING_COUNT, modbus_process_rating_block, NULL),
+};
+
+const size_t g_modbus_constant_lut_count = sizeof(g_modbus_constant_lut) / sizeof(g_modbus_constant_lut[0]);
+
+// Measurements first, so the status flags see the new charge.
+const uart_engine_request_t g_modbus_dynamic_lut[] = {
+    MODBUS_READ_REQUEST(MODBUS_MEASUREMENT_START, MODBUS_MEASUREMENT_COUNT, modbus_process_measurement_block, NULL),
+    MODBUS_READ_REQUEST(MODBUS_STATUS_START, MODBUS_STATUS_COUNT, modbus_process_status_block, NULL),
+};
+
+const size_t g_modbus_dynamic_lut_count = sizeof(g_modbus_dynamic_lut) / sizeof(g_modbus_dynamic_lut[0]);
+
+// UPSStatus (2 registers): a valid reply starts with address, 03, 4 bytes.
+const uart_engine_request_t g_modbus_constant_heartbeat =
+    MODBUS_READ_REQUEST(MODBUS_STATUS_START, 2U, NULL, NULL);
+
+const uint8_t g_modbus_constant_heartbeat_expect_return[] = {(uint8_t)MODBUS_UPS_ADDRESS, MODBUS_FC_READ_HOLDING, 0x04U};
+const size_t g_modbus_constant_heartbeat_expect_return_len = sizeof(g_modbus_constant_heartbeat_expect_return);
+
+// Returns the register data of a read reply holding exactly count
+// registers, or NULL. The engine has already checked and removed the CRC.
+static const uint8_t *modbus_reply_registers(const uint8_t *rx, uint16_t rx_len, uint8_t count)
+{
+    if ((rx == NULL) ||
+        (rx_len != (uint16_t)(MODBUS_REPLY_HEADER_LEN + (2U * count))) ||
+        (rx[0] != (uint8_t)MODBUS_UPS_ADDRESS) ||
+        (rx[1] != MODBUS_FC_READ_HOLDING) ||
+        (rx[2] != (uint8_t)(2U * count)))
+    {
+        return NULL;
+    }
+    return &rx[MODBUS_REPLY_HEADER_LEN];
+}
+
+static uint16_t modbus_u16(const uint8_t *regs, uint8_t index)
+{
+    return (uint16_t)(((uint16_t)regs[2U * index] << 8) | regs[(2U * index) + 1U]);
+}
+
+static uint32_t modbus_u32(const uint8_t *regs, uint8_t index)
+{
+    return ((uint32_t)modbus_u16(regs, index) << 16) | modbus_u16(regs, (uint8_t)(index + 1U));
+}
+
+// Rescales a binary fixed-point register value: raw * scale / 2^shift.
+static int32_t modbus_scale(int32_t raw, int32_t scale, uint8_t shift)
+{
+    return (raw * scale) / (int32_t)(1L << shift);
+}
+
+static uint16_t modbus_clamp_u16(int32_t value)
+{
+    return (uint16_t)((value < 0) ? 0 : ((value > UINT16_MAX) ? UINT16_MAX : value));
+}
+
+// Days since 2000-01-01 to the HID ManufacturerDate layout
+// ((year - 1980) << 9 | month << 5 | day).
+static uint16_t modbus_days_to_hid_date(uint16_t days)
+{
+    static const uint8_t k_days_in_month[12] = {31U, 28U, 31U, 30U, 31U, 30U, 31U, 31U, 30U, 31U, 30U, 31U};
+
+    uint16_t year = 2000U;
+    for (;;)
+    {
+        uint16_t const year_days = ((year % 4U) == 0U) ? 366U : 365U; // 2000..2099
+        if (days < year_days)
+        {
+            break;
+        }
+        days = (uint16_t)(days - year_days);
+        year++;
+    }
+
+    uint8_t month = 0U;
+    for (; month < 11U; month++)
+    {
+        uint16_t const month_days = (uint16_t)(k_days_in_month[month] + (((month == 1U) && ((year % 4U) == 0U)) ? 1U : 0U));
+        if (days < month_days)
+        {
+            break;
+        }
+        days = (uint16_t)(days - month_days);
+    }
+
+    return (uint16_t)(((uint16_t)(year - 1980U) << 9) | ((uint16_t)(month + 1U) << 5) | (uint16_t)(days + 1U));
+}
+
+bool modbus_process_measurement_block(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+    (void)out_value;
+
+    const uint8_t *regs = modbus_reply_registers(rx, rx_len, MODBUS_MEASUREMENT_COUNT);
+    if (regs == NULL)
+    {
+        return false;
+    }
+
+    uint32_t const runtime_s = modbus_u32(regs, MODBUS_REG_RUNTIME);
+    int32_t const charge = modbus_scale(modbus_u16(regs, MODBUS_REG_CHARGE), 1, 9);
+    int32_t const battery_cv = modbus_scale((int16_t)modbus_u16(regs, MODBUS_REG_BATTERY_VOLTAGE), 100, 5);
+    int32_t const temperature_dc = modbus_scale((int16_t)modbus_u16(regs, MODBUS_REG_TEMPERATURE), 10, 7);
+    int32_t const load = modbus_scale(modbus_u16(regs, MODBUS_REG_LOAD), 1, 8);
+    int32_t const output_ca = modbus_scale(modbus_u16(regs, MODBUS_REG_OUTPUT_CURRENT), 100, 5);
+    int32_t const output_cv = modbus_scale(modbus_u16(regs, MODBUS_REG_OUTPUT_VOLTAGE), 100, 6);
+    int32_t const output_chz = modbus_scale(modbus_u16(regs, MODBUS_REG_OUTPUT_FREQUENCY), 100, 7);
+    int32_t const input_cv = modbus_scale(modbus_u16(regs, MODBUS_REG_INPUT_VOLTAGE), 100, 6);
+
+    ups_state_t *ups = &g_ups[port];
+    ups->battery.run_time_to_empty_s = (uint16_t)((runtime_s > UINT16_MAX) ? UINT16_MAX : runtime_s);
+    ups->battery.remaining_capacity = (uint8_t)((charge > 100) ? 100 : charge);
+    ups->battery.battery_voltage = modbus_clamp_u16(battery_cv);
+    ups->battery.temperature = modbus_clamp_u16(temperature_dc + 2731);
+    ups->output.percent_load = (uint8_t)((load > UINT8_MAX) ? UINT8_MAX : load);
+    ups->output.current = (int16_t)((output_ca > INT16_MAX) ? INT16_MAX : output_ca);
+    ups->output.voltage = modbus_clamp_u16(output_cv);
+    ups->output.frequency = modbus_clamp_u16(output_chz);
+    ups->input.voltage = modbus_clamp_u16(input_cv);
+
+    return true;
+}
+
+bool modbus_process_status_block(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+    (void)out_value;
+
+    const uint8_t *regs = modbus_reply_registers(rx, rx_len, MODBUS_STATUS_COUNT);
+    if (regs == NULL)
+    {
+        return false;
+    }
+
+    uint32_t const status = modbus_u32(regs, MODBUS_REG_UPS_STATUS);
+    uint16_t const signaling = modbus_u16(regs, MODBUS_REG_SIMPLE_SIGNALING);
+    uint16_t const battery_error = modbus_u16(regs, MODBUS_REG_BATTERY_SYSTEM_ERROR);
+
+    bool const on_battery = ((status & MODBUS_UPS_STATUS_ON_BATTERY) != 0U);
+    bool const online = ((status & MODBUS_UPS_STATUS_ONLINE) != 0U);
+    bool const shutdown_imminent = ((signaling & MODBUS_SIGNALING_SHUTDOWN_IMMINENT) != 0U);
+
+    ups_state_t *ups = &g_ups[port];
+    // There is no input frequency register; on line the output follows it.
+    ups->input.frequency = (online && !on_battery) ? ups->output.frequency : 0U;
+
+    ups->present_status.ac_present = !on_battery;
+    ups->present_status.discharging = on_battery;
+    ups->present_status.charging = !on_battery && (ups->battery.remaining_capacity < 100U);
+    ups->present_status.fully_charged = (ups->battery.remaining_capacity >= 100U);
+    ups->present_status.overload = (ups->output.percent_load > 100U);
+    ups->present_status.below_remaining_capacity_limit =
+        shutdown_imminent || (on_battery && (ups->battery.remaining_capacity <= ups->summary.remaining_capacity_limit));
+    ups->present_status.shutdown_imminent = shutdown_imminent;
+    ups->present_status.need_replacement = ((battery_error & MODBUS_BATTERY_ERROR_NEEDS_REPLACEMENT) != 0U);
+    ups->present_status.battery_present = true;
+
+    return true;
+}
+
+bool modbus_process_rating_block(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+    (void)out_value;
+
+    const uint8_t *regs = modbus_reply_registers(rx, rx_len, MODBUS_RATING_COUNT);
+    if (regs == NULL)
+    {
+        return false;
+    }
+
+    ups_state_t *ups = &g_ups[port];
+    ups->output.config_active_power = modbus_u16(regs, MODBUS_REG_REAL_POWER_NOMINAL);
+
+    uint16_t const battery_date = modbus_u16(regs, MODBUS_REG_BATTERY_DATE);
+    if ((battery_date != 0U) && (battery_date < (100U * 365U)))
+    {
+        ups->battery.manufacturer_date = modbus_days_to_hid_date(battery_date);
+    }
+    return true;
+}
+
+bool modbus_process_string(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+
+    const modbus_string_t *desc = (const modbus_string_t *)out_value;
+    if (desc == NULL)
+    {
+        return false;
+    }
+
+    const uint8_t *regs = modbus_reply_registers(rx, rx_len, desc->count);
+    if (regs == NULL)
+    {
+        return false;
+    }
+
+    char text[33];
+    size_t len = (size_t)desc->count * 2U;
+    if (len >= sizeof(text))
+    {
+        len = sizeof(text) - 1U;
+    }
+
+    for (size_t i = 0U; i < len; i++)
+    {
+        char const c = (char)regs[i];
+        if (c == '\0')
+        {
+            len = i;
+            break;
+        }
+        if ((c < 0x20) || (c > 0x7E))
+        {
+            return false;
+        }
+        text[i] = c;
+    }
+    while ((len > 0U) && (text[len - 1U] == ' '))
+    {
+        len--;
+    }
+    text[len] = '\0';
+
+    // The device has one product and serial string; port 0's UPS names it.
+    if ((port != 0U) || (len == 0U))
+    {
+        return true;
+    }
+    return usb_desc_set_string_ascii(desc->usb_strid, text);
+}
@@ -0,0 +1,81 @@
+#include "power_mode.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+static power_mode_t s_mode = POWER_MODE_RUN;
+static power_mode_stats_t s_stats;
+static uint32_t s_low_since_ms = 0U;
+
+static void power_mode_enter(power_mode_t mode, uint32_t now_ms)
+{
+    if (mode == s_mode)
+    {
+        return;
+    }
+
+    if (mode == POWER_MODE_SUSPEND)
+    {
+        power_mode_clock_low();
+        s_stats.suspends++;
+        s_low_since_ms = now_ms;
+    }
+    else if (s_mode == POWER_MODE_SUSPEND)
+    {
+        power_mode_clock_run();
+        s_stats.low_power_ms += now_ms - s_low_since_ms;
+    }
+    s_mode = mode;
+}
+
+void power_mode_usb_suspend(uint32_t now_ms)
+{
+#if (POWER_MODE_SUSPEND_ENABLED != 0)
+    power_mode_enter(POWER_MODE_SUSPEND, now_ms);
+#else
+    (void)now_ms;
+#endif
+}
+
+void power_mode_usb_resume(uint32_t now_ms)
+{
+    power_mode_enter(POWER_MODE_RUN, now_ms);
+}
+
+void power_mode_wake(uint32_t now_ms)
+{
+    if (s_mode == POWER_MODE_SUSPEND)
+    {
+        s_stats.wakes++;
+        power_mode_enter(POWER_MODE_WAKING, now_ms);
+    }
+}
+
+power_mode_t power_mode_get(void)
+{
+    return s_mode;
+}
+
+bool power_mode_alerts_only(void)
+{
+    return s_mode == POWER_MODE_SUSPEND;
+}
+
+uint32_t power_mode_poll_period_ms(uint32_t period_ms)
+{
+    return (s_mode == POWER_MODE_SUSPEND) ? (period_ms * POWER_MODE_SUSPEND_POLL_FACTOR) : period_ms;
+}
+
+void power_mode_get_stats(uint32_t now_ms, power_mode_stats_t *out)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+    *out = s_stats;
+    if (s_mode == POWER_MODE_SUSPEND)
+    {
+        out->low_power_ms += now_ms - s_low_since_ms;
+    }
+}
@@ -4,7 +4,6 @@
 #include "ups_hid_reports.h"
 #include "usb_descriptors.h"
 
-#include <ctype.h>
 #include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -13,6 +12,17 @@
 #define SPM2K_CMD_LINE_TIMEOUT_MS 500U
 #define SPM2K_CMD_LINE_RETRIES 0U
 #define SPM2K_LINE_MAX_LEN 40U
+// Longest numeric reply payload (CRLF excluded) accepted for a spm2k_field_t.
+#define SPM2K_NUMBER_MAX_LEN 15U
+
+// Setting write-behind: '-' steps a setting to its next value.
+#define SPM2K_CMD_NEXT_VALUE 0x2DU
+// Steps tried before a write gives up. UPS value lists are shorter than this,
+// so a value not reached by then is not supported by the UPS.
+#ifndef SPM2K_SETTING_MAX_STEPS
+#define SPM2K_SETTING_MAX_STEPS 8U
+#endif
+#define SPM2K_SETTING_NO_VALUE UINT16_MAX
 
 static bool spm2k_rx_has_crlf(const uint8_t *rx, uint16_t rx_len);
 static bool spm2k_extract_text(const uint8_t *rx,
@@ -20,51 +30,79 @@ static bool spm2k_extract_text(const uint8_t *rx,
                                bool require_crlf,
                                char *out,
                                size_t out_size);
-static bool spm2k_parse_scaled_int(const char *text,
-                                   int32_t scale,
-                                   int32_t min_value,
-                                   int32_t max_value,
-                                   int32_t *out_value);
+static bool spm2k_parse_fixed(const uint8_t *text,
+                              size_t text_len,
+                              uint8_t fraction_digits,
+                              int32_t min_value,
+                              int32_t max_value,
+                              int32_t *out_value);
 static bool spm2k_parse_hex_byte(const char *text, uint8_t *out_value);
 static bool spm2k_get_csv_field(const char *csv,
                                 uint8_t field_index,
                                 char *out,
                                 size_t out_size);
+static void spm2k_on_remaining_capacity(ups_state_t *ups, int32_t percent);
+static void spm2k_on_battery_current(ups_state_t *ups, int32_t current_x100);
+static bool spm2k_process_warning_minutes(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+static bool spm2k_process_setting_voltage(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+static bool spm2k_process_edit_ack(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+
+static const spm2k_field_t s_spm2k_field_low_voltage_transfer = { .dest_offset = UPS_STATE_OFFSET(input.low_voltage_transfer), .fraction_digits = 2U, .min_value = 0, .max_value = UINT16_MAX, .width = SPM2K_FIELD_U16 };
+static const spm2k_field_t s_spm2k_field_high_voltage_transfer = { .dest_offset = UPS_STATE_OFFSET(input.high_voltage_transfer), .fraction_digits = 2U, .min_value = 0, .max_value = UINT16_MAX, .width = SPM2K_FIELD_U16 };
+static const spm2k_field_t s_spm2k_field_battery_voltage = { .dest_offset = UPS_STATE_OFFSET(battery.battery_voltage), .fraction_digits = 2U, .min_value = 0, .max_value = UINT16_MAX, .width = SPM2K_FIELD_U16 };
+static const spm2k_field_t s_spm2k_field_battery_current = { .dest_offset = UPS_STATE_OFFSET(battery.battery_current), .fraction_digits = 2U, .min_value = INT16_MIN, .max_value = INT16_MAX, .width = SPM2K_FIELD_I16, .on_stored = spm2k_on_battery_current };
+static const spm2k_field_t s_spm2k_field_temperature = { .dest_offset = UPS_STATE_OFFSET(battery.temperature), .fraction_digits = 1U, .min_value = -2731, .max_value = 5000, .offset = 2731, .width = SPM2K_FIELD_U16 };
+static const spm2k_field_t s_spm2k_field_remaining_capacity = { .dest_offset = UPS_STATE_OFFSET(battery.remaining_capacity), .fraction_digits = 1U, .min_value = 0, .max_value = 1000, .divisor = 10, .width = SPM2K_FIELD_U8, .on_stored = spm2k_on_remaining_capacity };
+static const spm2k_field_t s_spm2k_field_input_voltage = { .dest_offset = UPS_STATE_OFFSET(input.voltage), .fraction_digits = 2U, .min_value = 0, .max_value = UINT16_MAX, .width = SPM2K_FIELD_U16 };
+static const spm2k_field_t s_spm2k_field_input_frequency = { .dest_offset = UPS_STATE_OFFSET(input.frequency), .fraction_digits = 2U, .min_value = 0, .max_value = UINT16_MAX, .width = SPM2K_FIELD_U16 };
+static const spm2k_field_t s_spm2k_field_percent_load = { .dest_offset = UPS_STATE_OFFSET(output.percent_load), .fraction_digits = 2U, .min_value = 0, .max_value = 10000, .divisor = 100, .width = SPM2K_FIELD_U8 };
+static const spm2k_field_t s_spm2k_field_output_voltage = { .dest_offset = UPS_STATE_OFFSET(output.voltage), .fraction_digits = 2U, .min_value = 0, .max_value = UINT16_MAX, .width = SPM2K_FIELD_U16 };
+static const spm2k_field_t s_spm2k_field_output_current = { .dest_offset = UPS_STATE_OFFSET(output.current), .fraction_digits = 2U, .min_value = INT16_MIN, .max_value = INT16_MAX, .width = SPM2K_FIELD_I16 };
+static const spm2k_field_t s_spm2k_field_output_frequency = { .dest_offset = UPS_STATE_OFFSET(output.frequency), .fraction_digits = 2U, .min_value = 0, .max_value = UINT16_MAX, .width = SPM2K_FIELD_U16 };
 
 const uart_engine_request_t g_spm2k_constant_lut[] = {
-    { .out_value = &g_power_summary.i_product_2bit, .cmd = (uint16_t)0x01U, .cmd_bits = 8U, .expected_len = SPM2K_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_string },
-    { .out_value = &g_power_summary.i_serial_number_2bit, .cmd = (uint16_t)0x6EU, .cmd_bits = 8U, .expected_len = SPM2K_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_string },
+    { .out_value = NULL, .cmd = (uint16_t)0x01U, .cmd_bits = 8U, .expected_len = SPM2K_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_string },
+    { .out_value = NULL, .cmd = (uint16_t)0x6EU, .cmd_bits = 8U, .expected_len = SPM2K_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_string },
 
     { .out_value = NULL, .cmd = (uint16_t)0x9FD1U, .cmd_bits = 16U, .expected_len = SPM2K_LINE_MAX_LEN, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_rated_info },
 
-    { .out_value = &g_battery.manufacturer_date, .cmd = (uint16_t)0x78U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_manufacturer_date },
+    { .out_value = NULL, .cmd = (uint16_t)0x78U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_manufacturer_date },
 
-    { .out_value = &g_input.low_voltage_transfer, .cmd = (uint16_t)0x6CU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_voltage },
-    { .out_value = &g_input.high_voltage_transfer, .cmd = (uint16_t)0x75U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_voltage },
+    { .out_value = (void *)&s_spm2k_field_low_voltage_transfer, .cmd = (uint16_t)0x6CU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = (void *)&s_spm2k_field_high_voltage_transfer, .cmd = (uint16_t)0x75U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
 };
 
 const size_t g_spm2k_constant_lut_count = sizeof(g_spm2k_constant_lut) / sizeof(g_spm2k_constant_lut[0]);
 
 const uart_engine_request_t g_spm2k_dynamic_lut[] = {
     { .out_value = NULL, .cmd = (uint16_t)0x59U, .cmd_bits = 8U, .expected_len = 4U, .expected_ending = false, .expected_ending_len = 0U, .expected_ending_bytes = {0}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL },
-    { .out_value = &g_battery.battery_voltage, .cmd = (uint16_t)0x42U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_voltage },
-    { .out_value = &g_battery.battery_current, .cmd = (uint16_t)0x9FD4U, .cmd_bits = 16U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_bat_current },
-    { .out_value = &g_battery.run_time_to_empty_s, .cmd = (uint16_t)0x6AU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_runtime_minutes_to_seconds },
-    { .out_value = &g_battery.temperature, .cmd = (uint16_t)0x43U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_temperature_c_to_kelvin },
-    { .out_value = &g_battery.remaining_capacity, .cmd = (uint16_t)0x66U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_remaining_capacity },
+    { .out_value = (void *)&s_spm2k_field_battery_voltage, .cmd = (uint16_t)0x42U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = (void *)&s_spm2k_field_battery_current, .cmd = (uint16_t)0x9FD4U, .cmd_bits = 16U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = NULL, .cmd = (uint16_t)0x6AU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_runtime_minutes_to_seconds },
+    { .out_value = (void *)&s_spm2k_field_temperature, .cmd = (uint16_t)0x43U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = (void *)&s_spm2k_field_remaining_capacity, .cmd = (uint16_t)0x66U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
 
-    { .out_value = &g_power_summary_present_status.ac_present, .cmd = (uint16_t)0x39U, .cmd_bits = 8U, .expected_len = 2U, .expected_ending = false, .expected_ending_len = 0U, .expected_ending_bytes = {0}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_ac_present },
+    { .out_value = NULL, .cmd = (uint16_t)0x39U, .cmd_bits = 8U, .expected_len = 2U, .expected_ending = false, .expected_ending_len = 0U, .expected_ending_bytes = {0}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_ac_present },
     { .out_value = NULL, .cmd = (uint16_t)0x51U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_status_flags },
 
-    { .out_value = &g_input.voltage, .cmd = (uint16_t)0x4CU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_voltage },
-    { .out_value = &g_input.frequency, .cmd = (uint16_t)0x9FD3U, .cmd_bits = 16U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_frequency },
+    { .out_value = (void *)&s_spm2k_field_input_voltage, .cmd = (uint16_t)0x4CU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = (void *)&s_spm2k_field_input_frequency, .cmd = (uint16_t)0x9FD3U, .cmd_bits = 16U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
 
-    { .out_value = &g_output.percent_load, .cmd = (uint16_t)0x5CU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_percent_load },
-    { .out_value = &g_output.voltage, .cmd = (uint16_t)0x4FU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_voltage },
-    { .out_value = &g_output.current, .cmd = (uint16_t)0x2FU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_ac_current },
-    { .out_value = &g_output.frequency, .cmd = (uint16_t)0x46U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_frequency },
+    { .out_value = (void *)&s_spm2k_field_percent_load, .cmd = (uint16_t)0x5CU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = (void *)&s_spm2k_field_output_voltage, .cmd = (uint16_t)0x4FU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = (void *)&s_spm2k_field_output_current, .cmd = (uint16_t)0x2FU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = (void *)&s_spm2k_field_output_frequency, .cmd = (uint16_t)0x46U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
 };
 
+// Capacity first: the status flags are derived against it.
+const uart_engine_request_t g_spm2k_minimum_lut[] = {
+    { .out_value = (void *)&s_spm2k_field_remaining_capacity, .cmd = (uint16_t)0x66U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL, .feed_fn = spm2k_feed_field },
+    { .out_value = NULL, .cmd = (uint16_t)0x39U, .cmd_bits = 8U, .expected_len = 2U, .expected_ending = false, .expected_ending_len = 0U, .expected_ending_bytes = {0}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_ac_present },
+    { .out_value = NULL, .cmd = (uint16_t)0x51U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_status_flags },
+};
+
+const size_t g_spm2k_minimum_lut_count = sizeof(g_spm2k_minimum_lut) / sizeof(g_spm2k_minimum_lut[0]);
+
 const uart_engine_request_t g_spm2k_constant_heartbeat =
     { .out_value = NULL, .cmd = (uint16_t)0x59U, .cmd_bits = 8U, .expected_len = 4U, .expected_ending = false, .expected_ending_len = 0U, .expected_ending_bytes = {0}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = NULL };
 
@@ -73,6 +111,60 @@ const size_t g_spm2k_constant_heartbeat_expect_return_len = sizeof(g_spm2k_const
 
 const size_t g_spm2k_dynamic_lut_count = sizeof(g_spm2k_dynamic_lut) / sizeof(g_spm2k_dynamic_lut[0]);
 
+// Setting write-behind.
+//
+// probe reads the UPS value of the setting into the port's value; the
+// request's out_value is filled in per port when it is enqueued. The same
+// probe reads the final value back into the shadow once the write is over.
+typedef struct
+{
+    uint16_t shadow;     // UPS_STATE_OFFSET() of the uint16_t shadow, 0 = not supported
+    uint16_t resolution; // UPS step size in shadow units
+    uart_engine_request_t probe;
+} spm2k_setting_desc_t;
+
+typedef enum
+{
+    SPM2K_SETTING_IDLE = 0,
+    SPM2K_SETTING_PROBE,
+    SPM2K_SETTING_COMPARE,
+    SPM2K_SETTING_EDITED,
+    SPM2K_SETTING_FINISH,
+    SPM2K_SETTING_READBACK,
+} spm2k_setting_state_t;
+
+static const spm2k_setting_desc_t k_spm2k_settings[UPS_SETTING_COUNT] = {
+    [UPS_SETTING_LOW_VOLTAGE_TRANSFER] = {
+        .shadow = UPS_STATE_OFFSET(input.low_voltage_transfer),
+        .resolution = 100U,
+        .probe = { .out_value = NULL, .cmd = (uint16_t)0x6CU, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_setting_voltage },
+    },
+    [UPS_SETTING_HIGH_VOLTAGE_TRANSFER] = {
+        .shadow = UPS_STATE_OFFSET(input.high_voltage_transfer),
+        .resolution = 100U,
+        .probe = { .out_value = NULL, .cmd = (uint16_t)0x75U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_setting_voltage },
+    },
+    // 'q' is the low battery warning time in minutes.
+    [UPS_SETTING_REMAINING_TIME_LIMIT] = {
+        .shadow = UPS_STATE_OFFSET(battery.remaining_time_limit_s),
+        .resolution = 60U,
+        .probe = { .out_value = NULL, .cmd = (uint16_t)0x71U, .cmd_bits = 8U, .expected_len = 16U, .expected_ending = true, .expected_ending_len = 2U, .expected_ending_bytes = {0x0DU, 0x0AU}, .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS, .max_retries = SPM2K_CMD_LINE_RETRIES, .process_fn = spm2k_process_warning_minutes },
+    },
+};
+
+// One write in progress per port.
+typedef struct
+{
+    spm2k_setting_state_t state;
+    const spm2k_setting_desc_t *desc;
+    uint16_t target;
+    uint16_t value; // last probe result, SPM2K_SETTING_NO_VALUE if none
+    uint8_t steps;
+    bool edit_ok;
+} spm2k_setting_write_t;
+
+static spm2k_setting_write_t s_spm2k_setting_write[UPS_PORT_COUNT];
+
 static bool spm2k_rx_has_crlf(const uint8_t *rx, uint16_t rx_len)
 {
     if ((rx == NULL) || (rx_len < 2U))
@@ -111,7 +203,7 @@ static bool spm2k_extract_text(const uint8_t *rx,
 
     for (size_t i = 0U; i < payload_len; ++i)
     {
-        if (!isprint((int)rx[i]))
+        if ((rx[i] < 0x20U) || (rx[i] > 0x7EU))
         {
             return false;
         }
@@ -122,102 +214,194 @@ static bool spm2k_extract_text(const uint8_t *rx,
     return true;
 }
 
-static bool spm2k_parse_scaled_int(const char *text,
-                                   int32_t scale,
-                                   int32_t min_value,
-                                   int32_t max_value,
-                                   int32_t *out_value)
-{
-    if ((text == NULL) || (out_value == NULL) || (scale <= 0))
-    {
-        return false;
-    }
+static const uint32_t k_spm2k_pow10[] = {
+    1U, 10U, 100U, 1000U, 10000U, 100000U, 1000000U, 10000000U, 100000000U, 1000000000U,
+};
 
-    int32_t fraction_digits = 0;
-    int32_t tmp_scale = scale;
-    while ((tmp_scale > 1) && ((tmp_scale % 10) == 0))
-    {
-        tmp_scale /= 10;
-        fraction_digits++;
-    }
-    if (tmp_scale != 1)
-    {
-        return false;
-    }
+#define SPM2K_MAX_FRACTION_DIGITS ((uint8_t)(sizeof(k_spm2k_pow10) / sizeof(k_spm2k_pow10[0])) - 1U)
 
-    char const *cursor = text;
-    int sign = 1;
-    if (*cursor == '-')
-    {
-        sign = -1;
-        cursor++;
-    }
-    else if (*cursor == '+')
-    {
-        cursor++;
-    }
+// INT32_MAX / k_spm2k_pow10[n]: the largest integral part with n fraction digits.
+static const uint32_t k_spm2k_integral_limit[] = {
+    2147483647U, 214748364U, 21474836U, 2147483U, 214748U, 21474U, 2147U, 214U, 21U, 2U,
+};
 
-    if (!isdigit((int)*cursor))
-    {
-        return false;
-    }
+_Static_assert(sizeof(k_spm2k_integral_limit) == sizeof(k_spm2k_pow10), "one integral limit per power of ten");
+
+// Incremental fixed-point decimal parser ("[+-]digits[.digits]").
+//
+// spm2k_number_scan() consumes a run of bytes and can resume from where the
+// previous run stopped, so the same code serves the buffered path
+// (spm2k_parse_fixed) and the streaming feed path (spm2k_feed_field). Only
+// 32-bit arithmetic is used: the integral part is bounded by
+// INT32_MAX / 10^fraction_digits before every multiply.
+typedef enum
+{
+    SPM2K_NUMBER_SIGN = 0, // nothing consumed yet
+    SPM2K_NUMBER_INT_FIRST,
+    SPM2K_NUMBER_INT,
+    SPM2K_NUMBER_FRAC_FIRST,
+    SPM2K_NUMBER_FRAC,
+    SPM2K_NUMBER_CR, // streaming only: CR seen, value held in integral, LF expected
+} spm2k_number_phase_t;
+
+typedef struct
+{
+    uint32_t integral;
+    uint32_t fraction;
+    uint8_t phase;
+    uint8_t negative;
+    uint8_t captured_fraction_digits;
+    uint8_t length;
+} spm2k_number_state_t;
+
+_Static_assert(sizeof(spm2k_number_state_t) <= sizeof(uart_engine_feed_state_t),
+               "spm2k number state must fit the engine feed scratch");
+
+// Consumes the number bytes at the start of data[0..len). Returns how many
+// were consumed: all of them, or up to the first byte that cannot continue
+// the number (the caller decides whether that byte ends it). Returns
+// UINT16_MAX on overflow.
+static inline uint16_t spm2k_number_scan(spm2k_number_state_t *st, uint8_t fraction_digits, const uint8_t *data, uint16_t len)
+{
+    // Locals, so the loops keep the state in registers.
+    uint8_t phase = st->phase;
+    uint32_t integral = st->integral;
+    uint32_t fraction = st->fraction;
+    uint8_t captured = st->captured_fraction_digits;
+    size_t i = 0U;
 
-    int64_t integral = 0;
-    while (isdigit((int)*cursor))
+    if ((phase == SPM2K_NUMBER_SIGN) && (len > 0U))
     {
-        integral = (integral * 10) + (*cursor - '0');
-        if (integral > (INT32_MAX / scale))
+        phase = SPM2K_NUMBER_INT_FIRST;
+        if ((data[0] == '-') || (data[0] == '+'))
         {
-            return false;
+            st->negative = (data[0] == '-') ? 1U : 0U;
+            i++;
         }
-        cursor++;
     }
 
-    int64_t fraction = 0;
-    int32_t captured_fraction_digits = 0;
-    if (*cursor == '.')
+    if ((phase == SPM2K_NUMBER_INT_FIRST) || (phase == SPM2K_NUMBER_INT))
     {
-        cursor++;
-        if (!isdigit((int)*cursor))
+        uint32_t const integral_limit = k_spm2k_integral_limit[fraction_digits];
+        for (; i < len; i++)
         {
-            return false;
+            uint32_t const digit = (uint32_t)data[i] - (uint32_t)'0';
+            if (digit > 9U)
+            {
+                break;
+            }
+            if (integral > (integral_limit / 10U))
+            {
+                return UINT16_MAX;
+            }
+            integral = (integral * 10U) + digit;
+            if (integral > integral_limit)
+            {
+                return UINT16_MAX;
+            }
+            phase = SPM2K_NUMBER_INT;
         }
+        if ((i < len) && (phase == SPM2K_NUMBER_INT) && (data[i] == '.'))
+        {
+            phase = SPM2K_NUMBER_FRAC_FIRST;
+            i++;
+        }
+    }
 
-        while (isdigit((int)*cursor))
+    if ((phase == SPM2K_NUMBER_FRAC_FIRST) || (phase == SPM2K_NUMBER_FRAC))
+    {
+        for (; i < len; i++)
         {
-            if (captured_fraction_digits < fraction_digits)
+            uint32_t const digit = (uint32_t)data[i] - (uint32_t)'0';
+            if (digit > 9U)
             {
-                fraction = (fraction * 10) + (*cursor - '0');
-                captured_fraction_digits++;
+                break;
             }
-            cursor++;
+            if (captured < fraction_digits)
+            {
+                fraction = (fraction * 10U) + digit;
+                captured++;
+            }
+            phase = SPM2K_NUMBER_FRAC;
         }
     }
 
-    while (captured_fraction_digits < fraction_digits)
+    st->phase = phase;
+    st->integral = integral;
+    st->fraction = fraction;
+    st->captured_fraction_digits = captured;
+    return (uint16_t)i;
+}
+
+static bool spm2k_number_finish(const spm2k_number_state_t *st,
+                                uint8_t fraction_digits,
+                                int32_t min_value,
+                                int32_t max_value,
+                                int32_t *out_value)
+{
+    if ((st->phase != SPM2K_NUMBER_INT) && (st->phase != SPM2K_NUMBER_FRAC))
     {
-        fraction *= 10;
-        captured_fraction_digits++;
+        return false;
     }
 
-    if (*cursor != '\0')
+    // integral * scale <= INT32_MAX and fraction < scale, so this fits in 32 bits.
+    uint32_t const magnitude = (st->integral * k_spm2k_pow10[fraction_digits]) +
+                               (st->fraction * k_spm2k_pow10[fraction_digits - st->captured_fraction_digits]);
+    if (magnitude > ((uint32_t)INT32_MAX + ((st->negative != 0U) ? 1U : 0U)))
     {
         return false;
     }
 
-    int64_t scaled = (integral * scale) + fraction;
-    if (sign < 0)
+    int32_t const value = (st->negative != 0U) ? (int32_t)(0U - magnitude) : (int32_t)magnitude;
+    if ((value < min_value) || (value > max_value))
     {
-        scaled = -scaled;
+        return false;
     }
 
-    if ((scaled < min_value) || (scaled > max_value))
+    *out_value = value;
+    return true;
+}
+
+// Validates and parses a signed fixed-point decimal in a single pass over
+// text_len raw bytes. The result is scaled by 10^fraction_digits; surplus
+// fraction digits are truncated.
+static bool spm2k_parse_fixed(const uint8_t *text,
+                              size_t text_len,
+                              uint8_t fraction_digits,
+                              int32_t min_value,
+                              int32_t max_value,
+                              int32_t *out_value)
+{
+    if ((text == NULL) || (out_value == NULL) || (fraction_digits > SPM2K_MAX_FRACTION_DIGITS) ||
+        (text_len >= UINT16_MAX))
     {
         return false;
     }
 
-    *out_value = (int32_t)scaled;
-    return true;
+    spm2k_number_state_t st = {0};
+    if (spm2k_number_scan(&st, fraction_digits, text, (uint16_t)text_len) != text_len)
+    {
+        return false;
+    }
+
+    return spm2k_number_finish(&st, fraction_digits, min_value, max_value, out_value);
+}
+
+static int spm2k_hex_nibble(char c)
+{
+    if ((c >= '0') && (c <= '9'))
+    {
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f'))
+    {
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F'))
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
 }
 
 static bool spm2k_parse_hex_byte(const char *text, uint8_t *out_value)
@@ -232,8 +416,8 @@ static bool spm2k_parse_hex_byte(const char *text, uint8_t *out_value)
         return false;
     }
 
-    int hi = isdigit((int)text[0]) ? (text[0] - '0') : (tolower((int)text[0]) - 'a' + 10);
-    int lo = isdigit((int)text[1]) ? (text[1] - '0') : (tolower((int)text[1]) - 'a' + 10);
+    int hi = spm2k_hex_nibble(text[0]);
+    int lo = spm2k_hex_nibble(text[1]);
 
     if ((hi < 0) || (hi > 15) || (lo < 0) || (lo > 15))
     {
@@ -285,7 +469,113 @@ static bool spm2k_get_csv_field(const char *csv,
     }
 }
 
-bool spm2k_process_string(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+static void spm2k_on_remaining_capacity(ups_state_t *ups, int32_t percent)
+{
+    ups->present_status.fully_charged = (percent >= 100);
+}
+
+static void spm2k_on_battery_current(ups_state_t *ups, int32_t current_x100)
+{
+    if (current_x100 < 0)
+    {
+        ups->present_status.charging = false;
+        ups->present_status.discharging = true;
+    }
+    else if (current_x100 > 0)
+    {
+        ups->present_status.charging = true;
+        ups->present_status.discharging = false;
+    }
+}
+
+static bool spm2k_field_store(ups_state_t *ups, const spm2k_field_t *field, int32_t value)
+{
+    value += field->offset;
+    if (field->divisor > 1)
+    {
+        value /= field->divisor;
+    }
+
+    switch (field->width)
+    {
+    case SPM2K_FIELD_U8:
+        value = (value < 0) ? 0 : ((value > UINT8_MAX) ? UINT8_MAX : value);
+        *UPS_STATE_AT(ups, uint8_t, field->dest_offset) = (uint8_t)value;
+        break;
+    case SPM2K_FIELD_U16:
+        value = (value < 0) ? 0 : ((value > UINT16_MAX) ? UINT16_MAX : value);
+        *UPS_STATE_AT(ups, uint16_t, field->dest_offset) = (uint16_t)value;
+        break;
+    case SPM2K_FIELD_I16:
+        value = (value < INT16_MIN) ? INT16_MIN : ((value > INT16_MAX) ? INT16_MAX : value);
+        *UPS_STATE_AT(ups, int16_t, field->dest_offset) = (int16_t)value;
+        break;
+    default:
+        return false;
+    }
+
+    if (field->on_stored != NULL)
+    {
+        field->on_stored(ups, value);
+    }
+    return true;
+}
+
+// Numeric field parser: out_value points to the spm2k_field_t describing
+// scale, accepted range and destination. The reply is parsed run by run as
+// it is received and the value stored the moment the terminating CRLF
+// arrives.
+uart_engine_feed_result_t spm2k_feed_field(uint8_t port,
+                                           uart_engine_feed_state_t *state,
+                                           const uint8_t *data,
+                                           uint16_t len,
+                                           void *out_value)
+{
+    const spm2k_field_t *field = (const spm2k_field_t *)out_value;
+    if ((state == NULL) || (data == NULL) || (field == NULL) || (field->fraction_digits > SPM2K_MAX_FRACTION_DIGITS))
+    {
+        return UART_ENGINE_FEED_ERROR;
+    }
+
+    spm2k_number_state_t *st = (spm2k_number_state_t *)state;
+    uint16_t i = 0U;
+    if (st->phase != SPM2K_NUMBER_CR)
+    {
+        i = spm2k_number_scan(st, field->fraction_digits, data, len);
+        if ((i == UINT16_MAX) || (((uint32_t)st->length + i) > SPM2K_NUMBER_MAX_LEN))
+        {
+            return UART_ENGINE_FEED_ERROR;
+        }
+        st->length = (uint8_t)(st->length + i);
+        if (i == len)
+        {
+            return UART_ENGINE_FEED_MORE;
+        }
+
+        // The value is complete at CR; keep it until LF confirms the frame.
+        int32_t value = 0;
+        if ((data[i] != 0x0DU) ||
+            !spm2k_number_finish(st, field->fraction_digits, field->min_value, field->max_value, &value))
+        {
+            return UART_ENGINE_FEED_ERROR;
+        }
+        st->integral = (uint32_t)value;
+        st->phase = SPM2K_NUMBER_CR;
+        i++;
+        if (i == len)
+        {
+            return UART_ENGINE_FEED_MORE;
+        }
+    }
+
+    if ((data[i] != 0x0AU) || !spm2k_field_store(&g_ups[port], field, (int32_t)st->integral))
+    {
+        return UART_ENGINE_FEED_ERROR;
+    }
+    return UART_ENGINE_FEED_DONE;
+}
+
+bool spm2k_process_string(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
 {
     (void)out_value;
 
@@ -295,6 +585,12 @@ bool spm2k_process_string(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void
         return false;
     }
 
+    // The device has one product and serial string; port 0's UPS names it.
+    if (port != 0U)
+    {
+        return true;
+    }
+
     switch (cmd)
     {
     case 0x01U:
@@ -306,7 +602,7 @@ bool spm2k_process_string(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void
     }
 }
 
-bool spm2k_process_rated_info(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+bool spm2k_process_rated_info(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
 {
     (void)cmd;
     (void)out_value;
@@ -324,48 +620,46 @@ bool spm2k_process_rated_info(uint16_t cmd, const uint8_t *rx, uint16_t rx_len,
     int32_t parsed_battery_config_voltage = 0;
 
     if (!spm2k_get_csv_field(text, 0U, token, sizeof(token)) ||
-        !spm2k_parse_scaled_int(token, 1, 0, UINT16_MAX, &parsed_config_active_power))
+        !spm2k_parse_fixed((const uint8_t *)token, strlen(token), 0U, 0, UINT16_MAX, &parsed_config_active_power))
     {
         return false;
     }
 
     if (!spm2k_get_csv_field(text, 1U, token, sizeof(token)) ||
-        !spm2k_parse_scaled_int(token, 100, 0, UINT16_MAX, &parsed_input_config_voltage))
+        !spm2k_parse_fixed((const uint8_t *)token, strlen(token), 2U, 0, UINT16_MAX, &parsed_input_config_voltage))
     {
         return false;
     }
 
     if (!spm2k_get_csv_field(text, 2U, token, sizeof(token)) ||
-        !spm2k_parse_scaled_int(token, 100, 0, UINT16_MAX, &parsed_output_config_voltage))
+        !spm2k_parse_fixed((const uint8_t *)token, strlen(token), 2U, 0, UINT16_MAX, &parsed_output_config_voltage))
     {
         return false;
     }
 
     if (!spm2k_get_csv_field(text, 5U, token, sizeof(token)) ||
-        !spm2k_parse_scaled_int(token, 100, 0, UINT16_MAX, &parsed_battery_config_voltage))
+        !spm2k_parse_fixed((const uint8_t *)token, strlen(token), 2U, 0, UINT16_MAX, &parsed_battery_config_voltage))
     {
         return false;
     }
 
-    g_output.config_active_power = (uint16_t)parsed_config_active_power;
-    g_input.config_voltage = (uint16_t)parsed_input_config_voltage;
-    g_output.config_voltage = (uint16_t)parsed_output_config_voltage;
-    g_battery.config_voltage = (uint16_t)parsed_battery_config_voltage;
+    ups_state_t *ups = &g_ups[port];
+    ups->output.config_active_power = (uint16_t)parsed_config_active_power;
+    ups->input.config_voltage = (uint16_t)parsed_input_config_voltage;
+    ups->output.config_voltage = (uint16_t)parsed_output_config_voltage;
+    ups->battery.config_voltage = (uint16_t)parsed_battery_config_voltage;
 
     return true;
 }
 
-bool spm2k_process_manufacturer_date(uint16_t cmd,
+bool spm2k_process_manufacturer_date(uint8_t port,
+                                     uint16_t cmd,
                                      const uint8_t *rx,
                                      uint16_t rx_len,
                                      void *out_value)
 {
     (void)cmd;
-
-    if (out_value == NULL)
-    {
-        return false;
-    }
+    (void)out_value;
 
     char text[16];
     if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
@@ -379,295 +673,273 @@ bool spm2k_process_manufacturer_date(uint16_t cmd,
         return false;
     }
 
-    *(uint16_t *)out_value = packed_date;
+    ups_state_t *ups = &g_ups[port];
+    ups->battery.manufacturer_date = packed_date;
     return true;
 }
 
-bool spm2k_process_voltage(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+bool spm2k_process_runtime_minutes_to_seconds(uint8_t port,
+                                              uint16_t cmd,
+                                              const uint8_t *rx,
+                                              uint16_t rx_len,
+                                              void *out_value)
 {
     (void)cmd;
-
-    if (out_value == NULL)
-    {
-        return false;
-    }
+    (void)out_value;
 
     char text[16];
-    int32_t parsed = 0;
     if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
     {
         return false;
     }
 
-    if (!spm2k_parse_scaled_int(text, 100, 0, UINT16_MAX, &parsed))
-    {
-        return false;
-    }
-
-    *(uint16_t *)out_value = (uint16_t)parsed;
-    return true;
-}
-
-bool spm2k_process_frequency(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
-{
-    (void)cmd;
-
-    if (out_value == NULL)
+    char *colon = strchr(text, ':');
+    if (colon == NULL)
     {
         return false;
     }
+    *colon = '\0';
 
-    char text[16];
-    int32_t parsed = 0;
-    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
+    int32_t minutes = 0;
+    if (!spm2k_parse_fixed((const uint8_t *)text, strlen(text), 0U, 0, (INT32_MAX / 60), &minutes))
     {
         return false;
     }
 
-    if (!spm2k_parse_scaled_int(text, 100, 0, UINT16_MAX, &parsed))
+    int32_t seconds = minutes * 60;
+    if (seconds > UINT16_MAX)
     {
-        return false;
+        seconds = UINT16_MAX;
     }
 
-    *(uint16_t *)out_value = (uint16_t)parsed;
+    ups_state_t *ups = &g_ups[port];
+    ups->battery.run_time_to_empty_s = (uint16_t)seconds;
     return true;
 }
 
-bool spm2k_process_percent_load(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+bool spm2k_process_status_flags(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
 {
     (void)cmd;
+    (void)out_value;
 
-    if (out_value == NULL)
+    char text[8];
+    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
     {
         return false;
     }
 
-    char text[16];
-    int32_t parsed_x100 = 0;
-    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)) ||
-        !spm2k_parse_scaled_int(text, 100, 0, 10000, &parsed_x100))
+    uint8_t flags = 0U;
+    if (!spm2k_parse_hex_byte(text, &flags))
     {
         return false;
     }
 
-    uint8_t percent = (uint8_t)(parsed_x100 / 100);
-    *(uint8_t *)out_value = percent;
+    bool const on_line = ((flags & (1U << 3)) != 0U);
+    bool const on_battery = ((flags & (1U << 4)) != 0U);
+    bool const overload = ((flags & (1U << 5)) != 0U);
+    bool const battery_low = ((flags & (1U << 6)) != 0U);
+    bool const replace_battery = ((flags & (1U << 7)) != 0U);
+
+    ups_state_t *ups = &g_ups[port];
+    ups->present_status.ac_present = on_line && !on_battery;
+    ups->present_status.charging = on_line && !on_battery && (ups->battery.remaining_capacity < 100U);
+    ups->present_status.discharging = on_battery;
+    ups->present_status.overload = overload;
+    ups->present_status.below_remaining_capacity_limit = battery_low;
+    ups->present_status.shutdown_imminent = battery_low;
+    ups->present_status.need_replacement = replace_battery;
+    ups->present_status.battery_present = true;
+
     return true;
 }
 
-bool spm2k_process_runtime_minutes_to_seconds(uint16_t cmd,
-                                              const uint8_t *rx,
-                                              uint16_t rx_len,
-                                              void *out_value)
+bool spm2k_process_ac_present(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
 {
     (void)cmd;
+    (void)out_value;
 
-    if (out_value == NULL)
-    {
-        return false;
-    }
-
-    char text[16];
-    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
+    if ((rx == NULL) || (rx_len != 2U))
     {
         return false;
     }
 
-    char *colon = strchr(text, ':');
-    if (colon == NULL)
-    {
-        return false;
-    }
-    *colon = '\0';
+    char text[3] = {(char)rx[0], (char)rx[1], '\0'};
+    bool is_ff = ((text[0] == 'F') || (text[0] == 'f')) && ((text[1] == 'F') || (text[1] == 'f'));
+    bool is_00 = (text[0] == '0') && (text[1] == '0');
 
-    int32_t minutes = 0;
-    if (!spm2k_parse_scaled_int(text, 1, 0, (INT32_MAX / 60), &minutes))
+    if (!is_ff && !is_00)
     {
         return false;
     }
 
-    int32_t seconds = minutes * 60;
-    if (seconds > UINT16_MAX)
-    {
-        seconds = UINT16_MAX;
-    }
-
-    *(uint16_t *)out_value = (uint16_t)seconds;
+    ups_state_t *ups = &g_ups[port];
+    ups->present_status.ac_present = is_ff;
     return true;
 }
 
-bool spm2k_process_temperature_c_to_kelvin(uint16_t cmd,
-                                           const uint8_t *rx,
-                                           uint16_t rx_len,
-                                           void *out_value)
+static bool spm2k_process_warning_minutes(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
 {
+    (void)port;
     (void)cmd;
 
-    if (out_value == NULL)
+    if ((out_value == NULL) || !spm2k_rx_has_crlf(rx, rx_len))
     {
         return false;
     }
 
-    char text[16];
-    int32_t celsius_x10 = 0;
-    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)) ||
-        !spm2k_parse_scaled_int(text, 10, -2731, 5000, &celsius_x10))
+    int32_t minutes = 0;
+    if (!spm2k_parse_fixed(rx, (size_t)rx_len - 2U, 0U, 0, (UINT16_MAX / 60), &minutes))
     {
         return false;
     }
 
-    int32_t kelvin_x10 = celsius_x10 + 2731;
-    if (kelvin_x10 < 0)
-    {
-        kelvin_x10 = 0;
-    }
-    if (kelvin_x10 > UINT16_MAX)
-    {
-        kelvin_x10 = UINT16_MAX;
-    }
-
-    *(uint16_t *)out_value = (uint16_t)kelvin_x10;
+    *(uint16_t *)out_value = (uint16_t)(minutes * 60);
     return true;
 }
 
-bool spm2k_process_remaining_capacity(uint16_t cmd,
-                                      const uint8_t *rx,
-                                      uint16_t rx_len,
-                                      void *out_value)
+static bool spm2k_process_setting_voltage(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
 {
+    (void)port;
     (void)cmd;
 
-    if (out_value == NULL)
+    if ((out_value == NULL) || !spm2k_rx_has_crlf(rx, rx_len))
     {
         return false;
     }
 
-    char text[16];
-    int32_t capacity_x10 = 0;
-    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)) ||
-        !spm2k_parse_scaled_int(text, 10, 0, 1000, &capacity_x10))
+    int32_t value = 0;
+    if (!spm2k_parse_fixed(rx, (size_t)rx_len - 2U, 2U, 0, (int32_t)SPM2K_SETTING_NO_VALUE - 1, &value))
     {
         return false;
     }
 
-    uint8_t const capacity_percent = (uint8_t)(capacity_x10 / 10);
-    *(uint8_t *)out_value = capacity_percent;
-
-    g_power_summary_present_status.fully_charged = (capacity_percent >= 100U);
+    *(uint16_t *)out_value = (uint16_t)value;
     return true;
 }
 
-bool spm2k_process_status_flags(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+// The query and '-' go out as one 16-bit command so nothing can be queued
+// between them. The reply is the old value line, then "OK"; the request only
+// completes on "\r\nOK\r\n", so "NO"/"NA" ends in a timeout.
+static bool spm2k_process_edit_ack(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
 {
+    (void)port;
     (void)cmd;
-    (void)out_value;
+    (void)rx;
+    (void)rx_len;
 
-    char text[8];
-    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
-    {
-        return false;
-    }
-
-    uint8_t flags = 0U;
-    if (!spm2k_parse_hex_byte(text, &flags))
-    {
-        return false;
-    }
-
-    bool const on_line = ((flags & (1U << 3)) != 0U);
-    bool const on_battery = ((flags & (1U << 4)) != 0U);
-    bool const overload = ((flags & (1U << 5)) != 0U);
-    bool const battery_low = ((flags & (1U << 6)) != 0U);
-    bool const replace_battery = ((flags & (1U << 7)) != 0U);
+    *(bool *)out_value = true;
+    return true;
+}
 
-    g_power_summary_present_status.ac_present = on_line && !on_battery;
-    g_power_summary_present_status.charging = on_line && !on_battery && (g_battery.remaining_capacity < 100U);
-    g_power_summary_present_status.discharging = on_battery;
-    g_power_summary_present_status.overload = overload;
-    g_power_summary_present_status.below_remaining_capacity_limit = battery_low;
-    g_power_summary_present_status.shutdown_imminent = battery_low;
-    g_power_summary_present_status.need_replacement = replace_battery;
-    g_power_summary_present_status.battery_present = true;
+static bool spm2k_setting_enqueue_probe(uint8_t port, spm2k_setting_write_t *w)
+{
+    uart_engine_request_t req = w->desc->probe;
+    req.out_value = &w->value;
 
-    return true;
+    w->value = SPM2K_SETTING_NO_VALUE;
+    return (uart_engine_enqueue(port, &req) == UART_ENGINE_OK);
 }
 
-bool spm2k_process_ac_present(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+static bool spm2k_setting_enqueue_edit(uint8_t port, spm2k_setting_write_t *w)
 {
-    (void)cmd;
+    uart_engine_request_t const req = {
+        .out_value = &w->edit_ok,
+        .cmd = (uint16_t)((w->desc->probe.cmd << 8) | SPM2K_CMD_NEXT_VALUE),
+        .cmd_bits = 16U,
+        .expected_len = 16U,
+        .expected_ending = true,
+        .expected_ending_len = 6U,
+        .expected_ending_bytes = {0x0DU, 0x0AU, 0x4FU, 0x4BU, 0x0DU, 0x0AU},
+        .timeout_ms = SPM2K_CMD_LINE_TIMEOUT_MS,
+        .max_retries = 0U, // a retry could step past the value
+        .process_fn = spm2k_process_edit_ack,
+    };
+
+    w->edit_ok = false;
+    return (uart_engine_enqueue(port, &req) == UART_ENGINE_OK);
+}
 
-    if ((out_value == NULL) || (rx == NULL) || (rx_len != 2U))
+bool spm2k_setting_write_start(uint8_t port, ups_setting_t setting)
+{
+    if (port >= UPS_PORT_COUNT)
     {
         return false;
     }
 
-    char text[3] = {(char)rx[0], (char)rx[1], '\0'};
-    bool is_ff = ((text[0] == 'F') || (text[0] == 'f')) && ((text[1] == 'F') || (text[1] == 'f'));
-    bool is_00 = (text[0] == '0') && (text[1] == '0');
-
-    if (!is_ff && !is_00)
+    spm2k_setting_write_t *w = &s_spm2k_setting_write[port];
+    if ((w->state != SPM2K_SETTING_IDLE) ||
+        (setting >= UPS_SETTING_COUNT) ||
+        (k_spm2k_settings[setting].shadow == 0U))
     {
         return false;
     }
 
-    *(bool *)out_value = is_ff;
+    w->desc = &k_spm2k_settings[setting];
+    uint32_t const resolution = w->desc->resolution;
+    uint32_t const shadow = *UPS_STATE_AT(&g_ups[port], uint16_t, w->desc->shadow);
+    uint32_t const target = ((shadow + (resolution / 2U)) / resolution) * resolution;
+    w->target = (target > (UINT16_MAX - 1U)) ? (uint16_t)(UINT16_MAX - 1U) : (uint16_t)target;
+    w->steps = 0U;
+    w->state = SPM2K_SETTING_PROBE;
     return true;
 }
 
-bool spm2k_process_bat_current(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+bool spm2k_setting_write_step(uint8_t port)
 {
-    (void)cmd;
-
-    if (out_value == NULL)
+    if (port >= UPS_PORT_COUNT)
     {
         return false;
     }
 
-    char text[16];
-    int32_t parsed = 0;
-    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
-    {
-        return false;
-    }
+    spm2k_setting_write_t *w = &s_spm2k_setting_write[port];
 
-    if (!spm2k_parse_scaled_int(text, 100, INT16_MIN, INT16_MAX, &parsed))
+    switch (w->state)
     {
-        return false;
-    }
+    case SPM2K_SETTING_PROBE:
+        if (spm2k_setting_enqueue_probe(port, w))
+        {
+            w->state = SPM2K_SETTING_COMPARE;
+        }
+        break;
 
-    *(int16_t *)out_value = (int16_t)parsed;
+    case SPM2K_SETTING_COMPARE:
+        if ((w->value == SPM2K_SETTING_NO_VALUE) ||
+            (w->value == w->target) ||
+            (w->steps >= SPM2K_SETTING_MAX_STEPS))
+        {
+            w->state = SPM2K_SETTING_FINISH;
+        }
+        else if (spm2k_setting_enqueue_edit(port, w))
+        {
+            w->steps++;
+            w->state = SPM2K_SETTING_EDITED;
+        }
+        break;
 
-    if (parsed < 0)
-    {
-        g_power_summary_present_status.charging = false;
-        g_power_summary_present_status.discharging = true;
-    }
-    else if (parsed > 0)
-    {
-        g_power_summary_present_status.charging = true;
-        g_power_summary_present_status.discharging = false;
-    }
+    case SPM2K_SETTING_EDITED:
+        w->state = w->edit_ok ? SPM2K_SETTING_PROBE : SPM2K_SETTING_FINISH;
+        break;
 
-    return true;
-}
-
-bool spm2k_process_ac_current(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
-{
-    (void)cmd;
+    case SPM2K_SETTING_FINISH:
+        if (spm2k_setting_enqueue_probe(port, w))
+        {
+            w->state = SPM2K_SETTING_READBACK;
+        }
+        break;
 
-    if (out_value == NULL)
-    {
-        return false;
-    }
+    case SPM2K_SETTING_READBACK:
+        if (w->value != SPM2K_SETTING_NO_VALUE)
+        {
+            *UPS_STATE_AT(&g_ups[port], uint16_t, w->desc->shadow) = w->value;
+        }
+        w->desc = NULL;
+        w->state = SPM2K_SETTING_IDLE;
+        break;
 
-    char text[16];
-    int32_t parsed = 0;
-    if (!spm2k_extract_text(rx, rx_len, true, text, sizeof(text)) ||
-        !spm2k_parse_scaled_int(text, 100, INT16_MIN, INT16_MAX, &parsed))
-    {
-        return false;
+    case SPM2K_SETTING_IDLE:
+    default:
+        break;
     }
 
-    *(int16_t *)out_value = (int16_t)parsed;
-    return true;
+    return (w->state != SPM2K_SETTING_IDLE);
 }
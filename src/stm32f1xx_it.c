@@ -21,6 +21,7 @@
 #include "main.h"
 #include "stm32f1xx_it.h"
 #include "tusb.h"
+#include "task_sched.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 /* USER CODE END Includes */
@@ -69,7 +70,11 @@ static void fault_fail_fast_reset(void)
 
 /* External variables --------------------------------------------------------*/
 extern PCD_HandleTypeDef hpcd_USB_FS;
+extern UART_HandleTypeDef huart1;
 extern UART_HandleTypeDef huart2;
+#if (UPS_PORT_COUNT > 1U)
+extern UART_HandleTypeDef huart3;
+#endif
 /* USER CODE BEGIN EV */
 
 /* USER CODE END EV */
@@ -218,6 +223,7 @@ void USB_HP_CAN1_TX_IRQHandler(void)
   // Previous behavior (kept for reference):
   // HAL_PCD_IRQHandler(&hpcd_USB_FS);
   tud_int_handler(0);
+  task_sched_notify(TASK_SCHED_EVENT_USB);
   /* USER CODE BEGIN USB_HP_CAN1_TX_IRQn 1 */
 
   /* USER CODE END USB_HP_CAN1_TX_IRQn 1 */
@@ -228,6 +234,7 @@ void USB_HP_CAN1_TX_IRQHandler(void)
   */
 void USB_LP_CAN1_RX0_IRQHandler(void) {
     tud_int_handler(0);
+    task_sched_notify(TASK_SCHED_EVENT_USB);
 }
 /**
   * @brief This function handles USB wake-up interrupt through EXTI line 18.
@@ -250,10 +257,27 @@ void USBWakeUp_IRQHandler(void)
 }
 void OTG_FS_IRQHandler(void) {
   tud_int_handler(0);
+  task_sched_notify(TASK_SCHED_EVENT_USB);
 }
 /**
   * @brief This function handles USART2 global interrupt.
   */
+/**
+  * @brief This function handles USART1 global interrupt (log drain).
+  */
+void USART1_IRQHandler(void)
+{
+  HAL_UART_IRQHandler(&huart1);
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+  if (huart1.hdmatx != NULL)
+  {
+    HAL_DMA_IRQHandler(huart1.hdmatx);
+  }
+}
+
 void USART2_IRQHandler(void)
 {
   HAL_UART_IRQHandler(&huart2);
@@ -267,6 +291,24 @@ void DMA1_Channel7_IRQHandler(void)
   }
 }
 
+#if (UPS_PORT_COUNT > 1U)
+/**
+  * @brief This function handles USART3 global interrupt (second UPS port).
+  */
+void USART3_IRQHandler(void)
+{
+  HAL_UART_IRQHandler(&huart3);
+}
+
+void DMA1_Channel2_IRQHandler(void)
+{
+  if (huart3.hdmatx != NULL)
+  {
+    HAL_DMA_IRQHandler(huart3.hdmatx);
+  }
+}
+#endif
+
 /* USER CODE BEGIN 1 */
 
 /* USER CODE END 1 */
@@ -0,0 +1,149 @@
+#include "task_sched.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct
+{
+    task_sched_fn_t fn;
+    uint32_t events;
+    uint32_t due_ms;
+    bool armed; // due_ms is valid
+} task_sched_task_t;
+
+static task_sched_task_t s_tasks[TASK_SCHED_MAX_TASKS];
+static uint8_t s_task_count = 0U;
+
+// Earliest due_ms over the armed tasks, valid when s_any_armed.
+static uint32_t s_next_due_ms = 0U;
+static bool s_any_armed = false;
+
+// Set from interrupts, taken atomically by task_sched_run().
+static volatile uint32_t s_pending_events = 0U;
+static volatile uint32_t s_pending_wakes = 0U;
+
+static task_sched_stats_t s_stats;
+
+_Static_assert(TASK_SCHED_MAX_TASKS <= 32U, "wake mask holds one bit per task");
+
+static bool task_sched_is_due(uint32_t due_ms, uint32_t now_ms)
+{
+    return ((int32_t)(now_ms - due_ms) >= 0);
+}
+
+static void task_sched_update_next_due(void)
+{
+    s_any_armed = false;
+    for (uint8_t id = 0U; id < s_task_count; id++)
+    {
+        task_sched_task_t const *t = &s_tasks[id];
+        if (!t->armed)
+        {
+            continue;
+        }
+        if (!s_any_armed || ((int32_t)(t->due_ms - s_next_due_ms) < 0))
+        {
+            s_next_due_ms = t->due_ms;
+            s_any_armed = true;
+        }
+    }
+}
+
+static uint32_t task_sched_delay_to_next(uint32_t now_ms)
+{
+    if ((s_pending_events != 0U) || (s_pending_wakes != 0U))
+    {
+        return 0U;
+    }
+    if (!s_any_armed)
+    {
+        return TASK_SCHED_NEVER;
+    }
+    return task_sched_is_due(s_next_due_ms, now_ms) ? 0U : (s_next_due_ms - now_ms);
+}
+
+uint8_t task_sched_add(task_sched_fn_t fn, uint32_t events, uint32_t first_delay_ms, uint32_t now_ms)
+{
+    if ((fn == NULL) || (s_task_count >= TASK_SCHED_MAX_TASKS))
+    {
+        return TASK_SCHED_INVALID;
+    }
+
+    task_sched_task_t *t = &s_tasks[s_task_count];
+    t->fn = fn;
+    t->events = events;
+    t->armed = (first_delay_ms != TASK_SCHED_NEVER);
+    t->due_ms = now_ms + first_delay_ms;
+
+    uint8_t const id = s_task_count;
+    s_task_count++;
+    task_sched_update_next_due();
+    return id;
+}
+
+void task_sched_notify(uint32_t events)
+{
+    (void)__atomic_fetch_or(&s_pending_events, events, __ATOMIC_RELAXED);
+}
+
+void task_sched_wake(uint8_t id)
+{
+    if (id < TASK_SCHED_MAX_TASKS)
+    {
+        (void)__atomic_fetch_or(&s_pending_wakes, (1UL << id), __ATOMIC_RELAXED);
+    }
+}
+
+uint32_t task_sched_run(uint32_t now_ms)
+{
+    s_stats.passes++;
+
+    // Fast path: nothing raised and the earliest deadline is ahead.
+    uint32_t const delay = task_sched_delay_to_next(now_ms);
+    if (delay != 0U)
+    {
+        s_stats.idle_passes++;
+        return delay;
+    }
+
+    uint32_t const events = __atomic_exchange_n(&s_pending_events, 0U, __ATOMIC_RELAXED);
+    uint32_t const wakes = __atomic_exchange_n(&s_pending_wakes, 0U, __ATOMIC_RELAXED);
+
+    for (uint8_t id = 0U; id < s_task_count; id++)
+    {
+        task_sched_task_t *t = &s_tasks[id];
+        bool const signalled = ((t->events & events) != 0U) || ((wakes & (1UL << id)) != 0U);
+        bool const timed_out = t->armed && task_sched_is_due(t->due_ms, now_ms);
+        if (!signalled && !timed_out)
+        {
+            continue;
+        }
+
+        s_stats.runs++;
+        if (signalled && !timed_out)
+        {
+            s_stats.event_runs++;
+        }
+
+        uint32_t const next_ms = t->fn(now_ms);
+        t->armed = (next_ms != TASK_SCHED_NEVER);
+        t->due_ms = now_ms + next_ms;
+    }
+
+    task_sched_update_next_due();
+    return task_sched_delay_to_next(now_ms);
+}
+
+uint32_t task_sched_next_delay_ms(uint32_t now_ms)
+{
+    return task_sched_delay_to_next(now_ms);
+}
+
+void task_sched_get_stats(task_sched_stats_t *out)
+{
+    if (out != NULL)
+    {
+        *out = s_stats;
+    }
+}
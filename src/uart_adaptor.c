@@ -1,140 +1,295 @@
 
 #include "main.h"
+#include "task_sched.h"
+#include "uart_trace.h"
 
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 
 extern UART_HandleTypeDef huart2;
+#if (UPS_PORT_COUNT > 1U)
+extern UART_HandleTypeDef huart3;
+#endif
 
-static volatile uint8_t s_uart2_rx_byte;
-static volatile uint16_t s_uart2_rx_head;
-static volatile uint16_t s_uart2_rx_tail;
-static uint8_t s_uart2_rx_buf[UART2_RX_BUFFER_SIZE];
+// One UPS UART: interrupt RX into a ring, DMA TX, and the ownership lock
+// shared by uart_engine and the CDC passthrough.
+typedef struct
+{
+	UART_HandleTypeDef *huart;
+	volatile uint8_t rx_byte;
+	volatile uint16_t rx_head;
+	volatile uint16_t rx_tail;
+	uint8_t rx_buf[UPS_UART_RX_BUFFER_SIZE];
+	volatile bool locked;
+	volatile bool tx_done;
+	ups_uart_stats_t stats;
+} ups_uart_t;
+
+static ups_uart_t s_uart[UPS_PORT_COUNT] = {
+	[0] = {.huart = &huart2},
+#if (UPS_PORT_COUNT > 1U)
+	[1] = {.huart = &huart3},
+#endif
+};
+
+static ups_uart_t *uart_for_port(uint8_t port)
+{
+	return (port < UPS_PORT_COUNT) ? &s_uart[port] : NULL;
+}
 
-static volatile bool s_uart2_locked;
-static volatile bool s_uart2_tx_done;
+static ups_uart_t *uart_for_handle(UART_HandleTypeDef const *huart)
+{
+	if (huart == NULL)
+	{
+		return NULL;
+	}
+	for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+	{
+		if (s_uart[port].huart->Instance == huart->Instance)
+		{
+			return &s_uart[port];
+		}
+	}
+	return NULL;
+}
 
-static inline uint16_t uart2_rx_next(uint16_t index)
+static uint8_t uart_port_of(ups_uart_t const *u)
 {
-	return (uint16_t)((index + 1U) % UART2_RX_BUFFER_SIZE);
+	return (uint8_t)(u - s_uart);
 }
 
-static void uart2_discard_all(void)
+static inline uint16_t uart_rx_next(uint16_t index)
 {
-	__disable_irq();
-	s_uart2_rx_tail = s_uart2_rx_head;
-	__enable_irq();
+	return (uint16_t)((index + 1U) % UPS_UART_RX_BUFFER_SIZE);
 }
 
-bool UART2_TryLock(void)
+bool UPS_UART_TryLock(uint8_t port)
 {
+	ups_uart_t *u = uart_for_port(port);
+	if (u == NULL)
+	{
+		return false;
+	}
+
 	bool locked = false;
 	__disable_irq();
-	if (!s_uart2_locked)
+	if (!u->locked)
 	{
-		s_uart2_locked = true;
+		u->locked = true;
 		locked = true;
 	}
 	__enable_irq();
 	return locked;
 }
 
-void UART2_Unlock(void)
+void UPS_UART_Unlock(uint8_t port)
 {
+	ups_uart_t *u = uart_for_port(port);
+	if (u == NULL)
+	{
+		return;
+	}
+
 	__disable_irq();
-	s_uart2_locked = false;
+	u->locked = false;
 	__enable_irq();
 }
 
-void UART2_RxStartIT(void)
+void UPS_UART_RxStartIT(uint8_t port)
 {
-	s_uart2_rx_head = 0U;
-	s_uart2_rx_tail = 0U;
-	(void)HAL_UART_Receive_IT(&huart2, (uint8_t *)&s_uart2_rx_byte, 1U);
+	ups_uart_t *u = uart_for_port(port);
+	if (u == NULL)
+	{
+		return;
+	}
+
+	u->rx_head = 0U;
+	u->rx_tail = 0U;
+	(void)HAL_UART_Receive_IT(u->huart, (uint8_t *)&u->rx_byte, 1U);
+}
+
+// Changes the line rate. Only call while the port is idle: an ongoing
+// transfer is cut and buffered RX bytes are dropped.
+HAL_StatusTypeDef UPS_UART_SetBaud(uint8_t port, uint32_t baud)
+{
+	ups_uart_t *u = uart_for_port(port);
+	if ((u == NULL) || (baud == 0U))
+	{
+		return HAL_ERROR;
+	}
+	if (u->huart->Init.BaudRate == baud)
+	{
+		return HAL_OK;
+	}
+
+	(void)HAL_UART_AbortReceive(u->huart);
+	u->huart->Init.BaudRate = baud;
+	HAL_StatusTypeDef const status = HAL_UART_Init(u->huart);
+	UPS_UART_RxStartIT(port);
+	uart_trace_baud(port, baud);
+	return status;
+}
+
+uint32_t UPS_UART_GetBaud(uint8_t port)
+{
+	ups_uart_t *u = uart_for_port(port);
+	return (u != NULL) ? u->huart->Init.BaudRate : 0U;
 }
 
-HAL_StatusTypeDef UART2_SendBytes(const uint8_t *data, uint16_t len, uint32_t timeout_ms)
+HAL_StatusTypeDef UPS_UART_SendBytes(uint8_t port, const uint8_t *data, uint16_t len, uint32_t timeout_ms)
 {
+	ups_uart_t *u = uart_for_port(port);
+	if (u == NULL)
+	{
+		return HAL_ERROR;
+	}
 	if ((data == NULL) || (len == 0U))
 	{
 		return HAL_OK;
 	}
-	return HAL_UART_Transmit(&huart2, (uint8_t *)data, len, timeout_ms);
+	uart_trace_tx(port, data, len);
+	HAL_StatusTypeDef const status = HAL_UART_Transmit(u->huart, (uint8_t *)data, len, timeout_ms);
+	uart_trace_tx_done(port);
+	return status;
 }
 
-HAL_StatusTypeDef UART2_SendBytesDMA(const uint8_t *data, uint16_t len)
+HAL_StatusTypeDef UPS_UART_SendBytesDMA(uint8_t port, const uint8_t *data, uint16_t len)
 {
+	ups_uart_t *u = uart_for_port(port);
+	if (u == NULL)
+	{
+		return HAL_ERROR;
+	}
 	if ((data == NULL) || (len == 0U))
 	{
 		return HAL_OK;
 	}
 
-	s_uart2_tx_done = false;
-	return HAL_UART_Transmit_DMA(&huart2, (uint8_t *)data, len);
+	u->tx_done = false;
+	uart_trace_tx(port, data, len);
+	return HAL_UART_Transmit_DMA(u->huart, (uint8_t *)data, len);
 }
 
-bool UART2_TxDone(void)
+bool UPS_UART_TxDone(uint8_t port)
 {
-	return s_uart2_tx_done;
+	ups_uart_t *u = uart_for_port(port);
+	return (u != NULL) && u->tx_done;
 }
 
-void UART2_TxDoneClear(void)
+void UPS_UART_TxDoneClear(uint8_t port)
 {
-	s_uart2_tx_done = false;
+	ups_uart_t *u = uart_for_port(port);
+	if (u != NULL)
+	{
+		u->tx_done = false;
+	}
 }
 
-uint16_t UART2_Available(void)
+uint16_t UPS_UART_Available(uint8_t port)
 {
-	uint16_t head = s_uart2_rx_head;
-	uint16_t tail = s_uart2_rx_tail;
+	ups_uart_t *u = uart_for_port(port);
+	if (u == NULL)
+	{
+		return 0U;
+	}
+
+	uint16_t head = u->rx_head;
+	uint16_t tail = u->rx_tail;
 
 	if (head >= tail)
 	{
 		return (uint16_t)(head - tail);
 	}
-	return (uint16_t)(UART2_RX_BUFFER_SIZE - (tail - head));
+	return (uint16_t)(UPS_UART_RX_BUFFER_SIZE - (tail - head));
 }
 
-int UART2_ReadByte(uint8_t *out)
+int UPS_UART_ReadByte(uint8_t port, uint8_t *out)
 {
-	if (out == NULL)
+	ups_uart_t *u = uart_for_port(port);
+	if ((u == NULL) || (out == NULL))
 	{
 		return 0;
 	}
-	if (s_uart2_rx_head == s_uart2_rx_tail)
+	if (u->rx_head == u->rx_tail)
 	{
 		return 0;
 	}
 
-	*out = s_uart2_rx_buf[s_uart2_rx_tail];
-	s_uart2_rx_tail = uart2_rx_next(s_uart2_rx_tail);
+	*out = u->rx_buf[u->rx_tail];
+	u->rx_tail = uart_rx_next(u->rx_tail);
 	return 1;
 }
 
-uint16_t UART2_Read(uint8_t *dst, uint16_t len)
+uint16_t UPS_UART_Read(uint8_t port, uint8_t *dst, uint16_t len)
 {
-	if ((dst == NULL) || (len == 0U))
+	ups_uart_t *u = uart_for_port(port);
+	if ((u == NULL) || (dst == NULL) || (len == 0U))
 	{
 		return 0U;
 	}
 
 	uint16_t read_count = 0U;
-	while ((read_count < len) && (s_uart2_rx_head != s_uart2_rx_tail))
+	while ((read_count < len) && (u->rx_head != u->rx_tail))
 	{
-		dst[read_count] = s_uart2_rx_buf[s_uart2_rx_tail];
-		s_uart2_rx_tail = uart2_rx_next(s_uart2_rx_tail);
+		dst[read_count] = u->rx_buf[u->rx_tail];
+		u->rx_tail = uart_rx_next(u->rx_tail);
 		read_count++;
 	}
 	return read_count;
 }
 
-void UART2_DiscardBuffered(void)
+uint16_t UPS_UART_Peek(uint8_t port, const uint8_t **data)
+{
+	ups_uart_t *u = uart_for_port(port);
+	if ((u == NULL) || (data == NULL))
+	{
+		return 0U;
+	}
+
+	// The RX interrupt only moves the head, and never into the bytes
+	// between tail and head, so the run stays valid until it is skipped.
+	uint16_t head = u->rx_head;
+	uint16_t tail = u->rx_tail;
+
+	*data = &u->rx_buf[tail];
+	if (head >= tail)
+	{
+		return (uint16_t)(head - tail);
+	}
+	return (uint16_t)(UPS_UART_RX_BUFFER_SIZE - tail);
+}
+
+void UPS_UART_Skip(uint8_t port, uint16_t len)
+{
+	ups_uart_t *u = uart_for_port(port);
+	if (u == NULL)
+	{
+		return;
+	}
+
+	uint16_t const available = UPS_UART_Available(port);
+	if (len > available)
+	{
+		len = available;
+	}
+	u->rx_tail = (uint16_t)((u->rx_tail + len) % UPS_UART_RX_BUFFER_SIZE);
+}
+
+void UPS_UART_DiscardBuffered(uint8_t port)
 {
-	uart2_discard_all();
+	ups_uart_t *u = uart_for_port(port);
+	if (u == NULL)
+	{
+		return;
+	}
+
+	__disable_irq();
+	u->rx_tail = u->rx_head;
+	__enable_irq();
 }
 
-bool UART2_ReadExactTimeout(uint8_t *dst, uint16_t len, uint32_t timeout_ms)
+bool UPS_UART_ReadExactTimeout(uint8_t port, uint8_t *dst, uint16_t len, uint32_t timeout_ms)
 {
 	if ((dst == NULL) || (len == 0U))
 	{
@@ -146,7 +301,7 @@ bool UART2_ReadExactTimeout(uint8_t *dst, uint16_t len, uint32_t timeout_ms)
 
 	while (got < len)
 	{
-		got += UART2_Read(&dst[got], (uint16_t)(len - got));
+		got += UPS_UART_Read(port, &dst[got], (uint16_t)(len - got));
 		if (got >= len)
 		{
 			return true;
@@ -159,40 +314,72 @@ bool UART2_ReadExactTimeout(uint8_t *dst, uint16_t len, uint32_t timeout_ms)
 	return true;
 }
 
+void UPS_UART_GetStats(uint8_t port, ups_uart_stats_t *out)
+{
+	ups_uart_t *u = uart_for_port(port);
+	if ((u == NULL) || (out == NULL))
+	{
+		return;
+	}
+	__disable_irq();
+	*out = u->stats;
+	__enable_irq();
+}
+
 void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
-	if ((huart == NULL) || (huart->Instance != USART2))
+	ups_uart_t *u = uart_for_handle(huart);
+	if (u == NULL)
 	{
 		return;
 	}
-	s_uart2_tx_done = true;
+	u->tx_done = true;
+	uart_trace_tx_done(uart_port_of(u));
+	task_sched_notify(TASK_SCHED_EVENT_UART);
 }
 
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
-	if ((huart == NULL) || (huart->Instance != USART2))
+	ups_uart_t *u = uart_for_handle(huart);
+	if (u == NULL)
 	{
 		return;
 	}
 
-	uint16_t next = uart2_rx_next(s_uart2_rx_head);
-	if (next != s_uart2_rx_tail)
+	uart_trace_rx_byte(uart_port_of(u), u->rx_byte);
+
+	uint16_t next = uart_rx_next(u->rx_head);
+	if (next != u->rx_tail)
 	{
-		s_uart2_rx_buf[s_uart2_rx_head] = s_uart2_rx_byte;
-		s_uart2_rx_head = next;
+		u->rx_buf[u->rx_head] = u->rx_byte;
+		u->rx_head = next;
+
+		uint16_t const used = (uint16_t)((next + UPS_UART_RX_BUFFER_SIZE - u->rx_tail) % UPS_UART_RX_BUFFER_SIZE);
+		if (used > u->stats.rx_high_water)
+		{
+			u->stats.rx_high_water = used;
+		}
+	}
+	else
+	{
+		u->stats.rx_dropped++;
 	}
 
-	(void)HAL_UART_Receive_IT(huart, (uint8_t *)&s_uart2_rx_byte, 1U);
+	(void)HAL_UART_Receive_IT(huart, (uint8_t *)&u->rx_byte, 1U);
+	task_sched_notify(TASK_SCHED_EVENT_UART);
 }
 
 void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
-	if ((huart == NULL) || (huart->Instance != USART2))
+	ups_uart_t *u = uart_for_handle(huart);
+	if (u == NULL)
 	{
 		return;
 	}
 
+	u->stats.rx_errors++;
+	uart_trace_rx_error(uart_port_of(u), huart->ErrorCode);
 	__HAL_UART_CLEAR_OREFLAG(huart);
-	(void)HAL_UART_Receive_IT(huart, (uint8_t *)&s_uart2_rx_byte, 1U);
+	(void)HAL_UART_Receive_IT(huart, (uint8_t *)&u->rx_byte, 1U);
+	task_sched_notify(TASK_SCHED_EVENT_UART);
 }
-
@@ -2,9 +2,13 @@
  * @file uart_engine.c
  * @brief Non-blocking UART request/response engine.
  *
- * Implements a cooperative state machine around the UART2_* adapter functions
- * (DMA TX + buffered RX). Requests are queued and executed sequentially; each
- * request can optionally be retried on failure.
+ * Implements a cooperative state machine around the UPS_UART_* adapter
+ * functions (DMA TX + buffered RX). Requests are queued and executed
+ * sequentially; each request can optionally be retried on failure.
+ *
+ * There is one engine per UPS port, each with its own queue, active job and
+ * heartbeat. Every function takes the port it works on; uart_engine_tick()
+ * advances every port, so the ports' UPSes are polled concurrently.
  *
  * A periodic heartbeat can be configured via uart_engine_set_heartbeat() to
  * monitor link/UPS health and trigger a conservative "battery unknown" state
@@ -15,7 +19,10 @@
 
 #include "uart_engine.h"
 
+#include "crc16.h"
+#include "log_ring.h"
 #include "main.h"
+#include "uart_trace.h"
 
 #include <string.h>
 
@@ -35,12 +42,24 @@
 #define UART_ENGINE_RETRY_COOLDOWN_MS 25U
 #endif
 
+// After a feed parser rejects a reply, the remainder is discarded until the
+// terminator arrives or the line has been quiet for this many characters at
+// the port's rate, plus a margin (15 ms in all at 2400).
+#ifndef UART_ENGINE_DRAIN_IDLE_CHARS
+#define UART_ENGINE_DRAIN_IDLE_CHARS 3U
+#endif
+
+#ifndef UART_ENGINE_DRAIN_IDLE_MS
+#define UART_ENGINE_DRAIN_IDLE_MS 2U
+#endif
+
 typedef enum
 {
     UART_ENGINE_STATE_IDLE = 0,
     UART_ENGINE_STATE_TX_START,
     UART_ENGINE_STATE_TX_WAIT,
     UART_ENGINE_STATE_RX_WAIT,
+    UART_ENGINE_STATE_RX_DRAIN,
     UART_ENGINE_STATE_PROCESS,
 } uart_engine_state_t;
 
@@ -52,109 +71,124 @@ typedef struct
     bool is_heartbeat;
 } uart_engine_job_t;
 
-static uart_engine_job_t s_queue[UART_ENGINE_QUEUE_SIZE];
-static uint8_t s_q_head;
-static uint8_t s_q_tail;
-static uint8_t s_q_count;
-
-static uart_engine_job_t s_active;
-static uart_engine_state_t s_state;
-static uint32_t s_state_start_ms;
-static uint32_t s_retry_not_before_ms;
-
-static uint8_t s_rx_buf[UART_ENGINE_MAX_EXPECTED_LEN];
-static uint16_t s_rx_got;
-// DMA TX must use storage that outlives job_start_tx(); a stack buffer can be
-// overwritten before transfer completes, corrupting multi-byte commands.
-static uint8_t s_tx_buf[8U];
-
-static bool s_hb_enabled;
-static uart_engine_heartbeat_cfg_t s_hb_cfg;
-static uint32_t s_hb_next_due_ms;
-static uint8_t s_hb_consecutive_failures;
-static bool s_hb_queued_or_active;
-
-static bool s_enabled;
+typedef struct
+{
+    uint8_t port;
+
+    uart_engine_job_t queue[UART_ENGINE_QUEUE_SIZE];
+    uint8_t q_head;
+    uint8_t q_tail;
+    uint8_t q_count;
+
+    uart_engine_job_t active;
+    uart_engine_state_t state;
+    uint32_t state_start_ms;
+    uint32_t retry_not_before_ms;
+
+    uint8_t rx_buf[UART_ENGINE_MAX_EXPECTED_LEN];
+    uint16_t rx_got;
+    uint16_t rx_fed; // bytes handed to feed_fn, which are not kept in rx_buf
+    uint32_t rx_last_byte_ms;
+    uart_engine_feed_state_t feed_state;
+    // DMA TX must use storage that outlives job_start_tx(); a stack buffer can be
+    // overwritten before transfer completes, corrupting multi-byte commands.
+    uint8_t tx_buf[2U + UART_ENGINE_MAX_SUFFIX_LEN + 2U]; // cmd, suffix, CRC
+    uint32_t tx_start_ms;
+
+    bool hb_enabled;
+    uart_engine_heartbeat_cfg_t hb_cfg;
+    uint32_t hb_next_due_ms;
+    uint8_t hb_consecutive_failures;
+    bool hb_queued_or_active;
+
+    bool enabled;
+
+    uart_engine_stats_t stats;
+    uart_engine_latency_t latency[UART_ENGINE_LATENCY_SLOTS];
+    uint8_t latency_count;
+} uart_engine_port_t;
+
+static uart_engine_port_t s_ports[UPS_PORT_COUNT];
+static uart_engine_tuning_t s_tuning = {
+    .interjob_cooldown_ms = UART_ENGINE_INTERJOB_COOLDOWN_MS,
+    .reply_timeout_ms = 0U,
+    .failure_threshold = UART_ENGINE_FAILURE_THRESHOLD,
+};
+
+static uart_engine_port_t *engine_port(uint8_t port)
+{
+    return (port < UPS_PORT_COUNT) ? &s_ports[port] : NULL;
+}
 
-static void set_not_before_ms(uint32_t candidate_ms)
+static void set_not_before_ms(uart_engine_port_t *eng, uint32_t candidate_ms)
 {
-    if ((int32_t)(candidate_ms - s_retry_not_before_ms) > 0)
+    if ((int32_t)(candidate_ms - eng->retry_not_before_ms) > 0)
     {
-        s_retry_not_before_ms = candidate_ms;
+        eng->retry_not_before_ms = candidate_ms;
     }
 }
 
-static void apply_interjob_cooldown(uint32_t now_ms)
+static void apply_interjob_cooldown(uart_engine_port_t *eng, uint32_t now_ms)
 {
-#if (UART_ENGINE_INTERJOB_COOLDOWN_MS > 0U)
-    set_not_before_ms(now_ms + UART_ENGINE_INTERJOB_COOLDOWN_MS);
-#else
-    (void)now_ms;
-#endif
+    if (s_tuning.interjob_cooldown_ms > 0U)
+    {
+        set_not_before_ms(eng, now_ms + s_tuning.interjob_cooldown_ms);
+    }
 }
 
-static void uart_engine_debug_print_raw_rx(const char *reason, const uint8_t *rx, uint16_t rx_len)
+static void uart_engine_debug_print_raw_rx(uart_engine_port_t *eng, const char *reason, const uint8_t *rx, uint16_t rx_len)
 {
     if (!g_ups_debug_status_print_enabled)
     {
         return;
     }
 
-    printf("UART_ENG raw rx: %s len=%u",
-           (reason != NULL) ? reason : "unknown",
-           (unsigned int)rx_len);
+    LOG_RING_PRINTF("UART_ENG%u raw rx: %s len=%u\r\n",
+                    (unsigned int)eng->port,
+                    (reason != NULL) ? reason : "unknown",
+                    (unsigned int)rx_len);
 
-    if ((rx == NULL) || (rx_len == 0U))
+    if ((rx != NULL) && (rx_len > 0U))
     {
-        printf(" (empty)\r\n");
-        return;
+        log_ring_write_bytes("UART_ENG raw rx data=", rx, rx_len);
     }
-
-    printf(" data=");
-    for (uint16_t i = 0U; i < rx_len; i++)
-    {
-        printf("%02X", rx[i]);
-        if ((uint16_t)(i + 1U) < rx_len)
-        {
-            printf(" ");
-        }
-    }
-    printf("\r\n");
 }
 
-static void uart_engine_debug_print_retry(const uart_engine_job_t *job, const char *reason)
+static void uart_engine_debug_print_retry(uart_engine_port_t *eng, const uart_engine_job_t *job, const char *reason)
 {
     if (!g_ups_debug_status_print_enabled || (job == NULL))
     {
         return;
     }
 
-    printf("UART_ENG retry: %s cmd=0x%04X hb=%u retries_left=%u q=%u\r\n",
-           (reason != NULL) ? reason : "unknown",
-           (unsigned int)job->req.cmd,
-           job->is_heartbeat ? 1U : 0U,
-           (unsigned int)job->retries_left,
-           (unsigned int)s_q_count);
+    LOG_RING_PRINTF("UART_ENG%u retry: %s cmd=0x%04X hb=%u retries_left=%u q=%u\r\n",
+                    (unsigned int)eng->port,
+                    (reason != NULL) ? reason : "unknown",
+                    (unsigned int)job->req.cmd,
+                    job->is_heartbeat ? 1U : 0U,
+                    (unsigned int)job->retries_left,
+                    (unsigned int)eng->q_count);
 
-    uart_engine_debug_print_raw_rx("retry", s_rx_buf, s_rx_got);
+    uart_engine_debug_print_raw_rx(eng, "retry", eng->rx_buf, eng->rx_got);
 }
 
-static void uart_engine_debug_print_failure(const uart_engine_job_t *job, const char *reason)
+static void uart_engine_debug_print_failure(uart_engine_port_t *eng, const uart_engine_job_t *job, const char *reason)
 {
     if (!g_ups_debug_status_print_enabled || (job == NULL))
     {
         return;
     }
 
-    printf("UART_ENG failure: %s cmd=0x%04X hb=%u retries_left=%u q=%u\r\n",
-           (reason != NULL) ? reason : "unknown",
-           (unsigned int)job->req.cmd,
-           job->is_heartbeat ? 1U : 0U,
-           (unsigned int)job->retries_left,
-           (unsigned int)s_q_count);
+    LOG_RING_PRINTF("UART_ENG%u failure: %s cmd=0x%04X hb=%u retries_left=%u q=%u\r\n",
+                    (unsigned int)eng->port,
+                    (reason != NULL) ? reason : "unknown",
+                    (unsigned int)job->req.cmd,
+                    job->is_heartbeat ? 1U : 0U,
+                    (unsigned int)job->retries_left,
+                    (unsigned int)eng->q_count);
 }
 
-static void uart_engine_debug_print_timeout(const uart_engine_job_t *job,
+static void uart_engine_debug_print_timeout(uart_engine_port_t *eng, const uart_engine_job_t *job,
                                             const char *phase,
                                             uint32_t elapsed_ms,
                                             uint32_t timeout_ms)
@@ -164,16 +198,17 @@ static void uart_engine_debug_print_timeout(const uart_engine_job_t *job,
         return;
     }
 
-    printf("UART_ENG timeout: %s cmd=0x%04X hb=%u elapsed=%lu timeout=%lu retries_left=%u\r\n",
-           (phase != NULL) ? phase : "unknown",
-           (unsigned int)job->req.cmd,
-           job->is_heartbeat ? 1U : 0U,
-           (unsigned long)elapsed_ms,
-           (unsigned long)timeout_ms,
-           (unsigned int)job->retries_left);
+    LOG_RING_PRINTF("UART_ENG%u timeout: %s cmd=0x%04X hb=%u elapsed=%lu timeout=%lu retries_left=%u\r\n",
+                    (unsigned int)eng->port,
+                    (phase != NULL) ? phase : "unknown",
+                    (unsigned int)job->req.cmd,
+                    job->is_heartbeat ? 1U : 0U,
+                    (unsigned long)elapsed_ms,
+                    (unsigned long)timeout_ms,
+                    (unsigned int)job->retries_left);
 }
 
-static void uart_engine_debug_print_enqueue_failure(const char *reason, const uart_engine_request_t *req)
+static void uart_engine_debug_print_enqueue_failure(uart_engine_port_t *eng, const char *reason, const uart_engine_request_t *req)
 {
     if (!g_ups_debug_status_print_enabled)
     {
@@ -182,18 +217,20 @@ static void uart_engine_debug_print_enqueue_failure(const char *reason, const ua
 
     if (req == NULL)
     {
-        printf("UART_ENG enqueue failure: %s req=null q=%u\r\n",
-               (reason != NULL) ? reason : "unknown",
-               (unsigned int)s_q_count);
-        uart_engine_debug_print_raw_rx("enqueue failure", s_rx_buf, s_rx_got);
+        LOG_RING_PRINTF("UART_ENG%u enqueue failure: %s req=null q=%u\r\n",
+                        (unsigned int)eng->port,
+                        (reason != NULL) ? reason : "unknown",
+                        (unsigned int)eng->q_count);
+        uart_engine_debug_print_raw_rx(eng, "enqueue failure", eng->rx_buf, eng->rx_got);
         return;
     }
 
-    printf("UART_ENG enqueue failure: %s cmd=0x%04X q=%u\r\n",
-           (reason != NULL) ? reason : "unknown",
-           (unsigned int)req->cmd,
-           (unsigned int)s_q_count);
-    uart_engine_debug_print_raw_rx("enqueue failure", s_rx_buf, s_rx_got);
+    LOG_RING_PRINTF("UART_ENG%u enqueue failure: %s cmd=0x%04X q=%u\r\n",
+                    (unsigned int)eng->port,
+                    (reason != NULL) ? reason : "unknown",
+                    (unsigned int)req->cmd,
+                    (unsigned int)eng->q_count);
+    uart_engine_debug_print_raw_rx(eng, "enqueue failure", eng->rx_buf, eng->rx_got);
 }
 
 static uint32_t tick_now_ms(void)
@@ -201,52 +238,59 @@ static uint32_t tick_now_ms(void)
     return HAL_GetTick();
 }
 
-static bool queue_is_full(void)
+static bool queue_is_full(uart_engine_port_t *eng)
 {
-    return (s_q_count >= UART_ENGINE_QUEUE_SIZE);
+    return (eng->q_count >= UART_ENGINE_QUEUE_SIZE);
 }
 
-static bool queue_push(const uart_engine_request_t *req, bool is_heartbeat)
+static bool queue_push(uart_engine_port_t *eng, const uart_engine_request_t *req, bool is_heartbeat)
 {
-    if (queue_is_full())
+    if (queue_is_full(eng))
     {
         return false;
     }
 
-    uart_engine_job_t *slot = &s_queue[s_q_tail];
+    uart_engine_job_t *slot = &eng->queue[eng->q_tail];
     slot->req = *req;
     slot->retries_left = req->max_retries;
     slot->in_use = true;
     slot->is_heartbeat = is_heartbeat;
 
-    s_q_tail = (uint8_t)((s_q_tail + 1U) % UART_ENGINE_QUEUE_SIZE);
-    s_q_count++;
+    eng->q_tail = (uint8_t)((eng->q_tail + 1U) % UART_ENGINE_QUEUE_SIZE);
+    eng->q_count++;
+    if (eng->q_count > eng->stats.queue_high_water)
+    {
+        eng->stats.queue_high_water = eng->q_count;
+    }
     return true;
 }
 
-static bool queue_pop(uart_engine_job_t *out)
+static bool queue_pop(uart_engine_port_t *eng, uart_engine_job_t *out)
 {
-    if ((out == NULL) || (s_q_count == 0U))
+    if ((out == NULL) || (eng->q_count == 0U))
     {
         return false;
     }
 
-    uart_engine_job_t *slot = &s_queue[s_q_head];
+    uart_engine_job_t *slot = &eng->queue[eng->q_head];
     *out = *slot;
     slot->in_use = false;
 
-    s_q_head = (uint8_t)((s_q_head + 1U) % UART_ENGINE_QUEUE_SIZE);
-    s_q_count--;
+    eng->q_head = (uint8_t)((eng->q_head + 1U) % UART_ENGINE_QUEUE_SIZE);
+    eng->q_count--;
     return true;
 }
 
-static uint16_t build_cmd_bytes(uint8_t *tx, uint16_t tx_cap, uint16_t cmd, uint8_t cmd_bits)
+static uint16_t build_cmd_bytes(uint8_t *tx, uint16_t tx_cap, const uart_engine_request_t *req)
 {
-    if ((tx == NULL) || (tx_cap == 0U))
+    if ((tx == NULL) || (tx_cap == 0U) || (req == NULL))
     {
         return 0U;
     }
 
+    uint16_t const cmd = req->cmd;
+    uint8_t const cmd_bits = req->cmd_bits;
+
     uint16_t used = 0U;
 
     if (cmd_bits == 8U)
@@ -272,9 +316,38 @@ static uint16_t build_cmd_bytes(uint8_t *tx, uint16_t tx_cap, uint16_t cmd, uint
         return 0U;
     }
 
+    if ((req->cmd_suffix_len > UART_ENGINE_MAX_SUFFIX_LEN) ||
+        ((uint16_t)(used + req->cmd_suffix_len) > tx_cap))
+    {
+        return 0U;
+    }
+    memcpy(&tx[used], req->cmd_suffix_bytes, req->cmd_suffix_len);
+    used = (uint16_t)(used + req->cmd_suffix_len);
+
+    if (req->modbus_crc)
+    {
+        if ((uint16_t)(used + 2U) > tx_cap)
+        {
+            return 0U;
+        }
+        uint16_t const crc = crc16_modbus(tx, used);
+        tx[used++] = (uint8_t)(crc & 0xFFU);
+        tx[used++] = (uint8_t)(crc >> 8);
+    }
+
     return used;
 }
 
+static bool rx_crc_ok(const uint8_t *rx, uint16_t rx_len)
+{
+    if (rx_len < 3U)
+    {
+        return false;
+    }
+    uint16_t const crc = crc16_modbus(rx, (size_t)rx_len - 2U);
+    return (rx[rx_len - 2U] == (uint8_t)(crc & 0xFFU)) && (rx[rx_len - 1U] == (uint8_t)(crc >> 8));
+}
+
 static bool request_is_valid(const uart_engine_request_t *req)
 {
     if (req == NULL)
@@ -287,6 +360,17 @@ static bool request_is_valid(const uart_engine_request_t *req)
         return false;
     }
 
+    if (req->cmd_suffix_len > UART_ENGINE_MAX_SUFFIX_LEN)
+    {
+        return false;
+    }
+
+    // The CRC is checked over a fixed-length reply before process_fn runs.
+    if (req->modbus_crc && (req->expected_ending || (req->feed_fn != NULL) || (req->expected_len < 3U)))
+    {
+        return false;
+    }
+
     if (req->expected_len > UART_ENGINE_MAX_EXPECTED_LEN)
     {
         return false;
@@ -349,93 +433,164 @@ static bool rx_has_expected_ending(const uart_engine_request_t *req, const uint8
     return (memcmp(&rx[rx_len - ending_len], req->expected_ending_bytes, ending_len) == 0);
 }
 
-static void active_clear(void)
+static void active_clear(uart_engine_port_t *eng)
 {
-    (void)memset(&s_active, 0, sizeof(s_active));
-    s_rx_got = 0U;
+    (void)memset(&eng->active, 0, sizeof(eng->active));
+    eng->rx_got = 0U;
+    eng->rx_fed = 0U;
 }
 
-static void on_job_success(const uart_engine_job_t *job)
+static void trace_outcome(uart_engine_port_t *eng, const uart_engine_job_t *job, uart_trace_outcome_t outcome)
 {
-    if ((job != NULL) && job->is_heartbeat)
+    if (job != NULL)
     {
-        s_hb_consecutive_failures = 0U;
+        uart_trace_outcome(eng->port, outcome, job->req.cmd, job->retries_left);
     }
 }
 
-static void on_job_final_failure(const uart_engine_job_t *job)
+// Character time from the port's current rate: 10 bits per 8N1 character.
+static uint32_t drain_idle_ms(uart_engine_port_t *eng)
 {
-    if ((job != NULL))
+    uint32_t const baud = UPS_UART_GetBaud(eng->port);
+    uint32_t const chars_ms = (baud > 0U) ? (((UART_ENGINE_DRAIN_IDLE_CHARS * 10000U) + baud - 1U) / baud) : 0U;
+    return chars_ms + UART_ENGINE_DRAIN_IDLE_MS;
+}
+
+static void on_job_success(uart_engine_port_t *eng, const uart_engine_job_t *job)
+{
+    eng->stats.completed++;
+    trace_outcome(eng, job, UART_TRACE_OUTCOME_OK);
+    // Without a periodic heartbeat any answered job proves the link.
+    if ((job != NULL) && (job->is_heartbeat || !eng->hb_enabled))
     {
-        if (s_hb_consecutive_failures < 255U)
+        eng->hb_consecutive_failures = 0U;
+    }
+}
+
+static void record_latency(uart_engine_port_t *eng, uint16_t cmd, uint32_t now_ms)
+{
+    eng->stats.last_completed_ms = now_ms;
+
+    uart_engine_latency_t *slot = NULL;
+    for (uint8_t i = 0U; i < eng->latency_count; i++)
+    {
+        if (eng->latency[i].cmd == cmd)
         {
-            s_hb_consecutive_failures++;
+            slot = &eng->latency[i];
+            break;
         }
+    }
+    if (slot == NULL)
+    {
+        if (eng->latency_count >= UART_ENGINE_LATENCY_SLOTS)
+        {
+            return;
+        }
+        slot = &eng->latency[eng->latency_count++];
+        slot->cmd = cmd;
+    }
 
-        uint8_t threshold = s_hb_cfg.failure_threshold;
-        if (threshold == 0U)
+    uint32_t elapsed_ms = now_ms - eng->tx_start_ms;
+    if (elapsed_ms > 0xFFFFU)
+    {
+        elapsed_ms = 0xFFFFU;
+    }
+    slot->last_ms = (uint16_t)elapsed_ms;
+    if (slot->last_ms > slot->max_ms)
+    {
+        slot->max_ms = slot->last_ms;
+    }
+    slot->count++;
+    slot->total_ms += elapsed_ms;
+}
+
+static void on_job_final_failure(uart_engine_port_t *eng, const uart_engine_job_t *job)
+{
+    eng->stats.failed++;
+    trace_outcome(eng, job, UART_TRACE_OUTCOME_FAIL);
+    if ((job != NULL))
+    {
+        if (eng->hb_consecutive_failures < 255U)
         {
-            threshold = 5U;
+            eng->hb_consecutive_failures++;
         }
 
-        if (s_hb_consecutive_failures >= threshold)
+        uint8_t const threshold = (eng->hb_cfg.failure_threshold != 0U) ? eng->hb_cfg.failure_threshold
+                                                                         : s_tuning.failure_threshold;
+
+        if (eng->hb_consecutive_failures >= threshold)
         {
-            g_battery.remaining_capacity = 1U;
-            g_battery.remaining_time_limit_s = 1U;
-            g_power_summary_present_status.fully_charged = false;
-            g_power_summary_present_status.below_remaining_capacity_limit = true;
-            g_power_summary_present_status.shutdown_imminent = true;
-            g_power_summary_present_status.charging = false;
-            g_power_summary_present_status.discharging = true;
-            g_power_summary_present_status.ac_present = false;
+            // Link lost: report shutdown imminent through the status flags.
+            // remaining_time_limit_s is the host-written setting, not a
+            // measurement, and is left alone.
+            ups_state_t *ups = &g_ups[eng->port];
+            ups->battery.remaining_capacity = 1U;
+            ups->present_status.fully_charged = false;
+            ups->present_status.below_remaining_capacity_limit = true;
+            ups->present_status.shutdown_imminent = true;
+            ups->present_status.charging = false;
+            ups->present_status.discharging = true;
+            ups->present_status.ac_present = false;
         }
     }
 }
 
+static void uart_engine_port_init(uart_engine_port_t *eng);
+
 /**
- * @brief Initialize the UART engine runtime state.
+ * @brief Initialize the UART engine runtime state of every port.
  *
- * Resets the internal queue/state machine and enables the engine.
+ * Resets the internal queues/state machines and enables the engines.
  */
 void uart_engine_init(void)
 {
-    s_q_head = 0U;
-    s_q_tail = 0U;
-    s_q_count = 0U;
-    s_state = UART_ENGINE_STATE_IDLE;
-    s_state_start_ms = 0U;
-    s_retry_not_before_ms = 0U;
-
-    s_hb_enabled = false;
-    (void)memset(&s_hb_cfg, 0, sizeof(s_hb_cfg));
-    s_hb_next_due_ms = 0U;
-    s_hb_consecutive_failures = 0U;
-    s_hb_queued_or_active = false;
-
-    s_enabled = true;
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        uart_engine_port_t *eng = &s_ports[port];
+        eng->port = port;
+        uart_engine_port_init(eng);
+    }
+}
 
-    active_clear();
+static void uart_engine_port_init(uart_engine_port_t *eng)
+{
+    eng->q_head = 0U;
+    eng->q_tail = 0U;
+    eng->q_count = 0U;
+    eng->state = UART_ENGINE_STATE_IDLE;
+    eng->state_start_ms = 0U;
+    eng->retry_not_before_ms = 0U;
+
+    eng->hb_enabled = false;
+    (void)memset(&eng->hb_cfg, 0, sizeof(eng->hb_cfg));
+    eng->hb_next_due_ms = 0U;
+    eng->hb_consecutive_failures = 0U;
+    eng->hb_queued_or_active = false;
+
+    eng->enabled = true;
+
+    active_clear(eng);
 }
 
-static void uart_engine_reset_internal(void)
+static void uart_engine_reset_internal(uart_engine_port_t *eng)
 {
-    s_q_head = 0U;
-    s_q_tail = 0U;
-    s_q_count = 0U;
-    s_state = UART_ENGINE_STATE_IDLE;
-    s_state_start_ms = 0U;
-    s_retry_not_before_ms = 0U;
+    eng->q_head = 0U;
+    eng->q_tail = 0U;
+    eng->q_count = 0U;
+    eng->state = UART_ENGINE_STATE_IDLE;
+    eng->state_start_ms = 0U;
+    eng->retry_not_before_ms = 0U;
 
-    s_hb_enabled = false;
-    (void)memset(&s_hb_cfg, 0, sizeof(s_hb_cfg));
-    s_hb_next_due_ms = 0U;
-    s_hb_consecutive_failures = 0U;
-    s_hb_queued_or_active = false;
+    eng->hb_enabled = false;
+    (void)memset(&eng->hb_cfg, 0, sizeof(eng->hb_cfg));
+    eng->hb_next_due_ms = 0U;
+    eng->hb_consecutive_failures = 0U;
+    eng->hb_queued_or_active = false;
 
-    active_clear();
+    active_clear(eng);
 
     // Ensure we don't leave the UART locked if the engine was disabled mid-job.
-    UART2_Unlock();
+    UPS_UART_Unlock(eng->port);
 }
 
 /**
@@ -444,19 +599,21 @@ static void uart_engine_reset_internal(void)
  * When disabling, queued/active jobs are dropped, heartbeat scheduling is
  * stopped, and the UART lock is released.
  *
+ * @param port UPS port.
  * @param enable true to enable, false to disable.
  */
-void uart_engine_set_enabled(bool enable)
+void uart_engine_set_enabled(uint8_t port, bool enable)
 {
-    if (enable == s_enabled)
+    uart_engine_port_t *eng = engine_port(port);
+    if ((eng == NULL) || (enable == eng->enabled))
     {
         return;
     }
 
-    s_enabled = enable;
-    if (!s_enabled)
+    eng->enabled = enable;
+    if (!eng->enabled)
     {
-        uart_engine_reset_internal();
+        uart_engine_reset_internal(eng);
     }
 }
 
@@ -464,76 +621,140 @@ void uart_engine_set_enabled(bool enable)
  * @brief Get whether the engine is enabled.
  * @return true if enabled; false if disabled.
  */
-bool uart_engine_is_enabled(void)
+bool uart_engine_is_enabled(uint8_t port)
 {
-    return s_enabled;
+    uart_engine_port_t const *eng = engine_port(port);
+    return (eng != NULL) && eng->enabled;
 }
 
-bool uart_engine_is_busy(void)
+bool uart_engine_is_busy(uint8_t port)
 {
-    return (s_state != UART_ENGINE_STATE_IDLE) || (s_q_count != 0U);
+    uart_engine_port_t const *eng = engine_port(port);
+    return (eng != NULL) && ((eng->state != UART_ENGINE_STATE_IDLE) || (eng->q_count != 0U));
 }
 
 /**
  * @brief Enqueue a UART request for execution by uart_engine_tick().
+ * @param port UPS port whose engine runs the request.
  * @param req Request descriptor (command, expected length, timeout, callback).
  * @return Result code indicating success or why the enqueue failed.
  */
-uart_engine_result_t uart_engine_enqueue(const uart_engine_request_t *req)
+uart_engine_result_t uart_engine_enqueue(uint8_t port, const uart_engine_request_t *req)
 {
-    if (!s_enabled)
+    uart_engine_port_t *eng = engine_port(port);
+    if (eng == NULL)
     {
-        uart_engine_debug_print_enqueue_failure("engine disabled", req);
+        return UART_ENGINE_ERR_BAD_PARAM;
+    }
+    if (!eng->enabled)
+    {
+        uart_engine_debug_print_enqueue_failure(eng, "engine disabled", req);
         return UART_ENGINE_ERR_DISABLED;
     }
     if (!request_is_valid(req))
     {
-        uart_engine_debug_print_enqueue_failure("bad request", req);
+        uart_engine_debug_print_enqueue_failure(eng, "bad request", req);
         return UART_ENGINE_ERR_BAD_PARAM;
     }
 
-    if (!queue_push(req, false))
+    if (!queue_push(eng, req, false))
     {
-        uart_engine_debug_print_enqueue_failure("queue full", req);
+        eng->stats.queue_full++;
+        uart_engine_debug_print_enqueue_failure(eng, "queue full", req);
         return UART_ENGINE_ERR_QUEUE_FULL;
     }
+    eng->stats.enqueued++;
     return UART_ENGINE_OK;
 }
 
 /**
- * @brief Configure or disable the periodic heartbeat request.
- * @param cfg Heartbeat configuration. Pass NULL to disable.
+ * @brief Copy the engine counters and the current queue depth.
+ * @param port UPS port.
+ * @param out Destination, ignored if NULL.
  */
-void uart_engine_set_heartbeat(const uart_engine_heartbeat_cfg_t *cfg)
+void uart_engine_get_stats(uint8_t port, uart_engine_stats_t *out)
 {
-    if (!s_enabled)
+    uart_engine_port_t const *eng = engine_port(port);
+    if ((eng == NULL) || (out == NULL))
     {
         return;
     }
+
+    *out = eng->stats;
+    out->queue_depth = eng->q_count;
+    out->consecutive_failures = eng->hb_consecutive_failures;
+}
+
+/**
+ * @brief Copy the reply latency slots of a port.
+ * @param port UPS port.
+ * @param out Destination array.
+ * @param max Capacity of @p out in slots.
+ * @return Number of slots copied.
+ */
+uint8_t uart_engine_get_latencies(uint8_t port, uart_engine_latency_t *out, uint8_t max)
+{
+    uart_engine_port_t const *eng = engine_port(port);
+    if ((eng == NULL) || (out == NULL))
+    {
+        return 0U;
+    }
+
+    uint8_t const n = (eng->latency_count < max) ? eng->latency_count : max;
+    (void)memcpy(out, eng->latency, (size_t)n * sizeof(out[0]));
+    return n;
+}
+
+/**
+ * @brief Set the inter-job gap, reply timeout override and failure threshold
+ *        of every port's engine.
+ * @param cfg New values; a zero failure_threshold selects the build default.
+ */
+void uart_engine_set_tuning(const uart_engine_tuning_t *cfg)
+{
     if (cfg == NULL)
     {
-        s_hb_enabled = false;
-        s_hb_queued_or_active = false;
-        s_hb_consecutive_failures = 0U;
         return;
     }
 
-    s_hb_cfg = *cfg;
-    if (!request_is_valid(&s_hb_cfg.req))
+    s_tuning = *cfg;
+    if (s_tuning.failure_threshold == 0U)
+    {
+        s_tuning.failure_threshold = UART_ENGINE_FAILURE_THRESHOLD;
+    }
+}
+
+/**
+ * @brief Configure or disable the periodic heartbeat request.
+ * @param port UPS port.
+ * @param cfg Heartbeat configuration. Pass NULL to disable.
+ */
+void uart_engine_set_heartbeat(uint8_t port, const uart_engine_heartbeat_cfg_t *cfg)
+{
+    uart_engine_port_t *eng = engine_port(port);
+    if ((eng == NULL) || !eng->enabled)
     {
-        s_hb_enabled = false;
+        return;
+    }
+    if (cfg == NULL)
+    {
+        eng->hb_enabled = false;
+        eng->hb_queued_or_active = false;
+        eng->hb_consecutive_failures = 0U;
         return;
     }
 
-    if (s_hb_cfg.failure_threshold == 0U)
+    eng->hb_cfg = *cfg;
+    if (!request_is_valid(&eng->hb_cfg.req))
     {
-        s_hb_cfg.failure_threshold = 5U;
+        eng->hb_enabled = false;
+        return;
     }
 
-    s_hb_enabled = true;
-    s_hb_next_due_ms = tick_now_ms();
-    s_hb_consecutive_failures = 0U;
-    s_hb_queued_or_active = false;
+    eng->hb_enabled = true;
+    eng->hb_next_due_ms = tick_now_ms();
+    eng->hb_consecutive_failures = 0U;
+    eng->hb_queued_or_active = false;
 }
 
 /**
@@ -541,8 +762,10 @@ void uart_engine_set_heartbeat(const uart_engine_heartbeat_cfg_t *cfg)
  *
  * out_value must point to a uart_engine_expect_bytes_t.
  */
-bool uart_engine_process_expect_exact(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+bool uart_engine_process_expect_exact(uint8_t port, uint16_t cmd, const uint8_t *rx, uint16_t rx_len,
+                                      void *out_value)
 {
+    (void)port;
     (void)cmd;
     const uart_engine_expect_bytes_t *exp = (const uart_engine_expect_bytes_t *)out_value;
     if ((exp == NULL) || (exp->expected == NULL))
@@ -561,337 +784,490 @@ bool uart_engine_process_expect_exact(uint16_t cmd, const uint8_t *rx, uint16_t
     return (memcmp(rx, exp->expected, rx_len) == 0);
 }
 
-static void maybe_enqueue_heartbeat(uint32_t now_ms)
+static void maybe_enqueue_heartbeat(uart_engine_port_t *eng, uint32_t now_ms)
 {
-    if (!s_hb_enabled)
+    if (!eng->hb_enabled)
     {
         return;
     }
 
-    if (s_hb_queued_or_active)
+    if (eng->hb_queued_or_active)
     {
         return;
     }
 
-    if ((int32_t)(now_ms - s_hb_next_due_ms) < 0)
+    if ((int32_t)(now_ms - eng->hb_next_due_ms) < 0)
     {
         return;
     }
 
-    if (queue_is_full())
+    if (queue_is_full(eng))
     {
         if (g_ups_debug_status_print_enabled)
         {
-            printf("UART_ENG failure: heartbeat enqueue queue full q=%u\r\n",
-                   (unsigned int)s_q_count);
+            LOG_RING_PRINTF("UART_ENG%u failure: heartbeat enqueue queue full q=%u\r\n",
+                            (unsigned int)eng->port,
+                            (unsigned int)eng->q_count);
         }
         return;
     }
 
-    if (queue_push(&s_hb_cfg.req, true))
+    if (queue_push(eng, &eng->hb_cfg.req, true))
     {
-        s_hb_queued_or_active = true;
-        uint32_t interval = s_hb_cfg.interval_ms;
+        eng->stats.enqueued++;
+        eng->hb_queued_or_active = true;
+        uint32_t interval = eng->hb_cfg.interval_ms;
         if (interval == 0U)
         {
             interval = 1000U;
         }
-        s_hb_next_due_ms = now_ms + interval;
+        eng->hb_next_due_ms = now_ms + interval;
     }
 }
 
-static void job_start_tx(uint32_t now_ms)
+static void job_start_tx(uart_engine_port_t *eng, uint32_t now_ms)
 {
     // Build command bytes into persistent buffer for asynchronous DMA send.
-    uint16_t tx_len = build_cmd_bytes(s_tx_buf,
-                                      (uint16_t)sizeof(s_tx_buf),
-                                      s_active.req.cmd,
-                                      s_active.req.cmd_bits);
+    uint16_t tx_len = build_cmd_bytes(eng->tx_buf,
+                                      (uint16_t)sizeof(eng->tx_buf),
+                                      &eng->active.req);
     if (tx_len == 0U)
     {
-        s_state = UART_ENGINE_STATE_IDLE;
-        apply_interjob_cooldown(now_ms);
-        UART2_Unlock();
-        uart_engine_debug_print_failure(&s_active, "build tx command bytes failed");
-        on_job_final_failure(&s_active);
-        if (s_active.is_heartbeat)
+        eng->state = UART_ENGINE_STATE_IDLE;
+        apply_interjob_cooldown(eng, now_ms);
+        UPS_UART_Unlock(eng->port);
+        uart_engine_debug_print_failure(eng, &eng->active, "build tx command bytes failed");
+        on_job_final_failure(eng, &eng->active);
+        if (eng->active.is_heartbeat)
         {
-            s_hb_queued_or_active = false;
+            eng->hb_queued_or_active = false;
         }
-        active_clear();
+        active_clear(eng);
         return;
     }
 
-    UART2_DiscardBuffered();
-    UART2_TxDoneClear();
+    UPS_UART_DiscardBuffered(eng->port);
+    UPS_UART_TxDoneClear(eng->port);
 
-    UPS_DebugPrintTxCommand(s_tx_buf, tx_len);
+    UPS_DebugPrintTxCommand(eng->tx_buf, tx_len);
 
-    HAL_StatusTypeDef st = UART2_SendBytesDMA(s_tx_buf, tx_len);
+    HAL_StatusTypeDef st = UPS_UART_SendBytesDMA(eng->port, eng->tx_buf, tx_len);
     if (st == HAL_OK)
     {
-        s_state = UART_ENGINE_STATE_TX_WAIT;
-        s_state_start_ms = now_ms;
+        eng->state = UART_ENGINE_STATE_TX_WAIT;
+        eng->state_start_ms = now_ms;
+        eng->tx_start_ms = now_ms;
         return;
     }
 
     // Busy/error: treat as a failure and retry.
-    UART2_Unlock();
+    UPS_UART_Unlock(eng->port);
 
-    if (s_active.retries_left > 0U)
+    if (eng->active.retries_left > 0U)
     {
-        s_active.retries_left--;
-        if (queue_push(&s_active.req, s_active.is_heartbeat))
+        eng->active.retries_left--;
+        if (queue_push(eng, &eng->active.req, eng->active.is_heartbeat))
         {
-            uart_engine_debug_print_retry(&s_active, "tx dma start failed");
-            s_retry_not_before_ms = now_ms + UART_ENGINE_RETRY_COOLDOWN_MS;
+            eng->stats.retries++;
+            trace_outcome(eng, &eng->active, UART_TRACE_OUTCOME_RETRY);
+            uart_engine_debug_print_retry(eng, &eng->active, "tx dma start failed");
+            eng->retry_not_before_ms = now_ms + UART_ENGINE_RETRY_COOLDOWN_MS;
         }
         else
         {
-            uart_engine_debug_print_failure(&s_active, "tx dma start failed and retry enqueue failed");
-            on_job_final_failure(&s_active);
-            if (s_active.is_heartbeat)
+            uart_engine_debug_print_failure(eng, &eng->active, "tx dma start failed and retry enqueue failed");
+            on_job_final_failure(eng, &eng->active);
+            if (eng->active.is_heartbeat)
             {
-                s_hb_queued_or_active = false;
+                eng->hb_queued_or_active = false;
             }
         }
     }
     else
     {
-        uart_engine_debug_print_failure(&s_active, "tx dma start failed no retries left");
-        on_job_final_failure(&s_active);
-        if (s_active.is_heartbeat)
+        uart_engine_debug_print_failure(eng, &eng->active, "tx dma start failed no retries left");
+        on_job_final_failure(eng, &eng->active);
+        if (eng->active.is_heartbeat)
         {
-            s_hb_queued_or_active = false;
+            eng->hb_queued_or_active = false;
         }
     }
 
-    s_state = UART_ENGINE_STATE_IDLE;
-    apply_interjob_cooldown(now_ms);
-    active_clear();
+    eng->state = UART_ENGINE_STATE_IDLE;
+    apply_interjob_cooldown(eng, now_ms);
+    active_clear(eng);
 }
 
-static void job_fail_and_maybe_retry(uint32_t now_ms, const char *reason)
+static void job_fail_and_maybe_retry(uart_engine_port_t *eng, uint32_t now_ms, const char *reason)
 {
-    UART2_Unlock();
+    UPS_UART_Unlock(eng->port);
 
-    if (s_active.retries_left > 0U)
+    if (eng->active.retries_left > 0U)
     {
-        s_active.retries_left--;
-        if (queue_push(&s_active.req, s_active.is_heartbeat))
+        eng->active.retries_left--;
+        if (queue_push(eng, &eng->active.req, eng->active.is_heartbeat))
         {
-            uart_engine_debug_print_retry(&s_active, reason);
-            s_retry_not_before_ms = now_ms + UART_ENGINE_RETRY_COOLDOWN_MS;
+            eng->stats.retries++;
+            trace_outcome(eng, &eng->active, UART_TRACE_OUTCOME_RETRY);
+            uart_engine_debug_print_retry(eng, &eng->active, reason);
+            eng->retry_not_before_ms = now_ms + UART_ENGINE_RETRY_COOLDOWN_MS;
         }
         else
         {
-            uart_engine_debug_print_failure(&s_active, "retry enqueue failed");
-            on_job_final_failure(&s_active);
-            if (s_active.is_heartbeat)
+            uart_engine_debug_print_failure(eng, &eng->active, "retry enqueue failed");
+            on_job_final_failure(eng, &eng->active);
+            if (eng->active.is_heartbeat)
             {
-                s_hb_queued_or_active = false;
+                eng->hb_queued_or_active = false;
             }
         }
     }
     else
     {
-        uart_engine_debug_print_failure(&s_active, reason);
-        on_job_final_failure(&s_active);
-        if (s_active.is_heartbeat)
+        uart_engine_debug_print_failure(eng, &eng->active, reason);
+        on_job_final_failure(eng, &eng->active);
+        if (eng->active.is_heartbeat)
+        {
+            eng->hb_queued_or_active = false;
+        }
+    }
+
+    eng->state = UART_ENGINE_STATE_IDLE;
+    apply_interjob_cooldown(eng, now_ms);
+    active_clear(eng);
+}
+
+// RX_WAIT timeout, streamed or buffered reply alike.
+static void rx_check_timeout(uart_engine_port_t *eng, uint32_t now_ms)
+{
+    if ((now_ms - eng->state_start_ms) >= eng->active.req.timeout_ms)
+    {
+        trace_outcome(eng, &eng->active, UART_TRACE_OUTCOME_TIMEOUT);
+        uart_engine_debug_print_timeout(eng, &eng->active,
+                                        "rx wait",
+                                        (uint32_t)(now_ms - eng->state_start_ms),
+                                        eng->active.req.timeout_ms);
+        eng->stats.timeouts++;
+        job_fail_and_maybe_retry(eng, now_ms, "rx timeout");
+    }
+}
+
+// Streaming RX: hand the bytes received since the last tick to the request's
+// feed parser where they lie in the UART ring, one run per stretch before the
+// ring wraps. Nothing is copied; the wire trace (uart_trace.h) has the bytes.
+static void rx_feed_available(uart_engine_port_t *eng, uint32_t now_ms, uint16_t rx_cap)
+{
+    const uint8_t *run = NULL;
+    uint16_t got = 0U;
+    while ((eng->rx_fed < rx_cap) && ((got = UPS_UART_Peek(eng->port, &run)) != 0U))
+    {
+        if (got > (uint16_t)(rx_cap - eng->rx_fed))
+        {
+            got = (uint16_t)(rx_cap - eng->rx_fed);
+        }
+        eng->rx_fed += got;
+        eng->rx_last_byte_ms = now_ms;
+
+        uart_engine_feed_result_t const result = eng->active.req.feed_fn(eng->port,
+                                                                      &eng->feed_state,
+                                                                      run,
+                                                                      got,
+                                                                      eng->active.req.out_value);
+        if (result == UART_ENGINE_FEED_ERROR)
+        {
+            // Keep the run's last bytes: the drain looks for the ending, and
+            // it may already be here, or start here.
+            uint16_t const keep = (got < UART_ENGINE_MAX_ENDING_LEN) ? got : (uint16_t)UART_ENGINE_MAX_ENDING_LEN;
+            (void)memcpy(eng->rx_buf, &run[got - keep], keep);
+            eng->rx_got = keep;
+            uart_engine_debug_print_raw_rx(eng, "feed rejected reply", run, got);
+        }
+        UPS_UART_Skip(eng->port, got);
+
+        if (result == UART_ENGINE_FEED_DONE)
+        {
+            eng->state = UART_ENGINE_STATE_PROCESS;
+            return;
+        }
+        if (result == UART_ENGINE_FEED_ERROR)
+        {
+            if (rx_has_expected_ending(&eng->active.req, eng->rx_buf, eng->rx_got))
+            {
+                // The whole reply is in: nothing left to drain.
+                job_fail_and_maybe_retry(eng, now_ms, "rx malformed");
+                return;
+            }
+            eng->state = UART_ENGINE_STATE_RX_DRAIN;
+            return;
+        }
+    }
+
+    if (eng->rx_fed >= rx_cap)
+    {
+        job_fail_and_maybe_retry(eng, now_ms, "rx reached cap before feed completed");
+        return;
+    }
+
+    rx_check_timeout(eng, now_ms);
+}
+
+// Swallow the tail of a reply the feed parser already rejected so it cannot
+// bleed into the retry. Ends at the terminator, after a short idle gap, or at
+// the request's original RX timeout, whichever comes first.
+static void rx_drain_rejected(uart_engine_port_t *eng, uint32_t now_ms)
+{
+    uint8_t byte = 0U;
+    while (UPS_UART_ReadByte(eng->port, &byte) != 0)
+    {
+        eng->rx_last_byte_ms = now_ms;
+        if (eng->rx_got < (uint16_t)sizeof(eng->rx_buf))
         {
-            s_hb_queued_or_active = false;
+            eng->rx_buf[eng->rx_got++] = byte;
+        }
+        if (rx_has_expected_ending(&eng->active.req, eng->rx_buf, eng->rx_got))
+        {
+            job_fail_and_maybe_retry(eng, now_ms, "rx malformed");
+            return;
         }
     }
 
-    s_state = UART_ENGINE_STATE_IDLE;
-    apply_interjob_cooldown(now_ms);
-    active_clear();
+    if (((now_ms - eng->rx_last_byte_ms) >= drain_idle_ms(eng)) ||
+        ((now_ms - eng->state_start_ms) >= eng->active.req.timeout_ms))
+    {
+        job_fail_and_maybe_retry(eng, now_ms, "rx malformed");
+    }
 }
 
+static void uart_engine_port_tick(uart_engine_port_t *eng);
+
 /**
- * @brief Advance the UART engine state machine.
+ * @brief Advance the UART engine state machine of every port.
  *
  * Call frequently (e.g. each main loop iteration). This function is
- * non-blocking and will return quickly.
+ * non-blocking and will return quickly. Process/feed callbacks get the port
+ * of the job, so they store into that port's state.
  */
 void uart_engine_tick(void)
 {
-    if (!s_enabled)
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        uart_engine_port_t *eng = &s_ports[port];
+
+        uart_engine_state_t const state_before = eng->state;
+        uint16_t const cmd_before = eng->active.req.cmd;
+        uart_engine_port_tick(eng);
+        if (eng->state != state_before)
+        {
+            // Back to idle the job is already cleared; name the one that ended.
+            bool const ended = (eng->state == UART_ENGINE_STATE_IDLE);
+            uart_trace_state(port,
+                             (uint8_t)eng->state,
+                             ended ? cmd_before : eng->active.req.cmd,
+                             eng->active.retries_left);
+        }
+    }
+}
+
+static void uart_engine_port_tick(uart_engine_port_t *eng)
+{
+    if (!eng->enabled)
     {
         return;
     }
     uint32_t const now_ms = tick_now_ms();
 
-    maybe_enqueue_heartbeat(now_ms);
+    maybe_enqueue_heartbeat(eng, now_ms);
 
-    if ((int32_t)(now_ms - s_retry_not_before_ms) < 0)
+    if ((int32_t)(now_ms - eng->retry_not_before_ms) < 0)
     {
         return;
     }
 
-    switch (s_state)
+    switch (eng->state)
     {
     case UART_ENGINE_STATE_IDLE:
     {
-        if (s_q_count == 0U)
+        if (eng->q_count == 0U)
         {
             return;
         }
 
-        if (!UART2_TryLock())
+        if (!UPS_UART_TryLock(eng->port))
         {
             return;
         }
 
         uart_engine_job_t job;
-        if (!queue_pop(&job))
+        if (!queue_pop(eng, &job))
         {
-            UART2_Unlock();
+            UPS_UART_Unlock(eng->port);
             return;
         }
 
-        s_active = job;
-        s_state = UART_ENGINE_STATE_TX_START;
-        s_state_start_ms = now_ms;
-        if (s_active.is_heartbeat)
+        eng->active = job;
+        if (s_tuning.reply_timeout_ms != 0U)
+        {
+            eng->active.req.timeout_ms = s_tuning.reply_timeout_ms;
+        }
+        eng->state = UART_ENGINE_STATE_TX_START;
+        eng->state_start_ms = now_ms;
+        if (eng->active.is_heartbeat)
         {
             // consumed from queue into active
-            s_hb_queued_or_active = true;
+            eng->hb_queued_or_active = true;
         }
         break;
     }
 
     case UART_ENGINE_STATE_TX_START:
-        job_start_tx(now_ms);
+        job_start_tx(eng, now_ms);
         break;
 
     case UART_ENGINE_STATE_TX_WAIT:
-        if (UART2_TxDone())
+        if (UPS_UART_TxDone(eng->port))
         {
-            s_state = UART_ENGINE_STATE_RX_WAIT;
-            s_state_start_ms = now_ms;
-            s_rx_got = 0U;
+            eng->state = UART_ENGINE_STATE_RX_WAIT;
+            eng->state_start_ms = now_ms;
+            eng->rx_got = 0U;
+            eng->rx_fed = 0U;
+            (void)memset(&eng->feed_state, 0, sizeof(eng->feed_state));
         }
-        else if ((now_ms - s_state_start_ms) >= UART_ENGINE_TX_TIMEOUT_MS)
+        else if ((now_ms - eng->state_start_ms) >= UART_ENGINE_TX_TIMEOUT_MS)
         {
-            uart_engine_debug_print_timeout(&s_active,
+            trace_outcome(eng, &eng->active, UART_TRACE_OUTCOME_TIMEOUT);
+            uart_engine_debug_print_timeout(eng, &eng->active,
                                             "tx wait",
-                                            (uint32_t)(now_ms - s_state_start_ms),
+                                            (uint32_t)(now_ms - eng->state_start_ms),
                                             UART_ENGINE_TX_TIMEOUT_MS);
-            job_fail_and_maybe_retry(now_ms, "tx timeout");
+            job_fail_and_maybe_retry(eng, now_ms, "tx timeout");
         }
         break;
 
     case UART_ENGINE_STATE_RX_WAIT:
     {
-        uint16_t const rx_cap = request_rx_cap(&s_active.req);
+        uint16_t const rx_cap = request_rx_cap(&eng->active.req);
 
         if (rx_cap == 0U)
         {
-            s_state = UART_ENGINE_STATE_PROCESS;
+            eng->state = UART_ENGINE_STATE_PROCESS;
             break;
         }
 
-        if (s_rx_got < rx_cap)
+        if (eng->active.req.feed_fn != NULL)
         {
-            uint16_t want = (uint16_t)(rx_cap - s_rx_got);
-            s_rx_got += UART2_Read(&s_rx_buf[s_rx_got], want);
+            rx_feed_available(eng, now_ms, rx_cap);
+            break;
+        }
+
+        if (eng->rx_got < rx_cap)
+        {
+            uint16_t want = (uint16_t)(rx_cap - eng->rx_got);
+            eng->rx_got += UPS_UART_Read(eng->port, &eng->rx_buf[eng->rx_got], want);
         }
 
-        if (s_active.req.expected_ending)
+        if (eng->active.req.expected_ending)
         {
-            if (rx_has_expected_ending(&s_active.req, s_rx_buf, s_rx_got))
+            if (rx_has_expected_ending(&eng->active.req, eng->rx_buf, eng->rx_got))
             {
-                s_state = UART_ENGINE_STATE_PROCESS;
+                eng->state = UART_ENGINE_STATE_PROCESS;
                 break;
             }
 
-            if (s_rx_got >= rx_cap)
+            if (eng->rx_got >= rx_cap)
             {
-                uart_engine_debug_print_failure(&s_active, "rx reached cap before ending");
-                job_fail_and_maybe_retry(now_ms, "rx ending not found");
+                uart_engine_debug_print_failure(eng, &eng->active, "rx reached cap before ending");
+                job_fail_and_maybe_retry(eng, now_ms, "rx ending not found");
                 break;
             }
         }
-        else if (s_rx_got >= rx_cap)
+        else if (eng->rx_got >= rx_cap)
         {
-            s_state = UART_ENGINE_STATE_PROCESS;
+            if (eng->active.req.modbus_crc && !rx_crc_ok(eng->rx_buf, eng->rx_got))
+            {
+                uart_engine_debug_print_raw_rx(eng, "crc mismatch", eng->rx_buf, eng->rx_got);
+                job_fail_and_maybe_retry(eng, now_ms, "rx crc mismatch");
+                break;
+            }
+            eng->state = UART_ENGINE_STATE_PROCESS;
             break;
         }
 
-        if ((now_ms - s_state_start_ms) >= s_active.req.timeout_ms)
-        {
-            uart_engine_debug_print_timeout(&s_active,
-                                            "rx wait",
-                                            (uint32_t)(now_ms - s_state_start_ms),
-                                            s_active.req.timeout_ms);
-            job_fail_and_maybe_retry(now_ms, "rx timeout");
-        }
+        rx_check_timeout(eng, now_ms);
         break;
     }
 
+    case UART_ENGINE_STATE_RX_DRAIN:
+        rx_drain_rejected(eng, now_ms);
+        break;
+
     case UART_ENGINE_STATE_PROCESS:
     {
         bool ok = true;
-        if (s_active.req.process_fn != NULL)
+        if ((eng->active.req.feed_fn == NULL) && (eng->active.req.process_fn != NULL))
         {
-            ok = s_active.req.process_fn(s_active.req.cmd, s_rx_buf, s_rx_got, s_active.req.out_value);
+            // A checked CRC is not part of what the protocol code parses.
+            uint16_t const rx_len = eng->active.req.modbus_crc ? (uint16_t)(eng->rx_got - 2U) : eng->rx_got;
+            ok = eng->active.req.process_fn(eng->port, eng->active.req.cmd, eng->rx_buf, rx_len,
+                                            eng->active.req.out_value);
         }
 
-        UART2_Unlock();
+        UPS_UART_Unlock(eng->port);
 
         if (ok)
         {
-            on_job_success(&s_active);
-            if (s_active.is_heartbeat)
+            record_latency(eng, eng->active.req.cmd, now_ms);
+            on_job_success(eng, &eng->active);
+            if (eng->active.is_heartbeat)
             {
-                s_hb_queued_or_active = false;
+                eng->hb_queued_or_active = false;
             }
-            s_state = UART_ENGINE_STATE_IDLE;
-            apply_interjob_cooldown(now_ms);
-            active_clear();
+            eng->state = UART_ENGINE_STATE_IDLE;
+            apply_interjob_cooldown(eng, now_ms);
+            active_clear(eng);
             return;
         }
 
         // Parse failed.
-        uart_engine_debug_print_raw_rx("process callback returned false", s_rx_buf, s_rx_got);
-        if (s_active.retries_left > 0U)
+        uart_engine_debug_print_raw_rx(eng, "process callback returned false", eng->rx_buf, eng->rx_got);
+        if (eng->active.retries_left > 0U)
         {
-            s_active.retries_left--;
-            if (queue_push(&s_active.req, s_active.is_heartbeat))
+            eng->active.retries_left--;
+            if (queue_push(eng, &eng->active.req, eng->active.is_heartbeat))
             {
-                uart_engine_debug_print_retry(&s_active, "process callback returned false");
-                s_retry_not_before_ms = now_ms + UART_ENGINE_RETRY_COOLDOWN_MS;
+                eng->stats.retries++;
+                trace_outcome(eng, &eng->active, UART_TRACE_OUTCOME_RETRY);
+                uart_engine_debug_print_retry(eng, &eng->active, "process callback returned false");
+                eng->retry_not_before_ms = now_ms + UART_ENGINE_RETRY_COOLDOWN_MS;
             }
             else
             {
-                uart_engine_debug_print_failure(&s_active, "parse failed and retry enqueue failed");
-                on_job_final_failure(&s_active);
-                if (s_active.is_heartbeat)
+                uart_engine_debug_print_failure(eng, &eng->active, "parse failed and retry enqueue failed");
+                on_job_final_failure(eng, &eng->active);
+                if (eng->active.is_heartbeat)
                 {
-                    s_hb_queued_or_active = false;
+                    eng->hb_queued_or_active = false;
                 }
             }
         }
         else
         {
-            uart_engine_debug_print_failure(&s_active, "process callback returned false");
-            on_job_final_failure(&s_active);
-            if (s_active.is_heartbeat)
+            uart_engine_debug_print_failure(eng, &eng->active, "process callback returned false");
+            on_job_final_failure(eng, &eng->active);
+            if (eng->active.is_heartbeat)
             {
-                s_hb_queued_or_active = false;
+                eng->hb_queued_or_active = false;
             }
         }
 
-        s_state = UART_ENGINE_STATE_IDLE;
-        apply_interjob_cooldown(now_ms);
-        active_clear();
+        eng->state = UART_ENGINE_STATE_IDLE;
+        apply_interjob_cooldown(eng, now_ms);
+        active_clear(eng);
         break;
     }
 
     default:
-        s_state = UART_ENGINE_STATE_IDLE;
-        active_clear();
+        eng->state = UART_ENGINE_STATE_IDLE;
+        active_clear(eng);
         break;
     }
 }
@@ -0,0 +1,180 @@
+#include "uart_trace.h"
+
+#include "ups_data.h"
+
+#include "stm32f1xx_hal.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+_Static_assert(sizeof(uart_trace_event_t) == 8U, "trace events are 8 bytes");
+_Static_assert((UART_TRACE_EVENTS & (UART_TRACE_EVENTS - 1U)) == 0U, "event count is a power of two");
+_Static_assert(UPS_PORT_COUNT <= 4U, "port field is 2 bits");
+
+#define UART_TRACE_COUNT_MASK 0x07U
+
+static uart_trace_event_t s_events[UART_TRACE_EVENTS];
+static volatile uint32_t s_written = 0U;
+
+// Called with interrupts masked, so a SysTick wrap that is not counted yet
+// shows as a pending SysTick interrupt.
+static uint32_t uart_trace_time_masked(void)
+{
+    uint32_t ms = HAL_GetTick();
+    uint32_t val = SysTick->VAL;
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0U)
+    {
+        val = SysTick->VAL;
+        ms++;
+    }
+    uint32_t const ticks_per_ms = SysTick->LOAD + 1U;
+    uint32_t const tenths = (((ticks_per_ms - 1U) - val) * 10U) / ticks_per_ms;
+    return ((ms * 10U) + tenths) & UART_TRACE_TIME_MASK;
+}
+
+static uart_trace_event_t *uart_trace_new_event(uart_trace_type_t type, uint8_t port, uint8_t count)
+{
+    uart_trace_event_t *e = &s_events[s_written % UART_TRACE_EVENTS];
+    uint32_t const t = uart_trace_time_masked();
+
+    e->info = (uint8_t)(((uint8_t)type << 5) | ((port & 0x03U) << 3) | count);
+    e->time[0] = (uint8_t)(t & 0xFFU);
+    e->time[1] = (uint8_t)((t >> 8) & 0xFFU);
+    e->time[2] = (uint8_t)((t >> 16) & 0xFFU);
+    (void)memset(e->data, 0, sizeof(e->data));
+    s_written++;
+    return e;
+}
+
+static void uart_trace_put(uart_trace_type_t type, uint8_t port, const uint8_t *data)
+{
+    uint32_t const primask = __get_PRIMASK();
+    __disable_irq();
+    uart_trace_event_t *e = uart_trace_new_event(type, port, 0U);
+    memcpy(e->data, data, UART_TRACE_DATA_MAX);
+    __set_PRIMASK(primask);
+}
+
+static void uart_trace_put_job(uart_trace_type_t type, uint8_t port, uint8_t code, uint16_t cmd, uint8_t retries_left)
+{
+    uint8_t const data[UART_TRACE_DATA_MAX] = {
+        code,
+        (uint8_t)(cmd & 0xFFU),
+        (uint8_t)(cmd >> 8),
+        retries_left,
+    };
+    uart_trace_put(type, port, data);
+}
+
+void uart_trace_tx(uint8_t port, const uint8_t *data, uint16_t len)
+{
+    if (data == NULL)
+    {
+        return;
+    }
+
+    uint32_t const primask = __get_PRIMASK();
+    __disable_irq();
+    // Always a fresh event, so the first one carries the send time.
+    uint16_t i = 0U;
+    while (i < len)
+    {
+        uint16_t const left = (uint16_t)(len - i);
+        uint8_t const n = (left > UART_TRACE_DATA_MAX) ? (uint8_t)UART_TRACE_DATA_MAX : (uint8_t)left;
+        uart_trace_event_t *e = uart_trace_new_event(UART_TRACE_TX, port, n);
+        memcpy(e->data, &data[i], n);
+        i = (uint16_t)(i + n);
+    }
+    __set_PRIMASK(primask);
+}
+
+void uart_trace_tx_done(uint8_t port)
+{
+    uint32_t const primask = __get_PRIMASK();
+    __disable_irq();
+    (void)uart_trace_new_event(UART_TRACE_TX_DONE, port, 0U);
+    __set_PRIMASK(primask);
+}
+
+void uart_trace_rx_byte(uint8_t port, uint8_t byte)
+{
+    uint8_t const key = (uint8_t)(((uint8_t)UART_TRACE_RX << 5) | ((port & 0x03U) << 3));
+
+    uint32_t const primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t const written = s_written;
+    if (written > 0U)
+    {
+        // Append to this port's open RX event while it has room.
+        uart_trace_event_t *last = &s_events[(written - 1U) % UART_TRACE_EVENTS];
+        uint8_t const count = (uint8_t)(last->info & UART_TRACE_COUNT_MASK);
+        if (((last->info & (uint8_t)~UART_TRACE_COUNT_MASK) == key) && (count < UART_TRACE_DATA_MAX))
+        {
+            last->data[count] = byte;
+            last->info++;
+            __set_PRIMASK(primask);
+            return;
+        }
+    }
+    uart_trace_event_t *e = uart_trace_new_event(UART_TRACE_RX, port, 1U);
+    e->data[0] = byte;
+    __set_PRIMASK(primask);
+}
+
+void uart_trace_rx_error(uint8_t port, uint32_t error_code)
+{
+    uint8_t const data[UART_TRACE_DATA_MAX] = {(uint8_t)(error_code & 0xFFU), 0U, 0U, 0U};
+    uart_trace_put(UART_TRACE_RX_ERROR, port, data);
+}
+
+void uart_trace_state(uint8_t port, uint8_t state, uint16_t cmd, uint8_t retries_left)
+{
+    uart_trace_put_job(UART_TRACE_STATE, port, state, cmd, retries_left);
+}
+
+void uart_trace_outcome(uint8_t port, uart_trace_outcome_t outcome, uint16_t cmd, uint8_t retries_left)
+{
+    uart_trace_put_job(UART_TRACE_OUTCOME, port, (uint8_t)outcome, cmd, retries_left);
+}
+
+void uart_trace_baud(uint8_t port, uint32_t baud)
+{
+    uint8_t data[UART_TRACE_DATA_MAX];
+    memcpy(data, &baud, sizeof(data));
+    uart_trace_put(UART_TRACE_BAUD, port, data);
+}
+
+uint32_t uart_trace_now(void)
+{
+    uint32_t const primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t const t = uart_trace_time_masked();
+    __set_PRIMASK(primask);
+    return t;
+}
+
+uint32_t uart_trace_written(void)
+{
+    return s_written;
+}
+
+bool uart_trace_read(uint32_t index, uart_trace_event_t *out)
+{
+    if (out == NULL)
+    {
+        return false;
+    }
+
+    uint32_t const primask = __get_PRIMASK();
+    __disable_irq();
+    uint32_t const written = s_written;
+    bool const valid = ((written - index) - 1U) < UART_TRACE_EVENTS;
+    if (valid)
+    {
+        *out = s_events[index % UART_TRACE_EVENTS];
+    }
+    __set_PRIMASK(primask);
+    return valid;
+}
@@ -0,0 +1,140 @@
+#include "ups_cache.h"
+
+#include "flash_config.h"
+#include "ups_data.h"
+#include "usb_descriptors.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Values of one port that the constant LUTs read.
+typedef struct
+{
+    uint16_t battery_config_voltage;
+    uint16_t battery_manufacturer_date;
+    uint16_t input_config_voltage;
+    uint16_t input_low_voltage_transfer;
+    uint16_t input_high_voltage_transfer;
+    uint16_t output_config_voltage;
+    uint16_t output_config_active_power;
+    uint8_t valid;
+    uint8_t reserved;
+} ups_cache_port_t;
+
+// The USB strings identify the UPS of port 0 (see spm2k_process_string).
+typedef struct
+{
+    char manufacturer[USB_DESC_STR_MAX_CHARS];
+    char product[USB_DESC_STR_MAX_CHARS];
+    char serial[USB_DESC_STR_MAX_CHARS];
+    ups_cache_port_t port[UPS_PORT_COUNT];
+} ups_cache_t;
+
+static ups_cache_t s_cache;
+static bool s_identity_restored = false;
+static bool s_port_restored[UPS_PORT_COUNT];
+
+static void ups_cache_copy_string(char *dst, uint8_t strid)
+{
+    const char *src = usb_desc_get_string_ascii(strid);
+    memset(dst, 0, USB_DESC_STR_MAX_CHARS);
+    if (src != NULL)
+    {
+        strncpy(dst, src, USB_DESC_STR_MAX_CHARS - 1U);
+    }
+}
+
+bool ups_cache_restore(void)
+{
+    if (!flash_log_load(FLASH_CACHE_PAGE_ADDR, &s_cache, (uint16_t)sizeof(s_cache)))
+    {
+        memset(&s_cache, 0, sizeof(s_cache));
+        return false;
+    }
+
+    bool any = false;
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        ups_cache_port_t const *c = &s_cache.port[port];
+        if (c->valid == 0U)
+        {
+            continue;
+        }
+
+        ups_state_t *ups = &g_ups[port];
+        ups->battery.config_voltage = c->battery_config_voltage;
+        ups->battery.manufacturer_date = c->battery_manufacturer_date;
+        ups->input.config_voltage = c->input_config_voltage;
+        ups->input.low_voltage_transfer = c->input_low_voltage_transfer;
+        ups->input.high_voltage_transfer = c->input_high_voltage_transfer;
+        ups->output.config_voltage = c->output_config_voltage;
+        ups->output.config_active_power = c->output_config_active_power;
+        s_port_restored[port] = true;
+        any = true;
+    }
+
+    if (s_cache.port[0].valid != 0U)
+    {
+        s_cache.manufacturer[USB_DESC_STR_MAX_CHARS - 1U] = '\0';
+        s_cache.product[USB_DESC_STR_MAX_CHARS - 1U] = '\0';
+        s_cache.serial[USB_DESC_STR_MAX_CHARS - 1U] = '\0';
+        (void)usb_desc_set_string_ascii(USB_STRID_MANUFACTURER, s_cache.manufacturer);
+        (void)usb_desc_set_string_ascii(USB_STRID_PRODUCT, s_cache.product);
+        (void)usb_desc_set_string_ascii(USB_STRID_SERIAL, s_cache.serial);
+        s_identity_restored = true;
+    }
+    return any;
+}
+
+bool ups_cache_port_is_restored(uint8_t port)
+{
+    return (port < UPS_PORT_COUNT) && s_port_restored[port];
+}
+
+bool ups_cache_update(uint8_t port)
+{
+    if (port >= UPS_PORT_COUNT)
+    {
+        return false;
+    }
+
+    ups_state_t const *ups = &g_ups[port];
+    ups_cache_port_t *c = &s_cache.port[port];
+
+    memset(c, 0, sizeof(*c));
+    c->battery_config_voltage = ups->battery.config_voltage;
+    c->battery_manufacturer_date = ups->battery.manufacturer_date;
+    c->input_config_voltage = ups->input.config_voltage;
+    c->input_low_voltage_transfer = ups->input.low_voltage_transfer;
+    c->input_high_voltage_transfer = ups->input.high_voltage_transfer;
+    c->output_config_voltage = ups->output.config_voltage;
+    c->output_config_active_power = ups->output.config_active_power;
+    c->valid = 1U;
+
+    bool identity_changed = false;
+    if (port == 0U)
+    {
+        char manufacturer[USB_DESC_STR_MAX_CHARS];
+        char product[USB_DESC_STR_MAX_CHARS];
+        char serial[USB_DESC_STR_MAX_CHARS];
+        ups_cache_copy_string(manufacturer, USB_STRID_MANUFACTURER);
+        ups_cache_copy_string(product, USB_STRID_PRODUCT);
+        ups_cache_copy_string(serial, USB_STRID_SERIAL);
+
+        // Keyed by the serial: a different UPS (or a renamed one) means
+        // the host saw stale strings.
+        identity_changed = s_identity_restored &&
+                           ((strcmp(serial, s_cache.serial) != 0) ||
+                            (strcmp(product, s_cache.product) != 0) ||
+                            (strcmp(manufacturer, s_cache.manufacturer) != 0));
+
+        memcpy(s_cache.manufacturer, manufacturer, sizeof(manufacturer));
+        memcpy(s_cache.product, product, sizeof(product));
+        memcpy(s_cache.serial, serial, sizeof(serial));
+        s_identity_restored = false;
+    }
+
+    (void)flash_log_save(FLASH_CACHE_PAGE_ADDR, &s_cache, (uint16_t)sizeof(s_cache));
+    return identity_changed;
+}
@@ -0,0 +1,292 @@
+#include "ups_diag.h"
+
+#include "idle_sleep.h"
+#include "log_ring.h"
+#include "main.h"
+#include "power_mode.h"
+#include "task_sched.h"
+#include "uart_engine.h"
+#include "ups_data.h"
+#include "ups_hid_device.h"
+
+#include "stm32f1xx_hal.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+_Static_assert(UART_ENGINE_LATENCY_SLOTS <= UPS_DIAG_LATENCY_SLOTS, "every latency slot has room in the report");
+
+#define UPS_DIAG_STACK_PAINT 0xC5C5C5C5UL
+// Left unpainted below the stack pointer of ups_diag_init().
+#define UPS_DIAG_STACK_GUARD 64U
+#define UPS_DIAG_RAM_BASE 0x20000000UL
+
+extern uint8_t _end;    // linker script: end of .bss, start of the heap
+extern uint8_t _estack; // linker script: top of RAM
+void *_sbrk(ptrdiff_t incr);
+
+// Lowest stack address seen written; only goes down.
+static uintptr_t s_stack_low = 0U;
+static uint32_t s_stack_headroom_min = UINT32_MAX;
+
+static uint32_t s_pass_start_cycles = 0U;
+static uint32_t s_max_pass_cycles = 0U;
+static uint32_t s_window_start_ms = 0U;
+static uint32_t s_window_busy_cycles = 0U;
+static uint16_t s_busy_permille = 0U;
+
+static uint8_t *put_u8(uint8_t *p, uint8_t v)
+{
+    *p = v;
+    return p + 1;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint32_t v)
+{
+    if (v > 0xFFFFU)
+    {
+        v = 0xFFFFU;
+    }
+    p[0] = (uint8_t)(v & 0xFFU);
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v & 0xFFU);
+    p[1] = (uint8_t)((v >> 8) & 0xFFU);
+    p[2] = (uint8_t)((v >> 16) & 0xFFU);
+    p[3] = (uint8_t)(v >> 24);
+    return p + 4;
+}
+
+static uintptr_t heap_end(void)
+{
+    return ((uintptr_t)_sbrk(0) + 3U) & ~(uintptr_t)3U;
+}
+
+void ups_diag_init(void)
+{
+    uint32_t *p = (uint32_t *)heap_end();
+    uint32_t *const end = (uint32_t *)((__get_MSP() - UPS_DIAG_STACK_GUARD) & ~3UL);
+    while (p < end)
+    {
+        *p++ = UPS_DIAG_STACK_PAINT;
+    }
+    s_stack_low = (uintptr_t)end;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0U;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+// Scans up from the heap end to the first word the stack has overwritten.
+// Words above the previous low mark are known to be used already.
+static void ups_diag_scan_stack(void)
+{
+    uintptr_t const heap = heap_end();
+    uint32_t const *p = (uint32_t const *)heap;
+    while (((uintptr_t)p < s_stack_low) && (*p == UPS_DIAG_STACK_PAINT))
+    {
+        p++;
+    }
+    s_stack_low = (uintptr_t)p;
+
+    uint32_t const headroom = (s_stack_low > heap) ? (uint32_t)(s_stack_low - heap) : 0U;
+    if (headroom < s_stack_headroom_min)
+    {
+        s_stack_headroom_min = headroom;
+    }
+}
+
+void ups_diag_pass_begin(void)
+{
+    s_pass_start_cycles = DWT->CYCCNT;
+}
+
+void ups_diag_pass_end(uint32_t now_ms)
+{
+    uint32_t const cycles = DWT->CYCCNT - s_pass_start_cycles;
+    if (cycles > s_max_pass_cycles)
+    {
+        s_max_pass_cycles = cycles;
+    }
+    s_window_busy_cycles += cycles;
+
+    // The cycle counter stops in sleep, so the window is timed by the tick.
+    uint32_t const elapsed_ms = now_ms - s_window_start_ms;
+    if (elapsed_ms >= 1000U)
+    {
+        uint64_t const window_cycles = (uint64_t)elapsed_ms * (SystemCoreClock / 1000U);
+        uint64_t permille = ((uint64_t)s_window_busy_cycles * 1000U) / window_cycles;
+        s_busy_permille = (uint16_t)((permille > 1000U) ? 1000U : permille);
+        s_window_busy_cycles = 0U;
+        s_window_start_ms = now_ms;
+    }
+}
+
+bool ups_diag_is_report(uint8_t report_id)
+{
+    return (report_id >= REPORT_ID_DIAG_ENGINE) && (report_id <= REPORT_ID_DIAG_USB);
+}
+
+static uint16_t build_engine(uint8_t port, uint8_t *buffer)
+{
+    uart_engine_stats_t engine;
+    uart_engine_get_stats(port, &engine);
+
+    uint8_t *p = buffer;
+    p = put_u32(p, engine.enqueued);
+    p = put_u32(p, engine.completed);
+    p = put_u32(p, engine.failed);
+    p = put_u32(p, engine.retries);
+    p = put_u32(p, engine.timeouts);
+    p = put_u32(p, engine.queue_full);
+    p = put_u8(p, engine.queue_depth);
+    p = put_u8(p, engine.queue_high_water);
+    p = put_u8(p, engine.consecutive_failures);
+    return (uint16_t)(p - buffer);
+}
+
+static uint16_t build_latency(uint8_t port, uint8_t *buffer)
+{
+    uart_engine_latency_t latency[UART_ENGINE_LATENCY_SLOTS];
+    uint8_t const n = uart_engine_get_latencies(port, latency, UART_ENGINE_LATENCY_SLOTS);
+
+    uint8_t *p = buffer;
+    (void)memset(buffer, 0, UPS_DIAG_LATENCY_SIZE);
+    for (uint8_t i = 0U; i < n; i++)
+    {
+        uart_engine_latency_t const *l = &latency[i];
+        p = put_u16(p, l->cmd);
+        p = put_u16(p, l->count);
+        p = put_u16(p, (l->count > 0U) ? (l->total_ms / l->count) : 0U);
+        p = put_u16(p, l->last_ms);
+        p = put_u16(p, l->max_ms);
+    }
+    return UPS_DIAG_LATENCY_SIZE;
+}
+
+static uint16_t build_link(uint8_t port, uint8_t *buffer)
+{
+    uart_engine_stats_t engine;
+    uart_engine_get_stats(port, &engine);
+
+    ups_uart_stats_t uart;
+    UPS_UART_GetStats(port, &uart);
+
+    uint32_t const age_ms = (engine.last_completed_ms != 0U) ? (HAL_GetTick() - engine.last_completed_ms) : UINT32_MAX;
+    uint8_t const flags = (uint8_t)((ups_port_is_ready(port) ? (1U << 0) : 0U) |
+                                    (ups_port_has_constants(port) ? (1U << 1) : 0U));
+
+    uint8_t *p = buffer;
+    p = put_u8(p, (uint8_t)ups_port_readiness(port));
+    p = put_u8(p, flags);
+    p = put_u32(p, UPS_UART_GetBaud(port));
+    p = put_u32(p, age_ms);
+    p = put_u32(p, ups_port_readiness_ms(port, UPS_READINESS_LINK));
+    p = put_u32(p, uart.rx_errors);
+    p = put_u32(p, uart.rx_dropped);
+    p = put_u16(p, uart.rx_high_water);
+    p = put_u16(p, UPS_UART_RX_BUFFER_SIZE);
+    return (uint16_t)(p - buffer);
+}
+
+static uint16_t build_loop(uint8_t *buffer)
+{
+    task_sched_stats_t sched;
+    idle_sleep_stats_t idle;
+    task_sched_get_stats(&sched);
+    idle_sleep_get_stats(&idle);
+
+    uint32_t const cycles_per_us = SystemCoreClock / 1000000U;
+
+    uint8_t *p = buffer;
+    p = put_u32(p, HAL_GetTick());
+    p = put_u32(p, sched.passes);
+    p = put_u32(p, sched.idle_passes);
+    p = put_u32(p, sched.runs);
+    p = put_u32(p, sched.event_runs);
+    p = put_u32(p, idle.wakeups_per_s);
+    p = put_u32(p, idle.tickless_ms);
+    p = put_u32(p, (cycles_per_us > 0U) ? (s_max_pass_cycles / cycles_per_us) : 0U);
+    p = put_u16(p, s_busy_permille);
+    return (uint16_t)(p - buffer);
+}
+
+static uint16_t build_memory(uint8_t *buffer)
+{
+    ups_diag_scan_stack();
+
+    log_ring_stats_t log;
+    log_ring_get_stats(&log);
+
+    uintptr_t const ram_top = (uintptr_t)&_estack;
+    uintptr_t const static_end = (uintptr_t)&_end;
+
+    uint8_t *p = buffer;
+    p = put_u16(p, (uint32_t)(ram_top - UPS_DIAG_RAM_BASE));
+    p = put_u16(p, (uint32_t)(static_end - UPS_DIAG_RAM_BASE));
+    p = put_u16(p, (uint32_t)(heap_end() - static_end));
+    p = put_u16(p, (uint32_t)(ram_top - s_stack_low));
+    p = put_u16(p, s_stack_headroom_min);
+    p = put_u16(p, log.high_water);
+    p = put_u16(p, LOG_RING_SIZE);
+    p = put_u32(p, log.dropped);
+    return (uint16_t)(p - buffer);
+}
+
+static uint16_t build_usb(uint8_t *buffer)
+{
+    ups_hid_wakeup_stats_t wakeup;
+    ups_hid_get_wakeup_stats(&wakeup);
+    power_mode_stats_t power;
+    power_mode_get_stats(HAL_GetTick(), &power);
+
+    uint8_t const flags = (uint8_t)((wakeup.suspended ? (1U << 0) : 0U) |
+                                    (wakeup.remote_wakeup_en ? (1U << 1) : 0U) |
+                                    (wakeup.wakeup_pending ? (1U << 2) : 0U) |
+                                    ((power_mode_get() == POWER_MODE_SUSPEND) ? (1U << 3) : 0U));
+
+    uint8_t *p = buffer;
+    p = put_u8(p, flags);
+    p = put_u32(p, wakeup.suspends);
+    p = put_u32(p, wakeup.resumes);
+    p = put_u32(p, wakeup.wakeups);
+    p = put_u32(p, wakeup.wakeups_blocked);
+    p = put_u16(p, wakeup.last_resume_ms);
+    p = put_u16(p, wakeup.max_resume_ms);
+    p = put_u16(p, wakeup.last_report_ms);
+    p = put_u16(p, wakeup.max_report_ms);
+    p = put_u32(p, power.low_power_ms);
+    return (uint16_t)(p - buffer);
+}
+
+uint16_t ups_diag_build_report(uint8_t port, uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
+{
+    if ((buffer == NULL) || (port >= UPS_PORT_COUNT))
+    {
+        return 0U;
+    }
+
+    switch (report_id)
+    {
+    case REPORT_ID_DIAG_ENGINE:
+        return (reqlen >= UPS_DIAG_ENGINE_SIZE) ? build_engine(port, buffer) : 0U;
+    case REPORT_ID_DIAG_LATENCY:
+        return (reqlen >= UPS_DIAG_LATENCY_SIZE) ? build_latency(port, buffer) : 0U;
+    case REPORT_ID_DIAG_LINK:
+        return (reqlen >= UPS_DIAG_LINK_SIZE) ? build_link(port, buffer) : 0U;
+    case REPORT_ID_DIAG_LOOP:
+        return (reqlen >= UPS_DIAG_LOOP_SIZE) ? build_loop(buffer) : 0U;
+    case REPORT_ID_DIAG_MEMORY:
+        return (reqlen >= UPS_DIAG_MEMORY_SIZE) ? build_memory(buffer) : 0U;
+    case REPORT_ID_DIAG_USB:
+        return (reqlen >= UPS_DIAG_USB_SIZE) ? build_usb(buffer) : 0U;
+    default:
+        return 0U;
+    }
+}
@@ -3,233 +3,149 @@
 #include "tusb.h"
 
 #include "ups_data.h"
+#include "ups_hid_layout.h"
 
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
 // HID payload report layouts (do not include Report ID byte; TinyUSB prepends it).
-typedef struct TU_ATTR_PACKED
-{
-    uint8_t remaining_capacity;
-    uint16_t run_time_to_empty_s;
-    uint16_t ps_voltage;
-    uint16_t present_status_bits;
-} ups_report_power_summary_input_t;
-
-typedef struct TU_ATTR_PACKED
-{
-    uint8_t warning_capacity_limit;
-    uint8_t remaining_capacity_limit;
-    uint8_t remaining_capacity;
-    uint16_t run_time_to_empty_s;
-    uint16_t remaining_time_limit_s;
-    uint8_t i_device_chemistry;
-    uint8_t capacity_mode;
-    uint8_t full_charge_capacity;
-    uint8_t design_capacity;
-    uint8_t rechargeable_and_padding;
-    uint8_t capacity_granularity_1;
-    uint8_t capacity_granularity_2;
-    uint8_t i_strings_packed;
-    uint16_t present_status_bits;
-} ups_report_power_summary_feature_t;
-
-typedef struct TU_ATTR_PACKED
-{
-    uint16_t input_voltage;
-    uint16_t input_frequency;
-    uint16_t config_voltage;
-    uint16_t low_voltage_transfer;
-    uint16_t high_voltage_transfer;
-} ups_report_input_feature_t;
+//
+// One packed struct per (report, kind) is generated from ups_hid_layout.h.
+// Members are bit-fields in wire order; GCC packs them LSB first, which is
+// the HID bit order. A report with no fields of a kind becomes an empty
+// struct (GNU C, size 0) and is treated as absent by the builders.
+#define UPS_HID_MEMBER(sel, report, kind, member, ctype, bits, ...) \
+    UPS_HID_SELECT(sel, report, kind, ctype member : bits;)
+#define UPS_HID_PAD_MEMBER(sel, report, kind, bits) \
+    UPS_HID_SELECT(sel, report, kind, uint8_t : bits;)
+#define UPS_HID_BITS(sel, report, kind, member, ctype, bits, ...) \
+    UPS_HID_SELECT(sel, report, kind, +(bits))
+#define UPS_HID_PAD_BITS(sel, report, kind, bits) \
+    UPS_HID_SELECT(sel, report, kind, +(bits))
+#define UPS_HID_ASSIGN(sel, report, kind, member, ctype, bits, page, usage, lmin, lmax, unit, exp, flags, value) \
+    UPS_HID_SELECT(sel, report, kind, report_data.member = (ctype)(ups->value);)
+
+#define UPS_HID_SKIP_PAD(sel, report, kind, bits)
+#define UPS_HID_SKIP_BEGIN(page, usage)
+#define UPS_HID_SKIP_END()
+#define UPS_HID_SKIP_GLOBAL(...)
+
+// Struct, size checks and fill function for one (report, kind).
+#define UPS_HID_DEFINE_REPORT_KIND(sel)                                                                        \
+    typedef struct TU_ATTR_PACKED                                                                             \
+    {                                                                                                         \
+        UPS_HID_LAYOUT(UPS_HID_MEMBER, UPS_HID_PAD_MEMBER, UPS_HID_SKIP_BEGIN, UPS_HID_SKIP_END,              \
+            UPS_HID_SKIP_GLOBAL, sel)                                                                         \
+    } ups_report_##sel##_t;                                                                                   \
+    _Static_assert(sizeof(ups_report_##sel##_t) * 8U ==                                                       \
+                       (0 UPS_HID_LAYOUT(UPS_HID_BITS, UPS_HID_PAD_BITS, UPS_HID_SKIP_BEGIN, UPS_HID_SKIP_END, \
+                              UPS_HID_SKIP_GLOBAL, sel)),                                                     \
+                   "HID " #sel " report: struct size does not match descriptor bit count");                  \
+    _Static_assert(sizeof(ups_report_##sel##_t) < CFG_TUD_HID_EP_BUFSIZE,                                     \
+                   "HID " #sel " report does not fit the HID endpoint buffer");                              \
+    static void ups_hid_fill_##sel(const ups_state_t *ups, uint8_t *buffer)                                   \
+    {                                                                                                         \
+        ups_report_##sel##_t report_data;                                                                     \
+        memset(&report_data, 0, sizeof(report_data));                                                         \
+        UPS_HID_LAYOUT(UPS_HID_ASSIGN, UPS_HID_SKIP_PAD, UPS_HID_SKIP_BEGIN, UPS_HID_SKIP_END,                \
+            UPS_HID_SKIP_GLOBAL, sel)                                                                         \
+        memcpy(buffer, &report_data, sizeof(report_data));                                                    \
+    }
 
-typedef struct TU_ATTR_PACKED
-{
-    uint8_t percent_load;
-    uint16_t config_active_power;
-    uint16_t config_voltage;
-    uint16_t output_voltage;
-    int16_t output_current;
-    uint16_t output_frequency;
-} ups_report_output_feature_t;
+#define UPS_HID_DEFINE_REPORT(report)                   \
+    UPS_HID_DEFINE_REPORT_KIND(report##_INPUT)    \
+    UPS_HID_DEFINE_REPORT_KIND(report##_FEATURE)
 
-typedef struct TU_ATTR_PACKED
-{
-    uint16_t run_time_to_empty_s;
-    uint16_t remaining_time_limit_s;
-    uint16_t manufacturer_date;
-    uint16_t battery_voltage;
-    int16_t battery_current;
-    uint16_t config_voltage;
-    uint16_t temperature;
-} ups_report_battery_feature_t;
+UPS_HID_REPORTS(UPS_HID_DEFINE_REPORT)
 
-static inline uint8_t pack_2bit4(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+typedef struct
 {
-    return (uint8_t)(((a & 0x03U) << 0) |
-                     ((b & 0x03U) << 2) |
-                     ((c & 0x03U) << 4) |
-                     ((d & 0x03U) << 6));
-}
-
-static uint16_t pack_present_status(const ups_present_status_t *status)
+    uint16_t size;
+    void (*fill)(const ups_state_t *ups, uint8_t *buffer);
+} ups_hid_report_builder_t;
+
+#define UPS_HID_BUILDER_INPUT(report) \
+    [REPORT_ID_##report] = {(uint16_t)sizeof(ups_report_##report##_INPUT_t), ups_hid_fill_##report##_INPUT},
+#define UPS_HID_BUILDER_FEATURE(report) \
+    [REPORT_ID_##report] = {(uint16_t)sizeof(ups_report_##report##_FEATURE_t), ups_hid_fill_##report##_FEATURE},
+
+// Indexed by report ID; unused IDs stay zero (size 0 = no such report).
+static const ups_hid_report_builder_t k_ups_hid_input_builders[] = {
+    UPS_HID_REPORTS(UPS_HID_BUILDER_INPUT)};
+static const ups_hid_report_builder_t k_ups_hid_feature_builders[] = {
+    UPS_HID_REPORTS(UPS_HID_BUILDER_FEATURE)};
+
+static uint16_t ups_hid_build(const ups_hid_report_builder_t *builders, size_t count, const ups_state_t *ups,
+                              uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
 {
-    if (status == NULL)
+    if ((ups == NULL) || (buffer == NULL) || (reqlen == 0U) || (report_id >= count))
     {
         return 0U;
     }
-    uint16_t bits = 0U;
-    if (status->ac_present)
-        bits |= (1U << 0);
-    if (status->charging)
-        bits |= (1U << 1);
-    if (status->discharging)
-        bits |= (1U << 2);
-    if (status->fully_charged)
-        bits |= (1U << 3);
-    if (status->need_replacement)
-        bits |= (1U << 4);
-    if (status->below_remaining_capacity_limit)
-        bits |= (1U << 5);
-    if (status->battery_present)
-        bits |= (1U << 6);
-    if (status->overload)
-        bits |= (1U << 7);
-    if (status->shutdown_imminent)
-        bits |= (1U << 8);
-    return bits;
-}
 
-uint16_t build_hid_input_report(uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
-{
-    if ((buffer == NULL) || (reqlen == 0U))
+    const ups_hid_report_builder_t *builder = &builders[report_id];
+    if ((builder->size == 0U) || (reqlen < builder->size))
     {
         return 0U;
     }
 
-    switch (report_id)
-    {
-    case REPORT_ID_POWER_SUMMARY:
-    {
-        uint16_t const needed = (uint16_t)sizeof(ups_report_power_summary_input_t);
-        if (reqlen < needed)
-        {
-            return 0U;
-        }
-        ups_report_power_summary_input_t report = {
-            .remaining_capacity = g_battery.remaining_capacity,
-            .run_time_to_empty_s = g_battery.run_time_to_empty_s,
-            .ps_voltage = g_battery.battery_voltage,
-            .present_status_bits = pack_present_status(&g_power_summary_present_status),
-        };
-        memcpy(buffer, &report, sizeof(report));
-        return (uint16_t)sizeof(report);
-    }
-    default:
-        break;
-    }
+    builder->fill(ups, buffer);
+    return builder->size;
+}
 
-    return 0U;
+uint16_t build_hid_input_report(const ups_state_t *ups, uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
+{
+    return ups_hid_build(k_ups_hid_input_builders,
+                         sizeof(k_ups_hid_input_builders) / sizeof(k_ups_hid_input_builders[0]),
+                         ups, report_id, buffer, reqlen);
 }
 
-uint16_t build_hid_feature_report(uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
+uint16_t build_hid_feature_report(const ups_state_t *ups, uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
 {
-    if ((buffer == NULL) || (reqlen == 0U))
-    {
-        return 0U;
-    }
+    return ups_hid_build(k_ups_hid_feature_builders,
+                         sizeof(k_ups_hid_feature_builders) / sizeof(k_ups_hid_feature_builders[0]),
+                         ups, report_id, buffer, reqlen);
+}
 
-    switch (report_id)
-    {
-    case REPORT_ID_POWER_SUMMARY:
-    {
-        uint16_t const needed = (uint16_t)sizeof(ups_report_power_summary_feature_t);
-        if (reqlen < needed)
-        {
-            return 0U;
-        }
-        ups_report_power_summary_feature_t report = {
-            .warning_capacity_limit = g_power_summary.warning_capacity_limit,
-            .remaining_capacity_limit = g_power_summary.remaining_capacity_limit,
-            .remaining_capacity = g_battery.remaining_capacity,
-            .run_time_to_empty_s = g_battery.run_time_to_empty_s,
-            .remaining_time_limit_s = g_battery.remaining_time_limit_s,
-            .i_device_chemistry = g_power_summary.i_device_chemistry,
-            .capacity_mode = g_power_summary.capacity_mode,
-            .full_charge_capacity = g_power_summary.full_charge_capacity,
-            .design_capacity = g_power_summary.design_capacity,
-            .rechargeable_and_padding = (uint8_t)(g_power_summary.rechargeable ? 0x01U : 0x00U),
-            .capacity_granularity_1 = g_power_summary.capacity_granularity_1,
-            .capacity_granularity_2 = g_power_summary.capacity_granularity_2,
-            .i_strings_packed = pack_2bit4(g_power_summary.i_manufacturer_2bit,
-                                           g_power_summary.i_product_2bit,
-                                           g_power_summary.i_serial_number_2bit,
-                                           g_power_summary.i_name_2bit),
-            .present_status_bits = pack_present_status(&g_power_summary_present_status),
-        };
-        memcpy(buffer, &report, sizeof(report));
-        return (uint16_t)sizeof(report);
+// SET_REPORT handling: a writable field (UPS_HID_WRITABLE_<member>) is stored
+// only when the host changed it from what GET_REPORT returns now, so two
+// members sharing one shadow (ps_/bat_remaining_time_limit_s) don't undo each
+// other, and only when it is inside the descriptor's logical range.
+#define UPS_HID_STORE(sel, report, kind, member, ctype, bits, page, usage, lmin, lmax, unit, exp, flags, value) \
+    UPS_HID_SELECT(sel, report, kind, UPS_HID_IF_WRITABLE(member,                                              \
+        if ((report_data.member != current.member) &&                                                          \
+            ((int32_t)report_data.member >= (int32_t)(lmin)) &&                                                \
+            ((int32_t)report_data.member <= (int32_t)(lmax)))                                                  \
+        {                                                                                                       \
+            ups->value = report_data.member;                                                                   \
+            written |= (1UL << UPS_HID_SETTING_##member);                                                      \
+        }))
+
+#define UPS_HID_DEFINE_STORE(sel)                                                                    \
+    static uint32_t ups_hid_store_##sel(ups_state_t *ups, const uint8_t *buffer)                     \
+    {                                                                                                \
+        ups_report_##sel##_t report_data;                                                            \
+        ups_report_##sel##_t current;                                                                \
+        uint32_t written = 0UL;                                                                      \
+        memcpy(&report_data, buffer, sizeof(report_data));                                           \
+        ups_hid_fill_##sel(ups, (uint8_t *)&current);                                                \
+        UPS_HID_LAYOUT(UPS_HID_STORE, UPS_HID_SKIP_PAD, UPS_HID_SKIP_BEGIN, UPS_HID_SKIP_END,        \
+            UPS_HID_SKIP_GLOBAL, sel)                                                                \
+        return written;                                                                              \
     }
-    case REPORT_ID_INPUT:
-    {
-        uint16_t const needed = (uint16_t)sizeof(ups_report_input_feature_t);
-        if (reqlen < needed)
-        {
-            return 0U;
-        }
-        ups_report_input_feature_t report = {
-            .input_voltage = g_input.voltage,
-            .input_frequency = g_input.frequency,
-            .config_voltage = g_input.config_voltage,
-            .low_voltage_transfer = g_input.low_voltage_transfer,
-            .high_voltage_transfer = g_input.high_voltage_transfer,
-        };
-        memcpy(buffer, &report, sizeof(report));
-        return (uint16_t)sizeof(report);
-    }
-    case REPORT_ID_OUTPUT:
-    {
-        uint16_t const needed = (uint16_t)sizeof(ups_report_output_feature_t);
-        if (reqlen < needed)
-        {
-            return 0U;
-        }
-        ups_report_output_feature_t report = {
-            .percent_load = g_output.percent_load,
-            .config_active_power = g_output.config_active_power,
-            .config_voltage = g_output.config_voltage,
-            .output_voltage = g_output.voltage,
-            .output_current = g_output.current,
-            .output_frequency = g_output.frequency,
-        };
-        memcpy(buffer, &report, sizeof(report));
-        return (uint16_t)sizeof(report);
-    }
-    case REPORT_ID_BATTERY:
+
+UPS_HID_DEFINE_STORE(CONFIG_FEATURE)
+
+uint32_t apply_hid_feature_report(ups_state_t *ups, uint8_t report_id, const uint8_t *buffer, uint16_t len)
+{
+    if ((ups == NULL) || (buffer == NULL) || (report_id != REPORT_ID_CONFIG) ||
+        (len < (uint16_t)sizeof(ups_report_CONFIG_FEATURE_t)))
     {
-        uint16_t const needed = (uint16_t)sizeof(ups_report_battery_feature_t);
-        if (reqlen < needed)
-        {
-            return 0U;
-        }
-        ups_report_battery_feature_t report = {
-            .run_time_to_empty_s = g_battery.run_time_to_empty_s,
-            .remaining_time_limit_s = g_battery.remaining_time_limit_s,
-            .manufacturer_date = g_battery.manufacturer_date,
-            .battery_voltage = g_battery.battery_voltage,
-            .battery_current = g_battery.battery_current,
-            .config_voltage = g_battery.config_voltage,
-            .temperature = g_battery.temperature,
-        };
-        memcpy(buffer, &report, sizeof(report));
-        return (uint16_t)sizeof(report);
-    }
-    default:
-        break;
+        return 0UL;
     }
 
-    return 0U;
+    return ups_hid_store_CONFIG_FEATURE(ups, buffer) & ~(1UL << UPS_SETTING_NONE);
 }
 
 /*
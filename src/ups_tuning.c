@@ -0,0 +1,187 @@
+#include "ups_tuning.h"
+
+#include "flash_config.h"
+#include "task_sched.h"
+#include "uart_engine.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct
+{
+    uint16_t version;
+    uint16_t reserved;
+    ups_tuning_t values;
+} ups_tuning_record_t;
+
+static ups_tuning_record_t s_record;
+static bool s_stored = false;
+static bool s_pending = false;
+static bool s_rejected = false;
+static bool s_save_error = false;
+static uint32_t s_save_due_ms = 0U;
+
+static void ups_tuning_defaults(ups_tuning_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->dynamic_update_period_s = UPS_DYNAMIC_UPDATE_PERIOD_S;
+    out->init_retry_period_s = UPS_INIT_RETRY_PERIOD_S;
+    out->interjob_cooldown_ms = UART_ENGINE_INTERJOB_COOLDOWN_MS;
+    out->reply_timeout_ms = 0U;
+    out->iwdg_timeout_ms = UPS_IWDG_TIMEOUT_MS;
+    out->failure_threshold = UART_ENGINE_FAILURE_THRESHOLD;
+    out->ups_baud = UPS_UART_BAUD;
+}
+
+static bool in_range(uint32_t v, uint32_t min, uint32_t max)
+{
+    return (v >= min) && (v <= max);
+}
+
+static bool ups_tuning_is_valid(const ups_tuning_t *v)
+{
+    return in_range(v->dynamic_update_period_s, 1U, 3600U) &&
+           in_range(v->init_retry_period_s, 1U, 3600U) &&
+           in_range(v->interjob_cooldown_ms, 0U, 1000U) &&
+           ((v->reply_timeout_ms == 0U) || in_range(v->reply_timeout_ms, 50U, 10000U)) &&
+           in_range(v->iwdg_timeout_ms, 1000U, 26000U) &&
+           (v->failure_threshold > 0U) &&
+           in_range(v->ups_baud, 1200U, 115200U);
+}
+
+// Pushes the values the engines use; the rest is read where it is used.
+static void ups_tuning_apply(void)
+{
+    uart_engine_tuning_t const engine = {
+        .interjob_cooldown_ms = s_record.values.interjob_cooldown_ms,
+        .reply_timeout_ms = s_record.values.reply_timeout_ms,
+        .failure_threshold = s_record.values.failure_threshold,
+    };
+    uart_engine_set_tuning(&engine);
+}
+
+void ups_tuning_init(void)
+{
+    s_stored = flash_log_load(FLASH_TUNING_PAGE_ADDR, &s_record, (uint16_t)sizeof(s_record)) &&
+               (s_record.version == UPS_TUNING_VERSION) && ups_tuning_is_valid(&s_record.values);
+    if (!s_stored)
+    {
+        memset(&s_record, 0, sizeof(s_record));
+        s_record.version = UPS_TUNING_VERSION;
+        ups_tuning_defaults(&s_record.values);
+    }
+    ups_tuning_apply();
+}
+
+const ups_tuning_t *ups_tuning_get(void)
+{
+    return &s_record.values;
+}
+
+bool ups_tuning_set(const ups_tuning_t *values, uint32_t now_ms)
+{
+    if ((values == NULL) || !ups_tuning_is_valid(values))
+    {
+        s_rejected = true;
+        return false;
+    }
+
+    s_rejected = false;
+    s_record.values = *values;
+    s_record.values.reserved = 0U;
+    ups_tuning_apply();
+
+    // Every write pushes the save back, so a burst of writes is one save.
+    s_pending = true;
+    s_save_due_ms = now_ms + UPS_TUNING_SAVE_DELAY_MS;
+    task_sched_notify(TASK_SCHED_EVENT_TUNING);
+    return true;
+}
+
+uint32_t ups_tuning_flush(uint32_t now_ms)
+{
+    if (!s_pending)
+    {
+        return TASK_SCHED_NEVER;
+    }
+
+    int32_t const left_ms = (int32_t)(s_save_due_ms - now_ms);
+    if (left_ms > 0)
+    {
+        return (uint32_t)left_ms;
+    }
+
+    s_pending = false;
+    s_save_error = !flash_log_save(FLASH_TUNING_PAGE_ADDR, &s_record, (uint16_t)sizeof(s_record));
+    s_stored = !s_save_error;
+    return TASK_SCHED_NEVER;
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v & 0xFFU);
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+
+uint16_t ups_tuning_build_report(uint8_t *buffer, uint16_t reqlen)
+{
+    if ((buffer == NULL) || (reqlen < UPS_TUNING_REPORT_SIZE))
+    {
+        return 0U;
+    }
+
+    ups_tuning_t const *v = &s_record.values;
+    uint8_t const flags = (uint8_t)((s_stored ? UPS_TUNING_FLAG_STORED : 0U) |
+                                    (s_pending ? UPS_TUNING_FLAG_PENDING : 0U) |
+                                    (s_rejected ? UPS_TUNING_FLAG_REJECTED : 0U) |
+                                    (s_save_error ? UPS_TUNING_FLAG_SAVE_ERROR : 0U));
+
+    uint8_t *p = buffer;
+    *p++ = (uint8_t)UPS_TUNING_VERSION;
+    *p++ = flags;
+    p = put_u16(p, v->dynamic_update_period_s);
+    p = put_u16(p, v->init_retry_period_s);
+    p = put_u16(p, v->interjob_cooldown_ms);
+    p = put_u16(p, v->reply_timeout_ms);
+    p = put_u16(p, v->iwdg_timeout_ms);
+    *p++ = v->failure_threshold;
+    *p++ = 0U;
+    p = put_u16(p, (uint16_t)(v->ups_baud & 0xFFFFU));
+    p = put_u16(p, (uint16_t)(v->ups_baud >> 16));
+    return (uint16_t)(p - buffer);
+}
+
+void ups_tuning_apply_report(const uint8_t *buffer, uint16_t len, uint32_t now_ms)
+{
+    if ((buffer == NULL) || (len < UPS_TUNING_REPORT_SIZE) || (buffer[0] != UPS_TUNING_VERSION))
+    {
+        s_rejected = true;
+        return;
+    }
+
+    ups_tuning_t v;
+    if ((buffer[1] & UPS_TUNING_FLAG_DEFAULTS) != 0U)
+    {
+        ups_tuning_defaults(&v);
+    }
+    else
+    {
+        memset(&v, 0, sizeof(v));
+        v.dynamic_update_period_s = get_u16(&buffer[2]);
+        v.init_retry_period_s = get_u16(&buffer[4]);
+        v.interjob_cooldown_ms = get_u16(&buffer[6]);
+        v.reply_timeout_ms = get_u16(&buffer[8]);
+        v.iwdg_timeout_ms = get_u16(&buffer[10]);
+        v.failure_threshold = buffer[12];
+        v.ups_baud = (uint32_t)get_u16(&buffer[14]) | ((uint32_t)get_u16(&buffer[16]) << 16);
+    }
+    (void)ups_tuning_set(&v, now_ms);
+}
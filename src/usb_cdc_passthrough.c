@@ -0,0 +1,190 @@
+#include "usb_cdc_passthrough.h"
+
+#include "main.h"
+#include "uart_engine.h"
+#include "ups_data.h"
+
+#include "tusb.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if CFG_TUD_CDC > 1
+
+#define UPS_CDC_PASSTHROUGH_ITF 1U
+
+// UPS port whose UART the passthrough shares.
+#ifndef UPS_CDC_PASSTHROUGH_PORT
+#define UPS_CDC_PASSTHROUGH_PORT 0U
+#endif
+
+// Quiet time (both directions) that ends a slice. APC Smart replies start
+// within a few character times; this leaves margin for slow commands.
+#ifndef UPS_CDC_PASSTHROUGH_IDLE_MS
+#define UPS_CDC_PASSTHROUGH_IDLE_MS 100U
+#endif
+
+// After this long no new host bytes are sent in the current slice.
+#ifndef UPS_CDC_PASSTHROUGH_SLICE_MAX_MS
+#define UPS_CDC_PASSTHROUGH_SLICE_MAX_MS 1000U
+#endif
+
+#define UPS_CDC_PASSTHROUGH_CHUNK 32U
+
+static ups_cdc_passthrough_stats_t s_pt_stats;
+static uint32_t s_pt_slice_start_ms = 0U;
+static uint32_t s_pt_last_activity_ms = 0U;
+static uint32_t s_pt_engine_jobs_at_release = UINT32_MAX;
+static bool s_pt_tx_busy = false;
+// DMA source; must stay valid until the transfer completes.
+static uint8_t s_pt_tx_buf[UPS_CDC_PASSTHROUGH_CHUNK];
+
+static uint32_t pt_engine_jobs_done(void)
+{
+    uart_engine_stats_t st;
+    uart_engine_get_stats(UPS_CDC_PASSTHROUGH_PORT, &st);
+    return st.completed + st.failed;
+}
+
+// One engine job between two slices, unless the engine has nothing to do.
+static bool pt_engine_had_turn(void)
+{
+    return !uart_engine_is_busy(UPS_CDC_PASSTHROUGH_PORT) || (pt_engine_jobs_done() != s_pt_engine_jobs_at_release);
+}
+
+static void pt_release(void)
+{
+    s_pt_stats.active = false;
+    s_pt_tx_busy = false;
+    s_pt_engine_jobs_at_release = pt_engine_jobs_done();
+    UPS_UART_Unlock(UPS_CDC_PASSTHROUGH_PORT);
+}
+
+static void pt_forward_ups_to_host(uint32_t now_ms)
+{
+    uint8_t buf[UPS_CDC_PASSTHROUGH_CHUNK];
+    uint32_t room = tud_cdc_n_write_available(UPS_CDC_PASSTHROUGH_ITF);
+    if (room > sizeof(buf))
+    {
+        room = sizeof(buf);
+    }
+
+    uint16_t const n = UPS_UART_Read(UPS_CDC_PASSTHROUGH_PORT, buf, (uint16_t)room);
+    if (n == 0U)
+    {
+        return;
+    }
+
+    (void)tud_cdc_n_write(UPS_CDC_PASSTHROUGH_ITF, buf, n);
+    (void)tud_cdc_n_write_flush(UPS_CDC_PASSTHROUGH_ITF);
+    s_pt_stats.ups_bytes += n;
+    s_pt_last_activity_ms = now_ms;
+}
+
+static void pt_forward_host_to_ups(uint32_t now_ms)
+{
+    if (s_pt_tx_busy)
+    {
+        if (!UPS_UART_TxDone(UPS_CDC_PASSTHROUGH_PORT))
+        {
+            return;
+        }
+        s_pt_tx_busy = false;
+        s_pt_last_activity_ms = now_ms;
+    }
+
+    if ((now_ms - s_pt_slice_start_ms) >= UPS_CDC_PASSTHROUGH_SLICE_MAX_MS)
+    {
+        return;
+    }
+
+    uint32_t const n = tud_cdc_n_read(UPS_CDC_PASSTHROUGH_ITF, s_pt_tx_buf, sizeof(s_pt_tx_buf));
+    if (n == 0U)
+    {
+        return;
+    }
+
+    if (UPS_UART_SendBytesDMA(UPS_CDC_PASSTHROUGH_PORT, s_pt_tx_buf, (uint16_t)n) == HAL_OK)
+    {
+        s_pt_tx_busy = true;
+        s_pt_stats.host_bytes += n;
+    }
+    else
+    {
+        s_pt_stats.dropped += n;
+    }
+    s_pt_last_activity_ms = now_ms;
+}
+
+void ups_cdc_passthrough_task(void)
+{
+    uint32_t const now_ms = HAL_GetTick();
+
+    if (!tud_cdc_n_connected(UPS_CDC_PASSTHROUGH_ITF))
+    {
+        // Finish an in-flight DMA transfer before handing the UART back.
+        if (s_pt_stats.active && (!s_pt_tx_busy || UPS_UART_TxDone(UPS_CDC_PASSTHROUGH_PORT)))
+        {
+            pt_release();
+        }
+        return;
+    }
+
+    if (!s_pt_stats.active)
+    {
+        if ((tud_cdc_n_available(UPS_CDC_PASSTHROUGH_ITF) == 0U) || !pt_engine_had_turn())
+        {
+            return;
+        }
+
+        if (!UPS_UART_TryLock(UPS_CDC_PASSTHROUGH_PORT))
+        {
+            return; // engine job in progress
+        }
+
+        UPS_UART_DiscardBuffered(UPS_CDC_PASSTHROUGH_PORT);
+        s_pt_stats.active = true;
+        s_pt_stats.slices++;
+        s_pt_slice_start_ms = now_ms;
+        s_pt_last_activity_ms = now_ms;
+    }
+
+    pt_forward_host_to_ups(now_ms);
+    pt_forward_ups_to_host(now_ms);
+
+    bool const host_pending = (tud_cdc_n_available(UPS_CDC_PASSTHROUGH_ITF) > 0U) &&
+                              ((now_ms - s_pt_slice_start_ms) < UPS_CDC_PASSTHROUGH_SLICE_MAX_MS);
+    // UPS bytes the host has no room for don't count as activity; a host that
+    // stops reading must not hold the UART.
+    if (!s_pt_tx_busy && !host_pending &&
+        ((now_ms - s_pt_last_activity_ms) >= UPS_CDC_PASSTHROUGH_IDLE_MS))
+    {
+        pt_release();
+    }
+}
+
+void ups_cdc_passthrough_get_stats(ups_cdc_passthrough_stats_t *out)
+{
+    if (out == NULL)
+    {
+        return;
+    }
+    *out = s_pt_stats;
+}
+
+#else
+
+void ups_cdc_passthrough_task(void)
+{
+}
+
+void ups_cdc_passthrough_get_stats(ups_cdc_passthrough_stats_t *out)
+{
+    if (out != NULL)
+    {
+        (void)memset(out, 0, sizeof(*out));
+    }
+}
+
+#endif // CFG_TUD_CDC > 1
@@ -0,0 +1,481 @@
+#include "usb_cdc_telemetry.h"
+
+#include "idle_sleep.h"
+#include "task_sched.h"
+#include "uart_engine.h"
+#include "uart_trace.h"
+#include "usb_cdc_passthrough.h"
+#include "ups_data.h"
+#include "ups_hid_device.h"
+
+#include "stm32f1xx_hal.h"
+#include "tusb.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if CFG_TUD_CDC
+
+#ifndef UPS_CDC_TELEMETRY_PERIOD_MS
+#define UPS_CDC_TELEMETRY_PERIOD_MS 100U
+#endif
+
+// Lower bound for RATE. One D record is ~70 bytes, far below what a
+// full-speed bulk endpoint moves in 10 ms.
+#ifndef UPS_CDC_TELEMETRY_MIN_PERIOD_MS
+#define UPS_CDC_TELEMETRY_MIN_PERIOD_MS 10U
+#endif
+
+// E, H and P records are sent after this many D records.
+#ifndef UPS_CDC_COUNTERS_EVERY
+#define UPS_CDC_COUNTERS_EVERY 10U
+#endif
+
+#define UPS_CDC_CMD_MAX_LEN 24U
+#define UPS_CDC_RECORD_MAX_LEN 128U
+// "T,<index>,<16 hex digits>\r\n"
+#define UPS_CDC_TRACE_LINE_MAX_LEN 31U
+
+static bool s_cdc_streaming = true;
+static bool s_cdc_connected = false;
+static uint32_t s_cdc_period_ms = UPS_CDC_TELEMETRY_PERIOD_MS;
+static uint32_t s_cdc_next_record_ms = 0U;
+static uint32_t s_cdc_seq = 0U;
+static uint32_t s_cdc_dropped = 0U;
+static uint8_t s_cdc_counters_countdown = 0U;
+
+// TRACE dump in progress: events s_trace_next up to s_trace_end are still
+// to be sent, as FIFO space allows.
+static bool s_trace_dumping = false;
+static uint32_t s_trace_next = 0U;
+static uint32_t s_trace_end = 0U;
+static uint32_t s_trace_lost = 0U;
+
+static char s_cdc_cmd[UPS_CDC_CMD_MAX_LEN];
+static uint8_t s_cdc_cmd_len = 0U;
+static bool s_cdc_cmd_overflow = false;
+
+static void cdc_write_line(const char *line, int len)
+{
+    if ((len <= 0) || (len >= (int)UPS_CDC_RECORD_MAX_LEN))
+    {
+        return;
+    }
+
+    if (tud_cdc_write_available() < (uint32_t)len)
+    {
+        s_cdc_dropped++;
+        return;
+    }
+
+    (void)tud_cdc_write(line, (uint32_t)len);
+    (void)tud_cdc_write_flush();
+}
+
+static uint16_t cdc_present_status_bits(const ups_present_status_t *ps)
+{
+    return (uint16_t)((ps->ac_present ? (1U << 0) : 0U) |
+                      (ps->charging ? (1U << 1) : 0U) |
+                      (ps->discharging ? (1U << 2) : 0U) |
+                      (ps->fully_charged ? (1U << 3) : 0U) |
+                      (ps->need_replacement ? (1U << 4) : 0U) |
+                      (ps->below_remaining_capacity_limit ? (1U << 5) : 0U) |
+                      (ps->battery_present ? (1U << 6) : 0U) |
+                      (ps->overload ? (1U << 7) : 0U) |
+                      (ps->shutdown_imminent ? (1U << 8) : 0U));
+}
+
+static void cdc_send_data_record_port(uint8_t port, uint32_t now_ms)
+{
+    ups_state_t const *ups = &g_ups[port];
+    char line[UPS_CDC_RECORD_MAX_LEN];
+    int const len = snprintf(line, sizeof(line),
+                             "D,%u,%lu,%lu,%03X,%u,%u,%u,%d,%u,%u,%u,%u,%d,%u,%u\r\n",
+                             (unsigned)port,
+                             (unsigned long)s_cdc_seq,
+                             (unsigned long)now_ms,
+                             (unsigned)cdc_present_status_bits(&ups->present_status),
+                             (unsigned)ups->battery.remaining_capacity,
+                             (unsigned)ups->battery.run_time_to_empty_s,
+                             (unsigned)ups->battery.battery_voltage,
+                             (int)ups->battery.battery_current,
+                             (unsigned)ups->battery.temperature,
+                             (unsigned)ups->input.voltage,
+                             (unsigned)ups->input.frequency,
+                             (unsigned)ups->output.voltage,
+                             (int)ups->output.current,
+                             (unsigned)ups->output.frequency,
+                             (unsigned)ups->output.percent_load);
+    s_cdc_seq++;
+    cdc_write_line(line, len);
+}
+
+static void cdc_send_data_record(uint32_t now_ms)
+{
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        cdc_send_data_record_port(port, now_ms);
+    }
+}
+
+static void cdc_send_port_counter_records(uint8_t port, uint32_t now_ms)
+{
+    char line[UPS_CDC_RECORD_MAX_LEN];
+    uart_engine_stats_t engine;
+    ups_hid_tx_stats_t tx;
+    ups_hid_poll_stats_t poll;
+
+    uart_engine_get_stats(port, &engine);
+    ups_hid_get_tx_stats(port, &tx);
+    ups_hid_get_poll_stats(port, &poll);
+
+    int len = snprintf(line, sizeof(line),
+                       "E,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%u,%u\r\n",
+                       (unsigned)port,
+                       (unsigned long)now_ms,
+                       (unsigned long)engine.enqueued,
+                       (unsigned long)engine.completed,
+                       (unsigned long)engine.failed,
+                       (unsigned long)engine.retries,
+                       (unsigned long)engine.timeouts,
+                       (unsigned long)engine.queue_full,
+                       (unsigned)engine.queue_depth,
+                       (unsigned)engine.queue_high_water);
+    cdc_write_line(line, len);
+
+    len = snprintf(line, sizeof(line),
+                   "H,%u,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\r\n",
+                   (unsigned)port,
+                   (unsigned long)now_ms,
+                   (unsigned long)tx.queued,
+                   (unsigned long)tx.sent,
+                   (unsigned long)tx.coalesced,
+                   (unsigned long)tx.dropped,
+                   (unsigned long)poll.get_report_total,
+                   (unsigned long)poll.poll_cycles,
+                   (unsigned long)s_cdc_dropped);
+    cdc_write_line(line, len);
+
+    len = snprintf(line, sizeof(line),
+                   "B,%u,%lu,%u,%lu,%lu,%lu,%lu\r\n",
+                   (unsigned)port,
+                   (unsigned long)now_ms,
+                   (unsigned)ups_port_readiness(port),
+                   (unsigned long)ups_port_readiness_ms(port, UPS_READINESS_LINK),
+                   (unsigned long)ups_port_readiness_ms(port, UPS_READINESS_MINIMUM),
+                   (unsigned long)ups_port_readiness_ms(port, UPS_READINESS_CONSTANTS),
+                   (unsigned long)ups_port_readiness_ms(port, UPS_READINESS_FULL));
+    cdc_write_line(line, len);
+}
+
+static void cdc_send_counter_records(uint32_t now_ms)
+{
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        cdc_send_port_counter_records(port, now_ms);
+    }
+
+#if CFG_TUD_CDC > 1
+    char line[UPS_CDC_RECORD_MAX_LEN];
+    ups_cdc_passthrough_stats_t pt;
+    ups_cdc_passthrough_get_stats(&pt);
+    int const len = snprintf(line, sizeof(line),
+                             "P,%lu,%lu,%lu,%lu,%lu,%u\r\n",
+                             (unsigned long)now_ms,
+                             (unsigned long)pt.slices,
+                             (unsigned long)pt.host_bytes,
+                             (unsigned long)pt.ups_bytes,
+                             (unsigned long)pt.dropped,
+                             pt.active ? 1U : 0U);
+    cdc_write_line(line, len);
+#endif
+
+    char sched_line[UPS_CDC_RECORD_MAX_LEN];
+    task_sched_stats_t sched;
+    idle_sleep_stats_t idle;
+    task_sched_get_stats(&sched);
+    idle_sleep_get_stats(&idle);
+    int const sched_len = snprintf(sched_line, sizeof(sched_line),
+                                   "S,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu\r\n",
+                                   (unsigned long)now_ms,
+                                   (unsigned long)sched.passes,
+                                   (unsigned long)sched.idle_passes,
+                                   (unsigned long)sched.runs,
+                                   (unsigned long)sched.event_runs,
+                                   (unsigned long)idle.wakeups,
+                                   (unsigned long)idle.wakeups_per_s,
+                                   (unsigned long)idle.tickless_ms);
+    cdc_write_line(sched_line, sched_len);
+}
+
+static void cdc_send_text(const char *text)
+{
+    cdc_write_line(text, (int)strlen(text));
+}
+
+static void cdc_send_legend(void)
+{
+    cdc_send_text("#D,port,seq,ms,status,capacity_pct,runtime_s,battery_cV,battery_cA,temp_dK,"
+                  "input_cV,input_cHz,output_cV,output_cA,output_cHz,load_pct\r\n");
+    cdc_send_text("#E,port,ms,enqueued,completed,failed,retries,timeouts,queue_full,depth,high_water\r\n");
+    cdc_send_text("#H,port,ms,tx_queued,tx_sent,tx_coalesced,tx_dropped,get_reports,poll_cycles,cdc_dropped\r\n");
+    cdc_send_text("#B,port,ms,level,link_ms,minimum_ms,constants_ms,full_ms\r\n");
+#if CFG_TUD_CDC > 1
+    cdc_send_text("#P,ms,slices,host_bytes,ups_bytes,dropped,active\r\n");
+#endif
+    cdc_send_text("#S,ms,passes,idle_passes,runs,event_runs,wakeups,wakeups_per_s,tickless_ms\r\n");
+    cdc_send_text("#T,index,event_hex   (TRACE dump, decode with uarttrace.py)\r\n");
+    cdc_send_text("#cmd: START STOP RATE <ms> GET STATS TRACE HELP\r\n");
+}
+
+static void cdc_trace_dump_start(void)
+{
+    char line[UPS_CDC_RECORD_MAX_LEN];
+    uint32_t const written = uart_trace_written();
+
+    s_trace_end = written;
+    s_trace_next = (written > UART_TRACE_EVENTS) ? (written - UART_TRACE_EVENTS) : 0U;
+    s_trace_lost = 0U;
+    s_trace_dumping = true;
+
+    int const len = snprintf(line, sizeof(line),
+                             "T,BEGIN,%lu,%lu,%lu\r\n",
+                             (unsigned long)uart_trace_now(),
+                             (unsigned long)s_trace_next,
+                             (unsigned long)s_trace_end);
+    cdc_write_line(line, len);
+}
+
+// One line per event while the CDC FIFO has room; the rest goes out on the
+// next calls. Events overwritten meanwhile are skipped and counted.
+static void cdc_trace_dump_continue(void)
+{
+    char line[UPS_CDC_RECORD_MAX_LEN];
+
+    while (s_trace_dumping && (tud_cdc_write_available() >= UPS_CDC_TRACE_LINE_MAX_LEN))
+    {
+        if (s_trace_next == s_trace_end)
+        {
+            int const len = snprintf(line, sizeof(line),
+                                     "T,END,%lu,%lu\r\n",
+                                     (unsigned long)s_trace_end,
+                                     (unsigned long)s_trace_lost);
+            cdc_write_line(line, len);
+            s_trace_dumping = false;
+            return;
+        }
+
+        uart_trace_event_t e;
+        if (!uart_trace_read(s_trace_next, &e))
+        {
+            s_trace_lost++;
+            s_trace_next++;
+            continue;
+        }
+
+        int const len = snprintf(line, sizeof(line),
+                                 "T,%lu,%02X%02X%02X%02X%02X%02X%02X%02X\r\n",
+                                 (unsigned long)s_trace_next,
+                                 (unsigned)e.info,
+                                 (unsigned)e.time[0],
+                                 (unsigned)e.time[1],
+                                 (unsigned)e.time[2],
+                                 (unsigned)e.data[0],
+                                 (unsigned)e.data[1],
+                                 (unsigned)e.data[2],
+                                 (unsigned)e.data[3]);
+        cdc_write_line(line, len);
+        s_trace_next++;
+    }
+}
+
+static bool cdc_cmd_is(const char *line, const char *cmd)
+{
+    size_t i = 0U;
+    while (cmd[i] != '\0')
+    {
+        if (toupper((unsigned char)line[i]) != cmd[i])
+        {
+            return false;
+        }
+        i++;
+    }
+    return ((line[i] == '\0') || (line[i] == ' '));
+}
+
+static bool cdc_handle_command(const char *line, uint32_t now_ms)
+{
+    if (cdc_cmd_is(line, "START"))
+    {
+        s_cdc_streaming = true;
+        s_cdc_next_record_ms = now_ms;
+        return true;
+    }
+
+    if (cdc_cmd_is(line, "STOP"))
+    {
+        s_cdc_streaming = false;
+        return true;
+    }
+
+    if (cdc_cmd_is(line, "RATE"))
+    {
+        char *end = NULL;
+        unsigned long const period_ms = strtoul(&line[4], &end, 10);
+        if ((end == &line[4]) || (*end != '\0') ||
+            (period_ms < UPS_CDC_TELEMETRY_MIN_PERIOD_MS) || (period_ms > 60000UL))
+        {
+            return false;
+        }
+        s_cdc_period_ms = (uint32_t)period_ms;
+        s_cdc_next_record_ms = now_ms;
+        return true;
+    }
+
+    if (cdc_cmd_is(line, "BAUD"))
+    {
+        char *end = NULL;
+        unsigned long const port = strtoul(&line[4], &end, 10);
+        if ((end == &line[4]) || (*end != ' '))
+        {
+            return false;
+        }
+        while (*end == ' ')
+        {
+            end++;
+        }
+        if (cdc_cmd_is(end, "AUTO"))
+        {
+            return (port < UPS_PORT_COUNT) && ups_port_set_baud((uint8_t)port, 0U);
+        }
+        const char *const rate_text = end;
+        unsigned long const baud = strtoul(rate_text, &end, 10);
+        return (end != rate_text) && (*end == '\0') && (port < UPS_PORT_COUNT) && (baud != 0UL) &&
+               ups_port_set_baud((uint8_t)port, (uint32_t)baud);
+    }
+
+    if (cdc_cmd_is(line, "GET"))
+    {
+        cdc_send_data_record(now_ms);
+        return true;
+    }
+
+    if (cdc_cmd_is(line, "STATS"))
+    {
+        cdc_send_counter_records(now_ms);
+        return true;
+    }
+
+    if (cdc_cmd_is(line, "TRACE"))
+    {
+        cdc_trace_dump_start();
+        return true;
+    }
+
+    if (cdc_cmd_is(line, "HELP"))
+    {
+        cdc_send_legend();
+        return true;
+    }
+
+    return false;
+}
+
+static void cdc_poll_commands(uint32_t now_ms)
+{
+    uint8_t buf[16];
+
+    while (tud_cdc_available() > 0U)
+    {
+        uint32_t const n = tud_cdc_read(buf, sizeof(buf));
+        for (uint32_t i = 0U; i < n; i++)
+        {
+            char const c = (char)buf[i];
+            if ((c != '\r') && (c != '\n'))
+            {
+                if (s_cdc_cmd_len < (UPS_CDC_CMD_MAX_LEN - 1U))
+                {
+                    s_cdc_cmd[s_cdc_cmd_len++] = c;
+                }
+                else
+                {
+                    s_cdc_cmd_overflow = true;
+                }
+                continue;
+            }
+
+            if ((s_cdc_cmd_len == 0U) && !s_cdc_cmd_overflow)
+            {
+                continue; // empty line, or the LF of a CRLF
+            }
+
+            s_cdc_cmd[s_cdc_cmd_len] = '\0';
+            bool const ok = !s_cdc_cmd_overflow && cdc_handle_command(s_cdc_cmd, now_ms);
+            cdc_send_text(ok ? "OK\r\n" : "ERR\r\n");
+            s_cdc_cmd_len = 0U;
+            s_cdc_cmd_overflow = false;
+        }
+    }
+}
+
+void ups_cdc_telemetry_task(void)
+{
+    uint32_t const now_ms = HAL_GetTick();
+
+    if (!tud_cdc_connected())
+    {
+        s_cdc_connected = false;
+        s_cdc_cmd_len = 0U;
+        s_cdc_cmd_overflow = false;
+        s_trace_dumping = false;
+        return;
+    }
+
+    if (!s_cdc_connected)
+    {
+        s_cdc_connected = true;
+        s_cdc_next_record_ms = now_ms;
+        s_cdc_counters_countdown = 0U;
+        cdc_send_legend();
+    }
+
+    cdc_poll_commands(now_ms);
+    cdc_trace_dump_continue();
+
+    if (!s_cdc_streaming || ((int32_t)(now_ms - s_cdc_next_record_ms) < 0))
+    {
+        return;
+    }
+
+    s_cdc_next_record_ms = now_ms + s_cdc_period_ms;
+    cdc_send_data_record(now_ms);
+
+    if (s_cdc_counters_countdown == 0U)
+    {
+        s_cdc_counters_countdown = UPS_CDC_COUNTERS_EVERY;
+        cdc_send_counter_records(now_ms);
+    }
+    s_cdc_counters_countdown--;
+}
+
+bool ups_cdc_telemetry_is_streaming(void)
+{
+    return s_cdc_connected && (s_cdc_streaming || s_trace_dumping);
+}
+
+#else
+
+void ups_cdc_telemetry_task(void)
+{
+}
+
+bool ups_cdc_telemetry_is_streaming(void)
+{
+    return false;
+}
+
+#endif // CFG_TUD_CDC
@@ -35,7 +35,7 @@
  *   [MSB]         HID | MSC | CDC          [LSB]
  */
 #define PID_MAP(itf, n) ((CFG_TUD_##itf) ? (1 << (n)) : 0)
-#define USB_PID 0xcafe
+#define USB_PID (0xcafe | PID_MAP(CDC, 0) | ((CFG_TUD_CDC > 1) ? (1 << 8) : 0) | ((CFG_TUD_HID > 1) ? (1 << 9) : 0))
 #define USB_VID 0x051d
 #define USB_BCD 0x0200
 
@@ -47,9 +47,16 @@ static tusb_desc_device_t const desc_device =
         .bLength = sizeof(tusb_desc_device_t),
         .bDescriptorType = TUSB_DESC_DEVICE,
         .bcdUSB = USB_BCD,
+#if CFG_TUD_CDC
+        // CDC uses an Interface Association Descriptor.
+        .bDeviceClass = TUSB_CLASS_MISC,
+        .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+        .bDeviceProtocol = MISC_PROTOCOL_IAD,
+#else
         .bDeviceClass = 0x00,
         .bDeviceSubClass = 0x00,
         .bDeviceProtocol = 0x00,
+#endif
         .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
 
         .idVendor = USB_VID,
@@ -77,6 +84,8 @@ uint8_t const desc_hid_report[] = {
     TUD_HID_REPORT_DESC_UPS()
 };
 
+_Static_assert(sizeof(desc_hid_report) == UPS_HID_REPORT_DESC_LEN,
+               "HID report descriptor length changed: update UPS_HID_REPORT_DESC_LEN");
 
 // Invoked when received GET HID REPORT DESCRIPTOR
 // Application return pointer to descriptor
@@ -91,24 +100,66 @@ uint8_t const *tud_hid_descriptor_report_cb(uint8_t instance)
 // Configuration Descriptor
 //--------------------------------------------------------------------+
 
+// The HID UPS stays interface 0 so hosts that bind by interface number
+// still find it; the second UPS and the CDC telemetry pair follow it.
 enum
 {
     ITF_NUM_HID = 0,
-    ITF_NUM_TOTAL = 1
+#if CFG_TUD_HID > 1
+    ITF_NUM_HID2,
+#endif
+#if CFG_TUD_CDC
+    ITF_NUM_CDC,
+    ITF_NUM_CDC_DATA,
+#endif
+#if CFG_TUD_CDC > 1
+    ITF_NUM_CDC_PASSTHROUGH,
+    ITF_NUM_CDC_PASSTHROUGH_DATA,
+#endif
+    ITF_NUM_TOTAL
 };
 
-#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_HID_DESC_LEN)
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + (CFG_TUD_HID * TUD_HID_DESC_LEN) + (CFG_TUD_CDC * TUD_CDC_DESC_LEN))
 
 #define EPNUM_HID 0x81
+#define EPNUM_CDC_NOTIF 0x82
+#define EPNUM_CDC_OUT 0x03
+#define EPNUM_CDC_IN 0x83
+#define EPNUM_CDC_PASSTHROUGH_NOTIF 0x84
+#define EPNUM_CDC_PASSTHROUGH_OUT 0x05
+#define EPNUM_CDC_PASSTHROUGH_IN 0x85
+#define EPNUM_HID2 0x86
+
+// The F103 has 512 bytes of packet memory; after the buffer table, EP0 and
+// the telemetry port 184 bytes are left for the HID and passthrough
+// endpoints. 32-byte packets are plenty for a 2400 baud link, and larger
+// HID reports simply take two packets.
+#define UPS_HID_EP_SIZE 32
+#define CDC_PASSTHROUGH_EP_SIZE 32
 
 uint8_t const desc_configuration[] =
     {
         // Config number, interface count, string index, total length, attribute, power in mA
-        // set attribute to 0 for bus powered device without remote wakeup
-        TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+        // bus powered, remote wakeup so a power alert can wake a sleeping host
+        TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
 
         // Interface number, string index, protocol, report descriptor len, EP In address, size & polling interval
-        TUD_HID_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_HID, CFG_TUD_HID_EP_BUFSIZE, 200)};
+        TUD_HID_DESCRIPTOR(ITF_NUM_HID, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_HID, UPS_HID_EP_SIZE, UPS_HID_EP_INTERVAL_MS),
+
+#if CFG_TUD_HID > 1
+        TUD_HID_DESCRIPTOR(ITF_NUM_HID2, 0, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report), EPNUM_HID2, UPS_HID_EP_SIZE, UPS_HID_EP_INTERVAL_MS),
+#endif
+
+#if CFG_TUD_CDC
+        // Interface number, string index, EP notification address and size, EP data address (out, in) and size
+        TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, USB_STRID_CDC_INAME, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, CFG_TUD_CDC_EP_BUFSIZE),
+#endif
+
+#if CFG_TUD_CDC > 1
+        TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_PASSTHROUGH, USB_STRID_CDC_PASSTHROUGH_INAME, EPNUM_CDC_PASSTHROUGH_NOTIF, 8,
+                           EPNUM_CDC_PASSTHROUGH_OUT, EPNUM_CDC_PASSTHROUGH_IN, CDC_PASSTHROUGH_EP_SIZE),
+#endif
+};
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR
 // Application return pointer to descriptor
@@ -134,19 +185,19 @@ enum
     STRID_SERIAL,
     STRID_HID_INAME,
     STRID_HID_DEVICE_CHEM,
+    STRID_CDC_INAME,
+    STRID_CDC_PASSTHROUGH_INAME,
 };
 
 // array of pointer to string descriptors
 
-#ifndef USB_DESC_STR_MAX_CHARS
-#define USB_DESC_STR_MAX_CHARS 32U
-#endif
-
 static char s_usb_str_manufacturer[USB_DESC_STR_MAX_CHARS] = "American Power Conversion";
 static char s_usb_str_product[USB_DESC_STR_MAX_CHARS] = "SPM2K";
 static char s_usb_str_serial[USB_DESC_STR_MAX_CHARS] = "1145141919810";
 static char s_usb_str_hid_iname[USB_DESC_STR_MAX_CHARS] = "APC UPS";
 static char s_usb_str_hid_chem[USB_DESC_STR_MAX_CHARS] = "PbAc";
+static char s_usb_str_cdc_iname[USB_DESC_STR_MAX_CHARS] = "UPS Telemetry";
+static char s_usb_str_cdc_passthrough_iname[USB_DESC_STR_MAX_CHARS] = "UPS Serial";
 
 static char const *string_desc_arr[] = {
     (const char[]){0x09, 0x04}, // 0: supported language is English (0x0409)
@@ -155,6 +206,8 @@ static char const *string_desc_arr[] = {
     s_usb_str_serial,           // 3: Serial
     s_usb_str_hid_iname,        // 4: HID iName
     s_usb_str_hid_chem,         // 5: HID iDeviceChemistery
+    s_usb_str_cdc_iname,        // 6: CDC interface name
+    s_usb_str_cdc_passthrough_iname, // 7: CDC passthrough interface name
 };
 
 uint8_t usb_desc_string_count(void)
@@ -186,6 +239,10 @@ static char *usb_desc_mutable_string_for_index(uint8_t index)
         return s_usb_str_hid_iname;
     case USB_STRID_HID_DEVICE_CHEM:
         return s_usb_str_hid_chem;
+    case USB_STRID_CDC_INAME:
+        return s_usb_str_cdc_iname;
+    case USB_STRID_CDC_PASSTHROUGH_INAME:
+        return s_usb_str_cdc_passthrough_iname;
     default:
         return NULL;
     }
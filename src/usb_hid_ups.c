@@ -1,5 +1,10 @@
 #include "ups_hid_device.h"
 
+#include "log_ring.h"
+#include "power_mode.h"
+#include "ups_data.h"
+#include "ups_diag.h"
+#include "ups_tuning.h"
 #include "ups_hid_reports.h"
 
 #include "stm32f1xx_hal.h"
@@ -7,41 +12,388 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
-static uint32_t hid_last_report_ms;
-static uint8_t hid_report_cycle_index;
+#ifndef UPS_HID_POLL_CYCLE_GAP_MS
+#define UPS_HID_POLL_CYCLE_GAP_MS 500U
+#endif
 
-static void reset_hid_timing_state(void)
+// Minimum spacing between change-driven pushes of the STATUS INPUT report.
+#ifndef UPS_HID_INPUT_MIN_PUSH_MS
+#define UPS_HID_INPUT_MIN_PUSH_MS 100U
+#endif
+
+// The STATUS INPUT report is re-sent at least this often even if unchanged.
+#ifndef UPS_HID_INPUT_HEARTBEAT_MS
+#define UPS_HID_INPUT_HEARTBEAT_MS 5000U
+#endif
+
+// Remote wakeup is signalled again this often while the host has not resumed.
+#ifndef UPS_HID_WAKEUP_RETRY_MS
+#define UPS_HID_WAKEUP_RETRY_MS 1000U
+#endif
+
+// TinyUSB prepends the report ID to the payload in its endpoint buffer.
+#define UPS_HID_TX_PAYLOAD_MAX (CFG_TUD_HID_EP_BUFSIZE - 1U)
+
+typedef struct
+{
+    bool used;
+    bool urgent; // carries a power state change, see ups_hid_tx_enqueue()
+    uint8_t report_id;
+    uint16_t len;
+    uint8_t data[UPS_HID_TX_PAYLOAD_MAX];
+} hid_tx_slot_t;
+
+// One HID power device per UPS port; instance n reports port n.
+_Static_assert(CFG_TUD_HID == UPS_PORT_COUNT, "CFG_TUD_HID must match UPS_PORT_COUNT");
+
+typedef struct
+{
+    hid_tx_slot_t tx_pending;
+    ups_hid_tx_stats_t tx_stats;
+
+    uint32_t last_report_ms;
+    uint8_t last_input[CFG_TUD_HID_EP_BUFSIZE];
+    uint16_t last_input_len;
+    ups_present_status_t last_present_status;
+
+    ups_hid_poll_stats_t poll_stats;
+    uint32_t last_get_report_ms;
+    uint16_t cycle_transfers;
+
+    // Settings written by the host that the main loop has not taken yet.
+    uint32_t pending_settings;
+} hid_port_t;
+
+static hid_port_t hid_ports[CFG_TUD_HID];
+
+#define UPS_HID_ALERT_AC_LOST (1U << 0)
+#define UPS_HID_ALERT_LOW_BATTERY (1U << 1)
+#define UPS_HID_ALERT_SHUTDOWN (1U << 2)
+
+typedef struct
+{
+    ups_hid_wakeup_stats_t stats;
+    uint8_t alerts[CFG_TUD_HID]; // as last seen; only new bits wake the host
+    bool pending;                // alert seen while suspended, not resumed yet
+    bool signalled;
+    uint8_t instance;            // port whose alert woke the host
+    uint32_t event_ms;
+    uint32_t signal_ms;
+} hid_wakeup_t;
+
+static hid_wakeup_t s_wakeup;
+
+static hid_port_t *hid_port(uint8_t instance)
 {
-    hid_last_report_ms = 0U;
-    hid_report_cycle_index = 0U;
+    return (instance < CFG_TUD_HID) ? &hid_ports[instance] : NULL;
 }
 
-void ups_hid_periodic_task(void)
+static void reset_hid_timing_state(hid_port_t *hp)
+{
+    hp->last_report_ms = 0U;
+    // Forces the next periodic pass to push the current values.
+    hp->last_input_len = 0U;
+}
+
+static void reset_hid_poll_stats(hid_port_t *hp)
+{
+    memset(&hp->poll_stats, 0, sizeof(hp->poll_stats));
+    hp->last_get_report_ms = 0U;
+    hp->cycle_transfers = 0U;
+}
+
+static void count_get_report(hid_port_t *hp, hid_report_type_t report_type)
 {
-    // Both Linux and Windows rely on GET_REPORT to do the polling job.
-    // The interrupt IN report is a heartbeat to let the host know the device is alive.
     uint32_t const now_ms = HAL_GetTick();
-    if ((now_ms - hid_last_report_ms) < 5000U)
+
+    // A quiet gap closes the previous burst as one host poll cycle.
+    if ((hp->cycle_transfers > 0U) &&
+        ((now_ms - hp->last_get_report_ms) >= UPS_HID_POLL_CYCLE_GAP_MS))
+    {
+        hp->poll_stats.poll_cycles++;
+        hp->poll_stats.last_cycle_transfers = hp->cycle_transfers;
+        if (hp->cycle_transfers > hp->poll_stats.max_cycle_transfers)
+        {
+            hp->poll_stats.max_cycle_transfers = hp->cycle_transfers;
+        }
+        hp->cycle_transfers = 0U;
+    }
+
+    hp->last_get_report_ms = now_ms;
+    if (hp->cycle_transfers < UINT16_MAX)
+    {
+        hp->cycle_transfers++;
+    }
+
+    hp->poll_stats.get_report_total++;
+    if (report_type == HID_REPORT_TYPE_INPUT)
+    {
+        hp->poll_stats.get_report_input++;
+    }
+    else if (report_type == HID_REPORT_TYPE_FEATURE)
+    {
+        hp->poll_stats.get_report_feature++;
+    }
+}
+
+void ups_hid_get_poll_stats(uint8_t instance, ups_hid_poll_stats_t *out)
+{
+    hid_port_t const *hp = hid_port(instance);
+    if ((hp == NULL) || (out == NULL))
+    {
+        return;
+    }
+    *out = hp->poll_stats;
+}
+
+// ------------------------------------------------------------------
+// Interrupt IN pending report
+//
+// Only the STATUS report goes out on the interrupt endpoint, and the host
+// only needs its newest values, so one pending slot per port is enough: a
+// newer report replaces the pending one. TinyUSB copies the payload into its
+// own endpoint buffer, so the slot is free again as soon as tud_hid_report()
+// accepts it; a report queued while the endpoint is busy goes out from
+// tud_hid_report_complete_cb().
+// ------------------------------------------------------------------
+
+static void hid_tx_reset(hid_port_t *hp)
+{
+    memset(&hp->tx_pending, 0, sizeof(hp->tx_pending));
+}
+
+static void hid_tx_drain(uint8_t instance)
+{
+    hid_port_t *hp = hid_port(instance);
+    if ((hp == NULL) || !hp->tx_pending.used || !tud_hid_n_ready(instance))
+    {
+        return;
+    }
+
+    hid_tx_slot_t *slot = &hp->tx_pending;
+    if (tud_hid_n_report(instance, slot->report_id, slot->data, slot->len))
+    {
+        slot->used = false;
+        hp->tx_stats.sent++;
+    }
+}
+
+bool ups_hid_tx_enqueue(uint8_t instance, uint8_t report_id, ups_hid_tx_priority_t priority,
+                        uint8_t const *data, uint16_t len)
+{
+    hid_port_t *hp = hid_port(instance);
+    if ((hp == NULL) || (data == NULL) || (len == 0U) || (len > UPS_HID_TX_PAYLOAD_MAX))
+    {
+        return false;
+    }
+
+    hid_tx_slot_t *slot = &hp->tx_pending;
+    if (slot->used)
+    {
+        // A pending power state change must reach the host as it was: a
+        // second one, or a routine update, waits for the next pass.
+        if (slot->urgent)
+        {
+            hp->tx_stats.dropped++;
+            return false;
+        }
+        hp->tx_stats.coalesced++;
+    }
+
+    slot->used = true;
+    slot->urgent = (priority == UPS_HID_TX_PRIORITY_HIGH);
+    slot->report_id = report_id;
+    memcpy(slot->data, data, len);
+    slot->len = len;
+    hp->tx_stats.queued++;
+
+    hid_tx_drain(instance);
+    return true;
+}
+
+void ups_hid_get_tx_stats(uint8_t instance, ups_hid_tx_stats_t *out)
+{
+    hid_port_t const *hp = hid_port(instance);
+    if ((hp == NULL) || (out == NULL))
+    {
+        return;
+    }
+    *out = hp->tx_stats;
+}
+
+// ------------------------------------------------------------------
+// Remote wakeup
+//
+// The UART engines and the port state machines do not depend on the bus,
+// so the UPS is still polled while the host sleeps. Each pass compares the
+// alerts of every ready port with the last ones seen; an alert that was
+// not there (one already present when the host went to sleep does not
+// count) signals remote wakeup if the host allowed it. TinyUSB holds RESUME
+// on the bus, the host resumes it, and the first STATUS report after that
+// goes out at high priority.
+// ------------------------------------------------------------------
+
+static uint8_t hid_port_alerts(uint8_t instance)
+{
+    if (!ups_port_is_ready(instance))
+    {
+        return 0U;
+    }
+
+    ups_present_status_t const *ps = &g_ups[instance].present_status;
+    return (uint8_t)((ps->ac_present ? 0U : UPS_HID_ALERT_AC_LOST) |
+                     (ps->below_remaining_capacity_limit ? UPS_HID_ALERT_LOW_BATTERY : 0U) |
+                     (ps->shutdown_imminent ? UPS_HID_ALERT_SHUTDOWN : 0U));
+}
+
+static uint16_t hid_clamp_ms(uint32_t ms)
+{
+    return (ms > 0xFFFFU) ? 0xFFFFU : (uint16_t)ms;
+}
+
+static void hid_wakeup_check(uint32_t now_ms)
+{
+    for (uint8_t instance = 0U; instance < CFG_TUD_HID; instance++)
+    {
+        uint8_t const alerts = hid_port_alerts(instance);
+        uint8_t const raised = (uint8_t)(alerts & ~s_wakeup.alerts[instance]);
+        s_wakeup.alerts[instance] = alerts;
+        if ((raised == 0U) || s_wakeup.pending)
+        {
+            continue;
+        }
+
+        LOG_RING_PRINTF("USB ups%u alert 0x%x while suspended, remote wakeup %s\r\n",
+                        (unsigned int)instance, (unsigned int)raised,
+                        s_wakeup.stats.remote_wakeup_en ? "on" : "off");
+        if (!s_wakeup.stats.remote_wakeup_en)
+        {
+            s_wakeup.stats.wakeups_blocked++;
+            continue;
+        }
+        s_wakeup.pending = true;
+        s_wakeup.signalled = false;
+        s_wakeup.instance = instance;
+        s_wakeup.event_ms = now_ms;
+    }
+
+    if (!s_wakeup.pending)
+    {
+        return;
+    }
+    if (s_wakeup.signalled && ((now_ms - s_wakeup.signal_ms) < UPS_HID_WAKEUP_RETRY_MS))
+    {
+        return;
+    }
+    // The USB cell needs its clock back to drive RESUME.
+    power_mode_wake(now_ms);
+    if (tud_remote_wakeup())
+    {
+        s_wakeup.signalled = true;
+        s_wakeup.signal_ms = now_ms;
+        s_wakeup.stats.wakeups++;
+    }
+}
+
+void ups_hid_get_wakeup_stats(ups_hid_wakeup_stats_t *out)
+{
+    if (out == NULL)
     {
         return;
     }
+    *out = s_wakeup.stats;
+}
+
+void tud_hid_report_complete_cb(uint8_t instance, uint8_t const *report, uint16_t len)
+{
+    if (s_wakeup.stats.wakeup_pending && (instance == s_wakeup.instance) &&
+        (report != NULL) && (len > 0U) && (report[0] == REPORT_ID_STATUS))
+    {
+        // The host has read the alert: the end of the wakeup.
+        uint16_t const ms = hid_clamp_ms(HAL_GetTick() - s_wakeup.event_ms);
+        s_wakeup.stats.last_report_ms = ms;
+        if (ms > s_wakeup.stats.max_report_ms)
+        {
+            s_wakeup.stats.max_report_ms = ms;
+        }
+        s_wakeup.stats.wakeup_pending = false;
+        LOG_RING_PRINTF("USB ups%u alert read by the host after %u ms\r\n",
+                        (unsigned int)instance, (unsigned int)ms);
+    }
+
+    hid_tx_drain(instance);
+}
+
+static void hid_periodic_port(uint8_t instance, uint32_t now_ms)
+{
+    hid_port_t *hp = &hid_ports[instance];
 
-    hid_last_report_ms = now_ms;
+    hid_tx_drain(instance);
+
+    uint32_t const elapsed_ms = now_ms - hp->last_report_ms;
+    if (elapsed_ms < UPS_HID_INPUT_MIN_PUSH_MS)
+    {
+        return;
+    }
 
-    if (!tud_hid_ready())
+    // Nothing is pushed for a UPS that has not answered yet.
+    if (!ups_port_is_ready(instance))
     {
         return;
     }
 
-    uint8_t report[8];
-    uint8_t report_id = 1;
-    (void)hid_report_cycle_index;
+    ups_state_t const *ups = &g_ups[instance];
+    uint8_t report[CFG_TUD_HID_EP_BUFSIZE];
+    uint16_t const len = build_hid_input_report(ups, REPORT_ID_STATUS, report, sizeof(report));
+    if (len == 0U)
+    {
+        return;
+    }
 
-    uint16_t len = build_hid_input_report(report_id, report, sizeof(report));
-    if (len > 0U)
+    bool const changed = (len != hp->last_input_len) || (memcmp(report, hp->last_input, len) != 0);
+    if ((!changed) && (elapsed_ms < UPS_HID_INPUT_HEARTBEAT_MS))
     {
-        (void)tud_hid_report(report_id, report, len);
+        return;
+    }
+
+    // A power state transition must not be overwritten by a routine update.
+    bool const status_changed = (memcmp(&hp->last_present_status, &ups->present_status,
+                                        sizeof(hp->last_present_status)) != 0);
+    bool const wakeup_report = s_wakeup.stats.wakeup_pending && (s_wakeup.instance == instance);
+    ups_hid_tx_priority_t const priority = (status_changed || wakeup_report) ? UPS_HID_TX_PRIORITY_HIGH
+                                                                             : UPS_HID_TX_PRIORITY_NORMAL;
+
+    if (ups_hid_tx_enqueue(instance, REPORT_ID_STATUS, priority, report, len))
+    {
+        memcpy(hp->last_input, report, len);
+        hp->last_input_len = len;
+        hp->last_present_status = ups->present_status;
+        hp->last_report_ms = now_ms;
+    }
+}
+
+void ups_hid_periodic_task(void)
+{
+    // The STATUS INPUT report carries every volatile value. It is queued for
+    // the interrupt endpoint as soon as it changes, so hosts in interrupt
+    // mode get every measurement without GET_REPORT. Hosts that poll with
+    // GET_REPORT are unaffected; the periodic re-send doubles as a heartbeat.
+    uint32_t const now_ms = HAL_GetTick();
+    if (tud_suspended())
+    {
+        hid_wakeup_check(now_ms);
+        return;
+    }
+    if (!tud_ready())
+    {
+        return;
+    }
+
+    for (uint8_t instance = 0U; instance < CFG_TUD_HID; instance++)
+    {
+        hid_periodic_port(instance, now_ms);
     }
 }
 
@@ -51,11 +403,46 @@ void tud_hid_set_report_cb(uint8_t instance,
                            uint8_t const *buffer,
                            uint16_t bufsize)
 {
-    (void)instance;
-    (void)report_id;
-    (void)report_type;
-    (void)buffer;
-    (void)bufsize;
+    hid_port_t *hp = hid_port(instance);
+    if (hp == NULL)
+    {
+        return;
+    }
+
+    // Device-wide, and accepted whether or not a UPS answers.
+    if (report_id == REPORT_ID_TUNING)
+    {
+        if (report_type == HID_REPORT_TYPE_FEATURE)
+        {
+            ups_tuning_apply_report(buffer, bufsize, HAL_GetTick());
+        }
+        return;
+    }
+
+    if (!ups_port_is_ready(instance))
+    {
+        return;
+    }
+
+    // Writes are acknowledged at once: the shadow is updated here and the
+    // UPS side is done later by the main loop (see ups_hid_take_pending_settings).
+    if (report_type == HID_REPORT_TYPE_FEATURE)
+    {
+        hp->pending_settings |= apply_hid_feature_report(&g_ups[instance], report_id, buffer, bufsize);
+    }
+}
+
+uint32_t ups_hid_take_pending_settings(uint8_t instance)
+{
+    hid_port_t *hp = hid_port(instance);
+    if (hp == NULL)
+    {
+        return 0U;
+    }
+
+    uint32_t const pending = hp->pending_settings;
+    hp->pending_settings = 0U;
+    return pending;
 }
 
 uint16_t tud_hid_get_report_cb(uint8_t instance,
@@ -64,37 +451,114 @@ uint16_t tud_hid_get_report_cb(uint8_t instance,
                                uint8_t *buffer,
                                uint16_t reqlen)
 {
-    (void)instance;
+    hid_port_t *hp = hid_port(instance);
+    if (hp == NULL)
+    {
+        return 0U;
+    }
+
+    // Diagnostics answer at any time and are not host polls.
+    if (ups_diag_is_report(report_id))
+    {
+        return (report_type == HID_REPORT_TYPE_FEATURE) ? ups_diag_build_report(instance, report_id, buffer, reqlen) : 0U;
+    }
+    if (report_id == REPORT_ID_TUNING)
+    {
+        return (report_type == HID_REPORT_TYPE_FEATURE) ? ups_tuning_build_report(buffer, reqlen) : 0U;
+    }
+
+    count_get_report(hp, report_type);
+
+    // Stalled until the UPS has answered, so hosts see "no data" rather
+    // than a UPS at 0%. CONFIG only holds constants, which the flash cache
+    // can supply before that.
+    bool const constants_only = (report_type == HID_REPORT_TYPE_FEATURE) && (report_id == REPORT_ID_CONFIG);
+    if (constants_only ? !ups_port_has_constants(instance) : !ups_port_is_ready(instance))
+    {
+        return 0U;
+    }
 
     if (report_type == HID_REPORT_TYPE_INPUT)
     {
-        return build_hid_input_report(report_id, buffer, reqlen);
+        return build_hid_input_report(&g_ups[instance], report_id, buffer, reqlen);
     }
     if (report_type == HID_REPORT_TYPE_FEATURE)
     {
-        return build_hid_feature_report(report_id, buffer, reqlen);
+        return build_hid_feature_report(&g_ups[instance], report_id, buffer, reqlen);
     }
-
     return 0U;
 }
 
+// Some hosts reset the bus instead of resuming it; that ends a suspend too.
+static void hid_wakeup_resumed(void)
+{
+    if (!s_wakeup.stats.suspended)
+    {
+        return;
+    }
+
+    uint32_t const now_ms = HAL_GetTick();
+    power_mode_usb_resume(now_ms);
+
+    s_wakeup.stats.resumes++;
+    s_wakeup.stats.suspended = false;
+    if (s_wakeup.pending && s_wakeup.signalled)
+    {
+        uint16_t const ms = hid_clamp_ms(now_ms - s_wakeup.event_ms);
+        s_wakeup.stats.last_resume_ms = ms;
+        if (ms > s_wakeup.stats.max_resume_ms)
+        {
+            s_wakeup.stats.max_resume_ms = ms;
+        }
+        s_wakeup.stats.wakeup_pending = true;
+    }
+    s_wakeup.pending = false;
+}
+
 // Mount and unmount callbacks to prevent usb failures due to stale state.
 void tud_mount_cb(void)
 {
-    reset_hid_timing_state();
+    hid_wakeup_resumed();
+    for (uint8_t instance = 0U; instance < CFG_TUD_HID; instance++)
+    {
+        reset_hid_timing_state(&hid_ports[instance]);
+        reset_hid_poll_stats(&hid_ports[instance]);
+        hid_tx_reset(&hid_ports[instance]);
+    }
 }
 
 void tud_umount_cb(void)
 {
-    reset_hid_timing_state();
+    power_mode_usb_resume(HAL_GetTick());
+    s_wakeup.stats.suspended = false;
+    s_wakeup.stats.wakeup_pending = false;
+    s_wakeup.pending = false;
+    for (uint8_t instance = 0U; instance < CFG_TUD_HID; instance++)
+    {
+        reset_hid_timing_state(&hid_ports[instance]);
+        hid_tx_reset(&hid_ports[instance]);
+    }
 }
 
 void tud_suspend_cb(bool remote_wakeup_en)
 {
-    (void)remote_wakeup_en;
+    s_wakeup.stats.suspends++;
+    s_wakeup.stats.suspended = true;
+    s_wakeup.stats.remote_wakeup_en = remote_wakeup_en;
+    s_wakeup.stats.wakeup_pending = false;
+    s_wakeup.pending = false;
+    for (uint8_t instance = 0U; instance < CFG_TUD_HID; instance++)
+    {
+        s_wakeup.alerts[instance] = hid_port_alerts(instance);
+    }
+    power_mode_usb_suspend(HAL_GetTick());
 }
 
 void tud_resume_cb(void)
 {
-    reset_hid_timing_state();
+    hid_wakeup_resumed();
+    for (uint8_t instance = 0U; instance < CFG_TUD_HID; instance++)
+    {
+        reset_hid_timing_state(&hid_ports[instance]);
+    }
 }
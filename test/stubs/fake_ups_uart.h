@@ -0,0 +1,237 @@
+#ifndef FAKE_UPS_UART_H_
+#define FAKE_UPS_UART_H_
+
+// Simulated UPS UARTs and tick for the native tests that run uart_engine.c.
+//
+// Include once per test, in the file that includes uart_engine.c: it
+// defines the UPS_UART_* adapter (main.h), HAL_GetTick() and the log and
+// trace sinks the engine calls.
+//
+// Each port has a responder that plays the UPS: it gets the bytes of one
+// command and returns the reply. Time only moves with fake_tick_advance().
+// TX takes 10 bits per byte at the port's rate; the reply starts
+// reply_delay_ms after the command went out and arrives at the same rate.
+
+#include "log_ring.h"
+#include "main.h"
+#include "uart_trace.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FAKE_UPS_REPLY_MAX 256U
+
+typedef uint16_t (*fake_ups_responder_fn)(uint8_t port,
+                                          const uint8_t *cmd,
+                                          uint16_t cmd_len,
+                                          uint8_t *reply,
+                                          uint16_t reply_cap);
+
+typedef struct
+{
+    fake_ups_responder_fn responder;
+    uint32_t baud;
+    uint32_t reply_delay_ms;
+    uint32_t transactions; // commands sent
+
+    bool locked;
+    uint32_t tx_done_ms;
+    bool tx_active;
+
+    uint8_t reply[FAKE_UPS_REPLY_MAX];
+    uint16_t reply_len;
+    uint16_t reply_read;
+    uint32_t reply_start_ms;
+} fake_ups_port_t;
+
+static uint32_t s_fake_now_ms = 1U;
+static fake_ups_port_t s_fake_ups[UPS_PORT_COUNT];
+
+const bool g_ups_debug_status_print_enabled = false;
+
+static void fake_ups_reset(void)
+{
+    s_fake_now_ms = 1U;
+    (void)memset(s_fake_ups, 0, sizeof(s_fake_ups));
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        s_fake_ups[port].baud = 2400U;
+    }
+}
+
+static void fake_ups_attach(uint8_t port, fake_ups_responder_fn responder, uint32_t baud, uint32_t reply_delay_ms)
+{
+    s_fake_ups[port].responder = responder;
+    s_fake_ups[port].baud = baud;
+    s_fake_ups[port].reply_delay_ms = reply_delay_ms;
+}
+
+static void fake_tick_advance(uint32_t ms)
+{
+    s_fake_now_ms += ms;
+}
+
+// Milliseconds for n bytes at the port's rate, 8N1.
+static uint32_t fake_ups_bytes_ms(const fake_ups_port_t *p, uint32_t n)
+{
+    return ((n * 10000U) + p->baud - 1U) / p->baud;
+}
+
+// Reply bytes that have arrived by now.
+static uint16_t fake_ups_arrived(const fake_ups_port_t *p)
+{
+    if ((p->reply_len == 0U) || ((int32_t)(s_fake_now_ms - p->reply_start_ms) < 0))
+    {
+        return 0U;
+    }
+    uint32_t const n = ((s_fake_now_ms - p->reply_start_ms) * p->baud) / 10000U;
+    return (n > p->reply_len) ? p->reply_len : (uint16_t)n;
+}
+
+uint32_t HAL_GetTick(void)
+{
+    return s_fake_now_ms;
+}
+
+HAL_StatusTypeDef UPS_UART_SetBaud(uint8_t port, uint32_t baud)
+{
+    s_fake_ups[port].baud = baud;
+    return HAL_OK;
+}
+
+uint32_t UPS_UART_GetBaud(uint8_t port)
+{
+    return s_fake_ups[port].baud;
+}
+
+HAL_StatusTypeDef UPS_UART_SendBytesDMA(uint8_t port, const uint8_t *data, uint16_t len)
+{
+    fake_ups_port_t *p = &s_fake_ups[port];
+    if (p->tx_active)
+    {
+        return HAL_BUSY;
+    }
+
+    p->transactions++;
+    p->tx_active = true;
+    p->tx_done_ms = s_fake_now_ms + fake_ups_bytes_ms(p, len);
+    p->reply_len = (p->responder != NULL) ? p->responder(port, data, len, p->reply, FAKE_UPS_REPLY_MAX) : 0U;
+    p->reply_read = 0U;
+    p->reply_start_ms = p->tx_done_ms + p->reply_delay_ms;
+    return HAL_OK;
+}
+
+bool UPS_UART_TxDone(uint8_t port)
+{
+    fake_ups_port_t *p = &s_fake_ups[port];
+    if (p->tx_active && ((int32_t)(s_fake_now_ms - p->tx_done_ms) >= 0))
+    {
+        p->tx_active = false;
+    }
+    return !p->tx_active;
+}
+
+void UPS_UART_TxDoneClear(uint8_t port)
+{
+    (void)port;
+}
+
+uint16_t UPS_UART_Available(uint8_t port)
+{
+    fake_ups_port_t const *p = &s_fake_ups[port];
+    return (uint16_t)(fake_ups_arrived(p) - p->reply_read);
+}
+
+int UPS_UART_ReadByte(uint8_t port, uint8_t *out)
+{
+    fake_ups_port_t *p = &s_fake_ups[port];
+    if (p->reply_read >= fake_ups_arrived(p))
+    {
+        return 0;
+    }
+    *out = p->reply[p->reply_read++];
+    return 1;
+}
+
+uint16_t UPS_UART_Read(uint8_t port, uint8_t *dst, uint16_t len)
+{
+    uint16_t n = 0U;
+    while ((n < len) && (UPS_UART_ReadByte(port, &dst[n]) != 0))
+    {
+        n++;
+    }
+    return n;
+}
+
+uint16_t UPS_UART_Peek(uint8_t port, const uint8_t **data)
+{
+    fake_ups_port_t const *p = &s_fake_ups[port];
+    *data = &p->reply[p->reply_read];
+    return (uint16_t)(fake_ups_arrived(p) - p->reply_read);
+}
+
+void UPS_UART_Skip(uint8_t port, uint16_t len)
+{
+    uint16_t const available = UPS_UART_Available(port);
+    s_fake_ups[port].reply_read += (len > available) ? available : len;
+}
+
+void UPS_UART_DiscardBuffered(uint8_t port)
+{
+    s_fake_ups[port].reply_len = 0U;
+    s_fake_ups[port].reply_read = 0U;
+}
+
+bool UPS_UART_TryLock(uint8_t port)
+{
+    if (s_fake_ups[port].locked)
+    {
+        return false;
+    }
+    s_fake_ups[port].locked = true;
+    return true;
+}
+
+void UPS_UART_Unlock(uint8_t port)
+{
+    s_fake_ups[port].locked = false;
+}
+
+void UPS_DebugPrintTxCommand(const uint8_t *data, uint16_t len)
+{
+    (void)data;
+    (void)len;
+}
+
+void log_ring_write(const char *fmt, uint8_t nargs, const uint32_t *args)
+{
+    (void)fmt;
+    (void)nargs;
+    (void)args;
+}
+
+void log_ring_write_bytes(const char *prefix, const uint8_t *data, uint16_t len)
+{
+    (void)prefix;
+    (void)data;
+    (void)len;
+}
+
+void uart_trace_state(uint8_t port, uint8_t state, uint16_t cmd, uint8_t retries_left)
+{
+    (void)port;
+    (void)state;
+    (void)cmd;
+    (void)retries_left;
+}
+
+void uart_trace_outcome(uint8_t port, uart_trace_outcome_t outcome, uint16_t cmd, uint8_t retries_left)
+{
+    (void)port;
+    (void)outcome;
+    (void)cmd;
+    (void)retries_left;
+}
+
+#endif // FAKE_UPS_UART_H_
@@ -0,0 +1,162 @@
+#ifndef SPM2K_BASELINE_H_
+#define SPM2K_BASELINE_H_
+
+// The SPM2K reply parsing helpers as they were before the incremental
+// number parser and the field descriptors, verbatim apart from the old_
+// prefix and static inline, so a suite may use only some of them. The
+// native tests measure and check the current code against them.
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+static inline bool old_spm2k_rx_has_crlf(const uint8_t *rx, uint16_t rx_len)
+{
+    if ((rx == NULL) || (rx_len < 2U))
+    {
+        return false;
+    }
+
+    return (rx[rx_len - 2U] == 0x0DU) && (rx[rx_len - 1U] == 0x0AU);
+}
+
+static inline bool old_spm2k_extract_text(const uint8_t *rx,
+                                          uint16_t rx_len,
+                                          bool require_crlf,
+                                          char *out,
+                                          size_t out_size)
+{
+    if ((rx == NULL) || (out == NULL) || (out_size < 2U) || (rx_len == 0U))
+    {
+        return false;
+    }
+
+    size_t payload_len = (size_t)rx_len;
+    if (require_crlf)
+    {
+        if (!old_spm2k_rx_has_crlf(rx, rx_len))
+        {
+            return false;
+        }
+        payload_len -= 2U;
+    }
+
+    if ((payload_len == 0U) || (payload_len >= out_size))
+    {
+        return false;
+    }
+
+    for (size_t i = 0U; i < payload_len; ++i)
+    {
+        if (!isprint((int)rx[i]))
+        {
+            return false;
+        }
+    }
+
+    memcpy(out, rx, payload_len);
+    out[payload_len] = '\0';
+    return true;
+}
+
+static inline bool old_spm2k_parse_scaled_int(const char *text,
+                                              int32_t scale,
+                                              int32_t min_value,
+                                              int32_t max_value,
+                                              int32_t *out_value)
+{
+    if ((text == NULL) || (out_value == NULL) || (scale <= 0))
+    {
+        return false;
+    }
+
+    int32_t fraction_digits = 0;
+    int32_t tmp_scale = scale;
+    while ((tmp_scale > 1) && ((tmp_scale % 10) == 0))
+    {
+        tmp_scale /= 10;
+        fraction_digits++;
+    }
+    if (tmp_scale != 1)
+    {
+        return false;
+    }
+
+    char const *cursor = text;
+    int sign = 1;
+    if (*cursor == '-')
+    {
+        sign = -1;
+        cursor++;
+    }
+    else if (*cursor == '+')
+    {
+        cursor++;
+    }
+
+    if (!isdigit((int)*cursor))
+    {
+        return false;
+    }
+
+    int64_t integral = 0;
+    while (isdigit((int)*cursor))
+    {
+        integral = (integral * 10) + (*cursor - '0');
+        if (integral > (INT32_MAX / scale))
+        {
+            return false;
+        }
+        cursor++;
+    }
+
+    int64_t fraction = 0;
+    int32_t captured_fraction_digits = 0;
+    if (*cursor == '.')
+    {
+        cursor++;
+        if (!isdigit((int)*cursor))
+        {
+            return false;
+        }
+
+        while (isdigit((int)*cursor))
+        {
+            if (captured_fraction_digits < fraction_digits)
+            {
+                fraction = (fraction * 10) + (*cursor - '0');
+                captured_fraction_digits++;
+            }
+            cursor++;
+        }
+    }
+
+    while (captured_fraction_digits < fraction_digits)
+    {
+        fraction *= 10;
+        captured_fraction_digits++;
+    }
+
+    if (*cursor != '\0')
+    {
+        return false;
+    }
+
+    int64_t scaled = (integral * scale) + fraction;
+    if (sign < 0)
+    {
+        scaled = -scaled;
+    }
+
+    if ((scaled < min_value) || (scaled > max_value))
+    {
+        return false;
+    }
+
+    *out_value = (int32_t)scaled;
+    return true;
+}
+
+#endif // SPM2K_BASELINE_H_
@@ -0,0 +1,19 @@
+#ifndef STM32F1XX_HAL_H_
+#define STM32F1XX_HAL_H_
+
+// Host stand-in for the HAL names the firmware headers use, for the native
+// test environment only. HAL_GetTick() is provided by each test.
+
+#include <stdint.h>
+
+typedef enum
+{
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U,
+} HAL_StatusTypeDef;
+
+uint32_t HAL_GetTick(void);
+
+#endif // STM32F1XX_HAL_H_
@@ -0,0 +1,251 @@
+// The bootstrap MINIMUM step for each sub-adapter: its minimum LUT (the one
+// ups_sub_adapter_get() in main.c hands out) through the engine, against a
+// simulated UPS. main.c passes the step when none of its jobs failed, so
+// each LUT must leave the capacity known on its own, 0 % included.
+
+#include <unity.h>
+
+#include "fake_ups_uart.h"
+
+#include "../../src/crc16.c"
+#include "../../src/megatec.c"
+#include "../../src/modbus.c"
+#include "../../src/spm2k.c"
+#include "../../src/uart_engine.c"
+
+#include <stdio.h>
+
+ups_state_t g_ups[UPS_PORT_COUNT];
+
+bool usb_desc_set_string_ascii(uint8_t strid, const char *ascii)
+{
+    (void)strid;
+    (void)ascii;
+    return true;
+}
+
+int pack_hid_date_mmddyy(const char *s, uint16_t *out)
+{
+    (void)s;
+    *out = 0U;
+    return 1;
+}
+
+#define TEST_REPLY_DELAY_MS 5U
+#define TEST_RUN_LIMIT_MS 10000U
+#define TEST_REGISTER_COUNT 700U
+
+// What the simulated UPS reports, set per test.
+static bool s_battery_empty;
+
+static uint16_t test_reply(const char *text, uint8_t *reply, uint16_t reply_cap)
+{
+    size_t const len = strlen(text);
+    TEST_ASSERT_TRUE(len <= reply_cap);
+    (void)memcpy(reply, text, len);
+    return (uint16_t)len;
+}
+
+static uint16_t spm2k_ups(uint8_t port, const uint8_t *cmd, uint16_t cmd_len, uint8_t *reply, uint16_t reply_cap)
+{
+    (void)port;
+
+    if (cmd_len != 1U)
+    {
+        return 0U;
+    }
+    switch (cmd[0])
+    {
+    case 0x66U:
+        return test_reply(s_battery_empty ? "000.0\r\n" : "050.0\r\n", reply, reply_cap);
+    case 0x39U:
+        return test_reply("FF", reply, reply_cap);
+    case 0x51U:
+        return test_reply(s_battery_empty ? "10\r\n" : "08\r\n", reply, reply_cap);
+    default:
+        return 0U;
+    }
+}
+
+// 24 V string (12 cells); Q1 reports one cell, as online units do.
+static uint16_t megatec_ups(uint8_t port, const uint8_t *cmd, uint16_t cmd_len, uint8_t *reply, uint16_t reply_cap)
+{
+    (void)port;
+
+    if ((cmd_len == 2U) && (cmd[0] == 'F'))
+    {
+        return test_reply("#230.0 004 24.00 50.0\r", reply, reply_cap);
+    }
+    if ((cmd_len == 3U) && (cmd[0] == 'Q') && (cmd[1] == '1'))
+    {
+        return test_reply(s_battery_empty ? "(230.0 230.0 230.0 025 50.0 1.70 30.0 10000000\r"
+                                          : "(230.0 230.0 230.0 025 50.0 2.05 30.0 00000001\r",
+                          reply, reply_cap);
+    }
+    return 0U;
+}
+
+static uint16_t s_regs[TEST_REGISTER_COUNT];
+
+static uint16_t modbus_ups(uint8_t port, const uint8_t *cmd, uint16_t cmd_len, uint8_t *reply, uint16_t reply_cap)
+{
+    (void)port;
+
+    if ((cmd_len != 8U) || (cmd[1] != MODBUS_FC_READ_HOLDING))
+    {
+        return 0U;
+    }
+    uint16_t const start = (uint16_t)((cmd[2] << 8) | cmd[3]);
+    uint16_t const count = (uint16_t)((cmd[4] << 8) | cmd[5]);
+    if (((start + count) > TEST_REGISTER_COUNT) || ((5U + (2U * count)) > reply_cap))
+    {
+        return 0U;
+    }
+
+    uint16_t len = 0U;
+    reply[len++] = cmd[0];
+    reply[len++] = cmd[1];
+    reply[len++] = (uint8_t)(2U * count);
+    for (uint16_t i = 0U; i < count; i++)
+    {
+        reply[len++] = (uint8_t)(s_regs[start + i] >> 8);
+        reply[len++] = (uint8_t)(s_regs[start + i] & 0xFFU);
+    }
+    uint16_t const crc = crc16_modbus(reply, len);
+    reply[len++] = (uint8_t)(crc & 0xFFU);
+    reply[len++] = (uint8_t)(crc >> 8);
+    return len;
+}
+
+typedef struct
+{
+    const char *name;
+    const uart_engine_request_t *minimum_lut;
+    fake_ups_responder_fn ups;
+    uint32_t baud;
+    uint8_t capacity; // with s_battery_empty false
+} test_adapter_t;
+
+// As ups_sub_adapter_get() sets them up.
+static const test_adapter_t k_adapters[] = {
+    { "spm2k", g_spm2k_minimum_lut, spm2k_ups, 2400U, 50U },
+    { "megatec", g_megatec_minimum_lut, megatec_ups, 2400U, 73U },
+    { "modbus", g_modbus_dynamic_lut, modbus_ups, 9600U, 50U },
+};
+
+#define TEST_ADAPTER_COUNT (sizeof(k_adapters) / sizeof(k_adapters[0]))
+
+static size_t adapter_lut_count(size_t idx)
+{
+    // The counts are extern consts, not constant expressions.
+    switch (idx)
+    {
+    case 0U:
+        return g_spm2k_minimum_lut_count;
+    case 1U:
+        return g_megatec_minimum_lut_count;
+    default:
+        return g_modbus_dynamic_lut_count;
+    }
+}
+
+void setUp(void)
+{
+    fake_ups_reset();
+    (void)memset(g_ups, 0, sizeof(g_ups));
+    (void)memset(s_megatec_rating, 0, sizeof(s_megatec_rating));
+    uart_engine_init();
+    s_battery_empty = false;
+
+    (void)memset(s_regs, 0, sizeof(s_regs));
+    s_regs[1] = (uint16_t)MODBUS_UPS_STATUS_ONLINE;
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_CHARGE] = 50U * 512U;
+}
+
+void tearDown(void)
+{
+}
+
+// Runs one LUT to the end; returns the jobs that failed.
+static uint32_t run_lut(const uart_engine_request_t *lut, size_t count)
+{
+    uart_engine_stats_t before;
+    uart_engine_stats_t after;
+    uart_engine_get_stats(0U, &before);
+
+    for (size_t i = 0U; i < count; i++)
+    {
+        TEST_ASSERT_EQUAL(UART_ENGINE_OK, uart_engine_enqueue(0U, &lut[i]));
+    }
+    uint32_t const start_ms = HAL_GetTick();
+    while (uart_engine_is_busy(0U))
+    {
+        TEST_ASSERT_TRUE_MESSAGE((HAL_GetTick() - start_ms) < TEST_RUN_LIMIT_MS, "engine never went idle");
+        fake_tick_advance(1U);
+        uart_engine_tick();
+    }
+
+    uart_engine_get_stats(0U, &after);
+    TEST_ASSERT_EQUAL_UINT32(count, (after.completed - before.completed) + (after.failed - before.failed));
+    return after.failed - before.failed;
+}
+
+// Runs adapter idx's minimum LUT against its UPS; returns the failed jobs.
+static uint32_t run_minimum(size_t idx)
+{
+    fake_ups_attach(0U, k_adapters[idx].ups, k_adapters[idx].baud, TEST_REPLY_DELAY_MS);
+    return run_lut(k_adapters[idx].minimum_lut, adapter_lut_count(idx));
+}
+
+static void test_minimum_step_reads_the_capacity(void)
+{
+    for (size_t i = 0U; i < TEST_ADAPTER_COUNT; i++)
+    {
+        setUp();
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0U, run_minimum(i), k_adapters[i].name);
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(k_adapters[i].capacity, g_ups[0].battery.remaining_capacity, k_adapters[i].name);
+        TEST_ASSERT_TRUE_MESSAGE(g_ups[0].present_status.ac_present, k_adapters[i].name);
+
+        char msg[64];
+        (void)snprintf(msg, sizeof(msg), "%s: %lu jobs, %lu transactions, capacity %u %%", k_adapters[i].name,
+                       (unsigned long)adapter_lut_count(i), (unsigned long)s_fake_ups[0].transactions,
+                       (unsigned)g_ups[0].battery.remaining_capacity);
+        TEST_MESSAGE(msg);
+    }
+}
+
+// An empty battery is an answer, not a lost link: the step still passes.
+static void test_empty_battery_passes_the_minimum_step(void)
+{
+    for (size_t i = 0U; i < TEST_ADAPTER_COUNT; i++)
+    {
+        setUp();
+        s_battery_empty = true;
+        s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_CHARGE] = 0U;
+        g_ups[0].battery.remaining_capacity = 99U; // so the 0 below was read
+
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0U, run_minimum(i), k_adapters[i].name);
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(0U, g_ups[0].battery.remaining_capacity, k_adapters[i].name);
+    }
+}
+
+// Q1 alone cannot estimate the charge: without F's rated voltage the cell
+// count is unknown.
+static void test_megatec_q1_alone_has_no_capacity(void)
+{
+    fake_ups_attach(0U, megatec_ups, 2400U, TEST_REPLY_DELAY_MS);
+    TEST_ASSERT_EQUAL_UINT32(0U, run_lut(g_megatec_dynamic_lut, g_megatec_dynamic_lut_count));
+    TEST_ASSERT_EQUAL_UINT8(0U, g_ups[0].battery.remaining_capacity);
+
+    TEST_ASSERT_EQUAL_UINT32(0U, run_minimum(1U));
+    TEST_ASSERT_EQUAL_UINT8(73U, g_ups[0].battery.remaining_capacity);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_minimum_step_reads_the_capacity);
+    RUN_TEST(test_empty_battery_passes_the_minimum_step);
+    RUN_TEST(test_megatec_q1_alone_has_no_capacity);
+    return UNITY_END();
+}
@@ -0,0 +1,279 @@
+// The HID report descriptor generated from ups_hid_layout.h, parsed the way
+// a host does: every field and collection of the layout table must see its
+// own report ID, usage, logical range, unit, exponent and size, and no
+// global item may restate the value already in effect.
+
+#define CFG_TUSB_MCU OPT_MCU_STM32F1
+#define CFG_TUSB_OS OPT_OS_NONE
+#define STM32F103xB
+
+#include <unity.h>
+
+#include "tusb.h"
+#include "usb_descriptors.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static uint8_t const k_desc[] = {
+    TUD_HID_REPORT_DESC_UPS()
+};
+
+typedef struct
+{
+    uint8_t tag; // RI_MAIN_*
+    uint8_t report_id;
+    uint16_t page;
+    uint16_t usage;
+    int32_t lmin;
+    int32_t lmax;
+    uint32_t unit;
+    int32_t exp;
+    uint8_t bits;
+    bool constant;
+    const char *name;
+} test_item_t;
+
+// What each main item of the UPS collection must see, from the table.
+#define TEST_FIELD_ITEM(tag, report, member, bits, page, usage, lmin, lmax, unit, exp) \
+    { (tag), REPORT_ID_##report, HID_USAGE_PAGE_##page, HID_USAGE_##page##_##usage, (lmin), (lmax), \
+      UPS_HID_UNIT_##unit, (exp), (bits), false, #member },
+#define TEST_FIELD_INPUT(...) TEST_FIELD_ITEM(RI_MAIN_INPUT, __VA_ARGS__)
+#define TEST_FIELD_FEATURE(...) TEST_FIELD_ITEM(RI_MAIN_FEATURE, __VA_ARGS__)
+#define TEST_FIELD_BOTH(...) TEST_FIELD_INPUT(__VA_ARGS__) TEST_FIELD_FEATURE(__VA_ARGS__)
+#define TEST_FIELD(sel, report, kind, member, ctype, bits, page, usage, lmin, lmax, unit, exp, flags, value) \
+    TEST_FIELD_##kind(report, member, bits, page, usage, lmin, lmax, unit, exp)
+
+#define TEST_PAD_ITEM(tag, report, bits) { (tag), REPORT_ID_##report, 0U, 0U, 0, 0, 0U, 0, (bits), true, "pad" },
+#define TEST_PAD_INPUT(...) TEST_PAD_ITEM(RI_MAIN_INPUT, __VA_ARGS__)
+#define TEST_PAD_FEATURE(...) TEST_PAD_ITEM(RI_MAIN_FEATURE, __VA_ARGS__)
+#define TEST_PAD_BOTH(...) TEST_PAD_INPUT(__VA_ARGS__) TEST_PAD_FEATURE(__VA_ARGS__)
+#define TEST_PAD(sel, report, kind, bits) TEST_PAD_##kind(report, bits)
+
+#define TEST_BEGIN(page, usage) \
+    { RI_MAIN_COLLECTION, 0U, HID_USAGE_PAGE_##page, HID_USAGE_##page##_##usage, 0, 0, 0U, 0, 0U, false, #usage },
+#define TEST_END()
+#define TEST_GLOBAL(...)
+
+static const test_item_t k_expected[] = {
+    UPS_HID_LAYOUT(TEST_FIELD, TEST_PAD, TEST_BEGIN, TEST_END, TEST_GLOBAL, ~)
+};
+
+#define TEST_EXPECTED_COUNT (sizeof(k_expected) / sizeof(k_expected[0]))
+
+// Parser state.
+static int64_t s_globals[RI_GLOBAL_REPORT_COUNT + 1]; // -1 while unset
+static uint16_t s_usage;
+static bool s_usage_set;
+static size_t s_next_expected;
+static uint8_t s_depth;
+
+static int64_t test_item_value(uint8_t const *data, uint8_t len, bool is_signed)
+{
+    uint32_t value = 0U;
+    for (uint8_t i = 0U; i < len; i++)
+    {
+        value |= (uint32_t)data[i] << (8U * i);
+    }
+    if (is_signed && (len > 0U) && (len < 4U) && ((value >> ((8U * len) - 1U)) != 0U))
+    {
+        value |= ~0UL << (8U * len);
+    }
+    return is_signed ? (int64_t)(int32_t)value : (int64_t)value;
+}
+
+static void test_check_main(uint8_t tag, uint32_t data)
+{
+    char msg[96];
+
+    if ((tag != RI_MAIN_COLLECTION) && (tag != RI_MAIN_INPUT) && (tag != RI_MAIN_FEATURE))
+    {
+        return;
+    }
+    // The UPS application collection itself and the vendor collection after
+    // it are checked separately.
+    if (s_depth == 0U)
+    {
+        return;
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(s_next_expected < TEST_EXPECTED_COUNT, "more main items than table entries");
+    test_item_t const *e = &k_expected[s_next_expected++];
+    (void)snprintf(msg, sizeof(msg), "item %lu (%s)", (unsigned long)(s_next_expected - 1U), e->name);
+
+    TEST_ASSERT_EQUAL_MESSAGE(e->tag, tag, msg);
+    if (tag == RI_MAIN_COLLECTION)
+    {
+        TEST_ASSERT_EQUAL_MESSAGE(HID_COLLECTION_LOGICAL, data, msg);
+        TEST_ASSERT_TRUE_MESSAGE(s_usage_set, msg);
+        TEST_ASSERT_EQUAL_MESSAGE(e->page, s_globals[RI_GLOBAL_USAGE_PAGE], msg);
+        TEST_ASSERT_EQUAL_MESSAGE(e->usage, s_usage, msg);
+        return;
+    }
+
+    TEST_ASSERT_EQUAL_MESSAGE(e->report_id, s_globals[RI_GLOBAL_REPORT_ID], msg);
+    TEST_ASSERT_EQUAL_MESSAGE(e->bits, s_globals[RI_GLOBAL_REPORT_SIZE], msg);
+    TEST_ASSERT_EQUAL_MESSAGE(1, s_globals[RI_GLOBAL_REPORT_COUNT], msg);
+    TEST_ASSERT_EQUAL_MESSAGE(e->constant ? 1U : 0U, data & HID_CONSTANT, msg);
+    if (e->constant)
+    {
+        TEST_ASSERT_FALSE_MESSAGE(s_usage_set, msg);
+        return;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(s_usage_set, msg);
+    TEST_ASSERT_EQUAL_MESSAGE(e->page, s_globals[RI_GLOBAL_USAGE_PAGE], msg);
+    TEST_ASSERT_EQUAL_MESSAGE(e->usage, s_usage, msg);
+    TEST_ASSERT_EQUAL_MESSAGE(e->lmin, s_globals[RI_GLOBAL_LOGICAL_MIN], msg);
+    TEST_ASSERT_EQUAL_MESSAGE(e->lmax, s_globals[RI_GLOBAL_LOGICAL_MAX], msg);
+    TEST_ASSERT_EQUAL_MESSAGE(e->unit, s_globals[RI_GLOBAL_UNIT], msg);
+    TEST_ASSERT_EQUAL_MESSAGE(e->exp, s_globals[RI_GLOBAL_UNIT_EXPONENT], msg);
+}
+
+// Walks the descriptor; on_feature (if set) sees every FEATURE item of the
+// vendor collection.
+static void test_parse(void (*on_feature)(void))
+{
+    static uint8_t const k_data_len[4] = {0U, 1U, 2U, 4U};
+
+    for (size_t i = 0U; i <= RI_GLOBAL_REPORT_COUNT; i++)
+    {
+        s_globals[i] = -1;
+    }
+    s_usage_set = false;
+    s_next_expected = 0U;
+    s_depth = 0U;
+    bool in_vendor = false;
+
+    size_t pos = 0U;
+    while (pos < sizeof(k_desc))
+    {
+        uint8_t const prefix = k_desc[pos];
+        TEST_ASSERT_NOT_EQUAL_MESSAGE(0xFEU, prefix, "long item");
+        uint8_t const len = k_data_len[prefix & 0x03U];
+        uint8_t const type = (uint8_t)((prefix >> 2) & 0x03U);
+        uint8_t const tag = (uint8_t)(prefix >> 4);
+        TEST_ASSERT_TRUE_MESSAGE((pos + 1U + len) <= sizeof(k_desc), "item runs past the end");
+        uint8_t const *data = &k_desc[pos + 1U];
+        pos += 1U + len;
+
+        if (type == RI_TYPE_GLOBAL)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(tag <= RI_GLOBAL_REPORT_COUNT, "push/pop");
+            bool const is_signed = (tag == RI_GLOBAL_LOGICAL_MIN) || (tag == RI_GLOBAL_LOGICAL_MAX) ||
+                                   (tag == RI_GLOBAL_UNIT_EXPONENT);
+            int64_t const value = test_item_value(data, len, is_signed);
+            if (s_globals[tag] == value)
+            {
+                char msg[64];
+                (void)snprintf(msg, sizeof(msg), "global tag %u restates %ld at byte %lu", (unsigned)tag, (long)value,
+                               (unsigned long)(pos - 1U - len));
+                TEST_FAIL_MESSAGE(msg);
+            }
+            s_globals[tag] = value;
+        }
+        else if (type == RI_TYPE_LOCAL)
+        {
+            TEST_ASSERT_EQUAL_MESSAGE(RI_LOCAL_USAGE, tag, "local item other than Usage");
+            TEST_ASSERT_FALSE_MESSAGE(s_usage_set, "two usages for one item");
+            s_usage = (uint16_t)test_item_value(data, len, false);
+            s_usage_set = true;
+        }
+        else
+        {
+            uint32_t const value = (uint32_t)test_item_value(data, len, false);
+            if (!in_vendor)
+            {
+                test_check_main(tag, value);
+            }
+            else if ((tag == RI_MAIN_FEATURE) && (on_feature != NULL))
+            {
+                on_feature();
+            }
+
+            if (tag == RI_MAIN_COLLECTION)
+            {
+                if ((s_depth == 0U) && (s_globals[RI_GLOBAL_USAGE_PAGE] == HID_USAGE_PAGE_VENDOR))
+                {
+                    in_vendor = true;
+                }
+                s_depth++;
+            }
+            else if (tag == RI_MAIN_COLLECTION_END)
+            {
+                TEST_ASSERT_TRUE_MESSAGE(s_depth > 0U, "unbalanced collections");
+                s_depth--;
+            }
+            s_usage_set = false;
+        }
+    }
+    TEST_ASSERT_EQUAL_UINT8_MESSAGE(0U, s_depth, "unbalanced collections");
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_every_field_sees_its_table_values(void)
+{
+    test_parse(NULL);
+    TEST_ASSERT_EQUAL_UINT32(TEST_EXPECTED_COUNT, s_next_expected);
+
+    char msg[48];
+    (void)snprintf(msg, sizeof(msg), "%lu bytes, %lu main items", (unsigned long)sizeof(k_desc),
+                   (unsigned long)TEST_EXPECTED_COUNT);
+    TEST_MESSAGE(msg);
+}
+
+static const struct
+{
+    uint8_t report_id;
+    uint16_t size;
+} k_vendor_reports[] = {
+    { REPORT_ID_DIAG_ENGINE, UPS_DIAG_ENGINE_SIZE },
+    { REPORT_ID_DIAG_LATENCY, UPS_DIAG_LATENCY_SIZE },
+    { REPORT_ID_DIAG_LINK, UPS_DIAG_LINK_SIZE },
+    { REPORT_ID_DIAG_LOOP, UPS_DIAG_LOOP_SIZE },
+    { REPORT_ID_DIAG_MEMORY, UPS_DIAG_MEMORY_SIZE },
+    { REPORT_ID_DIAG_USB, UPS_DIAG_USB_SIZE },
+    { REPORT_ID_TUNING, UPS_TUNING_REPORT_SIZE },
+};
+
+static size_t s_vendor_seen;
+
+static void check_vendor_feature(void)
+{
+    TEST_ASSERT_TRUE(s_vendor_seen < (sizeof(k_vendor_reports) / sizeof(k_vendor_reports[0])));
+    TEST_ASSERT_EQUAL(k_vendor_reports[s_vendor_seen].report_id, s_globals[RI_GLOBAL_REPORT_ID]);
+    TEST_ASSERT_EQUAL(k_vendor_reports[s_vendor_seen].size, s_globals[RI_GLOBAL_REPORT_COUNT]);
+    TEST_ASSERT_EQUAL(0, s_globals[RI_GLOBAL_LOGICAL_MIN]);
+    TEST_ASSERT_EQUAL(255, s_globals[RI_GLOBAL_LOGICAL_MAX]);
+    TEST_ASSERT_EQUAL(8, s_globals[RI_GLOBAL_REPORT_SIZE]);
+    TEST_ASSERT_EQUAL(0, s_globals[RI_GLOBAL_UNIT]);
+    TEST_ASSERT_EQUAL(0, s_globals[RI_GLOBAL_UNIT_EXPONENT]);
+    s_vendor_seen++;
+}
+
+static void test_vendor_reports_are_byte_arrays(void)
+{
+    s_vendor_seen = 0U;
+    test_parse(check_vendor_feature);
+    TEST_ASSERT_EQUAL_UINT32(sizeof(k_vendor_reports) / sizeof(k_vendor_reports[0]), s_vendor_seen);
+}
+
+static void test_length_matches_the_compile_time_check(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(UPS_HID_REPORT_DESC_LEN, sizeof(k_desc));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_every_field_sees_its_table_values);
+    RUN_TEST(test_vendor_reports_are_byte_arrays);
+    RUN_TEST(test_length_matches_the_compile_time_check);
+    return UNITY_END();
+}
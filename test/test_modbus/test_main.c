@@ -0,0 +1,269 @@
+// The APC Modbus RTU sub-adapter through the engine, against a Modbus slave
+// stand-in holding APC's register map: a refresh cycle is two function 03
+// reads with CRC-16/MODBUS on both frames, and the registers land rescaled
+// in g_ups[].
+
+#include <unity.h>
+
+#include "fake_ups_uart.h"
+
+#include "../../src/crc16.c"
+#include "../../src/modbus.c"
+#include "../../src/uart_engine.c"
+
+#include <stdio.h>
+
+ups_state_t g_ups[UPS_PORT_COUNT];
+
+bool usb_desc_set_string_ascii(uint8_t strid, const char *ascii)
+{
+    (void)strid;
+    (void)ascii;
+    return true;
+}
+
+#define TEST_BAUD 9600U
+#define TEST_REPLY_DELAY_MS 5U
+#define TEST_RUN_LIMIT_MS 10000U
+#define TEST_REGISTER_COUNT 700U
+
+// Slave stand-in: holding registers and what it saw.
+static uint16_t s_regs[TEST_REGISTER_COUNT];
+static uint32_t s_bad_request_crc;
+static bool s_corrupt_reply_crc;
+static uint8_t s_last_request[8];
+
+// Bitwise CRC-16/MODBUS, the reference for the table.
+static uint16_t crc16_modbus_bitwise(const uint8_t *data, size_t len)
+{
+    uint16_t crc = CRC16_MODBUS_INIT;
+    for (size_t i = 0U; i < len; i++)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0U; bit < 8U; bit++)
+        {
+            crc = ((crc & 1U) != 0U) ? (uint16_t)((crc >> 1) ^ 0xA001U) : (uint16_t)(crc >> 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t modbus_slave(uint8_t port, const uint8_t *cmd, uint16_t cmd_len, uint8_t *reply, uint16_t reply_cap)
+{
+    (void)port;
+
+    if (cmd_len != 8U)
+    {
+        return 0U;
+    }
+    (void)memcpy(s_last_request, cmd, sizeof(s_last_request));
+
+    uint16_t const crc = crc16_modbus_bitwise(cmd, 6U);
+    if ((cmd[6] != (uint8_t)(crc & 0xFFU)) || (cmd[7] != (uint8_t)(crc >> 8)))
+    {
+        s_bad_request_crc++;
+        return 0U;
+    }
+
+    uint16_t const start = (uint16_t)((cmd[2] << 8) | cmd[3]);
+    uint16_t const count = (uint16_t)((cmd[4] << 8) | cmd[5]);
+    if ((cmd[0] != MODBUS_UPS_ADDRESS) || (cmd[1] != MODBUS_FC_READ_HOLDING) ||
+        ((start + count) > TEST_REGISTER_COUNT) || ((5U + (2U * count)) > reply_cap))
+    {
+        return 0U;
+    }
+
+    uint16_t len = 0U;
+    reply[len++] = cmd[0];
+    reply[len++] = cmd[1];
+    reply[len++] = (uint8_t)(2U * count);
+    for (uint16_t i = 0U; i < count; i++)
+    {
+        reply[len++] = (uint8_t)(s_regs[start + i] >> 8);
+        reply[len++] = (uint8_t)(s_regs[start + i] & 0xFFU);
+    }
+    uint16_t const reply_crc = crc16_modbus_bitwise(reply, len) ^ (s_corrupt_reply_crc ? 0x0001U : 0x0000U);
+    reply[len++] = (uint8_t)(reply_crc & 0xFFU);
+    reply[len++] = (uint8_t)(reply_crc >> 8);
+    return len;
+}
+
+static uint32_t run_until_idle(void)
+{
+    uint32_t const start_ms = HAL_GetTick();
+    while (uart_engine_is_busy(0U))
+    {
+        TEST_ASSERT_TRUE_MESSAGE((HAL_GetTick() - start_ms) < TEST_RUN_LIMIT_MS, "engine never went idle");
+        fake_tick_advance(1U);
+        uart_engine_tick();
+    }
+    return HAL_GetTick() - start_ms;
+}
+
+static void run_dynamic_cycle(void)
+{
+    for (size_t i = 0U; i < g_modbus_dynamic_lut_count; i++)
+    {
+        TEST_ASSERT_EQUAL(UART_ENGINE_OK, uart_engine_enqueue(0U, &g_modbus_dynamic_lut[i]));
+    }
+    (void)run_until_idle();
+}
+
+void setUp(void)
+{
+    fake_ups_reset();
+    (void)memset(g_ups, 0, sizeof(g_ups));
+    uart_engine_init();
+    fake_ups_attach(0U, modbus_slave, TEST_BAUD, TEST_REPLY_DELAY_MS);
+
+    s_bad_request_crc = 0U;
+    s_corrupt_reply_crc = false;
+    (void)memset(s_last_request, 0, sizeof(s_last_request));
+    (void)memset(s_regs, 0, sizeof(s_regs));
+
+    // On line, 85 % charge, battery needs replacing.
+    s_regs[1] = (uint16_t)MODBUS_UPS_STATUS_ONLINE;
+    s_regs[MODBUS_REG_BATTERY_SYSTEM_ERROR] = MODBUS_BATTERY_ERROR_NEEDS_REPLACEMENT;
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_RUNTIME + 1U] = 3600U;
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_CHARGE] = 85U * 512U;
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_BATTERY_VOLTAGE] = 872U;   // 27.25 V
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_TEMPERATURE] = 3904U;      // 30.5 C
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_LOAD] = 40U * 256U;
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_OUTPUT_CURRENT] = 80U;     // 2.5 A
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_OUTPUT_VOLTAGE] = 14720U;  // 230 V
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_OUTPUT_FREQUENCY] = 6400U; // 50 Hz
+    s_regs[MODBUS_MEASUREMENT_START + MODBUS_REG_INPUT_VOLTAGE] = 14816U;   // 231.5 V
+}
+
+void tearDown(void)
+{
+}
+
+static void test_crc16_vectors(void)
+{
+    static const uint8_t k_check[] = "123456789";
+    static const uint8_t k_read_one[] = {0x01U, 0x03U, 0x00U, 0x00U, 0x00U, 0x01U};
+
+    TEST_ASSERT_EQUAL_HEX16(0x4B37U, crc16_modbus(k_check, 9U));
+    TEST_ASSERT_EQUAL_HEX16(0x0A84U, crc16_modbus(k_read_one, sizeof(k_read_one)));
+    TEST_ASSERT_EQUAL_HEX16(CRC16_MODBUS_INIT, crc16_modbus(k_check, 0U));
+    TEST_ASSERT_EQUAL_HEX16(crc16_modbus(k_check, 9U), crc16_modbus_update(crc16_modbus(k_check, 4U), &k_check[4], 5U));
+
+    // A frame followed by its CRC, low byte first, checks to zero.
+    uint8_t frame[8];
+    (void)memcpy(frame, k_read_one, sizeof(k_read_one));
+    frame[6] = 0x84U;
+    frame[7] = 0x0AU;
+    TEST_ASSERT_EQUAL_HEX16(0x0000U, crc16_modbus(frame, sizeof(frame)));
+
+    // The table against the bitwise definition for every single byte and a
+    // run of pseudo-random frames.
+    uint8_t buf[64];
+    uint32_t seed = 1U;
+    for (uint16_t b = 0U; b < 256U; b++)
+    {
+        buf[0] = (uint8_t)b;
+        TEST_ASSERT_EQUAL_HEX16(crc16_modbus_bitwise(buf, 1U), crc16_modbus(buf, 1U));
+    }
+    for (uint16_t n = 0U; n < 1000U; n++)
+    {
+        size_t const len = (size_t)(n % sizeof(buf)) + 1U;
+        for (size_t i = 0U; i < len; i++)
+        {
+            seed = (seed * 1103515245U) + 12345U;
+            buf[i] = (uint8_t)(seed >> 16);
+        }
+        TEST_ASSERT_EQUAL_HEX16(crc16_modbus_bitwise(buf, len), crc16_modbus(buf, len));
+    }
+}
+
+static void test_refresh_cycle_takes_two_transactions(void)
+{
+    uart_engine_stats_t before;
+    uart_engine_stats_t after;
+    uart_engine_get_stats(0U, &before);
+    run_dynamic_cycle();
+    uart_engine_get_stats(0U, &after);
+
+    uint32_t const transactions = s_fake_ups[0].transactions;
+    char msg[48];
+    (void)snprintf(msg, sizeof(msg), "refresh cycle: %lu transactions", (unsigned long)transactions);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(transactions >= 1U);
+    TEST_ASSERT_TRUE(transactions <= 2U);
+    TEST_ASSERT_EQUAL_UINT32(0U, s_bad_request_crc);
+
+    TEST_ASSERT_EQUAL_UINT32(g_modbus_dynamic_lut_count, after.completed - before.completed);
+    TEST_ASSERT_EQUAL_UINT32(0U, after.failed - before.failed);
+    TEST_ASSERT_EQUAL_UINT32(0U, after.retries - before.retries);
+}
+
+static void test_registers_land_in_ups_state(void)
+{
+    run_dynamic_cycle();
+
+    TEST_ASSERT_EQUAL_UINT16(3600U, g_ups[0].battery.run_time_to_empty_s);
+    TEST_ASSERT_EQUAL_UINT8(85U, g_ups[0].battery.remaining_capacity);
+    TEST_ASSERT_EQUAL_UINT16(2725U, g_ups[0].battery.battery_voltage);
+    TEST_ASSERT_EQUAL_UINT16(305U + 2731U, g_ups[0].battery.temperature);
+    TEST_ASSERT_EQUAL_UINT8(40U, g_ups[0].output.percent_load);
+    TEST_ASSERT_EQUAL_INT16(250, g_ups[0].output.current);
+    TEST_ASSERT_EQUAL_UINT16(23000U, g_ups[0].output.voltage);
+    TEST_ASSERT_EQUAL_UINT16(5000U, g_ups[0].output.frequency);
+    TEST_ASSERT_EQUAL_UINT16(23150U, g_ups[0].input.voltage);
+    TEST_ASSERT_EQUAL_UINT16(5000U, g_ups[0].input.frequency);
+
+    TEST_ASSERT_TRUE(g_ups[0].present_status.ac_present);
+    TEST_ASSERT_FALSE(g_ups[0].present_status.discharging);
+    TEST_ASSERT_TRUE(g_ups[0].present_status.charging);
+    TEST_ASSERT_FALSE(g_ups[0].present_status.fully_charged);
+    TEST_ASSERT_TRUE(g_ups[0].present_status.need_replacement);
+    TEST_ASSERT_FALSE(g_ups[0].present_status.shutdown_imminent);
+}
+
+static void test_request_frame_is_function_03_with_crc(void)
+{
+    TEST_ASSERT_EQUAL(UART_ENGINE_OK, uart_engine_enqueue(0U, &g_modbus_dynamic_lut[0]));
+    (void)run_until_idle();
+
+    // Read 24 registers from 128, CRC low byte first.
+    uint16_t const crc = crc16_modbus_bitwise(s_last_request, 6U);
+    uint8_t const k_expected[8] = {0x01U, 0x03U, 0x00U, 0x80U, 0x00U, 0x18U, (uint8_t)(crc & 0xFFU), (uint8_t)(crc >> 8)};
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(k_expected, s_last_request, sizeof(k_expected));
+    TEST_ASSERT_EQUAL_UINT32(0U, s_bad_request_crc);
+}
+
+// A reply whose CRC does not match is retried and never reaches the
+// process function.
+static void test_bad_reply_crc_is_not_stored(void)
+{
+    s_corrupt_reply_crc = true;
+
+    uart_engine_stats_t before;
+    uart_engine_stats_t after;
+    uart_engine_get_stats(0U, &before);
+    TEST_ASSERT_EQUAL(UART_ENGINE_OK, uart_engine_enqueue(0U, &g_modbus_dynamic_lut[0]));
+    for (uint32_t ms = 0U; ms < 1000U; ms++)
+    {
+        fake_tick_advance(1U);
+        uart_engine_tick();
+    }
+    uart_engine_get_stats(0U, &after);
+
+    TEST_ASSERT_TRUE(s_fake_ups[0].transactions >= 2U);
+    TEST_ASSERT_TRUE(after.retries > before.retries);
+    TEST_ASSERT_EQUAL_UINT32(0U, after.completed - before.completed);
+    TEST_ASSERT_EQUAL_UINT8(0U, g_ups[0].battery.remaining_capacity);
+    TEST_ASSERT_EQUAL_UINT16(0U, g_ups[0].output.voltage);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_crc16_vectors);
+    RUN_TEST(test_refresh_cycle_takes_two_transactions);
+    RUN_TEST(test_registers_land_in_ups_state);
+    RUN_TEST(test_request_frame_is_function_03_with_crc);
+    RUN_TEST(test_bad_reply_crc_is_not_stored);
+    return UNITY_END();
+}
@@ -0,0 +1,432 @@
+// power_mode transitions with the board clock hooks mocked: every state
+// against every bus event, the clock switches each transition makes (and
+// only those), the refresh period per mode and the low-power time. Then the
+// same through the TinyUSB callbacks of usb_hid_ups.c, with the bus and
+// tud_remote_wakeup() stubbed: a mount ends a suspend, and an alert brings
+// the clocks back before remote wakeup is signalled.
+
+#define CFG_TUSB_MCU OPT_MCU_STM32F1
+#define CFG_TUSB_OS OPT_OS_NONE
+#define STM32F103xB
+
+#include <unity.h>
+
+#include "../../src/power_mode.c"
+#include "../../src/usb_hid_ups.c"
+
+#include <stdio.h>
+#include <string.h>
+
+// Hook calls in order: 'L' for clock_low, 'R' for clock_run, 'W' for
+// tud_remote_wakeup().
+static char s_calls[16];
+static uint8_t s_call_count;
+static power_mode_t s_mode_at_call;
+
+static void call_record(char call)
+{
+    if (s_call_count < (sizeof(s_calls) - 1U))
+    {
+        s_calls[s_call_count++] = call;
+    }
+    s_mode_at_call = power_mode_get();
+}
+
+void power_mode_clock_low(void)
+{
+    call_record('L');
+}
+
+void power_mode_clock_run(void)
+{
+    call_record('R');
+}
+
+// The bus and the rest of the firmware, as usb_hid_ups.c sees them.
+ups_state_t g_ups[UPS_PORT_COUNT];
+static uint32_t s_now_ms;
+static bool s_bus_suspended;
+
+uint32_t HAL_GetTick(void)
+{
+    return s_now_ms;
+}
+
+bool tud_remote_wakeup(void)
+{
+    call_record('W');
+    return true;
+}
+
+bool tud_suspended(void)
+{
+    return s_bus_suspended;
+}
+
+bool tud_mounted(void)
+{
+    return true;
+}
+
+bool tud_hid_n_ready(uint8_t instance)
+{
+    (void)instance;
+    return false;
+}
+
+bool tud_hid_n_report(uint8_t instance, uint8_t report_id, void const *report, uint16_t len)
+{
+    (void)instance;
+    (void)report_id;
+    (void)report;
+    (void)len;
+    return false;
+}
+
+bool ups_port_is_ready(uint8_t port)
+{
+    (void)port;
+    return true;
+}
+
+bool ups_port_has_constants(uint8_t port)
+{
+    (void)port;
+    return true;
+}
+
+uint16_t build_hid_input_report(const ups_state_t *ups, uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
+{
+    (void)ups;
+    (void)report_id;
+    (void)buffer;
+    (void)reqlen;
+    return 0U;
+}
+
+uint16_t build_hid_feature_report(const ups_state_t *ups, uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
+{
+    (void)ups;
+    (void)report_id;
+    (void)buffer;
+    (void)reqlen;
+    return 0U;
+}
+
+uint32_t apply_hid_feature_report(ups_state_t *ups, uint8_t report_id, const uint8_t *buffer, uint16_t len)
+{
+    (void)ups;
+    (void)report_id;
+    (void)buffer;
+    (void)len;
+    return 0U;
+}
+
+bool ups_diag_is_report(uint8_t report_id)
+{
+    (void)report_id;
+    return false;
+}
+
+uint16_t ups_diag_build_report(uint8_t port, uint8_t report_id, uint8_t *buffer, uint16_t reqlen)
+{
+    (void)port;
+    (void)report_id;
+    (void)buffer;
+    (void)reqlen;
+    return 0U;
+}
+
+uint16_t ups_tuning_build_report(uint8_t *buffer, uint16_t reqlen)
+{
+    (void)buffer;
+    (void)reqlen;
+    return 0U;
+}
+
+void ups_tuning_apply_report(const uint8_t *buffer, uint16_t len, uint32_t now_ms)
+{
+    (void)buffer;
+    (void)len;
+    (void)now_ms;
+}
+
+void log_ring_write(const char *fmt, uint8_t nargs, const uint32_t *args)
+{
+    (void)fmt;
+    (void)nargs;
+    (void)args;
+}
+
+static void calls_clear(void)
+{
+    (void)memset(s_calls, 0, sizeof(s_calls));
+    s_call_count = 0U;
+}
+
+typedef enum
+{
+    EVENT_SUSPEND = 0,
+    EVENT_RESUME,
+    EVENT_WAKE,
+} test_event_t;
+
+static void apply(test_event_t event, uint32_t now_ms)
+{
+    switch (event)
+    {
+    case EVENT_SUSPEND:
+        power_mode_usb_suspend(now_ms);
+        break;
+    case EVENT_RESUME:
+        power_mode_usb_resume(now_ms);
+        break;
+    case EVENT_WAKE:
+        power_mode_wake(now_ms);
+        break;
+    default:
+        break;
+    }
+}
+
+// Brings the module from RUN to mode through the bus events.
+static void enter(power_mode_t mode)
+{
+    if (mode != POWER_MODE_RUN)
+    {
+        power_mode_usb_suspend(0U);
+    }
+    if (mode == POWER_MODE_WAKING)
+    {
+        power_mode_wake(0U);
+    }
+    TEST_ASSERT_EQUAL(mode, power_mode_get());
+    calls_clear();
+}
+
+void setUp(void)
+{
+    // The module has no reset; the test owns its statics.
+    s_mode = POWER_MODE_RUN;
+    (void)memset(&s_stats, 0, sizeof(s_stats));
+    s_low_since_ms = 0U;
+    calls_clear();
+    s_mode_at_call = POWER_MODE_RUN;
+
+    (void)memset(&s_wakeup, 0, sizeof(s_wakeup));
+    (void)memset(g_ups, 0, sizeof(g_ups));
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        g_ups[port].present_status.ac_present = true;
+    }
+    s_now_ms = 0U;
+    s_bus_suspended = false;
+}
+
+// The bus suspends, as TinyUSB reports it.
+static void bus_suspend(bool remote_wakeup_en)
+{
+    s_bus_suspended = true;
+    tud_suspend_cb(remote_wakeup_en);
+}
+
+void tearDown(void)
+{
+}
+
+typedef struct
+{
+    power_mode_t from;
+    test_event_t event;
+    power_mode_t to;
+    const char *calls;
+} test_transition_t;
+
+static const test_transition_t k_transitions[] = {
+    { POWER_MODE_RUN, EVENT_SUSPEND, POWER_MODE_SUSPEND, "L" },
+    { POWER_MODE_RUN, EVENT_RESUME, POWER_MODE_RUN, "" },
+    { POWER_MODE_RUN, EVENT_WAKE, POWER_MODE_RUN, "" },
+    { POWER_MODE_SUSPEND, EVENT_SUSPEND, POWER_MODE_SUSPEND, "" },
+    { POWER_MODE_SUSPEND, EVENT_RESUME, POWER_MODE_RUN, "R" },
+    { POWER_MODE_SUSPEND, EVENT_WAKE, POWER_MODE_WAKING, "R" },
+    { POWER_MODE_WAKING, EVENT_SUSPEND, POWER_MODE_SUSPEND, "L" },
+    // WAKING already runs on full clocks.
+    { POWER_MODE_WAKING, EVENT_RESUME, POWER_MODE_RUN, "" },
+    { POWER_MODE_WAKING, EVENT_WAKE, POWER_MODE_WAKING, "" },
+};
+
+static void test_every_transition(void)
+{
+    static const char *const k_names[] = {"RUN", "SUSPEND", "WAKING"};
+    static const char *const k_events[] = {"suspend", "resume", "wake"};
+
+    for (size_t i = 0U; i < (sizeof(k_transitions) / sizeof(k_transitions[0])); i++)
+    {
+        test_transition_t const *t = &k_transitions[i];
+        char msg[48];
+        (void)snprintf(msg, sizeof(msg), "%s + %s", k_names[t->from], k_events[t->event]);
+
+        setUp();
+        enter(t->from);
+        apply(t->event, 100U);
+        TEST_ASSERT_EQUAL_MESSAGE(t->to, power_mode_get(), msg);
+        TEST_ASSERT_EQUAL_STRING_MESSAGE(t->calls, s_calls, msg);
+    }
+}
+
+static void test_clock_hooks_run_before_the_mode_changes(void)
+{
+    power_mode_usb_suspend(10U);
+    TEST_ASSERT_EQUAL(POWER_MODE_RUN, s_mode_at_call);
+    power_mode_wake(20U);
+    TEST_ASSERT_EQUAL(POWER_MODE_SUSPEND, s_mode_at_call);
+    TEST_ASSERT_EQUAL_STRING("LR", s_calls);
+}
+
+static void test_suspend_reads_alerts_only_at_a_longer_period(void)
+{
+    TEST_ASSERT_FALSE(power_mode_alerts_only());
+    TEST_ASSERT_EQUAL_UINT32(10000U, power_mode_poll_period_ms(10000U));
+
+    power_mode_usb_suspend(0U);
+    TEST_ASSERT_TRUE(power_mode_alerts_only());
+    TEST_ASSERT_EQUAL_UINT32(10000U * POWER_MODE_SUSPEND_POLL_FACTOR, power_mode_poll_period_ms(10000U));
+
+    power_mode_wake(0U);
+    TEST_ASSERT_FALSE(power_mode_alerts_only());
+    TEST_ASSERT_EQUAL_UINT32(10000U, power_mode_poll_period_ms(10000U));
+}
+
+static void test_stats_count_low_power_time(void)
+{
+    power_mode_stats_t stats;
+
+    power_mode_usb_suspend(100U);
+    power_mode_get_stats(350U, &stats);
+    TEST_ASSERT_EQUAL_UINT32(250U, stats.low_power_ms); // current stretch included
+
+    power_mode_wake(600U);
+    power_mode_usb_resume(900U);
+    power_mode_get_stats(1000U, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.suspends);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.wakes);
+    TEST_ASSERT_EQUAL_UINT32(500U, stats.low_power_ms); // WAKING is full clocks
+
+    power_mode_usb_suspend(2000U);
+    power_mode_usb_resume(2400U);
+    power_mode_get_stats(5000U, &stats);
+    TEST_ASSERT_EQUAL_UINT32(2U, stats.suspends);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.wakes);
+    TEST_ASSERT_EQUAL_UINT32(900U, stats.low_power_ms);
+    TEST_ASSERT_EQUAL_STRING("LRLR", s_calls);
+
+    // A wake outside SUSPEND is not counted.
+    power_mode_wake(5100U);
+    power_mode_get_stats(5200U, &stats);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.wakes);
+}
+
+static void test_bus_callbacks_drive_the_mode(void)
+{
+    ups_hid_wakeup_stats_t stats;
+
+    bus_suspend(false);
+    TEST_ASSERT_EQUAL(POWER_MODE_SUSPEND, power_mode_get());
+    s_bus_suspended = false;
+    tud_resume_cb();
+    TEST_ASSERT_EQUAL(POWER_MODE_RUN, power_mode_get());
+
+    bus_suspend(false);
+    tud_umount_cb();
+    TEST_ASSERT_EQUAL(POWER_MODE_RUN, power_mode_get());
+    TEST_ASSERT_EQUAL_STRING("LRLR", s_calls);
+
+    ups_hid_get_wakeup_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(2U, stats.suspends);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.resumes);
+    TEST_ASSERT_FALSE(stats.suspended);
+}
+
+// Some hosts reset the bus instead of resuming it: the mount that follows
+// ends the suspend like a resume.
+static void test_mount_counts_as_resume(void)
+{
+    ups_hid_wakeup_stats_t stats;
+
+    bus_suspend(true);
+    s_now_ms = 500U;
+    s_bus_suspended = false;
+    tud_mount_cb();
+    TEST_ASSERT_EQUAL(POWER_MODE_RUN, power_mode_get());
+    TEST_ASSERT_EQUAL_STRING("LR", s_calls);
+
+    ups_hid_get_wakeup_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.resumes);
+    TEST_ASSERT_FALSE(stats.suspended);
+
+    power_mode_stats_t mode_stats;
+    power_mode_get_stats(600U, &mode_stats);
+    TEST_ASSERT_EQUAL_UINT32(500U, mode_stats.low_power_ms);
+
+    // A mount without a suspend before it counts nothing.
+    tud_mount_cb();
+    ups_hid_get_wakeup_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.resumes);
+    TEST_ASSERT_EQUAL_STRING("LR", s_calls);
+}
+
+// The USB cell is clocked down while suspended; it needs full clocks to
+// drive RESUME, so the wake comes first.
+static void test_alert_wakes_the_clocks_before_remote_wakeup(void)
+{
+    bus_suspend(true);
+    s_now_ms = 100U;
+    ups_hid_periodic_task();
+    TEST_ASSERT_EQUAL_STRING("L", s_calls); // nothing new raised
+
+    g_ups[0].present_status.ac_present = false;
+    s_now_ms = 200U;
+    ups_hid_periodic_task();
+    TEST_ASSERT_EQUAL_STRING("LRW", s_calls);
+    TEST_ASSERT_EQUAL(POWER_MODE_WAKING, s_mode_at_call);
+
+    s_now_ms = 300U;
+    s_bus_suspended = false;
+    tud_resume_cb();
+    TEST_ASSERT_EQUAL(POWER_MODE_RUN, power_mode_get());
+    TEST_ASSERT_EQUAL_STRING("LRW", s_calls); // WAKING already runs on full clocks
+
+    ups_hid_wakeup_stats_t stats;
+    ups_hid_get_wakeup_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.wakeups);
+    TEST_ASSERT_EQUAL_UINT16(100U, stats.last_resume_ms);
+    TEST_ASSERT_TRUE(stats.wakeup_pending);
+}
+
+static void test_alert_without_remote_wakeup_stays_low(void)
+{
+    bus_suspend(false);
+    g_ups[0].present_status.ac_present = false;
+    ups_hid_periodic_task();
+    TEST_ASSERT_EQUAL(POWER_MODE_SUSPEND, power_mode_get());
+    TEST_ASSERT_EQUAL_STRING("L", s_calls);
+
+    ups_hid_wakeup_stats_t stats;
+    ups_hid_get_wakeup_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(0U, stats.wakeups);
+    TEST_ASSERT_EQUAL_UINT32(1U, stats.wakeups_blocked);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_every_transition);
+    RUN_TEST(test_clock_hooks_run_before_the_mode_changes);
+    RUN_TEST(test_suspend_reads_alerts_only_at_a_longer_period);
+    RUN_TEST(test_stats_count_low_power_time);
+    RUN_TEST(test_bus_callbacks_drive_the_mode);
+    RUN_TEST(test_mount_counts_as_resume);
+    RUN_TEST(test_alert_wakes_the_clocks_before_remote_wakeup);
+    RUN_TEST(test_alert_without_remote_wakeup_stays_low);
+    return UNITY_END();
+}
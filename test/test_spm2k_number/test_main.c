@@ -0,0 +1,236 @@
+// The incremental SPM2K number parser (spm2k_number_scan/finish, used by
+// spm2k_parse_fixed and spm2k_feed_field) against the ctype/int64 parser it
+// replaced, kept in spm2k_baseline.h: both must accept the same strings and
+// give the same values for every fraction width and range the firmware uses.
+
+#include <unity.h>
+
+#include "../../src/spm2k.c"
+#include "spm2k_baseline.h"
+
+#include <stdio.h>
+
+ups_state_t g_ups[UPS_PORT_COUNT];
+
+bool usb_desc_set_string_ascii(uint8_t strid, const char *ascii)
+{
+    (void)strid;
+    (void)ascii;
+    return true;
+}
+
+int pack_hid_date_mmddyy(const char *s, uint16_t *out)
+{
+    (void)s;
+    *out = 0U;
+    return 1;
+}
+
+uart_engine_result_t uart_engine_enqueue(uint8_t port, const uart_engine_request_t *req)
+{
+    (void)port;
+    (void)req;
+    return UART_ENGINE_ERR_DISABLED;
+}
+
+typedef struct
+{
+    int32_t min_value;
+    int32_t max_value;
+} test_range_t;
+
+// The ranges the SPM2K LUTs and settings use, plus the full int32 range to
+// reach the overflow checks.
+static const test_range_t k_ranges[] = {
+    { 0, UINT16_MAX },
+    { INT16_MIN, INT16_MAX },
+    { -2731, 5000 },
+    { 0, 1000 },
+    { 0, 10000 },
+    { 0, INT32_MAX / 60 },
+    { 0, UINT16_MAX / 60 },
+    { INT32_MIN, INT32_MAX },
+};
+
+#define TEST_RANGE_COUNT (sizeof(k_ranges) / sizeof(k_ranges[0]))
+
+// Strings at and just past the limits of each range and fraction width.
+static const char *const k_edges[] = {
+    "2147483647", "2147483648", "-2147483648", "-2147483649", "+2147483647",
+    "214748364", "214748365", "21474836.47", "21474836.48", "-21474836.48",
+    "-21474836.49", "2147483.647", "2147483.648", "2.147483647", "2.147483648",
+    "-2.147483648", "-2.147483649", "0.000000001", "9999999999", "00000002147483647",
+    "65535", "65536", "655.35", "655.36", "6553.5", "-32768", "-32769", "32767",
+    "32768", "-327.68", "-327.69", "-273.1", "-273.2", "500.0", "500.01", "500.1",
+    "100.0", "100.09", "1000", "1000.0", "1000.1", "35791394", "35791395", "1092",
+    "1093", "0.0", "-0", "+0", "-0.0", "00.00", "1.23456789012", "12.", ".5", "-.5",
+    "+-1", "--1", "1..2", "1.2.3", "1e3", " 1", "1 ", "", "-", "+",
+};
+
+#define TEST_EDGE_COUNT (sizeof(k_edges) / sizeof(k_edges[0]))
+
+static const char k_alphabet[] = "019.+-x";
+#define TEST_ALPHABET_LEN (sizeof(k_alphabet) - 1U)
+#define TEST_MAX_ENUM_LEN 6U
+
+static uint32_t s_accepted;
+static uint32_t s_compared;
+
+// Feeds text followed by CR through spm2k_feed_field(), one byte per run so
+// every byte resumes from the saved state; at CR the value is final and held
+// in the parser state until LF.
+static bool feed_until_cr(const char *text, const spm2k_field_t *field, int32_t *out_value)
+{
+    static const uint8_t k_cr = 0x0DU;
+
+    uart_engine_feed_state_t state;
+    (void)memset(&state, 0, sizeof(state));
+    for (size_t i = 0U; text[i] != '\0'; i++)
+    {
+        if (spm2k_feed_field(0U, &state, (const uint8_t *)&text[i], 1U, (void *)field) != UART_ENGINE_FEED_MORE)
+        {
+            return false;
+        }
+    }
+    if (spm2k_feed_field(0U, &state, &k_cr, 1U, (void *)field) != UART_ENGINE_FEED_MORE)
+    {
+        return false;
+    }
+    spm2k_number_state_t st;
+    (void)memcpy(&st, &state, sizeof(st));
+    *out_value = (int32_t)st.integral;
+    return true;
+}
+
+static void compare_one(const char *text, uint8_t fraction_digits, const test_range_t *range)
+{
+    int32_t old_value = 0;
+    int32_t new_value = 0;
+    int32_t feed_value = 0;
+    bool const old_ok = old_spm2k_parse_scaled_int(text, (int32_t)k_spm2k_pow10[fraction_digits],
+                                                   range->min_value, range->max_value, &old_value);
+    bool const new_ok = spm2k_parse_fixed((const uint8_t *)text, strlen(text), fraction_digits,
+                                          range->min_value, range->max_value, &new_value);
+
+    char msg[96];
+    (void)snprintf(msg, sizeof(msg), "\"%s\" fraction_digits=%u range=[%ld, %ld]", text,
+                   (unsigned)fraction_digits, (long)range->min_value, (long)range->max_value);
+    TEST_ASSERT_EQUAL_MESSAGE(old_ok, new_ok, msg);
+    if (old_ok)
+    {
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(old_value, new_value, msg);
+        s_accepted++;
+    }
+
+    // The streaming path caps the reply length; within it, it must agree too.
+    if (strlen(text) <= SPM2K_NUMBER_MAX_LEN)
+    {
+        spm2k_field_t const field = {
+            .fraction_digits = fraction_digits,
+            .min_value = range->min_value,
+            .max_value = range->max_value,
+        };
+        bool const feed_ok = feed_until_cr(text, &field, &feed_value);
+        TEST_ASSERT_EQUAL_MESSAGE(old_ok, feed_ok, msg);
+        if (old_ok)
+        {
+            TEST_ASSERT_EQUAL_INT32_MESSAGE(old_value, feed_value, msg);
+        }
+    }
+    s_compared++;
+}
+
+void setUp(void)
+{
+    s_accepted = 0U;
+    s_compared = 0U;
+}
+
+void tearDown(void)
+{
+}
+
+// Every string up to TEST_MAX_ENUM_LEN bytes over digits, '.', signs and one
+// stray byte, for fraction widths 0..3 and every range.
+static void test_all_short_strings_agree(void)
+{
+    char text[TEST_MAX_ENUM_LEN + 1U];
+    uint8_t idx[TEST_MAX_ENUM_LEN];
+
+    for (size_t len = 0U; len <= TEST_MAX_ENUM_LEN; len++)
+    {
+        (void)memset(idx, 0, sizeof(idx));
+        for (;;)
+        {
+            for (size_t i = 0U; i < len; i++)
+            {
+                text[i] = k_alphabet[idx[i]];
+            }
+            text[len] = '\0';
+
+            for (uint8_t fd = 0U; fd <= 3U; fd++)
+            {
+                for (size_t r = 0U; r < TEST_RANGE_COUNT; r++)
+                {
+                    compare_one(text, fd, &k_ranges[r]);
+                }
+            }
+
+            size_t pos = 0U;
+            while ((pos < len) && (++idx[pos] == TEST_ALPHABET_LEN))
+            {
+                idx[pos] = 0U;
+                pos++;
+            }
+            if (pos == len)
+            {
+                break;
+            }
+        }
+    }
+
+    char msg[64];
+    (void)snprintf(msg, sizeof(msg), "%lu cases, %lu accepted", (unsigned long)s_compared, (unsigned long)s_accepted);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(s_accepted > 0U);
+}
+
+// Range, overflow and truncation edges for every fraction width up to the
+// parser's maximum.
+static void test_edges_agree(void)
+{
+    for (size_t e = 0U; e < TEST_EDGE_COUNT; e++)
+    {
+        for (uint8_t fd = 0U; fd <= SPM2K_MAX_FRACTION_DIGITS; fd++)
+        {
+            for (size_t r = 0U; r < TEST_RANGE_COUNT; r++)
+            {
+                compare_one(k_edges[e], fd, &k_ranges[r]);
+            }
+        }
+    }
+    TEST_ASSERT_TRUE(s_accepted > 0U);
+}
+
+static void test_known_values(void)
+{
+    int32_t value = 0;
+
+    TEST_ASSERT_TRUE(spm2k_parse_fixed((const uint8_t *)"230.40", 6U, 2U, 0, UINT16_MAX, &value));
+    TEST_ASSERT_EQUAL_INT32(23040, value);
+    TEST_ASSERT_TRUE(spm2k_parse_fixed((const uint8_t *)"-2.256", 6U, 2U, INT16_MIN, INT16_MAX, &value));
+    TEST_ASSERT_EQUAL_INT32(-225, value);
+    TEST_ASSERT_TRUE(spm2k_parse_fixed((const uint8_t *)"-2147483647", 11U, 0U, INT32_MIN, INT32_MAX, &value));
+    TEST_ASSERT_EQUAL_INT32(-INT32_MAX, value);
+    TEST_ASSERT_FALSE(spm2k_parse_fixed((const uint8_t *)"655.36", 6U, 2U, 0, UINT16_MAX, &value));
+    TEST_ASSERT_FALSE(spm2k_parse_fixed((const uint8_t *)"1", 1U, SPM2K_MAX_FRACTION_DIGITS + 1U, 0, 1, &value));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_all_short_strings_agree);
+    RUN_TEST(test_edges_agree);
+    RUN_TEST(test_known_values);
+    return UNITY_END();
+}
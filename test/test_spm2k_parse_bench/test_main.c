@@ -0,0 +1,413 @@
+// Host timing of the SPM2K numeric reply parsing: the per-command process
+// functions the field descriptors replaced (extract the text, then
+// spm2k_parse_scaled_int) against spm2k_feed_field given the reply in one
+// run, both called the way the engine calls them. Both must store the same
+// values, and the field descriptors must not be slower. The number parsers
+// are also timed alone: spm2k_parse_scaled_int against spm2k_parse_fixed.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <unity.h>
+
+#include "../../src/spm2k.c"
+#include "spm2k_baseline.h"
+
+#include <stdio.h>
+#include <time.h>
+
+ups_state_t g_ups[UPS_PORT_COUNT];
+
+bool usb_desc_set_string_ascii(uint8_t strid, const char *ascii)
+{
+    (void)strid;
+    (void)ascii;
+    return true;
+}
+
+int pack_hid_date_mmddyy(const char *s, uint16_t *out)
+{
+    (void)s;
+    *out = 0U;
+    return 1;
+}
+
+uart_engine_result_t uart_engine_enqueue(uint8_t port, const uart_engine_request_t *req)
+{
+    (void)port;
+    (void)req;
+    return UART_ENGINE_ERR_DISABLED;
+}
+
+#define BENCH_ROUNDS 100000U
+#define BENCH_TRIALS 5U // best of, alternating, so a busy host slows both alike
+
+// The old process functions store into this instead of the g_* globals.
+static ups_state_t s_old;
+
+typedef bool (*old_process_fn)(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value);
+
+// The removed numeric process functions, as they were apart from the status
+// flags landing in s_old.
+
+static bool old_process_voltage(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+
+    if (out_value == NULL)
+    {
+        return false;
+    }
+
+    char text[16];
+    int32_t parsed = 0;
+    if (!old_spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
+    {
+        return false;
+    }
+
+    if (!old_spm2k_parse_scaled_int(text, 100, 0, UINT16_MAX, &parsed))
+    {
+        return false;
+    }
+
+    *(uint16_t *)out_value = (uint16_t)parsed;
+    return true;
+}
+
+static bool old_process_percent_load(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+
+    if (out_value == NULL)
+    {
+        return false;
+    }
+
+    char text[16];
+    int32_t parsed_x100 = 0;
+    if (!old_spm2k_extract_text(rx, rx_len, true, text, sizeof(text)) ||
+        !old_spm2k_parse_scaled_int(text, 100, 0, 10000, &parsed_x100))
+    {
+        return false;
+    }
+
+    uint8_t percent = (uint8_t)(parsed_x100 / 100);
+    *(uint8_t *)out_value = percent;
+    return true;
+}
+
+static bool old_process_temperature_c_to_kelvin(uint16_t cmd,
+                                                const uint8_t *rx,
+                                                uint16_t rx_len,
+                                                void *out_value)
+{
+    (void)cmd;
+
+    if (out_value == NULL)
+    {
+        return false;
+    }
+
+    char text[16];
+    int32_t celsius_x10 = 0;
+    if (!old_spm2k_extract_text(rx, rx_len, true, text, sizeof(text)) ||
+        !old_spm2k_parse_scaled_int(text, 10, -2731, 5000, &celsius_x10))
+    {
+        return false;
+    }
+
+    int32_t kelvin_x10 = celsius_x10 + 2731;
+    if (kelvin_x10 < 0)
+    {
+        kelvin_x10 = 0;
+    }
+    if (kelvin_x10 > UINT16_MAX)
+    {
+        kelvin_x10 = UINT16_MAX;
+    }
+
+    *(uint16_t *)out_value = (uint16_t)kelvin_x10;
+    return true;
+}
+
+static bool old_process_remaining_capacity(uint16_t cmd,
+                                           const uint8_t *rx,
+                                           uint16_t rx_len,
+                                           void *out_value)
+{
+    (void)cmd;
+
+    if (out_value == NULL)
+    {
+        return false;
+    }
+
+    char text[16];
+    int32_t capacity_x10 = 0;
+    if (!old_spm2k_extract_text(rx, rx_len, true, text, sizeof(text)) ||
+        !old_spm2k_parse_scaled_int(text, 10, 0, 1000, &capacity_x10))
+    {
+        return false;
+    }
+
+    uint8_t const capacity_percent = (uint8_t)(capacity_x10 / 10);
+    *(uint8_t *)out_value = capacity_percent;
+
+    s_old.present_status.fully_charged = (capacity_percent >= 100U);
+    return true;
+}
+
+static bool old_process_bat_current(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+
+    if (out_value == NULL)
+    {
+        return false;
+    }
+
+    char text[16];
+    int32_t parsed = 0;
+    if (!old_spm2k_extract_text(rx, rx_len, true, text, sizeof(text)))
+    {
+        return false;
+    }
+
+    if (!old_spm2k_parse_scaled_int(text, 100, INT16_MIN, INT16_MAX, &parsed))
+    {
+        return false;
+    }
+
+    *(int16_t *)out_value = (int16_t)parsed;
+
+    if (parsed < 0)
+    {
+        s_old.present_status.charging = false;
+        s_old.present_status.discharging = true;
+    }
+    else if (parsed > 0)
+    {
+        s_old.present_status.charging = true;
+        s_old.present_status.discharging = false;
+    }
+
+    return true;
+}
+
+static bool old_process_ac_current(uint16_t cmd, const uint8_t *rx, uint16_t rx_len, void *out_value)
+{
+    (void)cmd;
+
+    if (out_value == NULL)
+    {
+        return false;
+    }
+
+    char text[16];
+    int32_t parsed = 0;
+    if (!old_spm2k_extract_text(rx, rx_len, true, text, sizeof(text)) ||
+        !old_spm2k_parse_scaled_int(text, 100, INT16_MIN, INT16_MAX, &parsed))
+    {
+        return false;
+    }
+
+    *(int16_t *)out_value = (int16_t)parsed;
+    return true;
+}
+
+typedef struct
+{
+    uint16_t cmd;
+    const char *reply;
+    old_process_fn old_fn;
+    const spm2k_field_t *field; // from g_spm2k_dynamic_lut
+} bench_case_t;
+
+// One poll's worth of numeric replies, in dynamic LUT order.
+static bench_case_t s_cases[] = {
+    { 0x42U, "27.05\r\n", old_process_voltage, NULL },
+    { 0x9FD4U, "-2.25\r\n", old_process_bat_current, NULL },
+    { 0x43U, "029.5\r\n", old_process_temperature_c_to_kelvin, NULL },
+    { 0x66U, "100.0\r\n", old_process_remaining_capacity, NULL },
+    { 0x4CU, "230.40\r\n", old_process_voltage, NULL },
+    { 0x9FD3U, "50.00\r\n", old_process_voltage, NULL },
+    { 0x5CU, "025.00\r\n", old_process_percent_load, NULL },
+    { 0x4FU, "229.60\r\n", old_process_voltage, NULL },
+    { 0x2FU, "001.20\r\n", old_process_ac_current, NULL },
+    { 0x46U, "50.00\r\n", old_process_voltage, NULL },
+};
+
+#define BENCH_CASE_COUNT (sizeof(s_cases) / sizeof(s_cases[0]))
+
+// Each reply without CRLF, for the number parsers alone.
+typedef struct
+{
+    char text[16];
+    uint16_t len;
+} bench_text_t;
+
+static bench_text_t s_texts[BENCH_CASE_COUNT];
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static bool old_parse(const bench_case_t *c)
+{
+    // The old LUT pointed out_value at the destination field.
+    void *dest = (uint8_t *)&s_old + c->field->dest_offset;
+    return c->old_fn(c->cmd, (const uint8_t *)c->reply, (uint16_t)strlen(c->reply), dest);
+}
+
+static bool new_parse(const bench_case_t *c)
+{
+    uart_engine_feed_state_t state;
+    (void)memset(&state, 0, sizeof(state));
+    return spm2k_feed_field(0U, &state, (const uint8_t *)c->reply, (uint16_t)strlen(c->reply), (void *)c->field) ==
+           UART_ENGINE_FEED_DONE;
+}
+
+// The number parsers alone, on the reply text with the field's scale and
+// range: the old one after old_spm2k_extract_text, the new one on the raw
+// bytes.
+static int32_t s_number;
+
+static bool old_number(const bench_case_t *c)
+{
+    bench_text_t const *t = &s_texts[c - s_cases];
+    return old_spm2k_parse_scaled_int(t->text, (int32_t)k_spm2k_pow10[c->field->fraction_digits], c->field->min_value,
+                                      c->field->max_value, &s_number);
+}
+
+static bool new_number(const bench_case_t *c)
+{
+    bench_text_t const *t = &s_texts[c - s_cases];
+    return spm2k_parse_fixed((const uint8_t *)t->text, t->len, c->field->fraction_digits, c->field->min_value,
+                             c->field->max_value, &s_number);
+}
+
+void setUp(void)
+{
+    (void)memset(g_ups, 0, sizeof(g_ups));
+    (void)memset(&s_old, 0, sizeof(s_old));
+
+    for (size_t i = 0U; i < BENCH_CASE_COUNT; i++)
+    {
+        s_cases[i].field = NULL;
+        for (size_t j = 0U; j < g_spm2k_dynamic_lut_count; j++)
+        {
+            if ((g_spm2k_dynamic_lut[j].cmd == s_cases[i].cmd) && (g_spm2k_dynamic_lut[j].feed_fn == spm2k_feed_field))
+            {
+                s_cases[i].field = (const spm2k_field_t *)g_spm2k_dynamic_lut[j].out_value;
+            }
+        }
+        TEST_ASSERT_NOT_NULL(s_cases[i].field);
+
+        s_texts[i].len = (uint16_t)(strlen(s_cases[i].reply) - 2U);
+        TEST_ASSERT_TRUE(s_texts[i].len < sizeof(s_texts[i].text));
+        (void)memcpy(s_texts[i].text, s_cases[i].reply, s_texts[i].len);
+        s_texts[i].text[s_texts[i].len] = '\0';
+    }
+}
+
+void tearDown(void)
+{
+}
+
+static void test_both_parsers_store_the_same_state(void)
+{
+    for (size_t i = 0U; i < BENCH_CASE_COUNT; i++)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(old_parse(&s_cases[i]), s_cases[i].reply);
+        TEST_ASSERT_TRUE_MESSAGE(new_parse(&s_cases[i]), s_cases[i].reply);
+    }
+
+    TEST_ASSERT_EQUAL_UINT16(2705U, g_ups[0].battery.battery_voltage);
+    TEST_ASSERT_EQUAL_UINT16(3026U, g_ups[0].battery.temperature);
+    TEST_ASSERT_EQUAL_UINT8(25U, g_ups[0].output.percent_load);
+    TEST_ASSERT_EQUAL_MEMORY(&s_old, &g_ups[0], sizeof(s_old));
+}
+
+typedef bool (*bench_parse_fn)(const bench_case_t *c);
+
+// ns for BENCH_ROUNDS polls; failed parses are added to *failures.
+static uint64_t bench_run(bench_parse_fn parse, uint32_t *failures)
+{
+    uint64_t const start = bench_now_ns();
+    for (uint32_t round = 0U; round < BENCH_ROUNDS; round++)
+    {
+        for (size_t i = 0U; i < BENCH_CASE_COUNT; i++)
+        {
+            *failures += parse(&s_cases[i]) ? 0U : 1U;
+        }
+    }
+    return bench_now_ns() - start;
+}
+
+// Best of BENCH_TRIALS for each parser, in ns per call.
+static void bench_compare(bench_parse_fn old_fn, bench_parse_fn new_fn, double *old_ns, double *new_ns)
+{
+    uint32_t failures = 0U;
+    uint64_t old_best = UINT64_MAX;
+    uint64_t new_best = UINT64_MAX;
+
+    for (uint32_t trial = 0U; trial < BENCH_TRIALS; trial++)
+    {
+        uint64_t const old_trial = bench_run(old_fn, &failures);
+        uint64_t const new_trial = bench_run(new_fn, &failures);
+        old_best = (old_trial < old_best) ? old_trial : old_best;
+        new_best = (new_trial < new_best) ? new_trial : new_best;
+    }
+    TEST_ASSERT_EQUAL_UINT32(0U, failures);
+
+    double const calls = (double)BENCH_ROUNDS * (double)BENCH_CASE_COUNT;
+    *old_ns = (double)old_best / calls;
+    *new_ns = (double)new_best / calls;
+}
+
+static void test_ns_per_parse(void)
+{
+    double old_ns = 0.0;
+    double new_ns = 0.0;
+    bench_compare(old_parse, new_parse, &old_ns, &new_ns);
+
+    char msg[96];
+    (void)snprintf(msg, sizeof(msg), "process functions: %.1f ns/parse, field descriptors: %.1f ns/parse", old_ns,
+                   new_ns);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL_MEMORY(&s_old, &g_ups[0], sizeof(s_old));
+    TEST_ASSERT_TRUE_MESSAGE(new_ns <= old_ns, "field descriptors slower than the process functions");
+}
+
+static void test_ns_per_number(void)
+{
+    for (size_t i = 0U; i < BENCH_CASE_COUNT; i++)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(old_number(&s_cases[i]), s_texts[i].text);
+        int32_t const old_value = s_number;
+        TEST_ASSERT_TRUE_MESSAGE(new_number(&s_cases[i]), s_texts[i].text);
+        TEST_ASSERT_EQUAL_INT32_MESSAGE(old_value, s_number, s_texts[i].text);
+    }
+
+    double old_ns = 0.0;
+    double new_ns = 0.0;
+    bench_compare(old_number, new_number, &old_ns, &new_ns);
+
+    char msg[96];
+    (void)snprintf(msg, sizeof(msg), "spm2k_parse_scaled_int: %.1f ns/number, spm2k_parse_fixed: %.1f ns/number",
+                   old_ns, new_ns);
+    TEST_MESSAGE(msg);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_both_parsers_store_the_same_state);
+    RUN_TEST(test_ns_per_parse);
+    RUN_TEST(test_ns_per_number);
+    return UNITY_END();
+}
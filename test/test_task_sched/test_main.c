@@ -0,0 +1,301 @@
+// task_sched against a mocked tick: a main loop that sleeps exactly the
+// delay task_sched_run() returns, or until a simulated interrupt raises an
+// event. Compared with the old loop, which woke every SysTick and called
+// every task, it wakes only when something is due, and every task runs on
+// its deadline or on the pass right after its event.
+
+#include <unity.h>
+
+#include "../../src/task_sched.c"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SIM_DURATION_MS 10000U
+#define SIM_TASK_COUNT 4U
+
+// Runs of a task with period_ms in duration_ms, the first one at the start.
+#define SIM_RUNS(duration_ms, period_ms) (((duration_ms) + (period_ms) - 1U) / (period_ms))
+
+typedef struct
+{
+    uint32_t period_ms; // TASK_SCHED_NEVER: event driven only
+    uint32_t runs;
+    uint32_t expected_ms; // next deadline, or when the event was raised
+    uint32_t max_late_ms;
+} sim_task_t;
+
+static uint32_t s_now_ms;
+static sim_task_t s_sim[SIM_TASK_COUNT];
+
+// Periods like the firmware's tasks: the 10 ms USB poll while telemetry
+// streams, the 80 ms busy LED blink, a 250 ms watchdog refresh and a 1 s
+// housekeeping task.
+static const uint32_t k_periods_ms[SIM_TASK_COUNT] = {10U, 80U, 250U, 1000U};
+
+static uint32_t sim_task_run(uint8_t index, uint32_t now_ms)
+{
+    sim_task_t *t = &s_sim[index];
+    uint32_t const late_ms = now_ms - t->expected_ms;
+    if (late_ms > t->max_late_ms)
+    {
+        t->max_late_ms = late_ms;
+    }
+    t->runs++;
+    t->expected_ms = now_ms + t->period_ms;
+    return t->period_ms;
+}
+
+static uint32_t sim_task0(uint32_t now_ms)
+{
+    return sim_task_run(0U, now_ms);
+}
+
+static uint32_t sim_task1(uint32_t now_ms)
+{
+    return sim_task_run(1U, now_ms);
+}
+
+static uint32_t sim_task2(uint32_t now_ms)
+{
+    return sim_task_run(2U, now_ms);
+}
+
+static uint32_t sim_task3(uint32_t now_ms)
+{
+    return sim_task_run(3U, now_ms);
+}
+
+static const task_sched_fn_t k_sim_fns[SIM_TASK_COUNT] = {sim_task0, sim_task1, sim_task2, sim_task3};
+
+// An event-only task, like the log drain.
+static uint32_t s_event_runs;
+static uint32_t s_event_raised_ms;
+static uint32_t s_event_max_late_ms;
+
+static uint32_t sim_event_task(uint32_t now_ms)
+{
+    uint32_t const late_ms = now_ms - s_event_raised_ms;
+    if (late_ms > s_event_max_late_ms)
+    {
+        s_event_max_late_ms = late_ms;
+    }
+    s_event_runs++;
+    return TASK_SCHED_NEVER;
+}
+
+static uint32_t s_wake_runs;
+
+static uint32_t sim_wake_task(uint32_t now_ms)
+{
+    (void)now_ms;
+    s_wake_runs++;
+    return TASK_SCHED_NEVER;
+}
+
+// The scheduler has no reset; the test owns its statics.
+static void sched_reset(void)
+{
+    (void)memset(s_tasks, 0, sizeof(s_tasks));
+    s_task_count = 0U;
+    s_next_due_ms = 0U;
+    s_any_armed = false;
+    s_pending_events = 0U;
+    s_pending_wakes = 0U;
+    (void)memset(&s_stats, 0, sizeof(s_stats));
+}
+
+static void sim_add_periodic_tasks(void)
+{
+    for (uint8_t i = 0U; i < SIM_TASK_COUNT; i++)
+    {
+        s_sim[i].period_ms = k_periods_ms[i];
+        s_sim[i].expected_ms = s_now_ms;
+        TEST_ASSERT_EQUAL_UINT8(i, task_sched_add(k_sim_fns[i], 0U, 0U, s_now_ms));
+    }
+}
+
+// The main loop: run what is due, then sleep until the next deadline or the
+// next simulated interrupt, whichever comes first.
+static void sim_main_loop(uint32_t duration_ms, uint32_t event_every_ms)
+{
+    uint32_t const end_ms = s_now_ms + duration_ms;
+    uint32_t next_event_ms = s_now_ms + event_every_ms;
+
+    while ((int32_t)(end_ms - s_now_ms) > 0)
+    {
+        uint32_t delay_ms = task_sched_run(s_now_ms);
+        TEST_ASSERT_EQUAL_UINT32(delay_ms, task_sched_next_delay_ms(s_now_ms));
+        if ((event_every_ms != 0U) && ((next_event_ms - s_now_ms) < delay_ms))
+        {
+            delay_ms = next_event_ms - s_now_ms;
+        }
+        if ((end_ms - s_now_ms) < delay_ms)
+        {
+            delay_ms = end_ms - s_now_ms;
+        }
+        s_now_ms += delay_ms;
+
+        if ((event_every_ms != 0U) && (s_now_ms == next_event_ms))
+        {
+            s_event_raised_ms = s_now_ms;
+            task_sched_notify(TASK_SCHED_EVENT_LOG);
+            next_event_ms += event_every_ms;
+        }
+    }
+}
+
+void setUp(void)
+{
+    sched_reset();
+    s_now_ms = 1000U;
+    (void)memset(s_sim, 0, sizeof(s_sim));
+    s_event_runs = 0U;
+    s_event_raised_ms = 0U;
+    s_event_max_late_ms = 0U;
+    s_wake_runs = 0U;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_wakes_only_when_a_task_is_due(void)
+{
+    sim_add_periodic_tasks();
+    sim_main_loop(SIM_DURATION_MS, 0U);
+
+    task_sched_stats_t stats;
+    task_sched_get_stats(&stats);
+
+    // The old loop woke on every SysTick and called every task each time.
+    uint32_t const poll_wakeups = SIM_DURATION_MS;
+    uint32_t const poll_calls = SIM_DURATION_MS * SIM_TASK_COUNT;
+
+    uint32_t expected_runs = 0U;
+    for (uint8_t i = 0U; i < SIM_TASK_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(SIM_RUNS(SIM_DURATION_MS, k_periods_ms[i]), s_sim[i].runs);
+        expected_runs += SIM_RUNS(SIM_DURATION_MS, k_periods_ms[i]);
+    }
+
+    char msg[128];
+    (void)snprintf(msg, sizeof(msg), "poll loop: %lu wake-ups, %lu task calls; scheduler: %lu wake-ups, %lu task runs",
+                   (unsigned long)poll_wakeups, (unsigned long)poll_calls,
+                   (unsigned long)stats.passes, (unsigned long)stats.runs);
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL_UINT32(expected_runs, stats.runs);
+    // The 10 ms task sets the pace: one pass per 10 ms, nothing in between.
+    TEST_ASSERT_EQUAL_UINT32(SIM_RUNS(SIM_DURATION_MS, k_periods_ms[0]), stats.passes);
+    TEST_ASSERT_EQUAL_UINT32(0U, stats.idle_passes);
+    TEST_ASSERT_TRUE(stats.passes <= (poll_wakeups / 10U));
+    TEST_ASSERT_TRUE(stats.runs < (poll_calls / 10U));
+}
+
+static void test_tasks_run_on_their_deadline(void)
+{
+    sim_add_periodic_tasks();
+    sim_main_loop(SIM_DURATION_MS, 0U);
+
+    for (uint8_t i = 0U; i < SIM_TASK_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(0U, s_sim[i].max_late_ms);
+    }
+}
+
+static void test_event_runs_on_the_next_pass(void)
+{
+    sim_add_periodic_tasks();
+    TEST_ASSERT_NOT_EQUAL(TASK_SCHED_INVALID, task_sched_add(sim_event_task, TASK_SCHED_EVENT_LOG, TASK_SCHED_NEVER, s_now_ms));
+
+    // Events at 7 ms steps land between the periodic deadlines.
+    sim_main_loop(SIM_DURATION_MS, 7U);
+
+    task_sched_stats_t stats;
+    task_sched_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32((SIM_DURATION_MS - 1U) / 7U, s_event_runs);
+    TEST_ASSERT_EQUAL_UINT32(s_event_runs, stats.event_runs);
+    TEST_ASSERT_EQUAL_UINT32(0U, s_event_max_late_ms);
+    for (uint8_t i = 0U; i < SIM_TASK_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(0U, s_sim[i].max_late_ms);
+    }
+}
+
+static void test_next_delay_is_exact(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(TASK_SCHED_NEVER, task_sched_next_delay_ms(s_now_ms));
+
+    s_sim[0].period_ms = 37U;
+    s_sim[0].expected_ms = s_now_ms + 37U;
+    (void)task_sched_add(sim_task0, 0U, 37U, s_now_ms);
+    TEST_ASSERT_EQUAL_UINT32(37U, task_sched_run(s_now_ms));
+    TEST_ASSERT_EQUAL_UINT32(27U, task_sched_next_delay_ms(s_now_ms + 10U));
+
+    // A pass before the deadline is a compare and nothing else.
+    TEST_ASSERT_EQUAL_UINT32(27U, task_sched_run(s_now_ms + 10U));
+    TEST_ASSERT_EQUAL_UINT32(0U, s_sim[0].runs);
+
+    task_sched_notify(TASK_SCHED_EVENT_USB);
+    TEST_ASSERT_EQUAL_UINT32(0U, task_sched_next_delay_ms(s_now_ms + 10U));
+
+    TEST_ASSERT_EQUAL_UINT32(37U, task_sched_run(s_now_ms + 37U));
+    TEST_ASSERT_EQUAL_UINT32(1U, s_sim[0].runs);
+
+    task_sched_stats_t stats;
+    task_sched_get_stats(&stats);
+    TEST_ASSERT_EQUAL_UINT32(3U, stats.passes);
+    TEST_ASSERT_EQUAL_UINT32(2U, stats.idle_passes);
+}
+
+static void test_wake_runs_a_sleeping_task_once(void)
+{
+    uint8_t const id = task_sched_add(sim_wake_task, 0U, TASK_SCHED_NEVER, s_now_ms);
+    TEST_ASSERT_NOT_EQUAL(TASK_SCHED_INVALID, id);
+
+    TEST_ASSERT_EQUAL_UINT32(TASK_SCHED_NEVER, task_sched_run(s_now_ms));
+    TEST_ASSERT_EQUAL_UINT32(0U, s_wake_runs);
+
+    task_sched_wake(id);
+    TEST_ASSERT_EQUAL_UINT32(TASK_SCHED_NEVER, task_sched_run(s_now_ms + 5U));
+    TEST_ASSERT_EQUAL_UINT32(1U, s_wake_runs);
+    TEST_ASSERT_EQUAL_UINT32(TASK_SCHED_NEVER, task_sched_run(s_now_ms + 6U));
+    TEST_ASSERT_EQUAL_UINT32(1U, s_wake_runs);
+}
+
+static void test_deadlines_survive_tick_wraparound(void)
+{
+    s_now_ms = 0xFFFFFFFFUL - 25U;
+    sim_add_periodic_tasks();
+    sim_main_loop(1000U, 0U);
+
+    for (uint8_t i = 0U; i < SIM_TASK_COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(SIM_RUNS(1000U, k_periods_ms[i]), s_sim[i].runs);
+        TEST_ASSERT_EQUAL_UINT32(0U, s_sim[i].max_late_ms);
+    }
+}
+
+static void test_full_table_is_rejected(void)
+{
+    for (uint8_t i = 0U; i < TASK_SCHED_MAX_TASKS; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT8(i, task_sched_add(sim_wake_task, 0U, TASK_SCHED_NEVER, s_now_ms));
+    }
+    TEST_ASSERT_EQUAL_UINT8(TASK_SCHED_INVALID, task_sched_add(sim_wake_task, 0U, TASK_SCHED_NEVER, s_now_ms));
+    TEST_ASSERT_EQUAL_UINT8(TASK_SCHED_INVALID, task_sched_add(NULL, 0U, 0U, s_now_ms));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_wakes_only_when_a_task_is_due);
+    RUN_TEST(test_tasks_run_on_their_deadline);
+    RUN_TEST(test_event_runs_on_the_next_pass);
+    RUN_TEST(test_next_delay_is_exact);
+    RUN_TEST(test_wake_runs_a_sleeping_task_once);
+    RUN_TEST(test_deadlines_survive_tick_wraparound);
+    RUN_TEST(test_full_table_is_rejected);
+    return UNITY_END();
+}
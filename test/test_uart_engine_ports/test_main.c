@@ -0,0 +1,190 @@
+// Two UPS ports polled at once: each engine talks to its own simulated SPM2K
+// UPS, replies land in that port's g_ups[] entry only, and the second port
+// costs no extra wall time.
+
+#define UPS_PORT_COUNT 2U
+
+#include <unity.h>
+
+#include "fake_ups_uart.h"
+
+#include "../../src/crc16.c"
+#include "../../src/spm2k.c"
+#include "../../src/uart_engine.c"
+
+#include <stdio.h>
+
+ups_state_t g_ups[UPS_PORT_COUNT];
+
+bool usb_desc_set_string_ascii(uint8_t strid, const char *ascii)
+{
+    (void)strid;
+    (void)ascii;
+    return true;
+}
+
+int pack_hid_date_mmddyy(const char *s, uint16_t *out)
+{
+    (void)s;
+    *out = 0U;
+    return 1;
+}
+
+#define TEST_BAUD 2400U
+#define TEST_REPLY_DELAY_MS 5U
+#define TEST_RUN_LIMIT_MS 60000U
+
+typedef struct
+{
+    uint16_t cmd;
+    const char *reply[UPS_PORT_COUNT];
+} test_spm2k_reply_t;
+
+// Different values per port, so a reply stored into the wrong port shows.
+static const test_spm2k_reply_t k_replies[] = {
+    { 0x59U, { "SM\r\n", "SM\r\n" } },
+    { 0x42U, { "27.05\r\n", "13.60\r\n" } },
+    { 0x9FD4U, { "+1.50\r\n", "-2.25\r\n" } },
+    { 0x6AU, { "0042:\r\n", "0007:\r\n" } },
+    { 0x43U, { "029.5\r\n", "031.0\r\n" } },
+    { 0x66U, { "100.0\r\n", "050.0\r\n" } },
+    { 0x39U, { "FF", "00" } },
+    { 0x51U, { "08\r\n", "10\r\n" } },
+    { 0x4CU, { "230.40\r\n", "118.00\r\n" } },
+    { 0x9FD3U, { "50.00\r\n", "60.00\r\n" } },
+    { 0x5CU, { "025.00\r\n", "075.00\r\n" } },
+    { 0x4FU, { "229.60\r\n", "120.00\r\n" } },
+    { 0x2FU, { "001.20\r\n", "004.00\r\n" } },
+    { 0x46U, { "50.00\r\n", "60.00\r\n" } },
+};
+
+static uint16_t spm2k_responder(uint8_t port, const uint8_t *cmd, uint16_t cmd_len, uint8_t *reply, uint16_t reply_cap)
+{
+    uint16_t const code = (cmd_len == 2U) ? (uint16_t)((cmd[0] << 8) | cmd[1]) : cmd[0];
+    for (size_t i = 0U; i < (sizeof(k_replies) / sizeof(k_replies[0])); i++)
+    {
+        if (k_replies[i].cmd == code)
+        {
+            size_t const len = strlen(k_replies[i].reply[port]);
+            TEST_ASSERT_TRUE(len <= reply_cap);
+            memcpy(reply, k_replies[i].reply[port], len);
+            return (uint16_t)len;
+        }
+    }
+    return 0U;
+}
+
+static void enqueue_dynamic_lut(uint8_t port)
+{
+    for (size_t i = 0U; i < g_spm2k_dynamic_lut_count; i++)
+    {
+        TEST_ASSERT_EQUAL(UART_ENGINE_OK, uart_engine_enqueue(port, &g_spm2k_dynamic_lut[i]));
+    }
+}
+
+// Ticks every millisecond until both engines are idle; returns the time taken.
+static uint32_t run_until_idle(void)
+{
+    uint32_t const start_ms = HAL_GetTick();
+    while (uart_engine_is_busy(0U) || uart_engine_is_busy(1U))
+    {
+        TEST_ASSERT_TRUE_MESSAGE((HAL_GetTick() - start_ms) < TEST_RUN_LIMIT_MS, "engines never went idle");
+        fake_tick_advance(1U);
+        uart_engine_tick();
+    }
+    return HAL_GetTick() - start_ms;
+}
+
+void setUp(void)
+{
+    fake_ups_reset();
+    (void)memset(g_ups, 0, sizeof(g_ups));
+    uart_engine_init();
+    fake_ups_attach(0U, spm2k_responder, TEST_BAUD, TEST_REPLY_DELAY_MS);
+    fake_ups_attach(1U, spm2k_responder, TEST_BAUD, TEST_REPLY_DELAY_MS);
+}
+
+void tearDown(void)
+{
+}
+
+static void test_replies_land_in_their_own_port(void)
+{
+    enqueue_dynamic_lut(0U);
+    enqueue_dynamic_lut(1U);
+    (void)run_until_idle();
+
+    uart_engine_stats_t stats[UPS_PORT_COUNT];
+    for (uint8_t port = 0U; port < UPS_PORT_COUNT; port++)
+    {
+        uart_engine_get_stats(port, &stats[port]);
+        TEST_ASSERT_EQUAL_UINT32(g_spm2k_dynamic_lut_count, stats[port].completed);
+        TEST_ASSERT_EQUAL_UINT32(0U, stats[port].failed);
+    }
+
+    TEST_ASSERT_EQUAL_UINT16(2705U, g_ups[0].battery.battery_voltage);
+    TEST_ASSERT_EQUAL_UINT16(1360U, g_ups[1].battery.battery_voltage);
+    TEST_ASSERT_EQUAL_INT16(150, g_ups[0].battery.battery_current);
+    TEST_ASSERT_EQUAL_INT16(-225, g_ups[1].battery.battery_current);
+    TEST_ASSERT_EQUAL_UINT16(42U * 60U, g_ups[0].battery.run_time_to_empty_s);
+    TEST_ASSERT_EQUAL_UINT16(7U * 60U, g_ups[1].battery.run_time_to_empty_s);
+    TEST_ASSERT_EQUAL_UINT8(100U, g_ups[0].battery.remaining_capacity);
+    TEST_ASSERT_EQUAL_UINT8(50U, g_ups[1].battery.remaining_capacity);
+    TEST_ASSERT_EQUAL_UINT16(23040U, g_ups[0].input.voltage);
+    TEST_ASSERT_EQUAL_UINT16(11800U, g_ups[1].input.voltage);
+    TEST_ASSERT_EQUAL_UINT8(25U, g_ups[0].output.percent_load);
+    TEST_ASSERT_EQUAL_UINT8(75U, g_ups[1].output.percent_load);
+
+    // 'Q' 08 is on line, 10 on battery; '9' agrees.
+    TEST_ASSERT_TRUE(g_ups[0].present_status.ac_present);
+    TEST_ASSERT_FALSE(g_ups[0].present_status.discharging);
+    TEST_ASSERT_TRUE(g_ups[0].present_status.fully_charged);
+    TEST_ASSERT_FALSE(g_ups[1].present_status.ac_present);
+    TEST_ASSERT_TRUE(g_ups[1].present_status.discharging);
+    TEST_ASSERT_FALSE(g_ups[1].present_status.fully_charged);
+}
+
+static void test_second_port_adds_no_wall_time(void)
+{
+    enqueue_dynamic_lut(0U);
+    uint32_t const one_port_ms = run_until_idle();
+
+    setUp();
+    enqueue_dynamic_lut(0U);
+    enqueue_dynamic_lut(1U);
+    uint32_t const two_ports_ms = run_until_idle();
+
+    uint32_t const jobs = (uint32_t)g_spm2k_dynamic_lut_count;
+    char msg[96];
+    (void)snprintf(msg, sizeof(msg), "one port: %lu jobs/s, two ports: %lu jobs/s",
+                   (unsigned long)((jobs * 1000U) / one_port_ms),
+                   (unsigned long)((2U * jobs * 1000U) / two_ports_ms));
+    TEST_MESSAGE(msg);
+
+    TEST_ASSERT_EQUAL_UINT32(jobs, s_fake_ups[0].transactions);
+    TEST_ASSERT_EQUAL_UINT32(jobs, s_fake_ups[1].transactions);
+    // The ports share only the tick loop, so both finish within a few ticks
+    // of one port alone: twice the jobs in the same time.
+    TEST_ASSERT_UINT32_WITHIN(jobs, one_port_ms, two_ports_ms);
+}
+
+static void test_bad_port_is_rejected(void)
+{
+    uart_engine_stats_t stats;
+    (void)memset(&stats, 0xA5, sizeof(stats));
+
+    TEST_ASSERT_EQUAL(UART_ENGINE_ERR_BAD_PARAM, uart_engine_enqueue(UPS_PORT_COUNT, &g_spm2k_dynamic_lut[0]));
+    TEST_ASSERT_FALSE(uart_engine_is_busy(UPS_PORT_COUNT));
+    TEST_ASSERT_FALSE(uart_engine_is_enabled(UPS_PORT_COUNT));
+    uart_engine_get_stats(UPS_PORT_COUNT, &stats);
+    TEST_ASSERT_EQUAL_HEX8(0xA5U, ((const uint8_t *)&stats)[0]);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_replies_land_in_their_own_port);
+    RUN_TEST(test_second_port_adds_no_wall_time);
+    RUN_TEST(test_bad_port_is_rejected);
+    return UNITY_END();
+}
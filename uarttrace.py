@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""
+Decode the converter's UART wire trace (include/uart_trace.h) into:
+  Send: ASCII (HEX)
+  Receive: ASCII (HEX)
+with the time of each burst, how long the send took on the wire and how
+long the UPS took to answer it.
+
+The trace is read with the TRACE command of the telemetry CDC port, or from
+a terminal log that contains the T lines of a dump:
+
+  python uarttrace.py COM8
+  python uarttrace.py /dev/ttyACM0 --save trace.txt
+  python uarttrace.py --file trace.txt --states
+
+Times are seconds since the first event in the dump, at 0.1 ms resolution.
+Reading a serial port requires pyserial.
+"""
+
+from __future__ import annotations
+
+import argparse
+import sys
+import time
+from typing import Iterable
+
+try:
+    import serial
+except ImportError:
+    serial = None
+
+TIME_MASK = 0xFFFFFF
+TICKS_PER_MS = 10
+
+TX, TX_DONE, RX, RX_ERROR, STATE, OUTCOME, BAUD = range(7)
+
+STATES = ["IDLE", "TX_START", "TX_WAIT", "RX_WAIT", "RX_DRAIN", "PROCESS"]
+OUTCOMES = ["ok", "retry", "timeout", "fail"]
+UART_ERRORS = [(0x01, "parity"), (0x02, "noise"), (0x04, "framing"), (0x08, "overrun"), (0x10, "dma")]
+
+
+def to_ascii(data: Iterable[int]) -> str:
+    return "".join(chr(b) if 32 <= b <= 126 else "." for b in data)
+
+
+def to_hex(data: Iterable[int]) -> str:
+    return " ".join(f"{b:02X}" for b in data)
+
+
+class Event:
+    def __init__(self, index: int, raw: bytes) -> None:
+        self.index = index
+        self.type = raw[0] >> 5
+        self.port = (raw[0] >> 3) & 0x03
+        self.count = raw[0] & 0x07
+        self.stamp = raw[1] | (raw[2] << 8) | (raw[3] << 16)
+        self.data = raw[4:8]
+        self.time = 0  # unwrapped, trace ticks since the first event
+
+
+class Burst:
+    def __init__(self, label: str, port: int, start: int) -> None:
+        self.label = label
+        self.port = port
+        self.start = start
+        self.last = start
+        self.done: int | None = None
+        self.payload = bytearray()
+        self.latency: int | None = None
+
+
+def parse_dump(lines: Iterable[str]) -> tuple[list[Event], int]:
+    """Returns the events of the last complete dump in lines and the lost count."""
+    events: list[Event] = []
+    lost = 0
+    complete: tuple[list[Event], int] | None = None
+    for line in lines:
+        fields = line.strip().split(",")
+        if len(fields) < 2 or fields[0] != "T":
+            continue
+        if fields[1] == "BEGIN":
+            events = []
+        elif fields[1] == "END":
+            lost = int(fields[3]) if len(fields) > 3 else 0
+            complete = (events, lost)
+        elif len(fields) == 3 and len(fields[2]) == 16:
+            try:
+                events.append(Event(int(fields[1]), bytes.fromhex(fields[2])))
+            except ValueError:
+                continue
+    if complete is None:
+        # Dump cut short: decode what arrived.
+        return events, lost
+    return complete
+
+
+def unwrap_times(events: list[Event]) -> None:
+    now = 0
+    prev: int | None = None
+    for e in events:
+        if prev is not None:
+            now += (e.stamp - prev) & TIME_MASK
+        prev = e.stamp
+        e.time = now
+
+
+def fmt_ms(ticks: int) -> str:
+    return f"{ticks / TICKS_PER_MS:.1f} ms"
+
+
+def decode(events: list[Event], gap_ms: float, show_states: bool) -> list[tuple[int, int, str]]:
+    """Returns (time, order, text) rows; bursts are placed at their start."""
+    rows: list[tuple[int, int, str]] = []
+    gap = int(gap_ms * TICKS_PER_MS)
+    open_burst: dict[int, Burst] = {}
+    last_tx_end: dict[int, int] = {}
+    latencies: dict[int, list[int]] = {}
+    outcomes: dict[int, dict[str, int]] = {}
+
+    def emit(time: int, order: int, port: int, text: str) -> None:
+        rows.append((time, order, f"{time / (TICKS_PER_MS * 1000):10.4f}  P{port} {text}"))
+
+    def close(port: int) -> None:
+        b = open_burst.pop(port, None)
+        if b is None:
+            return
+        text = f"{b.label}: {to_ascii(b.payload)} ({to_hex(b.payload)})"
+        if b.label == "Send" and b.done is not None:
+            text += f"  [tx {fmt_ms(b.done - b.start)}]"
+            last_tx_end[port] = b.done
+        elif b.label == "Send":
+            last_tx_end[port] = b.last
+        if b.latency is not None:
+            text += f"  [reply after {fmt_ms(b.latency)}]"
+            latencies.setdefault(port, []).append(b.latency)
+        emit(b.start, 0, port, text)
+
+    for order, e in enumerate(events, start=1):
+        port = e.port
+        b = open_burst.get(port)
+
+        if e.type in (TX, RX):
+            label = "Send" if e.type == TX else "Receive"
+            stale = b is not None and (e.time - b.last) > gap
+            if b is not None and (b.label != label or stale or (label == "Send" and b.done is not None)):
+                close(port)
+                b = None
+            if b is None:
+                b = Burst(label, port, e.time)
+                if label == "Receive" and port in last_tx_end:
+                    b.latency = e.time - last_tx_end.pop(port)
+                open_burst[port] = b
+            b.payload += e.data[:e.count]
+            b.last = e.time
+            continue
+
+        if e.type == TX_DONE:
+            if b is not None and b.label == "Send":
+                b.done = e.time
+            else:
+                last_tx_end[port] = e.time
+            continue
+
+        if e.type == RX_ERROR:
+            names = [name for bit, name in UART_ERRORS if e.data[0] & bit] or [f"0x{e.data[0]:02X}"]
+            emit(e.time, order, port, f"-- rx error: {' '.join(names)}")
+        elif e.type == STATE:
+            if show_states:
+                state = STATES[e.data[0]] if e.data[0] < len(STATES) else str(e.data[0])
+                cmd = e.data[1] | (e.data[2] << 8)
+                emit(e.time, order, port, f"-- {state} cmd=0x{cmd:04X}")
+        elif e.type == OUTCOME:
+            outcome = OUTCOMES[e.data[0]] if e.data[0] < len(OUTCOMES) else str(e.data[0])
+            cmd = e.data[1] | (e.data[2] << 8)
+            outcomes.setdefault(port, {}).setdefault(outcome, 0)
+            outcomes[port][outcome] += 1
+            emit(e.time, order, port, f"-- {outcome} cmd=0x{cmd:04X} retries_left={e.data[3]}")
+            # The job is over; a late reply is not an answer to it.
+            close(port)
+            last_tx_end.pop(port, None)
+        elif e.type == BAUD:
+            baud = int.from_bytes(e.data, "little")
+            emit(e.time, order, port, f"-- baud {baud}")
+
+    for port in list(open_burst):
+        close(port)
+
+    rows.sort(key=lambda r: (r[0], r[1]))
+
+    for port in sorted(set(latencies) | set(outcomes)):
+        parts = []
+        lat = latencies.get(port)
+        if lat:
+            parts.append(f"{len(lat)} replies, latency min {fmt_ms(min(lat))} "
+                         f"avg {fmt_ms(sum(lat) // len(lat))} max {fmt_ms(max(lat))}")
+        counts = outcomes.get(port, {})
+        if counts:
+            parts.append(", ".join(f"{n} {name}" for name, n in counts.items()))
+        rows.append((-1, -1, f"{'':>10}  P{port} summary: " + "; ".join(parts)))
+    return rows
+
+
+def read_serial(port: str, save: str | None, timeout_s: float) -> list[str]:
+    lines: list[str] = []
+    with serial.Serial(port, 115200, timeout=0.2) as ser:
+        ser.reset_input_buffer()
+        ser.write(b"TRACE\r\n")
+        deadline = time.monotonic() + timeout_s
+        pending = b""
+        while time.monotonic() < deadline:
+            pending += ser.read(512)
+            *complete, pending = pending.split(b"\n")
+            for raw in complete:
+                line = raw.decode("latin-1").rstrip("\r")
+                if line.startswith("T,"):
+                    lines.append(line)
+                if line.startswith("T,END"):
+                    deadline = 0.0
+    if save:
+        with open(save, "w", encoding="ascii") as f:
+            f.write("\n".join(lines) + "\n")
+    return lines
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description="Decode the converter's UART wire trace")
+    parser.add_argument("port", nargs="?", help="telemetry CDC port, e.g. COM8 or /dev/ttyACM0")
+    parser.add_argument("--file", help="decode T lines from a saved dump or terminal log instead")
+    parser.add_argument("--save", help="also write the dump read from the port to this file")
+    parser.add_argument("--states", action="store_true", help="show engine state changes")
+    parser.add_argument("--gap-ms", type=float, default=50.0,
+                        help="quiet time that splits a burst (default: 50)")
+    parser.add_argument("--timeout", type=float, default=5.0, help="seconds to wait for the dump")
+    args = parser.parse_args()
+
+    if args.file:
+        with open(args.file, encoding="latin-1") as f:
+            lines = f.readlines()
+    else:
+        if not args.port:
+            parser.error("a serial port or --file is required")
+        if serial is None:
+            print("Error: pyserial is required (pip install pyserial).", file=sys.stderr)
+            return 2
+        lines = read_serial(args.port, args.save, args.timeout)
+
+    events, lost = parse_dump(lines)
+    if not events:
+        print("No trace events found.", file=sys.stderr)
+        return 1
+
+    unwrap_times(events)
+    for _time, _order, text in decode(events, args.gap_ms, args.states):
+        print(text)
+    if lost:
+        print(f"*** {lost} events overwritten during the dump", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())